@@ -0,0 +1,505 @@
+//--------------------------------------------------------------------------------------
+// File: Animation.cpp
+//
+// Keyframe animation clips for the model viewer
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//-------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Animation.h"
+
+#include "SDKMesh.h"
+
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace VSD3DStarter
+{
+    // .CMO animation clips, following the bones in the skeleton section
+    // UINT - Animation clip count
+    // { [Animation clip count]
+    //      UINT - Clip name length
+    //      wchar_t[] - Clip name (if length > 0)
+    //      Clip structure
+    //      { [Clip->keys]
+    //          Keyframe structure
+    //      }
+    // }
+
+#pragma pack(push,1)
+
+    struct Clip
+    {
+        float StartTime;
+        float EndTime;
+        uint32_t keys;
+    };
+
+    struct Keyframe
+    {
+        uint32_t BoneIndex;
+        float Time;
+        DirectX::XMFLOAT4X4 Transform;
+    };
+
+#pragma pack(pop)
+
+} // namespace
+
+static_assert(sizeof(VSD3DStarter::Clip) == 12, "CMO Mesh structure size incorrect");
+static_assert(sizeof(VSD3DStarter::Keyframe) == 72, "CMO Mesh structure size incorrect");
+
+namespace
+{
+    using VectorArray = std::unique_ptr<XMVECTOR[], ModelBone::aligned_deleter>;
+
+    VectorArray MakeVectorArray(size_t count)
+    {
+        void* temp = _aligned_malloc(sizeof(XMVECTOR) * count, 16);
+        if (!temp)
+            throw std::bad_alloc();
+        return VectorArray(static_cast<XMVECTOR*>(temp));
+    }
+
+    // Blends two decomposed keys, using a normalized lerp along the shorter arc for the
+    // rotation; close enough to slerp at keyframe rates.
+    inline XMMATRIX XM_CALLCONV InterpolateKeys(
+        FXMVECTOR t0, FXMVECTOR t1,
+        FXMVECTOR r0, GXMVECTOR r1,
+        HXMVECTOR s0, HXMVECTOR s1,
+        CXMVECTOR alpha) noexcept
+    {
+        const XMVECTOR q1 = XMVectorSelect(r1, XMVectorNegate(r1), XMVectorLess(XMVector4Dot(r0, r1), XMVectorZero()));
+        const XMVECTOR rotation = XMQuaternionNormalize(XMVectorLerpV(r0, q1, alpha));
+
+        const XMVECTOR translation = XMVectorLerpV(t0, t1, alpha);
+        const XMVECTOR scale = XMVectorLerpV(s0, s1, alpha);
+
+        return XMMatrixAffineTransformation(scale, XMVectorZero(), rotation, translation);
+    }
+
+    inline double WrapTime(double time, double duration) noexcept
+    {
+        if (duration <= 0.0)
+            return 0.0;
+
+        double t = fmod(time, duration);
+        if (t < 0.0)
+            t += duration;
+        return t;
+    }
+}
+
+
+//======================================================================================
+// AnimationSDKMESH
+//======================================================================================
+
+AnimationSDKMESH::AnimationSDKMESH() noexcept :
+    m_fps(0),
+    m_numKeys(0),
+    m_boundTracks(0)
+{
+}
+
+
+_Use_decl_annotations_
+void AnimationSDKMESH::Load(const wchar_t* fileName)
+{
+    const ModelFileView animFile(fileName);
+
+    Load(animFile.GetData(), animFile.GetSize());
+}
+
+
+_Use_decl_annotations_
+void AnimationSDKMESH::Load(const uint8_t* data, size_t dataSize)
+{
+    using namespace DXUT;
+
+    Release();
+
+    if (!data || dataSize < sizeof(SDKANIMATION_FILE_HEADER))
+        throw std::runtime_error("End of file");
+
+    auto header = reinterpret_cast<const SDKANIMATION_FILE_HEADER*>(data);
+
+    if (header->Version != SDKMESH_FILE_VERSION)
+        throw std::runtime_error("Not a supported SDKMESH_ANIM file");
+
+    if (header->IsBigEndian)
+        throw std::runtime_error("Big-endian SDKMESH_ANIM files are not supported");
+
+    if (!header->NumFrames || !header->NumAnimationKeys || !header->AnimationFPS)
+        throw std::runtime_error("SDKMESH_ANIM file contains no animation");
+
+    const uint64_t dataEnd = header->AnimationDataOffset + header->AnimationDataSize;
+    if (dataEnd < header->AnimationDataOffset || dataEnd > dataSize)
+        throw std::runtime_error("End of file");
+
+    const uint64_t framesEnd = header->AnimationDataOffset + uint64_t(header->NumFrames) * sizeof(SDKANIMATION_FRAME_DATA);
+    if (header->AnimationDataOffset < sizeof(SDKANIMATION_FILE_HEADER) || framesEnd > dataEnd)
+        throw std::runtime_error("End of file");
+
+    auto frameArray = reinterpret_cast<const SDKANIMATION_FRAME_DATA*>(data + header->AnimationDataOffset);
+
+    const size_t ntracks = header->NumFrames;
+    const size_t nkeys = header->NumAnimationKeys;
+    const uint64_t keysSize = uint64_t(nkeys) * sizeof(SDKANIMATION_DATA);
+
+    auto translations = MakeVectorArray(nkeys * ntracks);
+    auto rotations = MakeVectorArray(nkeys * ntracks);
+    auto scales = MakeVectorArray(nkeys * ntracks);
+
+    std::vector<std::wstring> names;
+    names.reserve(ntracks);
+
+    for (size_t j = 0; j < ntracks; ++j)
+    {
+        // Key data offsets are relative to the end of the file header.
+        const uint64_t offset = sizeof(SDKANIMATION_FILE_HEADER) + frameArray[j].DataOffset;
+        if (offset < frameArray[j].DataOffset || (offset + keysSize) > dataEnd)
+            throw std::runtime_error("End of file");
+
+        char frameName[MAX_FRAME_NAME + 1] = {};
+        memcpy(frameName, frameArray[j].FrameName, MAX_FRAME_NAME);
+
+        wchar_t trackName[MAX_FRAME_NAME + 1] = {};
+        MultiByteToWideChar(CP_UTF8, 0, frameName, -1, trackName, MAX_FRAME_NAME + 1);
+        names.emplace_back(trackName);
+
+        auto keys = reinterpret_cast<const SDKANIMATION_DATA*>(data + offset);
+        for (size_t k = 0; k < nkeys; ++k)
+        {
+            const size_t index = k * ntracks + j;
+
+            translations[index] = XMLoadFloat3(&keys[k].Translation);
+
+            XMVECTOR quat = XMLoadFloat4(&keys[k].Orientation);
+            rotations[index] = XMVector4Equal(quat, XMVectorZero()) ? XMQuaternionIdentity() : XMQuaternionNormalize(quat);
+
+            XMVECTOR scale = XMLoadFloat3(&keys[k].Scaling);
+            scales[index] = XMVector3Equal(scale, XMVectorZero()) ? XMVectorSplatOne() : scale;
+        }
+    }
+
+    m_fps = header->AnimationFPS;
+    m_numKeys = header->NumAnimationKeys;
+    m_trackNames = std::move(names);
+    m_trackToBone.assign(ntracks, ModelBone::c_Invalid);
+    m_translations = std::move(translations);
+    m_rotations = std::move(rotations);
+    m_scales = std::move(scales);
+}
+
+
+void AnimationSDKMESH::Release() noexcept
+{
+    m_fps = 0;
+    m_numKeys = 0;
+    m_boundTracks = 0;
+    m_trackNames.clear();
+    m_trackToBone.clear();
+    m_translations.reset();
+    m_rotations.reset();
+    m_scales.reset();
+}
+
+
+bool AnimationSDKMESH::Bind(const Model& model)
+{
+    m_boundTracks = 0;
+    m_trackToBone.assign(m_trackNames.size(), ModelBone::c_Invalid);
+
+    std::unordered_map<std::wstring, uint32_t> boneNames;
+    boneNames.reserve(model.bones.size());
+    for (size_t j = 0; j < model.bones.size(); ++j)
+    {
+        boneNames.emplace(model.bones[j].name, static_cast<uint32_t>(j));
+    }
+
+    for (size_t j = 0; j < m_trackNames.size(); ++j)
+    {
+        auto it = boneNames.find(m_trackNames[j]);
+        if (it != boneNames.cend())
+        {
+            m_trackToBone[j] = it->second;
+            ++m_boundTracks;
+        }
+    }
+
+    return m_boundTracks > 0;
+}
+
+
+_Use_decl_annotations_
+void AnimationSDKMESH::Sample(double time, size_t nbones, XMMATRIX* boneTransforms) const
+{
+    assert(boneTransforms != nullptr);
+
+    if (!m_numKeys || !m_boundTracks)
+        return;
+
+    const double frame = WrapTime(time, GetDuration()) * double(m_fps);
+    const uint32_t key0 = std::min(static_cast<uint32_t>(frame), m_numKeys - 1);
+    const uint32_t key1 = (key0 + 1 < m_numKeys) ? key0 + 1 : 0;
+    const XMVECTOR alpha = XMVectorReplicate(static_cast<float>(frame - double(key0)));
+
+    const size_t ntracks = m_trackToBone.size();
+    const XMVECTOR* t0 = m_translations.get() + key0 * ntracks;
+    const XMVECTOR* t1 = m_translations.get() + key1 * ntracks;
+    const XMVECTOR* r0 = m_rotations.get() + key0 * ntracks;
+    const XMVECTOR* r1 = m_rotations.get() + key1 * ntracks;
+    const XMVECTOR* s0 = m_scales.get() + key0 * ntracks;
+    const XMVECTOR* s1 = m_scales.get() + key1 * ntracks;
+
+    for (size_t j = 0; j < ntracks; ++j)
+    {
+        const uint32_t bone = m_trackToBone[j];
+        if (bone >= nbones)
+            continue;
+
+        boneTransforms[bone] = InterpolateKeys(t0[j], t1[j], r0[j], r1[j], s0[j], s1[j], alpha);
+    }
+}
+
+
+//======================================================================================
+// AnimationCMO
+//======================================================================================
+
+AnimationCMO::AnimationCMO() noexcept :
+    m_startTime(0.f),
+    m_endTime(0.f),
+    m_boundTracks(0),
+    m_lastTime(0.0)
+{
+}
+
+
+_Use_decl_annotations_
+void AnimationCMO::Load(const wchar_t* fileName, size_t offset, const wchar_t* clipName)
+{
+    const ModelFileView modelFile(fileName);
+
+    Load(modelFile.GetData(), modelFile.GetSize(), offset, clipName);
+}
+
+
+_Use_decl_annotations_
+void AnimationCMO::Load(const uint8_t* data, size_t dataSize, size_t offset, const wchar_t* clipName)
+{
+    Release();
+
+    if (!data || !offset)
+        throw std::runtime_error("CMO file contains no animation clips");
+
+    size_t usedSize = offset + sizeof(uint32_t);
+    if (usedSize < offset || dataSize < usedSize)
+        throw std::runtime_error("End of file");
+
+    const uint32_t nClips = *reinterpret_cast<const uint32_t*>(data + offset);
+
+    for (uint32_t j = 0; j < nClips; ++j)
+    {
+        // Clip name
+        if (dataSize < usedSize + sizeof(uint32_t))
+            throw std::runtime_error("End of file");
+
+        const uint32_t nName = *reinterpret_cast<const uint32_t*>(data + usedSize);
+        usedSize += sizeof(uint32_t);
+
+        auto name = reinterpret_cast<const wchar_t*>(static_cast<const void*>(data + usedSize));
+
+        usedSize += sizeof(wchar_t) * size_t(nName);
+        if (dataSize < usedSize)
+            throw std::runtime_error("End of file");
+
+        // Clip settings
+        auto clip = reinterpret_cast<const VSD3DStarter::Clip*>(data + usedSize);
+        usedSize += sizeof(VSD3DStarter::Clip);
+        if (dataSize < usedSize)
+            throw std::runtime_error("End of file");
+
+        auto keys = reinterpret_cast<const VSD3DStarter::Keyframe*>(data + usedSize);
+        usedSize += sizeof(VSD3DStarter::Keyframe) * size_t(clip->keys);
+        if (dataSize < usedSize)
+            throw std::runtime_error("End of file");
+
+        std::wstring clipNameStr(name, wcsnlen(name, nName));
+        if (clipName && _wcsicmp(clipName, clipNameStr.c_str()) != 0)
+            continue;
+
+        if (!clip->keys)
+            throw std::runtime_error("Animation clip contains no keyframes");
+
+        // Group keys into per-bone tracks, each in time order.
+        const size_t nkeys = clip->keys;
+        std::vector<uint32_t> order(nkeys);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [keys](uint32_t a, uint32_t b) noexcept
+            {
+                if (keys[a].BoneIndex != keys[b].BoneIndex)
+                    return keys[a].BoneIndex < keys[b].BoneIndex;
+                return keys[a].Time < keys[b].Time;
+            });
+
+        std::vector<Track> tracks;
+        std::vector<float> keyTimes(nkeys);
+        auto keyTransforms = ModelBone::MakeArray(nkeys);
+        auto translations = MakeVectorArray(nkeys);
+        auto rotations = MakeVectorArray(nkeys);
+        auto scales = MakeVectorArray(nkeys);
+
+        for (size_t k = 0; k < nkeys; ++k)
+        {
+            const auto& key = keys[order[k]];
+
+            if (tracks.empty() || tracks.back().bone != key.BoneIndex)
+            {
+                tracks.emplace_back(Track{ key.BoneIndex, static_cast<uint32_t>(k), 0, true });
+            }
+
+            Track& track = tracks.back();
+            ++track.keyCount;
+
+            keyTimes[k] = key.Time;
+            keyTransforms[k] = XMLoadFloat4x4(&key.Transform);
+
+            if (!XMMatrixDecompose(&scales[k], &rotations[k], &translations[k], keyTransforms[k]))
+            {
+                track.decomposed = false;
+            }
+            else if (k > track.firstKey
+                && XMVectorGetX(XMVector4Dot(rotations[k - 1], rotations[k])) < 0.f)
+            {
+                // Keep consecutive keys on the same hemisphere for blending.
+                rotations[k] = XMVectorNegate(rotations[k]);
+            }
+        }
+
+        m_name = std::move(clipNameStr);
+        m_startTime = clip->StartTime;
+        m_endTime = clip->EndTime;
+        if (m_endTime < m_startTime)
+        {
+            m_endTime = m_startTime;
+        }
+        m_tracks = std::move(tracks);
+        m_cursors.assign(m_tracks.size(), 0u);
+        m_keyTimes = std::move(keyTimes);
+        m_keyTransforms = std::move(keyTransforms);
+        m_translations = std::move(translations);
+        m_rotations = std::move(rotations);
+        m_scales = std::move(scales);
+        return;
+    }
+
+    throw std::runtime_error("Animation clip not found");
+}
+
+
+void AnimationCMO::Release() noexcept
+{
+    m_name.clear();
+    m_startTime = m_endTime = 0.f;
+    m_boundTracks = 0;
+    m_lastTime = 0.0;
+    m_tracks.clear();
+    m_cursors.clear();
+    m_keyTimes.clear();
+    m_keyTransforms.reset();
+    m_translations.reset();
+    m_rotations.reset();
+    m_scales.reset();
+}
+
+
+bool AnimationCMO::Bind(const Model& model)
+{
+    m_boundTracks = 0;
+    for (const auto& it : m_tracks)
+    {
+        if (it.bone < model.bones.size())
+        {
+            ++m_boundTracks;
+        }
+    }
+
+    std::fill(m_cursors.begin(), m_cursors.end(), 0u);
+    m_lastTime = 0.0;
+
+    return m_boundTracks > 0;
+}
+
+
+_Use_decl_annotations_
+void AnimationCMO::Evaluate(double time, size_t nbones, XMMATRIX* boneTransforms)
+{
+    assert(boneTransforms != nullptr);
+
+    if (!m_boundTracks)
+        return;
+
+    const double localTime = double(m_startTime) + WrapTime(time, GetDuration());
+
+    // Cursors only move forward; rewind them when playback wraps or is scrubbed back.
+    if (localTime < m_lastTime)
+    {
+        std::fill(m_cursors.begin(), m_cursors.end(), 0u);
+    }
+    m_lastTime = localTime;
+
+    const auto t = static_cast<float>(localTime);
+
+    for (size_t j = 0; j < m_tracks.size(); ++j)
+    {
+        const Track& track = m_tracks[j];
+        if (track.bone >= nbones)
+            continue;
+
+        const float* times = m_keyTimes.data() + track.firstKey;
+
+        uint32_t cursor = m_cursors[j];
+        while (cursor + 1 < track.keyCount && times[cursor + 1] <= t)
+        {
+            ++cursor;
+        }
+        m_cursors[j] = cursor;
+
+        const size_t key0 = size_t(track.firstKey) + cursor;
+
+        if (track.decomposed && (cursor + 1 < track.keyCount) && (t > times[cursor]))
+        {
+            const size_t key1 = key0 + 1;
+            const XMVECTOR alpha = XMVectorReplicate((t - times[cursor]) / (times[cursor + 1] - times[cursor]));
+
+            boneTransforms[track.bone] = InterpolateKeys(
+                m_translations[key0], m_translations[key1],
+                m_rotations[key0], m_rotations[key1],
+                m_scales[key0], m_scales[key1],
+                alpha);
+        }
+        else
+        {
+            boneTransforms[track.bone] = m_keyTransforms[key0];
+        }
+    }
+}
+
+
+void AnimationCMO::Apply(double time, Model& model)
+{
+    if (!model.boneMatrices || model.bones.empty())
+        return;
+
+    Evaluate(time, model.bones.size(), model.boneMatrices.get());
+}
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// File: Animation.h
+//
+// Keyframe animation clips for the model viewer
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//-------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include <Model.h>
+
+namespace DX
+{
+    // Animation clip loaded from a DXUT .SDKMESH_ANIM file.
+    //
+    // Keys are stored as structure-of-arrays (translation, rotation, and scale streams) in
+    // key-major order, so sampling a time reads two contiguous runs per stream. The clip
+    // is immutable once loaded and bound, so one instance can drive any number of skeletons.
+    class AnimationSDKMESH
+    {
+    public:
+        AnimationSDKMESH() noexcept;
+
+        AnimationSDKMESH(AnimationSDKMESH&&) = default;
+        AnimationSDKMESH& operator= (AnimationSDKMESH&&) = default;
+
+        AnimationSDKMESH(AnimationSDKMESH const&) = delete;
+        AnimationSDKMESH& operator= (AnimationSDKMESH const&) = delete;
+
+        void Load(_In_z_ const wchar_t* fileName);
+        void Load(_In_reads_bytes_(dataSize) const uint8_t* data, size_t dataSize);
+
+        void Release() noexcept;
+
+        // Maps the clip's frame names to the model's bones. Returns false if none match.
+        bool Bind(const DirectX::Model& model);
+
+        // Overwrites the relative transforms of the animated bones for time t (in seconds, wraps
+        // around the clip). Bones without a track are left as-is, so seed the array with the bind pose.
+        void Sample(double time, size_t nbones, _Inout_updates_(nbones) DirectX::XMMATRIX* boneTransforms) const;
+
+        double GetDuration() const noexcept { return m_fps ? double(m_numKeys) / double(m_fps) : 0.0; }
+        uint32_t GetFPS() const noexcept { return m_fps; }
+        uint32_t GetKeyCount() const noexcept { return m_numKeys; }
+        size_t GetTrackCount() const noexcept { return m_trackNames.size(); }
+        size_t GetBoundTrackCount() const noexcept { return m_boundTracks; }
+
+    private:
+        using VectorArray = std::unique_ptr<DirectX::XMVECTOR[], DirectX::ModelBone::aligned_deleter>;
+
+        uint32_t                    m_fps;
+        uint32_t                    m_numKeys;
+        size_t                      m_boundTracks;
+        std::vector<std::wstring>   m_trackNames;
+        std::vector<uint32_t>       m_trackToBone;
+
+        // [key * tracks + track]
+        VectorArray                 m_translations;
+        VectorArray                 m_rotations;
+        VectorArray                 m_scales;
+    };
+
+    // Animation clip loaded from the skeleton section of a Visual Studio .CMO file.
+    //
+    // Keys are grouped into one track per bone and sorted by time. Each track keeps a cursor to
+    // its current key, so evaluating a clip that plays forward is O(bones) per frame; the cursors
+    // only rewind when the time moves backwards.
+    class AnimationCMO
+    {
+    public:
+        AnimationCMO() noexcept;
+
+        AnimationCMO(AnimationCMO&&) = default;
+        AnimationCMO& operator= (AnimationCMO&&) = default;
+
+        AnimationCMO(AnimationCMO const&) = delete;
+        AnimationCMO& operator= (AnimationCMO const&) = delete;
+
+        // offset is the animsOffset returned by Model::CreateFromCMO. Loads the first clip if clipName is null.
+        void Load(_In_z_ const wchar_t* fileName, size_t offset, _In_opt_z_ const wchar_t* clipName = nullptr);
+        void Load(_In_reads_bytes_(dataSize) const uint8_t* data, size_t dataSize, size_t offset, _In_opt_z_ const wchar_t* clipName = nullptr);
+
+        void Release() noexcept;
+
+        // Checks the clip's bone indices against the model. Returns false if none are valid.
+        bool Bind(const DirectX::Model& model);
+
+        // Overwrites the relative transforms of the animated bones for time t (in seconds from the
+        // start of the clip, wraps around). Bones without keys are left as-is.
+        void Evaluate(double time, size_t nbones, _Inout_updates_(nbones) DirectX::XMMATRIX* boneTransforms);
+
+        // Evaluates the clip into Model::boneMatrices.
+        void Apply(double time, DirectX::Model& model);
+
+        const std::wstring& GetName() const noexcept { return m_name; }
+        double GetDuration() const noexcept { return double(m_endTime) - double(m_startTime); }
+        size_t GetKeyCount() const noexcept { return m_keyTimes.size(); }
+        size_t GetTrackCount() const noexcept { return m_tracks.size(); }
+        size_t GetBoundTrackCount() const noexcept { return m_boundTracks; }
+
+    private:
+        using VectorArray = std::unique_ptr<DirectX::XMVECTOR[], DirectX::ModelBone::aligned_deleter>;
+
+        struct Track
+        {
+            uint32_t    bone;
+            uint32_t    firstKey;
+            uint32_t    keyCount;
+            bool        decomposed;     // false if any key isn't an affine transform; those tracks step
+        };
+
+        std::wstring                        m_name;
+        float                               m_startTime;
+        float                               m_endTime;
+        size_t                              m_boundTracks;
+        double                              m_lastTime;
+        std::vector<Track>                  m_tracks;
+        std::vector<uint32_t>               m_cursors;
+
+        // [track->firstKey + key]
+        std::vector<float>                  m_keyTimes;
+        DirectX::ModelBone::TransformArray  m_keyTransforms;
+        VectorArray                         m_translations;
+        VectorArray                         m_rotations;
+        VectorArray                         m_scales;
+    };
+}
@@ -0,0 +1,23 @@
+//--------------------------------------------------------------------------------------
+// File: BakedSource.h
+//
+// Source format recorded in the UserData field of a .dtkmodel header, so the viewer can
+// pick the same effects and winding as the file the model was baked from.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+
+enum BakedSource : uint32_t
+{
+    BakedSource_Unknown = 0,
+    BakedSource_SDKMESH,
+    BakedSource_SDKMESH2,
+    BakedSource_CMO,
+    BakedSource_VBO,
+};
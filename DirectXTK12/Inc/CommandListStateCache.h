@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// File: CommandListStateCache.h
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifdef _GAMING_XBOX_SCARLETT
+#include <d3d12_xs.h>
+#elif (defined(_XBOX_ONE) && defined(_TITLE)) || defined(_GAMING_XBOX)
+#include <d3d12_x.h>
+#elif defined(USING_DIRECTX_HEADERS)
+#include <directx/d3d12.h>
+#include <dxguids/dxguids.h>
+#else
+#include <d3d12.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace DirectX
+{
+    inline namespace DX12
+    {
+        class GraphicsMemoryContext;
+
+        // Records through a graphics command list, dropping root signature, pipeline state, root argument
+        // and input assembler calls whose arguments match what is already bound. The tracked state starts
+        // out unknown; call Invalidate after recording through the command list directly (including
+        // SetDescriptorHeaps) so the next calls are issued again.
+        //
+        // Effects applied through the cache upload their constants from graphicsMemory when one is given,
+        // which must belong to the recording thread, instead of from the shared GraphicsMemory.
+        class CommandListStateCache
+        {
+        public:
+            explicit CommandListStateCache(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                _In_opt_ GraphicsMemoryContext* graphicsMemory = nullptr) noexcept;
+
+            CommandListStateCache(CommandListStateCache&&) = default;
+            CommandListStateCache& operator= (CommandListStateCache&&) = default;
+
+            CommandListStateCache(CommandListStateCache const&) = delete;
+            CommandListStateCache& operator= (CommandListStateCache const&) = delete;
+
+            enum CallType : uint32_t
+            {
+                RootSignature,
+                PipelineState,
+                RootDescriptorTable,
+                RootConstantBufferView,
+                VertexBuffers,
+                IndexBuffer,
+                PrimitiveTopology,
+                CallTypeCount
+            };
+
+            struct Statistics
+            {
+                size_t issued[CallTypeCount];
+                size_t skipped[CallTypeCount];
+
+                size_t __cdecl TotalIssued() const noexcept;
+                size_t __cdecl TotalSkipped() const noexcept;
+            };
+
+            ID3D12GraphicsCommandList* __cdecl GetCommandList() const noexcept { return mCommandList; }
+            GraphicsMemoryContext* __cdecl GetGraphicsMemory() const noexcept { return mGraphicsMemory; }
+
+            // Forget all tracked state.
+            void __cdecl Invalidate() noexcept;
+
+            // Setting a different root signature also forgets the root arguments, as D3D does.
+            void __cdecl SetGraphicsRootSignature(_In_opt_ ID3D12RootSignature* rootSignature);
+            void __cdecl SetPipelineState(_In_ ID3D12PipelineState* pipelineState);
+            void __cdecl SetGraphicsRootDescriptorTable(uint32_t rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor);
+            void __cdecl SetGraphicsRootConstantBufferView(uint32_t rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+
+            void __cdecl IASetVertexBuffers(uint32_t startSlot, uint32_t numViews, _In_reads_opt_(numViews) const D3D12_VERTEX_BUFFER_VIEW* views);
+            void __cdecl IASetIndexBuffer(_In_opt_ const D3D12_INDEX_BUFFER_VIEW* view);
+            void __cdecl IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology);
+
+            // Not filtered; forwarded for convenience.
+            void __cdecl DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndexLocation, int32_t baseVertexLocation, uint32_t startInstanceLocation)
+            {
+                mCommandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+            }
+
+            const Statistics& __cdecl GetStatistics() const noexcept { return mStatistics; }
+            void __cdecl ResetStatistics() noexcept;
+
+        private:
+            static constexpr uint32_t c_MaxRootParameters = 64;
+            static constexpr uint32_t c_MaxVertexBuffers = D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+
+            enum RootArgumentType : uint8_t
+            {
+                RootArgumentUnknown,
+                RootArgumentTable,
+                RootArgumentCBV,
+            };
+
+            bool Track(CallType type, bool redundant) noexcept;
+
+            ID3D12GraphicsCommandList*  mCommandList;
+            GraphicsMemoryContext*      mGraphicsMemory;
+
+            bool                        mRootSignatureValid;
+            bool                        mPipelineStateValid;
+            bool                        mIndexBufferValid;
+            bool                        mTopologyValid;
+            uint32_t                    mVertexBuffersValid;    // One bit per slot
+
+            ID3D12RootSignature*        mRootSignature;
+            ID3D12PipelineState*        mPipelineState;
+            D3D12_INDEX_BUFFER_VIEW     mIndexBuffer;
+            D3D12_PRIMITIVE_TOPOLOGY    mTopology;
+            D3D12_VERTEX_BUFFER_VIEW    mVertexBuffers[c_MaxVertexBuffers];
+            RootArgumentType            mRootArgumentTypes[c_MaxRootParameters];
+            uint64_t                    mRootArguments[c_MaxRootParameters];
+
+            Statistics                  mStatistics;
+        };
+    }
+}
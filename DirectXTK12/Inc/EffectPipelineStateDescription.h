@@ -110,6 +110,10 @@ namespace DirectX
 
         uint32_t ComputeHash() const noexcept;
 
+        // 64-bit hash of every field, including the contents of the input layout elements. Unlike
+        // ComputeHash it doesn't depend on pointers or padding, so it is stable between runs.
+        uint64_t ComputeHash64() const noexcept;
+
         D3D12_INPUT_LAYOUT_DESC             inputLayout;
         D3D12_BLEND_DESC                    blendDesc;
         D3D12_DEPTH_STENCIL_DESC            depthStencilDesc;
@@ -32,6 +32,7 @@
 
 #include "RenderTargetState.h"
 #include "EffectPipelineStateDescription.h"
+#include "GraphicsMemory.h"
 
 
 namespace DirectX
@@ -39,6 +40,11 @@ namespace DirectX
     class DescriptorHeap;
     class ResourceUploadBatch;
 
+    inline namespace DX12
+    {
+        class CommandListStateCache;
+    }
+
     inline namespace DX12
     {
         //------------------------------------------------------------------------------
@@ -53,6 +59,10 @@ namespace DirectX
 
             virtual void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) = 0;
 
+            // Applies through a state cache, so state that is already bound isn't set again. The default
+            // applies to the underlying command list and invalidates the cache.
+            virtual void __cdecl Apply(CommandListStateCache& commandList);
+
         protected:
             IEffect() = default;
             IEffect(IEffect&&) = default;
@@ -60,6 +70,70 @@ namespace DirectX
         };
 
 
+        // World, view, and projection matrices shared by many effects. The values the built-in effects
+        // derive from them (world-view-projection, world inverse transpose, and eye position) are computed
+        // once when the matrices are set, and the effects copy them rather than each computing their own.
+        class SharedEffectMatrices
+        {
+        public:
+            SharedEffectMatrices() noexcept;
+
+            SharedEffectMatrices(SharedEffectMatrices&&) = default;
+            SharedEffectMatrices& operator= (SharedEffectMatrices&&) = default;
+
+            SharedEffectMatrices(SharedEffectMatrices const&) = delete;
+            SharedEffectMatrices& operator= (SharedEffectMatrices const&) = delete;
+
+            void XM_CALLCONV SetWorld(FXMMATRIX value) noexcept;
+            void XM_CALLCONV SetView(FXMMATRIX value) noexcept;
+            void XM_CALLCONV SetProjection(FXMMATRIX value) noexcept;
+            void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) noexcept;
+
+            XMMATRIX XM_CALLCONV GetWorld() const noexcept { return XMLoadFloat4x4(&mWorld); }
+            XMMATRIX XM_CALLCONV GetView() const noexcept { return XMLoadFloat4x4(&mView); }
+            XMMATRIX XM_CALLCONV GetProjection() const noexcept { return XMLoadFloat4x4(&mProjection); }
+            XMMATRIX XM_CALLCONV GetWorldView() const noexcept { return XMLoadFloat4x4(&mWorldView); }
+
+            // Transposed, as the shaders take it.
+            XMMATRIX XM_CALLCONV GetWorldViewProj() const noexcept { return XMLoadFloat4x4(&mWorldViewProj); }
+
+            // The shaders read these three rows of the world inverse as its transpose.
+            XMVECTOR XM_CALLCONV GetWorldInverse(size_t row) const noexcept { return XMLoadFloat4(&mWorldInverse[row]); }
+            XMVECTOR XM_CALLCONV GetEyePosition() const noexcept { return XMLoadFloat4(&mEyePosition); }
+
+            // Changes whenever a matrix is set, and is never the same for two different sets of values.
+            uint64_t __cdecl GetVersion() const noexcept { return mVersion; }
+
+            // Uploads the world, world inverse transpose, world-view-projection and eye position to a constant
+            // buffer, unless it already holds the current values. The built-in effects bind it at b2 in place of
+            // their own copy; call this before handing the block to the effects.
+            D3D12_GPU_VIRTUAL_ADDRESS __cdecl UpdateConstantBuffer(_In_opt_ ID3D12Device* device = nullptr);
+            D3D12_GPU_VIRTUAL_ADDRESS __cdecl UpdateConstantBuffer(GraphicsMemoryContext& graphicsMemory);
+
+            // Zero unless UpdateConstantBuffer has been called since the matrices last changed.
+            D3D12_GPU_VIRTUAL_ADDRESS __cdecl GetConstantBuffer() const noexcept
+            {
+                return (mConstantBufferVersion == mVersion) ? mConstantBuffer.GpuAddress() : 0;
+            }
+
+        private:
+            void UpdateWorld() noexcept;
+            void UpdateWorldViewProj() noexcept;
+            void UpdateEyePosition() noexcept;
+
+            XMFLOAT4X4 mWorld;
+            XMFLOAT4X4 mView;
+            XMFLOAT4X4 mProjection;
+            XMFLOAT4X4 mWorldView;
+            XMFLOAT4X4 mWorldViewProj;
+            XMFLOAT4 mWorldInverse[3];
+            XMFLOAT4 mEyePosition;
+            uint64_t mVersion;
+            GraphicsResource mConstantBuffer;
+            uint64_t mConstantBufferVersion;
+        };
+
+
         // Abstract interface for effects with world, view, and projection matrices.
         class IEffectMatrices
         {
@@ -74,6 +148,11 @@ namespace DirectX
             virtual void XM_CALLCONV SetProjection(FXMMATRIX value) = 0;
             virtual void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection);
 
+            // Takes the matrices from a shared block. The built-in effects copy its derived values, and do
+            // nothing if it hasn't changed since they last took it. Setting the world directly keeps the shared
+            // view and projection; setting either of those detaches them. The default calls SetMatrices.
+            virtual void __cdecl SetSharedMatrices(const SharedEffectMatrices& value);
+
         protected:
             IEffectMatrices() = default;
             IEffectMatrices(IEffectMatrices&&) = default;
@@ -140,7 +219,18 @@ namespace DirectX
             virtual void __cdecl SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, size_t count) = 0;
             virtual void __cdecl ResetBoneTransforms() = 0;
 
+            // Binds a bone palette constant buffer (MaxBones 3x4 matrices, see BonePaletteSize) built by the
+            // caller, so parts that share a palette don't each upload a copy. Setting or resetting the bone
+            // transforms switches back to the effect's own palette, as does passing 0. Returns false if the
+            // effect can't bind a shared palette, in which case the caller must use SetBoneTransforms.
+            virtual bool __cdecl SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette)
+            {
+                UNREFERENCED_PARAMETER(palette);
+                return false;
+            }
+
             static constexpr int MaxBones = 72;
+            static constexpr size_t BonePaletteSize = MaxBones * 3 * 4 * sizeof(float);
 
         protected:
             IEffectSkinning() = default;
@@ -149,6 +239,28 @@ namespace DirectX
         };
 
 
+        // Abstract interface for effects which can report the state Apply binds, so draws can be ordered to share it
+        class IEffectPipelineState
+        {
+        public:
+            virtual ~IEffectPipelineState() = default;
+
+            IEffectPipelineState(const IEffectPipelineState&) = delete;
+            IEffectPipelineState& operator=(const IEffectPipelineState&) = delete;
+
+            virtual ID3D12PipelineState* __cdecl GetPipelineState() const noexcept = 0;
+            virtual ID3D12RootSignature* __cdecl GetRootSignature() const noexcept = 0;
+
+            // Descriptor of the effect's first texture, or a null handle if it has none.
+            virtual D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept = 0;
+
+        protected:
+            IEffectPipelineState() = default;
+            IEffectPipelineState(IEffectPipelineState&&) = default;
+            IEffectPipelineState& operator=(IEffectPipelineState&&) = default;
+        };
+
+
         //------------------------------------------------------------------------------
         namespace EffectFlags
         {
@@ -182,7 +294,7 @@ namespace DirectX
 
         //------------------------------------------------------------------------------
         // Built-in shader supports optional texture mapping, vertex coloring, directional lighting, and fog.
-        class BasicEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog
+        class BasicEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog, public IEffectPipelineState
         {
         public:
             BasicEffect(_In_ ID3D12Device* device, uint32_t effectFlags, const EffectPipelineStateDescription& pipelineDescription);
@@ -197,12 +309,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -240,7 +359,7 @@ namespace DirectX
 
 
         // Built-in shader supports per-pixel alpha testing.
-        class AlphaTestEffect : public IEffect, public IEffectMatrices, public IEffectFog
+        class AlphaTestEffect : public IEffect, public IEffectMatrices, public IEffectFog, public IEffectPipelineState
         {
         public:
             AlphaTestEffect(_In_ ID3D12Device* device, uint32_t effectFlags,
@@ -257,12 +376,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -289,7 +415,7 @@ namespace DirectX
 
 
         // Built-in shader supports two layer multitexturing (eg. for lightmaps or detail textures).
-        class DualTextureEffect : public IEffect, public IEffectMatrices, public IEffectFog
+        class DualTextureEffect : public IEffect, public IEffectMatrices, public IEffectFog, public IEffectPipelineState
         {
         public:
             DualTextureEffect(_In_ ID3D12Device* device, uint32_t effectFlags,
@@ -305,12 +431,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -335,7 +468,7 @@ namespace DirectX
 
 
         // Built-in shader supports cubic environment mapping.
-        class EnvironmentMapEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog
+        class EnvironmentMapEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog, public IEffectPipelineState
         {
         public:
             enum Mapping
@@ -359,12 +492,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -407,7 +547,7 @@ namespace DirectX
 
 
         // Built-in shader supports skinned animation.
-        class SkinnedEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog, public IEffectSkinning
+        class SkinnedEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog, public IEffectPipelineState, public IEffectSkinning
         {
         public:
             SkinnedEffect(_In_ ID3D12Device* device, uint32_t effectFlags,
@@ -423,12 +563,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -460,6 +607,7 @@ namespace DirectX
             // Animation settings.
             void __cdecl SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, size_t count) override;
             void __cdecl ResetBoneTransforms() override;
+            bool __cdecl SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette) override;
 
         private:
             // Private implementation.
@@ -471,7 +619,7 @@ namespace DirectX
 
         //------------------------------------------------------------------------------
         // Built-in shader extends BasicEffect with normal map and optional specular map
-        class NormalMapEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog
+        class NormalMapEffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectFog, public IEffectPipelineState
         {
         public:
             NormalMapEffect(_In_ ID3D12Device* device, uint32_t effectFlags,
@@ -490,12 +638,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Material settings.
             void XM_CALLCONV SetDiffuseColor(FXMVECTOR value);
@@ -556,12 +711,13 @@ namespace DirectX
             // Animation settings.
             void __cdecl SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, size_t count) override;
             void __cdecl ResetBoneTransforms() override;
+            bool __cdecl SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette) override;
         };
 
 
         //------------------------------------------------------------------------------
         // Built-in shader for Physically-Based Rendering (Roughness/Metalness) with Image-based lighting
-        class PBREffect : public IEffect, public IEffectMatrices, public IEffectLights
+        class PBREffect : public IEffect, public IEffectMatrices, public IEffectLights, public IEffectPipelineState
         {
         public:
             PBREffect(_In_ ID3D12Device* device, uint32_t effectFlags,
@@ -580,12 +736,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Light settings.
             void __cdecl SetLightEnabled(int whichLight, bool value) override;
@@ -656,12 +819,13 @@ namespace DirectX
             // Animation settings.
             void __cdecl SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, size_t count) override;
             void __cdecl ResetBoneTransforms() override;
+            bool __cdecl SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette) override;
         };
 
 
         //------------------------------------------------------------------------------
         // Built-in shader for debug visualization of normals, tangents, etc.
-        class DebugEffect : public IEffect, public IEffectMatrices
+        class DebugEffect : public IEffect, public IEffectMatrices, public IEffectPipelineState
         {
         public:
             enum Mode
@@ -686,12 +850,19 @@ namespace DirectX
 
             // IEffect methods.
             void __cdecl Apply(_In_ ID3D12GraphicsCommandList* commandList) override;
+            void __cdecl Apply(CommandListStateCache& commandList) override;
+
+            // IEffectPipelineState methods.
+            ID3D12PipelineState* __cdecl GetPipelineState() const noexcept override;
+            ID3D12RootSignature* __cdecl GetRootSignature() const noexcept override;
+            D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetPrimaryTexture() const noexcept override;
 
             // Camera settings.
             void XM_CALLCONV SetWorld(FXMMATRIX value) override;
             void XM_CALLCONV SetView(FXMMATRIX value) override;
             void XM_CALLCONV SetProjection(FXMMATRIX value) override;
             void XM_CALLCONV SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) override;
+            void __cdecl SetSharedMatrices(const SharedEffectMatrices& value) override;
 
             // Debug Settings.
             void XM_CALLCONV SetHemisphericalAmbientColor(FXMVECTOR upper, FXMVECTOR lower);
@@ -705,6 +876,44 @@ namespace DirectX
         };
 
 
+        //------------------------------------------------------------------------------
+        // An effect with its optional interfaces looked up once, so code that runs every frame can reach
+        // them without RTTI. Dereferences like a pointer to the effect, so a collection of these can be
+        // passed wherever the Model draw methods take an effect iterator.
+        struct ResolvedEffect
+        {
+            std::shared_ptr<IEffect>    effect;
+            IEffectMatrices*            matrices;
+            IEffectLights*              lights;
+            IEffectFog*                 fog;
+            IEffectSkinning*            skinning;
+            IEffectPipelineState*       pipelineState;
+            PBREffect*                  pbr;
+
+            ResolvedEffect() noexcept;
+            ResolvedEffect(std::shared_ptr<IEffect> ieffect) noexcept;
+
+            IEffect* __cdecl get() const noexcept { return effect.get(); }
+            IEffect* operator->() const noexcept { return effect.get(); }
+            IEffect& operator*() const noexcept { return *effect; }
+            explicit operator bool() const noexcept { return effect != nullptr; }
+        };
+
+        // Optional interface lookups for any effect pointer type: cached for ResolvedEffect, RTTI otherwise.
+        inline IEffectMatrices* __cdecl GetEffectMatrices(const ResolvedEffect& effect) noexcept { return effect.matrices; }
+        inline IEffectSkinning* __cdecl GetEffectSkinning(const ResolvedEffect& effect) noexcept { return effect.skinning; }
+        inline IEffectPipelineState* __cdecl GetEffectPipelineState(const ResolvedEffect& effect) noexcept { return effect.pipelineState; }
+
+        template<typename TEffectPtr>
+        IEffectMatrices* GetEffectMatrices(const TEffectPtr& effect) { return dynamic_cast<IEffectMatrices*>(&*effect); }
+
+        template<typename TEffectPtr>
+        IEffectSkinning* GetEffectSkinning(const TEffectPtr& effect) { return dynamic_cast<IEffectSkinning*>(&*effect); }
+
+        template<typename TEffectPtr>
+        IEffectPipelineState* GetEffectPipelineState(const TEffectPtr& effect) { return dynamic_cast<IEffectPipelineState*>(&*effect); }
+
+
         //------------------------------------------------------------------------------
         // Abstract interface to factory texture resources
         class IEffectTextureFactory
@@ -864,7 +1073,8 @@ namespace DirectX
 
             ~EffectFactory() override;
 
-            // IEffectFactory methods.
+            // IEffectFactory methods. CreateEffect may be called from several threads at once, as long as
+            // the settings below aren't changed meanwhile.
             virtual std::shared_ptr<IEffect> __cdecl CreateEffect(
                 const EffectInfo& info,
                 const EffectPipelineStateDescription& opaquePipelineState,
@@ -913,7 +1123,8 @@ namespace DirectX
 
             ~PBREffectFactory() override;
 
-            // IEffectFactory methods.
+            // IEffectFactory methods. CreateEffect may be called from several threads at once, as long as
+            // the settings below aren't changed meanwhile.
             virtual std::shared_ptr<IEffect> __cdecl CreateEffect(
                 const EffectInfo& info,
                 const EffectPipelineStateDescription& opaquePipelineState,
@@ -21,6 +21,7 @@
 #endif
 
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <memory>
 
@@ -131,6 +132,59 @@ namespace DirectX
             size_t peakCommitedMemory;  // Peak commited memory value since last reset
             size_t peakTotalMemory;     // Peak total bytes
             size_t peakTotalPages;      // Peak total page count
+            size_t lastCommitFencedPages; // Pages handed to the GPU by the last Commit
+            size_t lastCommitSignals;   // Fence signals issued by the last Commit (previously one per fenced page)
+            size_t usedMemory;          // Bytes suballocated from pages being filled or in flight
+            size_t slackMemory;         // Bytes of those pages that were skipped or left unallocated
+            size_t unusedMemory;        // Bytes of pages ready for reuse
+            size_t trimmedPages;        // Pages freed by the budget since the GraphicsMemory was created
+        };
+
+        struct GraphicsMemoryPoolStatistics
+        {
+            size_t pageSize;
+            size_t totalPages;
+            size_t activePages;         // Pages being filled or in flight
+            size_t pendingPages;        // Pages in flight
+            size_t ownedPages;          // Pages held by allocation contexts, which aren't sampled
+            size_t unusedPages;
+            size_t usedBytes;           // Bytes suballocated from the active pages
+            size_t slackBytes;          // Bytes of the active pages that were skipped or left unallocated
+        };
+
+        struct GraphicsMemoryTagStatistics
+        {
+            size_t allocations;         // Allocations made with the tag in the last frame
+            size_t bytes;               // Bytes requested by those allocations
+            size_t alignmentBytes;      // Bytes skipped to align them
+        };
+
+        // Where the upload memory is going. Pools are the power-of-two page size buckets, smallest first.
+        // Tags are indexed by GraphicsMemory::Tag; any other tag counts as TAG_GENERIC. A frame runs
+        // from one Commit to the next, and allocation contexts report their tags when they change pages.
+        struct GraphicsMemoryFragmentation
+        {
+            static constexpr size_t PoolCount = 21;
+            static constexpr size_t TagCount = 7;
+            static constexpr size_t HistogramBuckets = 10;
+
+            GraphicsMemoryPoolStatistics pools[PoolCount];
+            GraphicsMemoryTagStatistics tags[TagCount];
+            size_t histogram[HistogramBuckets]; // Active pages by how full they are, in 10% steps
+        };
+
+        // Limits applied at each Commit, after the pages the GPU is done with are reclaimed. The
+        // defaults keep every page for reuse.
+        struct GraphicsMemoryBudget
+        {
+            size_t maxUnusedMemory;     // Unused pages beyond this are freed, largest pages first
+            size_t maxTotalMemory;      // Above this, unused pages are freed until the total is 1/8th below it
+
+            GraphicsMemoryBudget() noexcept
+                : maxUnusedMemory(SIZE_MAX)
+                , maxTotalMemory(SIZE_MAX)
+            {
+            }
         };
 
         //------------------------------------------------------------------------------
@@ -163,11 +217,9 @@ namespace DirectX
             // the GraphicsResource object, or your memory may be overwritten later.
             GraphicsResource __cdecl Allocate(size_t size, size_t alignment = 16, uint32_t tag = TAG_GENERIC)
             {
-                auto alloc = AllocateImpl(size, alignment);
+                auto alloc = AllocateImpl(size, alignment, tag);
 #ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
                 std::ignore = ReportCustomMemoryAlloc(alloc.Memory(), alloc.Size(), tag);
-#else
-                UNREFERENCED_PARAMETER(tag);
 #endif
                 return alloc;
             }
@@ -177,7 +229,7 @@ namespace DirectX
             {
                 constexpr size_t alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
                 constexpr size_t alignedSize = (sizeof(T) + alignment - 1) & ~(alignment - 1);
-                auto alloc = AllocateImpl(alignedSize, alignment);
+                auto alloc = AllocateImpl(alignedSize, alignment, TAG_CONSTANT);
 #ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
                 // This cast is needed to capture the type information in the PDB
                 std::ignore = reinterpret_cast<T*>(ReportCustomMemoryAlloc(alloc.Memory(), alloc.Size(), TAG_CONSTANT));
@@ -205,15 +257,25 @@ namespace DirectX
             GraphicsMemoryStatistics __cdecl GetStatistics();
             void __cdecl ResetStatistics();
 
+            // Per-pool and per-tag usage, and how full the pages are. Pages held by allocation
+            // contexts are counted, but not how much of them is used.
+            GraphicsMemoryFragmentation __cdecl GetFragmentation();
+
+            // Trims unused pages to the budget at each Commit.
+            void __cdecl SetBudget(const GraphicsMemoryBudget& budget);
+            GraphicsMemoryBudget __cdecl GetBudget();
+
             // Singleton
             // Should only use nullptr for single GPU scenarios; mGPU requires a specific device
             static GraphicsMemory& __cdecl Get(_In_opt_ ID3D12Device* device = nullptr);
 
         private:
+            friend class GraphicsMemoryContext;
+
             // Private implementation.
             class Impl;
 
-            GraphicsResource __cdecl AllocateImpl(size_t size, size_t alignment);
+            GraphicsResource __cdecl AllocateImpl(size_t size, size_t alignment, uint32_t tag);
 
 #ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
             // The declspec is required to ensure the proper information is captured in the PDB
@@ -222,5 +284,65 @@ namespace DirectX
 
             std::unique_ptr<Impl> pImpl;
         };
+
+        //------------------------------------------------------------------------------
+        // Allocation context for one thread. Small allocations bump allocate from a page the context
+        // owns, so they take no lock; only getting a new page, and allocations of 32KB or more, go
+        // through the shared pools. Give each thread that records command lists its own context,
+        // and destroy the contexts before the GraphicsMemory.
+        //
+        // A page is handed back to the shared pools when it fills, or on Flush, and is then fenced by
+        // the next Commit like any other. Command lists using a context's memory must be submitted
+        // before the Commit that follows, as with GraphicsMemory::Allocate.
+        class GraphicsMemoryContext
+        {
+        public:
+            explicit GraphicsMemoryContext(_In_opt_ ID3D12Device* device = nullptr);
+
+            GraphicsMemoryContext(GraphicsMemoryContext&&) noexcept;
+            GraphicsMemoryContext& operator= (GraphicsMemoryContext&&) noexcept;
+
+            GraphicsMemoryContext(GraphicsMemoryContext const&) = delete;
+            GraphicsMemoryContext& operator=(GraphicsMemoryContext const&) = delete;
+
+            ~GraphicsMemoryContext();
+
+            GraphicsResource __cdecl Allocate(size_t size, size_t alignment = 16, uint32_t tag = GraphicsMemory::TAG_GENERIC)
+            {
+                auto alloc = AllocateImpl(size, alignment, tag);
+#ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
+                std::ignore = GraphicsMemory::ReportCustomMemoryAlloc(alloc.Memory(), alloc.Size(), tag);
+#endif
+                return alloc;
+            }
+
+            template<typename T> GraphicsResource AllocateConstant()
+            {
+                constexpr size_t alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+                constexpr size_t alignedSize = (sizeof(T) + alignment - 1) & ~(alignment - 1);
+                auto alloc = AllocateImpl(alignedSize, alignment, GraphicsMemory::TAG_CONSTANT);
+#ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
+                std::ignore = reinterpret_cast<T*>(GraphicsMemory::ReportCustomMemoryAlloc(alloc.Memory(), alloc.Size(), GraphicsMemory::TAG_CONSTANT));
+#endif
+                return alloc;
+            }
+            template<typename T> GraphicsResource AllocateConstant(const T& setData)
+            {
+                GraphicsResource alloc = AllocateConstant<T>();
+                memcpy(alloc.Memory(), &setData, sizeof(T));
+                return alloc;
+            }
+
+            // Hands the current page back to the shared pools, so the next Commit can fence it once its
+            // allocations are released. Call from the owning thread when it's done recording for a while.
+            void __cdecl Flush();
+
+        private:
+            class Impl;
+
+            GraphicsResource __cdecl AllocateImpl(size_t size, size_t alignment, uint32_t tag);
+
+            std::unique_ptr<Impl> pImpl;
+        };
     }
 }
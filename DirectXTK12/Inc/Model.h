@@ -50,6 +50,7 @@ namespace DirectX
 {
     inline namespace DX12
     {
+        class CommandListStateCache;
         class IEffect;
         class IEffectFactory;
         class ModelMesh;
@@ -139,6 +140,8 @@ namespace DirectX
             SharedGraphicsResource                                  vertexBuffer;
             Microsoft::WRL::ComPtr<ID3D12Resource>                  staticIndexBuffer;
             Microsoft::WRL::ComPtr<ID3D12Resource>                  staticVertexBuffer;
+            uint64_t                                                staticIndexBufferOffset;    // Byte offset into staticIndexBuffer
+            uint64_t                                                staticVertexBufferOffset;   // Byte offset into staticVertexBuffer
             std::shared_ptr<InputLayoutCollection>                  vbDecl;
 
             // Draw mesh part
@@ -146,6 +149,11 @@ namespace DirectX
 
             void __cdecl DrawInstanced(_In_ ID3D12GraphicsCommandList* commandList, uint32_t instanceCount, uint32_t startInstance = 0) const;
 
+            // Draw mesh part through a state cache, skipping input assembler state that is already bound
+            void __cdecl Draw(CommandListStateCache& commandList) const;
+
+            void __cdecl DrawInstanced(CommandListStateCache& commandList, uint32_t instanceCount, uint32_t startInstance = 0) const;
+
             //
             // Utilities for drawing multiple mesh parts
             //
@@ -209,7 +217,7 @@ namespace DirectX
                     TEffectIterator effect_iterator = partEffects;
                     std::advance(effect_iterator, part->partIndex);
 
-                    auto imatrices = dynamic_cast<IEffectMatrices*>((*effect_iterator).get());
+                    auto imatrices = GetEffectMatrices(*effect_iterator);
                     if (imatrices)
                     {
                         imatrices->SetWorld(world);
@@ -230,6 +238,33 @@ namespace DirectX
                 _In_reads_(nbones) const XMMATRIX* boneTransforms,
                 FXMMATRIX world,
                 TEffectIterator partEffects);
+
+            // As above, with the mesh's influence-mapped bone palette already built by the caller.
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            static void XM_CALLCONV DrawSkinnedMeshParts(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                const ModelMesh& mesh,
+                const Collection& meshParts,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                size_t npalette,
+                _In_reads_(npalette) const XMMATRIX* palette,
+                FXMMATRIX world,
+                TEffectIterator partEffects);
+
+            // As above, with the mesh's palette already in a constant buffer (see IEffectSkinning::SetBonePalette).
+            // Effects that can't bind it get the palette built from boneTransforms instead. TCommandList is
+            // ID3D12GraphicsCommandList* or CommandListStateCache.
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category, typename TCommandList>
+            static void XM_CALLCONV DrawSkinnedMeshParts(
+                TCommandList& commandList,
+                const ModelMesh& mesh,
+                const Collection& meshParts,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+                FXMMATRIX world,
+                TEffectIterator partEffects);
         };
 
 
@@ -352,6 +387,109 @@ namespace DirectX
                 ModelMeshPart::DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, *this, alphaMeshParts,
                     nbones, boneTransforms, world, effects);
             }
+
+            // Draw using skinning given the mesh's bone palette constant buffer (see ModelSkinningContext).
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawSkinnedOpaque(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+                FXMMATRIX world,
+                TEffectIterator effects) const
+            {
+                ModelMeshPart::DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, *this, opaqueMeshParts,
+                    nbones, boneTransforms, bonePalette, world, effects);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawSkinnedAlpha(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+                FXMMATRIX world,
+                TEffectIterator effects) const
+            {
+                ModelMeshPart::DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, *this, alphaMeshParts,
+                    nbones, boneTransforms, bonePalette, world, effects);
+            }
+
+            // As above, applying the effects through the cache so their constants come from its allocation context.
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawSkinnedOpaque(
+                CommandListStateCache& commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+                FXMMATRIX world,
+                TEffectIterator effects) const
+            {
+                ModelMeshPart::DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, *this, opaqueMeshParts,
+                    nbones, boneTransforms, bonePalette, world, effects);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawSkinnedAlpha(
+                CommandListStateCache& commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+                FXMMATRIX world,
+                TEffectIterator effects) const
+            {
+                ModelMeshPart::DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, *this, alphaMeshParts,
+                    nbones, boneTransforms, bonePalette, world, effects);
+            }
+        };
+
+
+        //------------------------------------------------------------------------------
+        // Read-only memory-mapped view of a model file, used for zero-copy loading
+        class ModelFileView
+        {
+        public:
+            explicit ModelFileView(_In_z_ const wchar_t* szFileName);
+
+            ModelFileView(ModelFileView&&) noexcept;
+            ModelFileView& operator= (ModelFileView&&) noexcept;
+
+            ModelFileView(ModelFileView const&) = delete;
+            ModelFileView& operator= (ModelFileView const&) = delete;
+
+            virtual ~ModelFileView();
+
+            const uint8_t* __cdecl GetData() const noexcept;
+            size_t __cdecl GetSize() const noexcept;
+            const wchar_t* __cdecl GetFileName() const noexcept;
+
+        private:
+            class Impl;
+
+            std::unique_ptr<Impl> pImpl;
+        };
+
+
+        //------------------------------------------------------------------------------
+        // Per-mesh results of Model::Cull, indexed like Model::meshes
+        struct ModelVisibility
+        {
+            std::vector<uint8_t>    visible;
+            size_t                  visibleCount;
+            size_t                  culledCount;
+            size_t                  spheresTested;      // Hierarchy node children or meshes tested, four at a time
+
+            ModelVisibility() noexcept :
+                visibleCount(0),
+                culledCount(0),
+                spheresTested(0)
+            {
+            }
+
+            bool __cdecl IsVisible(size_t meshIndex) const noexcept
+            {
+                return meshIndex < visible.size() && visible[meshIndex] != 0;
+            }
         };
 
 
@@ -371,6 +509,7 @@ namespace DirectX
             virtual ~Model();
 
             using EffectCollection = std::vector<std::shared_ptr<IEffect>>;
+            using ResolvedEffectCollection = std::vector<ResolvedEffect>;
             using ModelMaterialInfo = IEffectFactory::EffectInfo;
             using ModelMaterialInfoCollection = std::vector<ModelMaterialInfo>;
             using TextureCollection = std::vector<std::wstring>;
@@ -442,6 +581,96 @@ namespace DirectX
                 DrawSkinnedAlpha(commandList, std::forward<TForwardArgs>(args)...);
             }
 
+            // Draw only the meshes that passed Cull.
+            template<typename... TForwardArgs> void DrawVisibleOpaque(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                for (size_t i = 0; i < meshes.size(); ++i)
+                {
+                    if (!visibility.IsVisible(i))
+                        continue;
+
+                    auto mesh = meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    mesh->DrawOpaque(commandList, std::forward<TForwardArgs>(args)...);
+                }
+            }
+
+            template<typename... TForwardArgs> void DrawVisibleAlpha(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                for (size_t i = 0; i < meshes.size(); ++i)
+                {
+                    if (!visibility.IsVisible(i))
+                        continue;
+
+                    auto mesh = meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    mesh->DrawAlpha(commandList, std::forward<TForwardArgs>(args)...);
+                }
+            }
+
+            template<typename... TForwardArgs> void DrawVisible(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                DrawVisibleOpaque(commandList, visibility, args...);
+                DrawVisibleAlpha(commandList, visibility, std::forward<TForwardArgs>(args)...);
+            }
+
+            template<typename... TForwardArgs> void DrawVisibleSkinnedOpaque(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                for (size_t i = 0; i < meshes.size(); ++i)
+                {
+                    if (!visibility.IsVisible(i))
+                        continue;
+
+                    auto mesh = meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    mesh->DrawSkinnedOpaque(commandList, std::forward<TForwardArgs>(args)...);
+                }
+            }
+
+            template<typename... TForwardArgs> void DrawVisibleSkinnedAlpha(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                for (size_t i = 0; i < meshes.size(); ++i)
+                {
+                    if (!visibility.IsVisible(i))
+                        continue;
+
+                    auto mesh = meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    mesh->DrawSkinnedAlpha(commandList, std::forward<TForwardArgs>(args)...);
+                }
+            }
+
+            template<typename... TForwardArgs> void DrawVisibleSkinned(_In_ ID3D12GraphicsCommandList* commandList, const ModelVisibility& visibility, TForwardArgs&&... args) const
+            {
+                DrawVisibleSkinnedOpaque(commandList, visibility, args...);
+                DrawVisibleSkinnedAlpha(commandList, visibility, std::forward<TForwardArgs>(args)...);
+            }
+
+            // Frustum culling of the meshes' bounding spheres against a view-projection matrix, walking the
+            // hierarchy built by UpdateCullingBounds. Meshes without bounds, and meshes with skinned parts, are
+            // always visible.
+            void XM_CALLCONV Cull(
+                FXMMATRIX world,
+                CXMMATRIX viewProjection,
+                ModelVisibility& visibility) const;
+
+            // As above for drawing with bones: each mesh's bounds are moved by its bone like Draw with bones
+            // does. Meshes with skinned parts can't be bounded from the bind pose, so they are always visible.
+            void XM_CALLCONV Cull(
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                CXMMATRIX viewProjection,
+                ModelVisibility& visibility) const;
+
+            // Builds the bounding sphere hierarchy used by Cull. The loaders call this; call it again after
+            // modifying meshes or their bounds.
+            void __cdecl UpdateCullingBounds();
+
             // Load texture resources into an existing Effect Texture Factory
             int __cdecl LoadTextures(IEffectTextureFactory& texFactory, int destinationDescriptorOffset = 0) const;
 
@@ -452,12 +681,28 @@ namespace DirectX
                 _In_opt_z_ const wchar_t* texturesPath = nullptr,
                 D3D12_DESCRIPTOR_HEAP_FLAGS flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE) const;
 
+            // Split skinned meshes whose bone palette exceeds maxBones into meshes with smaller palettes,
+            // remapping vertex blend indices. Needs CPU-side VB/IB, so call before LoadStaticBuffers and
+            // CreateEffects. Returns the number of meshes that were split.
+            size_t __cdecl SplitSkinnedMeshes(
+                _In_ ID3D12Device* device,
+                size_t maxBones = IEffectSkinning::MaxBones);
+
             // Load VB/IB resources for static geometry
             void __cdecl LoadStaticBuffers(
                 _In_ ID3D12Device* device,
                 ResourceUploadBatch& resourceUploadBatch,
                 bool keepMemory = false);
 
+            // Load VB/IB resources for static geometry suballocated from a few large shared buffers
+            static constexpr uint64_t c_DefaultArenaBlockSize = 64u * 1024u * 1024u;
+
+            void __cdecl LoadStaticBuffersArena(
+                _In_ ID3D12Device* device,
+                ResourceUploadBatch& resourceUploadBatch,
+                bool keepMemory = false,
+                uint64_t blockSize = c_DefaultArenaBlockSize);
+
             // Create effects using the default effect factory
             EffectCollection __cdecl CreateEffects(
                 const EffectPipelineStateDescription& opaquePipelineState,
@@ -475,6 +720,23 @@ namespace DirectX
                 int textureDescriptorOffset = 0,
                 int samplerDescriptorOffset = 0) const;
 
+            // Like CreateEffects, but creates each distinct material and input layout pair once, spread over
+            // threadCount threads (0 uses one per hardware thread). Parts with the same material and input
+            // layout share an effect even if the factory doesn't. The factory must be safe to call from
+            // several threads, which EffectFactory and PBREffectFactory are, and its settings must not
+            // change until this returns.
+            EffectCollection __cdecl CreateEffectsParallel(
+                IEffectFactory& fxFactory,
+                const EffectPipelineStateDescription& opaquePipelineState,
+                const EffectPipelineStateDescription& alphaPipelineState,
+                int textureDescriptorOffset = 0,
+                int samplerDescriptorOffset = 0,
+                unsigned int threadCount = 0) const;
+
+            // Looks up the optional interfaces of each effect once. The result can be drawn with like an
+            // EffectCollection, and the draw and update paths then use the cached interfaces instead of RTTI.
+            static ResolvedEffectCollection __cdecl ResolveEffects(const EffectCollection& effects);
+
             // Compute bone positions based on heirarchy and transform matrices
             void __cdecl CopyAbsoluteBoneTransformsTo(
                 size_t nbones,
@@ -485,6 +747,17 @@ namespace DirectX
                 _In_reads_(nbones) const XMMATRIX* inBoneTransforms,
                 _Out_writes_(nbones) XMMATRIX* outBoneTransforms) const;
 
+            // Compute bone positions for a batch of skeleton instances (each nbones transforms, packed back to back)
+            void __cdecl CopyAbsoluteBoneTransforms(
+                size_t ninstances,
+                size_t nbones,
+                _In_reads_(ninstances * nbones) const XMMATRIX* inBoneTransforms,
+                _Out_writes_(ninstances * nbones) XMMATRIX* outBoneTransforms) const;
+
+            // Validates the bone graph and flattens it into the parents-first order used by the
+            // functions above. The loaders call this; call it again after modifying bones.
+            void __cdecl UpdateBoneOrder();
+
             // Set bone matrices to a set of relative tansforms
             void __cdecl CopyBoneTransformsFrom(
                 size_t nbones,
@@ -516,6 +789,10 @@ namespace DirectX
                 _In_opt_ ID3D12Device* device,
                 _In_z_ const wchar_t* szFileName,
                 ModelLoaderFlags flags = ModelLoader_Default);
+            static std::unique_ptr<Model> __cdecl CreateFromSDKMESH(
+                _In_opt_ ID3D12Device* device,
+                const ModelFileView& fileView,
+                ModelLoaderFlags flags = ModelLoader_Default);
 
             // Loads a model from a .VBO file
             static std::unique_ptr<Model> __cdecl CreateFromVBO(
@@ -527,6 +804,24 @@ namespace DirectX
                 _In_z_ const wchar_t* szFileName,
                 ModelLoaderFlags flags = ModelLoader_Default);
 
+            // Loads a model from a pre-baked .DTKMODEL file
+            static std::unique_ptr<Model> __cdecl CreateFromDTKMODEL(
+                _In_opt_ ID3D12Device* device,
+                _In_reads_bytes_(dataSize) const uint8_t* meshData, _In_ size_t dataSize,
+                ModelLoaderFlags flags = ModelLoader_Default);
+            static std::unique_ptr<Model> __cdecl CreateFromDTKMODEL(
+                _In_opt_ ID3D12Device* device,
+                _In_z_ const wchar_t* szFileName,
+                ModelLoaderFlags flags = ModelLoader_Default);
+            static std::unique_ptr<Model> __cdecl CreateFromDTKMODEL(
+                _In_opt_ ID3D12Device* device,
+                const ModelFileView& fileView,
+                ModelLoaderFlags flags = ModelLoader_Default);
+
+            // Writes the model as a .DTKMODEL file. VB/IB data must still be in CPU memory, so call this
+            // before LoadStaticBuffers (or after it with keepMemory). userData is stored as-is in the header.
+            void __cdecl SaveToDTKMODEL(_In_z_ const wchar_t* szFileName, uint32_t userData = 0) const;
+
             // Utility function for getting a GPU descriptor for a mesh part/material index. If there is no texture the
             // descriptor will be zero.
             D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetGpuTextureHandleForMaterialIndex(uint32_t materialIndex, _In_ ID3D12DescriptorHeap* heap, _In_ size_t descriptorSize, _In_ size_t descriptorOffset) const
@@ -558,6 +853,18 @@ namespace DirectX
                 CXMMATRIX view,
                 CXMMATRIX proj);
 
+            static void XM_CALLCONV UpdateEffectMatrices(
+                ResolvedEffectCollection& effects,
+                FXMMATRIX world,
+                CXMMATRIX view,
+                CXMMATRIX proj);
+
+            // Updates every effect in the list from a shared block of matrices, so the world inverse, eye position
+            // and world-view-projection are computed once for all of them instead of once per effect.
+            static void __cdecl UpdateEffectMatrices(
+                ResolvedEffectCollection& effects,
+                const SharedEffectMatrices& matrices);
+
             // Utility function to transition VB/IB resources for static geometry.
             void __cdecl Transition(
                 _In_ ID3D12GraphicsCommandList* commandList,
@@ -598,6 +905,13 @@ namespace DirectX
                 _In_z_ const __wchar_t* szFileName,
                 ModelLoaderFlags flags = ModelLoader_Default);
 
+            static std::unique_ptr<Model> __cdecl CreateFromDTKMODEL(
+                _In_opt_ ID3D12Device* device,
+                _In_z_ const __wchar_t* szFileName,
+                ModelLoaderFlags flags = ModelLoader_Default);
+
+            void __cdecl SaveToDTKMODEL(_In_z_ const __wchar_t* szFileName, uint32_t userData = 0) const;
+
 #endif // !_NATIVE_WCHAR_T_DEFINED
 
         private:
@@ -614,6 +928,417 @@ namespace DirectX
                 _In_reads_(nbones) const XMMATRIX* inBoneTransforms,
                 _Inout_updates_(nbones) XMMATRIX* outBoneTransforms,
                 size_t& visited) const;
+
+            void __cdecl ComputeAbsoluteOrdered(
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* inBoneTransforms,
+                _Out_writes_(nbones) XMMATRIX* outBoneTransforms) const noexcept;
+
+            struct BoneOrder
+            {
+                uint32_t index;
+                uint32_t parent;        // ModelBone::c_Invalid for roots
+            };
+
+            std::vector<BoneOrder>          boneOrder;
+            size_t                          boneOrderCount;     // bones.size() when boneOrder was built
+            bool                            boneOrderComplete;  // every bone is reached exactly once
+
+            // Four-wide node of the culling hierarchy; each lane is a child's bounding sphere.
+            struct CullNode
+            {
+                XMFLOAT4    centerX;
+                XMFLOAT4    centerY;
+                XMFLOAT4    centerZ;
+                XMFLOAT4    radius;
+                uint32_t    children[4];    // node index, mesh index | c_CullLeaf, or c_CullEmpty
+            };
+
+            static constexpr uint32_t c_CullLeaf = 0x80000000;
+            static constexpr uint32_t c_CullEmpty = uint32_t(-1);
+
+            std::vector<CullNode>           cullNodes;
+            std::vector<uint32_t>           cullUnbounded;      // meshes without usable bounds, or skinned
+            std::vector<uint8_t>            cullSkinned;        // meshes with skinned parts
+            size_t                          cullMeshCount;      // meshes.size() when cullNodes was built
+        };
+
+
+        //------------------------------------------------------------------------------
+        // Scratch state for drawing a skinned model. The palettes of every mesh are sized and
+        // validated once; Update then writes all of them, already in the skinned effects' constant
+        // buffer layout, into a single upload allocation that each mesh's parts bind in place of
+        // their own copy. Meshes without boneInfluences share one palette. Reset if the model's
+        // meshes or bones change.
+        class ModelSkinningContext
+        {
+        public:
+            ModelSkinningContext() noexcept;
+            ModelSkinningContext(_In_ ID3D12Device* device, const Model& model);
+
+            ModelSkinningContext(ModelSkinningContext&&) = default;
+            ModelSkinningContext& operator= (ModelSkinningContext&&) = default;
+
+            ModelSkinningContext(ModelSkinningContext const&) = delete;
+            ModelSkinningContext& operator= (ModelSkinningContext const&) = delete;
+
+            void __cdecl Reset(_In_ ID3D12Device* device, const Model& model);
+
+            // Builds the bone palettes for this frame. Call once per frame before drawing. The cache version
+            // allocates them from the cache's allocation context, if it has one.
+            void __cdecl Update(size_t nbones, _In_reads_(nbones) const XMMATRIX* boneTransforms);
+            void __cdecl Update(CommandListStateCache& commandList, size_t nbones, _In_reads_(nbones) const XMMATRIX* boneTransforms);
+
+            // Draw using the palettes from the last Update. boneTransforms is only used for parts whose
+            // effect doesn't support skinning.
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawOpaque(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr) const
+            {
+                DrawMeshes<TEffectIterator, TEffectIteratorCategory>(commandList, false, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawAlpha(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr) const
+            {
+                DrawMeshes<TEffectIterator, TEffectIteratorCategory>(commandList, true, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawOpaque(
+                CommandListStateCache& commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr) const
+            {
+                DrawMeshes<TEffectIterator, TEffectIteratorCategory>(commandList, false, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV DrawAlpha(
+                CommandListStateCache& commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr) const
+            {
+                DrawMeshes<TEffectIterator, TEffectIteratorCategory>(commandList, true, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            // Update and draw all parts, or only the meshes marked visible.
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV Draw(
+                _In_ ID3D12GraphicsCommandList* commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr)
+            {
+                Update(nbones, boneTransforms);
+                DrawOpaque<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms, world, effects, visibility);
+                DrawAlpha<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV Draw(
+                CommandListStateCache& commandList,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr)
+            {
+                Update(commandList, nbones, boneTransforms);
+                DrawOpaque<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms, world, effects, visibility);
+                DrawAlpha<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms, world, effects, visibility);
+            }
+
+            // GPU address of a mesh's palette from the last Update, or 0 if the mesh has none.
+            D3D12_GPU_VIRTUAL_ADDRESS __cdecl GetPaletteAddress(size_t meshIndex) const noexcept
+            {
+                if (meshIndex >= mMeshes.size() || mMeshes[meshIndex].slot == c_NoSlot || !mPalettes)
+                    return 0;
+
+                return mPalettes.GpuAddress() + mMeshes[meshIndex].slot * c_SlotSize;
+            }
+
+        private:
+            static constexpr size_t c_NoSlot = size_t(-1);
+            static constexpr size_t c_SlotSize =
+                (IEffectSkinning::BonePaletteSize + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)
+                & ~size_t(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory, typename TCommandList>
+            void XM_CALLCONV DrawMeshes(
+                TCommandList& commandList,
+                bool alpha,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility) const
+            {
+                assert(mModel != nullptr && mModel->meshes.size() == mMeshes.size());
+                for (size_t i = 0; i < mMeshes.size(); ++i)
+                {
+                    if (visibility && !visibility->IsVisible(i))
+                        continue;
+
+                    auto mesh = mModel->meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    if (alpha)
+                    {
+                        mesh->DrawSkinnedAlpha<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms,
+                            GetPaletteAddress(i), world, effects);
+                    }
+                    else
+                    {
+                        mesh->DrawSkinnedOpaque<TEffectIterator, TEffectIteratorCategory>(commandList, nbones, boneTransforms,
+                            GetPaletteAddress(i), world, effects);
+                    }
+                }
+            }
+
+            void UpdateImpl(_In_opt_ GraphicsMemoryContext* graphicsMemory, size_t nbones, _In_reads_(nbones) const XMMATRIX* boneTransforms);
+
+            struct MeshPalette
+            {
+                size_t offset;      // into mInfluences
+                size_t count;       // 0 for meshes that index the bones directly
+                size_t slot;        // c_NoSlot if the mesh doesn't skin
+            };
+
+            Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+            const Model*                mModel;
+            std::vector<MeshPalette>    mMeshes;
+            std::vector<uint32_t>       mInfluences;        // All meshes' boneInfluences, back to back
+            size_t                      mSlotCount;
+            size_t                      mDirectSlot;        // Shared by meshes without boneInfluences
+            size_t                      mRequiredBones;     // Largest influence index + 1
+            GraphicsResource            mPalettes;
+        };
+
+
+        //------------------------------------------------------------------------------
+        // Collects mesh parts from one or more models and draws them in a better order than
+        // Model::Draw's file order: opaque parts grouped by pipeline state, root signature, texture
+        // and buffers, alpha parts back-to-front. Effects that don't implement IEffectPipelineState
+        // are grouped by instance.
+        class ModelRenderQueue
+        {
+        public:
+            ModelRenderQueue() noexcept;
+
+            ModelRenderQueue(ModelRenderQueue&&) = default;
+            ModelRenderQueue& operator= (ModelRenderQueue&&) = default;
+
+            ModelRenderQueue(ModelRenderQueue const&) = delete;
+            ModelRenderQueue& operator= (ModelRenderQueue const&) = delete;
+
+            // Number of times each kind of state differs from the previous draw.
+            struct StateChanges
+            {
+                size_t pipelineState;
+                size_t rootSignature;
+                size_t texture;
+                size_t vertexBuffer;
+                size_t indexBuffer;
+            };
+
+            struct Statistics
+            {
+                size_t          opaqueCount;
+                size_t          alphaCount;
+                StateChanges    unsorted;       // In the order the parts were added
+                StateChanges    sorted;         // In the order Submit draws them
+                size_t          callsIssued;    // State calls made by the last Submit
+                size_t          callsSkipped;   // Redundant state calls the last Submit filtered out
+            };
+
+            void __cdecl Clear() noexcept;
+
+            // Queue a model's parts, indexing the effects like Model::Draw. Without a world matrix the
+            // effects are left as they are; with one it is set on each effect before Apply, which keeps any
+            // view and projection the effects took from SharedEffectMatrices. With bones,
+            // each mesh uses its bone transform like Model::Draw with bones (skinned parts aren't supported).
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void Add(
+                const Model& model,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr)
+            {
+                AddModel<TEffectIterator, TEffectIteratorCategory>(model, c_NoWorld, XMMatrixIdentity(), effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV Add(
+                const Model& model,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr)
+            {
+                AddModel<TEffectIterator, TEffectIteratorCategory>(model, AddWorld(world), world, effects, visibility);
+            }
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory = typename TEffectIterator::iterator_category>
+            void XM_CALLCONV Add(
+                const Model& model,
+                size_t nbones,
+                _In_reads_(nbones) const XMMATRIX* boneTransforms,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility = nullptr)
+            {
+                // This assert is here to prevent accidental use of containers that would cause undesirable performance penalties.
+                static_assert(
+                    std::is_base_of<std::random_access_iterator_tag, TEffectIteratorCategory>::value,
+                    "Providing an iterator without random access capabilities -- such as from std::list -- is not supported.");
+
+                assert(nbones > 0 && boneTransforms != nullptr);
+
+                for (size_t i = 0; i < model.meshes.size(); ++i)
+                {
+                    if (visibility && !visibility->IsVisible(i))
+                        continue;
+
+                    auto mesh = model.meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    const XMMATRIX local = (mesh->boneIndex != ModelBone::c_Invalid && mesh->boneIndex < nbones)
+                        ? XMMatrixMultiply(boneTransforms[mesh->boneIndex], world) : XMMATRIX(world);
+
+                    AddMesh<TEffectIterator>(*mesh, AddWorld(local), local, effects);
+                }
+            }
+
+            // Queue a single part. The bounding sphere is only used to order alpha parts.
+            void XM_CALLCONV Add(
+                const ModelMeshPart& part,
+                const ResolvedEffect& effect,
+                bool alpha,
+                const BoundingSphere& bounds,
+                FXMMATRIX world);
+
+            // Slow path for effects that weren't resolved: the effect's interfaces are looked up with RTTI
+            // on every call.
+            void XM_CALLCONV Add(
+                const ModelMeshPart& part,
+                _In_ IEffect* effect,
+                bool alpha,
+                const BoundingSphere& bounds,
+                FXMMATRIX world);
+
+            // Orders the queue for the given view and updates the statistics.
+            void XM_CALLCONV Sort(FXMMATRIX view, bool rhcoords = true);
+
+            // Draws opaque parts, then alpha parts, in the order from the last Sort. State that is already
+            // bound is skipped; the command list version assumes nothing is bound yet.
+            void __cdecl Submit(_In_ ID3D12GraphicsCommandList* commandList);
+            void __cdecl Submit(CommandListStateCache& commandList);
+
+            const Statistics& __cdecl GetStatistics() const noexcept { return mStatistics; }
+
+        private:
+            static constexpr uint32_t c_NoWorld = uint32_t(-1);
+
+            struct Item
+            {
+                const ModelMeshPart*    part;
+                IEffect*                effect;
+                IEffectMatrices*        matrices;
+                IEffectPipelineState*   pipelineState;
+                uint32_t                world;      // Into mWorlds, or c_NoWorld
+                XMFLOAT3                center;     // World space bounding sphere center
+            };
+
+            template<typename TEffectIterator, typename TEffectIteratorCategory>
+            void XM_CALLCONV AddModel(
+                const Model& model,
+                uint32_t worldIndex,
+                FXMMATRIX world,
+                TEffectIterator effects,
+                _In_opt_ const ModelVisibility* visibility)
+            {
+                // This assert is here to prevent accidental use of containers that would cause undesirable performance penalties.
+                static_assert(
+                    std::is_base_of<std::random_access_iterator_tag, TEffectIteratorCategory>::value,
+                    "Providing an iterator without random access capabilities -- such as from std::list -- is not supported.");
+
+                for (size_t i = 0; i < model.meshes.size(); ++i)
+                {
+                    if (visibility && !visibility->IsVisible(i))
+                        continue;
+
+                    auto mesh = model.meshes[i].get();
+                    assert(mesh != nullptr);
+
+                    AddMesh<TEffectIterator>(*mesh, worldIndex, world, effects);
+                }
+            }
+
+            template<typename TEffectIterator>
+            void XM_CALLCONV AddMesh(
+                const ModelMesh& mesh,
+                uint32_t worldIndex,
+                FXMMATRIX world,
+                TEffectIterator effects)
+            {
+                const XMVECTOR center = XMVector3Transform(XMLoadFloat3(&mesh.boundingSphere.Center), world);
+
+                for (const auto& it : mesh.opaqueMeshParts)
+                {
+                    TEffectIterator effect_iterator = effects;
+                    std::advance(effect_iterator, it->partIndex);
+                    AddItem(*it, &**effect_iterator, GetEffectMatrices(*effect_iterator), GetEffectPipelineState(*effect_iterator), false, worldIndex, center);
+                }
+
+                for (const auto& it : mesh.alphaMeshParts)
+                {
+                    TEffectIterator effect_iterator = effects;
+                    std::advance(effect_iterator, it->partIndex);
+                    AddItem(*it, &**effect_iterator, GetEffectMatrices(*effect_iterator), GetEffectPipelineState(*effect_iterator), true, worldIndex, center);
+                }
+            }
+
+            uint32_t XM_CALLCONV AddWorld(FXMMATRIX world);
+            void XM_CALLCONV AddItem(
+                const ModelMeshPart& part,
+                _In_ IEffect* effect,
+                _In_opt_ IEffectMatrices* matrices,
+                _In_opt_ IEffectPipelineState* pipelineState,
+                bool alpha,
+                uint32_t worldIndex,
+                FXMVECTOR center);
+
+            struct SortEntry
+            {
+                uint64_t    key;
+                uint32_t    index;
+            };
+
+            std::vector<XMFLOAT4X4>     mWorlds;
+            std::vector<Item>           mOpaque;
+            std::vector<Item>           mAlpha;
+            std::vector<uint64_t>       mStates;        // Sort scratch: per-item state values
+            std::vector<SortEntry>      mSortScratch;   // Sort scratch: keys, then the radix ping-pong buffer
+            std::vector<Item>           mScratchItems;  // Sort scratch: items in sorted order
+            Statistics                  mStatistics;
         };
 
 
@@ -634,7 +1359,120 @@ namespace DirectX
 
             assert(nbones > 0 && boneTransforms != nullptr);
 
+            if (meshParts.empty())
+                return;
+
+            if (mesh.boneInfluences.empty())
+            {
+                // Direct-mapping of vertex bone indices to our master bone array
+                DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, mesh, meshParts,
+                    nbones, boneTransforms, nbones, boneTransforms, world, partEffects);
+                return;
+            }
+
+            // Create the influence mapped bones.
+            ModelBone::TransformArray temp = ModelBone::MakeArray(IEffectSkinning::MaxBones);
+
+            size_t count = 0;
+            for (auto it : mesh.boneInfluences)
+            {
+                ++count;
+                if (count > IEffectSkinning::MaxBones)
+                {
+                    throw std::runtime_error("Too many bones for skinning");
+                }
+
+                if (it >= nbones)
+                {
+                    throw std::runtime_error("Invalid bone influence index");
+                }
+
+                temp[count - 1] = boneTransforms[it];
+            }
+
+            assert(count == mesh.boneInfluences.size());
+
+            DrawSkinnedMeshParts<TEffectIterator, TEffectIteratorCategory>(commandList, mesh, meshParts,
+                nbones, boneTransforms, count, temp.get(), world, partEffects);
+        }
+
+        template<typename TEffectIterator, typename TEffectIteratorCategory>
+        void XM_CALLCONV ModelMeshPart::DrawSkinnedMeshParts(
+            _In_ ID3D12GraphicsCommandList* commandList,
+            const ModelMesh& mesh,
+            const ModelMeshPart::Collection& meshParts,
+            size_t nbones,
+            _In_reads_(nbones) const XMMATRIX* boneTransforms,
+            size_t npalette,
+            _In_reads_(npalette) const XMMATRIX* palette,
+            FXMMATRIX world,
+            TEffectIterator partEffects)
+        {
+            // This assert is here to prevent accidental use of containers that would cause undesirable performance penalties.
+            static_assert(
+                std::is_base_of<std::random_access_iterator_tag, TEffectIteratorCategory>::value,
+                "Providing an iterator without random access capabilities -- such as from std::list -- is not supported.");
+
+            assert(nbones > 0 && boneTransforms != nullptr);
+            assert(npalette > 0 && palette != nullptr);
+
+            for (const auto& mit : meshParts)
+            {
+                auto part = mit.get();
+                assert(part != nullptr);
+
+                // Get the effect at the location specified by the part's material
+                TEffectIterator effect_iterator = partEffects;
+                std::advance(effect_iterator, part->partIndex);
+
+                auto imatrices = GetEffectMatrices(*effect_iterator);
+                if (imatrices)
+                {
+                    imatrices->SetWorld(world);
+                }
+
+                auto iskinning = GetEffectSkinning(*effect_iterator);
+                if (iskinning)
+                {
+                    iskinning->SetBoneTransforms(palette, npalette);
+                }
+                else if (imatrices)
+                {
+                    // Fallback for if we encounter a non-skinning effect in the model
+                    XMMATRIX bm = (mesh.boneIndex != ModelBone::c_Invalid && mesh.boneIndex < nbones)
+                        ? boneTransforms[mesh.boneIndex] : XMMatrixIdentity();
+
+                    imatrices->SetWorld(XMMatrixMultiply(bm, world));
+                }
+
+                // Apply the effect and draw
+                (*effect_iterator)->Apply(commandList);
+                part->Draw(commandList);
+            }
+        }
+
+        template<typename TEffectIterator, typename TEffectIteratorCategory, typename TCommandList>
+        void XM_CALLCONV ModelMeshPart::DrawSkinnedMeshParts(
+            TCommandList& commandList,
+            const ModelMesh& mesh,
+            const ModelMeshPart::Collection& meshParts,
+            size_t nbones,
+            _In_reads_(nbones) const XMMATRIX* boneTransforms,
+            D3D12_GPU_VIRTUAL_ADDRESS bonePalette,
+            FXMMATRIX world,
+            TEffectIterator partEffects)
+        {
+            // This assert is here to prevent accidental use of containers that would cause undesirable performance penalties.
+            static_assert(
+                std::is_base_of<std::random_access_iterator_tag, TEffectIteratorCategory>::value,
+                "Providing an iterator without random access capabilities -- such as from std::list -- is not supported.");
+
+            assert(nbones > 0 && boneTransforms != nullptr);
+
+            // Only built for effects that can't bind the shared palette
             ModelBone::TransformArray temp;
+            const XMMATRIX* palette = nullptr;
+            size_t npalette = 0;
 
             for (const auto& mit : meshParts)
             {
@@ -645,48 +1483,49 @@ namespace DirectX
                 TEffectIterator effect_iterator = partEffects;
                 std::advance(effect_iterator, part->partIndex);
 
-                auto imatrices = dynamic_cast<IEffectMatrices*>((*effect_iterator).get());
+                auto imatrices = GetEffectMatrices(*effect_iterator);
                 if (imatrices)
                 {
                     imatrices->SetWorld(world);
                 }
 
-                auto iskinning = dynamic_cast<IEffectSkinning*>((*effect_iterator).get());
+                auto iskinning = GetEffectSkinning(*effect_iterator);
                 if (iskinning)
                 {
-                    if (mesh.boneInfluences.empty())
+                    if (!bonePalette || !iskinning->SetBonePalette(bonePalette))
                     {
-                        // Direct-mapping of vertex bone indices to our master bone array
-                        iskinning->SetBoneTransforms(boneTransforms, nbones);
-                    }
-                    else
-                    {
-                        if (!temp)
+                        if (!palette)
                         {
-                            // Create the influence mapped bones on-demand.
-                            temp = ModelBone::MakeArray(IEffectSkinning::MaxBones);
-
-                            size_t count = 0;
-                            for (auto it : mesh.boneInfluences)
+                            if (mesh.boneInfluences.empty())
+                            {
+                                palette = boneTransforms;
+                                npalette = nbones;
+                            }
+                            else
                             {
-                                ++count;
-                                if (count > IEffectSkinning::MaxBones)
+                                if (mesh.boneInfluences.size() > IEffectSkinning::MaxBones)
                                 {
                                     throw std::runtime_error("Too many bones for skinning");
                                 }
 
-                                if (it >= nbones)
+                                temp = ModelBone::MakeArray(mesh.boneInfluences.size());
+                                for (size_t j = 0; j < mesh.boneInfluences.size(); ++j)
                                 {
-                                    throw std::runtime_error("Invalid bone influence index");
+                                    const auto index = mesh.boneInfluences[j];
+                                    if (index >= nbones)
+                                    {
+                                        throw std::runtime_error("Invalid bone influence index");
+                                    }
+
+                                    temp[j] = boneTransforms[index];
                                 }
 
-                                temp[count - 1] = boneTransforms[it];
+                                palette = temp.get();
+                                npalette = mesh.boneInfluences.size();
                             }
-
-                            assert(count == mesh.boneInfluences.size());
                         }
 
-                        iskinning->SetBoneTransforms(temp.get(), mesh.boneInfluences.size());
+                        iskinning->SetBoneTransforms(palette, npalette);
                     }
                 }
                 else if (imatrices)
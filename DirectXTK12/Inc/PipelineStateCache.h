@@ -0,0 +1,95 @@
+//--------------------------------------------------------------------------------------
+// File: PipelineStateCache.h
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifdef _GAMING_XBOX_SCARLETT
+#include <d3d12_xs.h>
+#elif (defined(_XBOX_ONE) && defined(_TITLE)) || defined(_GAMING_XBOX)
+#include <d3d12_x.h>
+#elif defined(USING_DIRECTX_HEADERS)
+#include <directx/d3d12.h>
+#include <dxguids/dxguids.h>
+#else
+#include <d3d12.h>
+#endif
+
+#include <cstddef>
+#include <memory>
+
+#include "EffectPipelineStateDescription.h"
+
+
+namespace DirectX
+{
+    inline namespace DX12
+    {
+        // Device-wide cache of graphics pipeline states. All instances created for the same device share
+        // one cache, which the built-in effects use, so effects that differ only in their constants or
+        // textures share a single pipeline state instead of each compiling an identical one.
+        //
+        // Entries are keyed on the shaders, the root signature and the full pipeline description,
+        // including the contents of the input layout. The cache holds a reference to every pipeline
+        // state it has created until Clear is called or the last instance for the device goes away.
+        //
+        // With a disk cache open, compiled pipelines are also stored in an ID3D12PipelineLibrary that
+        // is saved to a file and reloaded on the next run, so cold starts skip the compiles.
+        class PipelineStateCache
+        {
+        public:
+            explicit PipelineStateCache(_In_ ID3D12Device* device);
+
+            PipelineStateCache(PipelineStateCache&&) noexcept;
+            PipelineStateCache& operator= (PipelineStateCache&&) noexcept;
+
+            PipelineStateCache(PipelineStateCache const&) = delete;
+            PipelineStateCache& operator= (PipelineStateCache const&) = delete;
+
+            ~PipelineStateCache();
+
+            struct Statistics
+            {
+                size_t hits;
+                size_t misses;          // Each miss is either loaded from the disk cache or compiled
+                size_t diskLoads;
+                size_t diskStores;
+                size_t pipelineStates;
+            };
+
+            // Returns the cached pipeline state, or creates and caches it. Safe to call from multiple threads;
+            // the pipeline state is compiled outside the lock.
+            void __cdecl GetPipelineState(
+                const EffectPipelineStateDescription& description,
+                _In_ ID3D12RootSignature* rootSignature,
+                const D3D12_SHADER_BYTECODE& vertexShader,
+                const D3D12_SHADER_BYTECODE& pixelShader,
+                _Outptr_ ID3D12PipelineState** pPipelineState);
+
+            Statistics __cdecl GetStatistics() const;
+            void __cdecl ResetStatistics();
+
+            // Releases the cache's references. Pipeline states still held by effects stay alive.
+            void __cdecl Clear();
+
+            // Opens the disk cache, loading the pipelines saved to the file by a previous run. A file
+            // from another cache version, adapter or driver is discarded, and the cache starts empty.
+            // Returns false if the device doesn't support pipeline libraries.
+            bool __cdecl OpenDiskCache(_In_z_ const wchar_t* fileName);
+
+            // Writes the disk cache back to its file if pipelines were added since it was opened or last
+            // saved. Returns S_FALSE if there was nothing to write.
+            HRESULT __cdecl SaveDiskCache();
+
+        private:
+            class Impl;
+
+            std::shared_ptr<Impl> pImpl;
+        };
+    }
+}
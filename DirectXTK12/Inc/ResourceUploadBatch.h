@@ -32,6 +32,10 @@
 namespace DirectX
 {
     // Has a command list of it's own so it can upload at any time.
+    //
+    // Texture uploads are staged in upload heap chunks that all the batches for a device share,
+    // and that go back to the pool once the GPU has finished with the batch that used them. The
+    // pool lives as long as any batch for the device, so keep one around to reuse it between loads.
     class ResourceUploadBatch
     {
     public:
@@ -61,6 +65,18 @@ namespace DirectX
             const SharedGraphicsResource& buffer
         );
 
+        // Asynchronously uploads a buffer into a region of a larger buffer resource.
+        void __cdecl Upload(
+            _In_ ID3D12Resource* resource,
+            uint64_t destinationOffset,
+            const SharedGraphicsResource& buffer
+        );
+
+        // Limits the staging memory the batch holds. An Upload that would go over the budget first
+        // submits the work recorded so far to commandQueue and waits for it, so very large batches
+        // stream through in chunks. Use the queue you'll pass to End. A budget of 0 means no limit.
+        void __cdecl SetStagingBudget(size_t budget, _In_opt_ ID3D12CommandQueue* commandQueue);
+
         // Asynchronously generate mips from a resource.
         // Resource must be in the PIXEL_SHADER_RESOURCE state
         void __cdecl GenerateMips(_In_ ID3D12Resource* resource);
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 using namespace DirectX;
 
@@ -21,7 +22,6 @@ namespace
         XMVECTOR alphaTest;
         XMVECTOR fogColor;
         XMVECTOR fogVector;
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(AlphaTestEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -49,6 +49,7 @@ public:
     enum RootParameterIndex
     {
         ConstantBuffer,
+        ConstantBufferTransforms,
         TextureSRV,
         TextureSampler,
         RootParameterCount
@@ -64,7 +65,8 @@ public:
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 };
 
 
@@ -207,6 +209,7 @@ AlphaTestEffect::Impl::Impl(
         rootParameters[RootParameterIndex::TextureSRV].InitAsDescriptorTable(1, &textureRange, D3D12_SHADER_VISIBILITY_PIXEL);
         rootParameters[RootParameterIndex::TextureSampler].InitAsDescriptorTable(1, &textureSamplerRange, D3D12_SHADER_VISIBILITY_PIXEL);
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc = {};
         rsigDesc.Init(static_cast<UINT>(std::size(rootParameters)), rootParameters, 0, nullptr, rootSignatureFlags);
@@ -246,12 +249,10 @@ AlphaTestEffect::Impl::Impl(
     assert(pi >= 0 && pi < AlphaTestEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < AlphaTestEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<AlphaTestEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<AlphaTestEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<AlphaTestEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"AlphaTestEffect");
 }
@@ -285,14 +286,16 @@ int AlphaTestEffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) con
 
 
 // Sets our state onto the D3D device.
-void AlphaTestEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void AlphaTestEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
     color.SetConstants(dirtyFlags, constants.diffuseColor);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
     // Recompute the alpha test settings?
     if (dirtyFlags & EffectDirtyFlags::AlphaTest)
@@ -389,6 +392,7 @@ void AlphaTestEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -417,10 +421,35 @@ void AlphaTestEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void AlphaTestEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* AlphaTestEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* AlphaTestEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE AlphaTestEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->texture;
+}
+
+
 // Camera settings
 void XM_CALLCONV AlphaTestEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -429,6 +458,7 @@ void XM_CALLCONV AlphaTestEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV AlphaTestEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -437,6 +467,7 @@ void XM_CALLCONV AlphaTestEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV AlphaTestEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -447,11 +478,18 @@ void XM_CALLCONV AlphaTestEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, C
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void AlphaTestEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings
 void XM_CALLCONV AlphaTestEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 using namespace DirectX;
 
@@ -25,14 +26,8 @@ namespace
         XMVECTOR lightDiffuseColor[IEffectLights::MaxDirectionalLights];
         XMVECTOR lightSpecularColor[IEffectLights::MaxDirectionalLights];
 
-        XMVECTOR eyePosition;
-
         XMVECTOR fogColor;
         XMVECTOR fogVector;
-
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(BasicEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -59,6 +54,7 @@ public:
     enum RootParameterIndex
     {
         ConstantBuffer,
+        ConstantBufferTransforms,
         TextureSRV,
         TextureSampler,
         RootParameterCount
@@ -74,7 +70,8 @@ public:
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 };
 
 
@@ -453,6 +450,7 @@ BasicEffect::Impl::Impl(
         // Create root parameters and initialize first (constants)
         CD3DX12_ROOT_PARAMETER rootParameters[RootParameterIndex::RootParameterCount] = {};
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         // Root parameter descriptor - conditionally initialized
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc = {};
@@ -473,8 +471,8 @@ BasicEffect::Impl::Impl(
         }
         else
         {
-            // only use constant
-            rsigDesc.Init(1, rootParameters, 0, nullptr, rootSignatureFlags);
+            // only use constants
+            rsigDesc.Init(2, rootParameters, 0, nullptr, rootSignatureFlags);
 
             mRootSignature = GetRootSignature(0, rsigDesc);
         }
@@ -494,12 +492,10 @@ BasicEffect::Impl::Impl(
     assert(pi >= 0 && pi < BasicEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < BasicEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<BasicEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<BasicEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<BasicEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"BasicEffect");
 }
@@ -551,14 +547,16 @@ int BasicEffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) const n
 
 
 // Sets our state onto the D3D device.
-void BasicEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void BasicEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
-    lights.SetConstants(dirtyFlags, matrices, constants.world, constants.worldInverseTranspose, constants.eyePosition, constants.diffuseColor, constants.emissiveColor, lightingEnabled);
+    lights.SetConstants(dirtyFlags, matrices, transforms.world, transforms.worldInverseTranspose, transforms.eyePosition, constants.diffuseColor, constants.emissiveColor, lightingEnabled);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
     // Set the root signature
     commandList->SetGraphicsRootSignature(mRootSignature);
@@ -579,6 +577,7 @@ void BasicEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -608,10 +607,35 @@ void BasicEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void BasicEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* BasicEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* BasicEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE BasicEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->textureEnabled ? pImpl->texture : D3D12_GPU_DESCRIPTOR_HANDLE{};
+}
+
+
 // Camera settings
 void XM_CALLCONV BasicEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -620,6 +644,7 @@ void XM_CALLCONV BasicEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV BasicEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -628,6 +653,7 @@ void XM_CALLCONV BasicEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV BasicEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -638,11 +664,18 @@ void XM_CALLCONV BasicEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMA
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void BasicEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings
 void XM_CALLCONV BasicEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+// File: CommandListStateCache.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "CommandListStateCache.h"
+
+using namespace DirectX;
+
+static_assert(D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT <= 32, "mVertexBuffersValid needs a bit per slot");
+
+
+size_t CommandListStateCache::Statistics::TotalIssued() const noexcept
+{
+    size_t total = 0;
+    for (auto count : issued)
+        total += count;
+    return total;
+}
+
+
+size_t CommandListStateCache::Statistics::TotalSkipped() const noexcept
+{
+    size_t total = 0;
+    for (auto count : skipped)
+        total += count;
+    return total;
+}
+
+
+_Use_decl_annotations_
+CommandListStateCache::CommandListStateCache(ID3D12GraphicsCommandList* commandList, GraphicsMemoryContext* graphicsMemory) noexcept :
+    mCommandList(commandList),
+    mGraphicsMemory(graphicsMemory),
+    mRootSignatureValid(false),
+    mPipelineStateValid(false),
+    mIndexBufferValid(false),
+    mTopologyValid(false),
+    mVertexBuffersValid(0),
+    mRootSignature(nullptr),
+    mPipelineState(nullptr),
+    mIndexBuffer{},
+    mTopology(D3D_PRIMITIVE_TOPOLOGY_UNDEFINED),
+    mVertexBuffers{},
+    mRootArgumentTypes{},
+    mRootArguments{},
+    mStatistics{}
+{
+    assert(commandList != nullptr);
+}
+
+
+void CommandListStateCache::Invalidate() noexcept
+{
+    mRootSignatureValid = false;
+    mPipelineStateValid = false;
+    mIndexBufferValid = false;
+    mTopologyValid = false;
+    mVertexBuffersValid = 0;
+
+    for (auto& type : mRootArgumentTypes)
+        type = RootArgumentUnknown;
+}
+
+
+void CommandListStateCache::ResetStatistics() noexcept
+{
+    mStatistics = {};
+}
+
+
+bool CommandListStateCache::Track(CallType type, bool redundant) noexcept
+{
+    if (redundant)
+    {
+        ++mStatistics.skipped[type];
+        return false;
+    }
+
+    ++mStatistics.issued[type];
+    return true;
+}
+
+
+_Use_decl_annotations_
+void CommandListStateCache::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+{
+    if (!Track(RootSignature, mRootSignatureValid && mRootSignature == rootSignature))
+        return;
+
+    mCommandList->SetGraphicsRootSignature(rootSignature);
+
+    mRootSignature = rootSignature;
+    mRootSignatureValid = true;
+
+    for (auto& type : mRootArgumentTypes)
+        type = RootArgumentUnknown;
+}
+
+
+_Use_decl_annotations_
+void CommandListStateCache::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+    if (!Track(PipelineState, mPipelineStateValid && mPipelineState == pipelineState))
+        return;
+
+    mCommandList->SetPipelineState(pipelineState);
+
+    mPipelineState = pipelineState;
+    mPipelineStateValid = true;
+}
+
+
+void CommandListStateCache::SetGraphicsRootDescriptorTable(uint32_t rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+{
+    const bool tracked = rootParameterIndex < c_MaxRootParameters;
+    if (!Track(RootDescriptorTable, tracked
+        && mRootArgumentTypes[rootParameterIndex] == RootArgumentTable
+        && mRootArguments[rootParameterIndex] == baseDescriptor.ptr))
+        return;
+
+    mCommandList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+
+    if (tracked)
+    {
+        mRootArgumentTypes[rootParameterIndex] = RootArgumentTable;
+        mRootArguments[rootParameterIndex] = baseDescriptor.ptr;
+    }
+}
+
+
+void CommandListStateCache::SetGraphicsRootConstantBufferView(uint32_t rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+    const bool tracked = rootParameterIndex < c_MaxRootParameters;
+    if (!Track(RootConstantBufferView, tracked
+        && mRootArgumentTypes[rootParameterIndex] == RootArgumentCBV
+        && mRootArguments[rootParameterIndex] == bufferLocation))
+        return;
+
+    mCommandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+
+    if (tracked)
+    {
+        mRootArgumentTypes[rootParameterIndex] = RootArgumentCBV;
+        mRootArguments[rootParameterIndex] = bufferLocation;
+    }
+}
+
+
+_Use_decl_annotations_
+void CommandListStateCache::IASetVertexBuffers(uint32_t startSlot, uint32_t numViews, const D3D12_VERTEX_BUFFER_VIEW* views)
+{
+    const bool tracked = views != nullptr && numViews > 0
+        && startSlot < c_MaxVertexBuffers && numViews <= c_MaxVertexBuffers - startSlot;
+
+    bool redundant = tracked;
+    for (uint32_t i = 0; redundant && i < numViews; ++i)
+    {
+        const uint32_t slot = startSlot + i;
+        redundant = (mVertexBuffersValid & (1u << slot)) != 0
+            && mVertexBuffers[slot].BufferLocation == views[i].BufferLocation
+            && mVertexBuffers[slot].SizeInBytes == views[i].SizeInBytes
+            && mVertexBuffers[slot].StrideInBytes == views[i].StrideInBytes;
+    }
+
+    if (!Track(VertexBuffers, redundant))
+        return;
+
+    mCommandList->IASetVertexBuffers(startSlot, numViews, views);
+
+    if (tracked)
+    {
+        for (uint32_t i = 0; i < numViews; ++i)
+        {
+            mVertexBuffers[startSlot + i] = views[i];
+            mVertexBuffersValid |= 1u << (startSlot + i);
+        }
+    }
+    else
+    {
+        // Unbinding or out of range slots; stop trying to match the affected slots.
+        for (uint32_t i = 0; i < numViews && startSlot + i < c_MaxVertexBuffers; ++i)
+        {
+            mVertexBuffersValid &= ~(1u << (startSlot + i));
+        }
+    }
+}
+
+
+_Use_decl_annotations_
+void CommandListStateCache::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view)
+{
+    if (!Track(IndexBuffer, view != nullptr && mIndexBufferValid
+        && mIndexBuffer.BufferLocation == view->BufferLocation
+        && mIndexBuffer.SizeInBytes == view->SizeInBytes
+        && mIndexBuffer.Format == view->Format))
+        return;
+
+    mCommandList->IASetIndexBuffer(view);
+
+    if (view)
+    {
+        mIndexBuffer = *view;
+        mIndexBufferValid = true;
+    }
+    else
+    {
+        mIndexBufferValid = false;
+    }
+}
+
+
+void CommandListStateCache::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+    if (!Track(PrimitiveTopology, mTopologyValid && mTopology == primitiveTopology))
+        return;
+
+    mCommandList->IASetPrimitiveTopology(primitiveTopology);
+
+    mTopology = primitiveTopology;
+    mTopologyValid = true;
+}
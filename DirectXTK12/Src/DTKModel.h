@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// File: DTKModel.h
+//
+// DTKMODEL is a pre-baked runtime format written by Model::SaveToDTKMODEL. It stores
+// the Model structures as produced by the SDKMESH, CMO, and VBO loaders so that
+// loading is just validation plus a copy of each VB/IB blob into upload memory.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace DTKMODEL
+{
+    // .DTKMODEL files
+
+    // DTKMODEL_HEADER
+    // DTKMODEL_BUFFER          header->Buffers
+    // DTKMODEL_INPUT_LAYOUT    header->InputLayouts
+    // DTKMODEL_INPUT_ELEMENT   header->InputElements
+    // DTKMODEL_MESH            header->Meshes
+    // DTKMODEL_MESH_PART       header->MeshParts (each mesh's opaque parts, then its alpha parts)
+    // uint32_t                 header->BoneInfluences
+    // DTKMODEL_MATERIAL        header->Materials
+    // DTKMODEL_STRING          header->Textures
+    // DTKMODEL_BONE            header->Bones
+    // float[16]                header->BoneMatrices
+    // float[16]                header->InvBindPoseMatrices
+    // wchar_t                  header->Strings
+    // { [ header->Buffers.Count ]
+    //      VB/IB data, each blob DATA_ALIGNMENT aligned from header->Data.Offset
+    // }
+
+    constexpr uint32_t DTKMODEL_MAGIC = 0x4D4B5444; // "DTKM"
+    constexpr uint32_t DTKMODEL_FILE_VERSION = 1;
+    constexpr uint32_t DATA_ALIGNMENT = 16;
+    constexpr uint32_t INVALID_INDEX = uint32_t(-1);
+
+    enum BUFFER_TYPE : uint32_t
+    {
+        BUFFER_VERTEX = 0,
+        BUFFER_INDEX = 1,
+    };
+
+    // Input element semantics; names are restored from a fixed table so the pointers stay valid
+    enum SEMANTIC : uint32_t
+    {
+        SEMANTIC_POSITION = 0,  // SV_Position
+        SEMANTIC_NORMAL,
+        SEMANTIC_COLOR,
+        SEMANTIC_TANGENT,
+        SEMANTIC_BINORMAL,
+        SEMANTIC_TEXCOORD,
+        SEMANTIC_BLENDINDICES,
+        SEMANTIC_BLENDWEIGHT,
+        SEMANTIC_COUNT
+    };
+
+    enum MATERIAL_FLAGS : uint32_t
+    {
+        MATERIAL_PER_VERTEX_COLOR = 0x1,
+        MATERIAL_SKINNING = 0x2,
+        MATERIAL_DUAL_TEXTURE = 0x4,
+        MATERIAL_NORMAL_MAPS = 0x8,
+        MATERIAL_BIASED_VERTEX_NORMALS = 0x10,
+    };
+
+    // Byte offset from the start of the file and element count (bytes for Data, characters for Strings)
+    struct DTKMODEL_SECTION
+    {
+        uint64_t Offset;
+        uint64_t Count;
+    };
+
+    // Range of characters in the string pool; not null-terminated
+    struct DTKMODEL_STRING
+    {
+        uint32_t Offset;
+        uint32_t Length;
+    };
+
+    struct DTKMODEL_HEADER
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t HeaderSize;
+        uint32_t UserData;          // Stored as-is for the application
+        uint64_t FileSize;
+
+        DTKMODEL_SECTION Buffers;
+        DTKMODEL_SECTION InputLayouts;
+        DTKMODEL_SECTION InputElements;
+        DTKMODEL_SECTION Meshes;
+        DTKMODEL_SECTION MeshParts;
+        DTKMODEL_SECTION BoneInfluences;
+        DTKMODEL_SECTION Materials;
+        DTKMODEL_SECTION Textures;
+        DTKMODEL_SECTION Bones;
+        DTKMODEL_SECTION BoneMatrices;
+        DTKMODEL_SECTION InvBindPoseMatrices;
+        DTKMODEL_SECTION Strings;
+        DTKMODEL_SECTION Data;
+
+        DTKMODEL_STRING Name;
+    };
+
+    struct DTKMODEL_BUFFER
+    {
+        uint64_t DataOffset;        // Relative to header->Data.Offset
+        uint32_t SizeBytes;
+        uint32_t Type;              // BUFFER_TYPE
+    };
+
+    struct DTKMODEL_INPUT_LAYOUT
+    {
+        uint32_t FirstElement;
+        uint32_t NumElements;
+    };
+
+    struct DTKMODEL_INPUT_ELEMENT
+    {
+        uint32_t Semantic;          // SEMANTIC
+        uint32_t SemanticIndex;
+        uint32_t Format;            // DXGI_FORMAT
+        uint32_t InputSlot;
+        uint32_t AlignedByteOffset;
+        uint32_t InputSlotClass;    // D3D12_INPUT_CLASSIFICATION
+        uint32_t InstanceDataStepRate;
+    };
+
+    struct DTKMODEL_MESH
+    {
+        DTKMODEL_STRING Name;
+        float BoundingSphere[4];    // Center, Radius
+        float BoxCenter[3];
+        float BoxExtents[3];
+        uint32_t BoneIndex;
+        uint32_t FirstBoneInfluence;
+        uint32_t NumBoneInfluences;
+        uint32_t FirstPart;
+        uint32_t NumOpaqueParts;
+        uint32_t NumAlphaParts;
+    };
+
+    struct DTKMODEL_MESH_PART
+    {
+        uint32_t PartIndex;
+        uint32_t MaterialIndex;
+        uint32_t IndexCount;
+        uint32_t StartIndex;
+        int32_t  VertexOffset;
+        uint32_t VertexStride;
+        uint32_t VertexCount;
+        uint32_t IndexBufferSize;
+        uint32_t VertexBufferSize;
+        uint32_t PrimitiveType;     // D3D_PRIMITIVE_TOPOLOGY
+        uint32_t IndexFormat;       // DXGI_FORMAT
+        uint32_t InputLayout;
+        uint32_t VertexBuffer;
+        uint32_t IndexBuffer;
+    };
+
+    struct DTKMODEL_MATERIAL
+    {
+        DTKMODEL_STRING Name;
+        uint32_t Flags;             // MATERIAL_FLAGS
+        float SpecularPower;
+        float Alpha;
+        float Ambient[3];
+        float Diffuse[3];
+        float Specular[3];
+        float Emissive[3];
+        int32_t DiffuseTexture;
+        int32_t SpecularTexture;
+        int32_t NormalTexture;
+        int32_t EmissiveTexture;
+        int32_t SamplerIndex;
+        int32_t SamplerIndex2;
+    };
+
+    struct DTKMODEL_BONE
+    {
+        uint32_t ParentIndex;
+        uint32_t ChildIndex;
+        uint32_t SiblingIndex;
+        DTKMODEL_STRING Name;
+    };
+
+} // namespace
+
+static_assert(sizeof(DTKMODEL::DTKMODEL_SECTION) == 16, "DTKMODEL section size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_STRING) == 8, "DTKMODEL string size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_HEADER) == 240, "DTKMODEL header size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_BUFFER) == 16, "DTKMODEL buffer size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_INPUT_LAYOUT) == 8, "DTKMODEL input layout size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_INPUT_ELEMENT) == 28, "DTKMODEL input element size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_MESH) == 72, "DTKMODEL mesh size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_MESH_PART) == 56, "DTKMODEL mesh part size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_MATERIAL) == 92, "DTKMODEL material size mismatch");
+static_assert(sizeof(DTKMODEL::DTKMODEL_BONE) == 20, "DTKMODEL bone size mismatch");
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 using namespace DirectX;
 
@@ -19,10 +20,6 @@ namespace
     {
         XMVECTOR ambientDownAndAlpha;
         XMVECTOR ambientRange;
-
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(DebugEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -50,12 +47,14 @@ public:
     enum RootParameterIndex
     {
         ConstantBuffer,
+        ConstantBufferTransforms,
         RootParameterCount
     };
 
     int GetPipelineStatePermutation(DebugEffect::Mode debugMode, uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 };
 
 
@@ -287,11 +286,12 @@ DebugEffect::Impl::Impl(
         // Create root parameters and initialize first (constants)
         CD3DX12_ROOT_PARAMETER rootParameters[RootParameterIndex::RootParameterCount] = {};
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         // Root parameter descriptor - conditionally initialized
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc = {};
 
-        rsigDesc.Init(1, rootParameters, 0, nullptr, rootSignatureFlags);
+        rsigDesc.Init(static_cast<UINT>(std::size(rootParameters)), rootParameters, 0, nullptr, rootSignatureFlags);
 
         mRootSignature = GetRootSignature(0, rsigDesc);
     }
@@ -310,12 +310,10 @@ DebugEffect::Impl::Impl(
     assert(pi >= 0 && pi < DebugEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < DebugEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<DebugEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<DebugEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<DebugEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"DebugEffect");
 }
@@ -348,33 +346,21 @@ int DebugEffect::Impl::GetPipelineStatePermutation(DebugEffect::Mode debugMode,
 
 
 // Sets our state onto the D3D device.
-void DebugEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void DebugEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
-
-    // World inverse transpose matrix.
-    if (dirtyFlags & EffectDirtyFlags::WorldInverseTranspose)
-    {
-        constants.world = XMMatrixTranspose(matrices.world);
-
-        const XMMATRIX worldInverse = XMMatrixInverse(nullptr, matrices.world);
-
-        constants.worldInverseTranspose[0] = worldInverse.r[0];
-        constants.worldInverseTranspose[1] = worldInverse.r[1];
-        constants.worldInverseTranspose[2] = worldInverse.r[2];
-
-        dirtyFlags &= ~EffectDirtyFlags::WorldInverseTranspose;
-        dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
-    }
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
     // Set the root signature
     commandList->SetGraphicsRootSignature(mRootSignature);
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -404,10 +390,35 @@ void DebugEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void DebugEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* DebugEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* DebugEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE DebugEffect::GetPrimaryTexture() const noexcept
+{
+    return D3D12_GPU_DESCRIPTOR_HANDLE{};
+}
+
+
 // Camera settings.
 void XM_CALLCONV DebugEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose;
 }
@@ -416,6 +427,7 @@ void XM_CALLCONV DebugEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV DebugEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -424,6 +436,7 @@ void XM_CALLCONV DebugEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV DebugEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -434,11 +447,18 @@ void XM_CALLCONV DebugEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMA
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose;
 }
 
 
+void DebugEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings.
 void XM_CALLCONV DebugEffect::SetHemisphericalAmbientColor(FXMVECTOR upper, FXMVECTOR lower)
 {
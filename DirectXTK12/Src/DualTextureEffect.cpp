@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -21,7 +22,6 @@ namespace
         XMVECTOR diffuseColor;
         XMVECTOR fogColor;
         XMVECTOR fogVector;
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(DualTextureEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -52,6 +52,7 @@ public:
         Texture2SRV,
         Texture2Sampler,
         ConstantBuffer,
+        ConstantBufferTransforms,
         RootParameterCount
     };
 
@@ -64,7 +65,8 @@ public:
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 };
 
 
@@ -184,6 +186,7 @@ DualTextureEffect::Impl::Impl(
 
         CD3DX12_ROOT_PARAMETER rootParameters[RootParameterIndex::RootParameterCount] = {};
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         // Texture 1
         const CD3DX12_DESCRIPTOR_RANGE texture1Range(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
@@ -237,12 +240,10 @@ DualTextureEffect::Impl::Impl(
     assert(pi >= 0 && pi < DualTextureEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < DualTextureEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<DualTextureEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<DualTextureEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<DualTextureEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"DualTextureEffect");
 }
@@ -269,16 +270,18 @@ int DualTextureEffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) c
 
 
 // Sets our state onto the D3D device.
-void DualTextureEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void DualTextureEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
 
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
 
     color.SetConstants(dirtyFlags, constants.diffuseColor);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
     // Set the root signature
     commandList->SetGraphicsRootSignature(mRootSignature);
@@ -303,6 +306,7 @@ void DualTextureEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -331,10 +335,35 @@ void DualTextureEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void DualTextureEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* DualTextureEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* DualTextureEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE DualTextureEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->texture1;
+}
+
+
 // Camera settings
 void XM_CALLCONV DualTextureEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -343,6 +372,7 @@ void XM_CALLCONV DualTextureEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV DualTextureEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -351,6 +381,7 @@ void XM_CALLCONV DualTextureEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV DualTextureEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -361,11 +392,18 @@ void XM_CALLCONV DualTextureEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view,
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void DualTextureEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings
 void XM_CALLCONV DualTextureEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 #include "DemandCreate.h"
 #include "ResourceUploadBatch.h"
 
@@ -16,6 +17,38 @@ using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
 
+// IEffect default method
+void IEffect::Apply(CommandListStateCache& commandList)
+{
+    Apply(commandList.GetCommandList());
+    commandList.Invalidate();
+}
+
+
+// ResolvedEffect
+ResolvedEffect::ResolvedEffect() noexcept :
+    matrices(nullptr),
+    lights(nullptr),
+    fog(nullptr),
+    skinning(nullptr),
+    pipelineState(nullptr),
+    pbr(nullptr)
+{
+}
+
+
+ResolvedEffect::ResolvedEffect(std::shared_ptr<IEffect> ieffect) noexcept :
+    effect(std::move(ieffect)),
+    matrices(dynamic_cast<IEffectMatrices*>(effect.get())),
+    lights(dynamic_cast<IEffectLights*>(effect.get())),
+    fog(dynamic_cast<IEffectFog*>(effect.get())),
+    skinning(dynamic_cast<IEffectSkinning*>(effect.get())),
+    pipelineState(dynamic_cast<IEffectPipelineState*>(effect.get())),
+    pbr(dynamic_cast<PBREffect*>(effect.get()))
+{
+}
+
+
 // IEffectMatrices default method
 void XM_CALLCONV IEffectMatrices::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection)
 {
@@ -25,14 +58,182 @@ void XM_CALLCONV IEffectMatrices::SetMatrices(FXMMATRIX world, CXMMATRIX view, C
 }
 
 
+void IEffectMatrices::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    SetMatrices(value.GetWorld(), value.GetView(), value.GetProjection());
+}
+
+
+// SharedEffectMatrices
+namespace
+{
+    // Versions come from one counter, so two blocks never share a version with different values.
+    std::atomic<uint64_t> s_sharedMatricesVersion(0);
+}
+
+SharedEffectMatrices::SharedEffectMatrices() noexcept :
+    mWorldInverse{},
+    mEyePosition{},
+    mVersion(++s_sharedMatricesVersion),
+    mConstantBufferVersion(0)
+{
+    XMStoreFloat4x4(&mWorld, XMMatrixIdentity());
+    mView = mProjection = mWorldView = mWorldViewProj = mWorld;
+    XMStoreFloat4(&mWorldInverse[0], g_XMIdentityR0);
+    XMStoreFloat4(&mWorldInverse[1], g_XMIdentityR1);
+    XMStoreFloat4(&mWorldInverse[2], g_XMIdentityR2);
+    XMStoreFloat4(&mEyePosition, g_XMIdentityR3);
+}
+
+
+void XM_CALLCONV SharedEffectMatrices::SetWorld(FXMMATRIX value) noexcept
+{
+    XMStoreFloat4x4(&mWorld, value);
+    UpdateWorld();
+    UpdateWorldViewProj();
+    mVersion = ++s_sharedMatricesVersion;
+}
+
+
+void XM_CALLCONV SharedEffectMatrices::SetView(FXMMATRIX value) noexcept
+{
+    XMStoreFloat4x4(&mView, value);
+    UpdateWorldViewProj();
+    UpdateEyePosition();
+    mVersion = ++s_sharedMatricesVersion;
+}
+
+
+void XM_CALLCONV SharedEffectMatrices::SetProjection(FXMMATRIX value) noexcept
+{
+    XMStoreFloat4x4(&mProjection, value);
+    UpdateWorldViewProj();
+    mVersion = ++s_sharedMatricesVersion;
+}
+
+
+void XM_CALLCONV SharedEffectMatrices::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection) noexcept
+{
+    XMStoreFloat4x4(&mWorld, world);
+    XMStoreFloat4x4(&mView, view);
+    XMStoreFloat4x4(&mProjection, projection);
+    UpdateWorld();
+    UpdateWorldViewProj();
+    UpdateEyePosition();
+    mVersion = ++s_sharedMatricesVersion;
+}
+
+
+void SharedEffectMatrices::UpdateWorld() noexcept
+{
+    const XMMATRIX worldInverse = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mWorld));
+
+    XMStoreFloat4(&mWorldInverse[0], worldInverse.r[0]);
+    XMStoreFloat4(&mWorldInverse[1], worldInverse.r[1]);
+    XMStoreFloat4(&mWorldInverse[2], worldInverse.r[2]);
+}
+
+
+void SharedEffectMatrices::UpdateWorldViewProj() noexcept
+{
+    const XMMATRIX worldView = XMMatrixMultiply(XMLoadFloat4x4(&mWorld), XMLoadFloat4x4(&mView));
+
+    XMStoreFloat4x4(&mWorldView, worldView);
+    XMStoreFloat4x4(&mWorldViewProj, XMMatrixTranspose(XMMatrixMultiply(worldView, XMLoadFloat4x4(&mProjection))));
+}
+
+
+void SharedEffectMatrices::UpdateEyePosition() noexcept
+{
+    const XMMATRIX viewInverse = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView));
+
+    XMStoreFloat4(&mEyePosition, viewInverse.r[3]);
+}
+
+
+namespace
+{
+    EffectTransformConstants GetTransformConstants(SharedEffectMatrices const& matrices) noexcept
+    {
+        EffectTransformConstants constants;
+        constants.world = XMMatrixTranspose(matrices.GetWorld());
+        constants.worldInverseTranspose[0] = matrices.GetWorldInverse(0);
+        constants.worldInverseTranspose[1] = matrices.GetWorldInverse(1);
+        constants.worldInverseTranspose[2] = matrices.GetWorldInverse(2);
+        constants.worldViewProj = matrices.GetWorldViewProj();
+        constants.eyePosition = matrices.GetEyePosition();
+        return constants;
+    }
+}
+
+
+_Use_decl_annotations_
+D3D12_GPU_VIRTUAL_ADDRESS SharedEffectMatrices::UpdateConstantBuffer(ID3D12Device* device)
+{
+    if (mConstantBufferVersion != mVersion)
+    {
+        mConstantBuffer = GraphicsMemory::Get(device).AllocateConstant(GetTransformConstants(*this));
+        mConstantBufferVersion = mVersion;
+    }
+
+    return mConstantBuffer.GpuAddress();
+}
+
+
+D3D12_GPU_VIRTUAL_ADDRESS SharedEffectMatrices::UpdateConstantBuffer(GraphicsMemoryContext& graphicsMemory)
+{
+    if (mConstantBufferVersion != mVersion)
+    {
+        mConstantBuffer = graphicsMemory.AllocateConstant(GetTransformConstants(*this));
+        mConstantBufferVersion = mVersion;
+    }
+
+    return mConstantBuffer.GpuAddress();
+}
+
+
 // Constructor initializes default matrix values.
-EffectMatrices::EffectMatrices() noexcept
+EffectMatrices::EffectMatrices() noexcept :
+    sharedVersion(0),
+    sharedWorld(false),
+    sharedConstantBuffer(0)
 {
     const XMMATRIX id = XMMatrixIdentity();
     world = id;
     view = id;
     projection = id;
     worldView = id;
+    sharedWorldViewProj = id;
+    sharedWorldInverse[0] = id.r[0];
+    sharedWorldInverse[1] = id.r[1];
+    sharedWorldInverse[2] = id.r[2];
+    sharedEyePosition = id.r[3];
+}
+
+
+// Copies the matrices and their derived values from a shared block, unless they're already current.
+int EffectMatrices::SetShared(SharedEffectMatrices const& value) noexcept
+{
+    // The buffer can be uploaded after an effect has taken the values it holds.
+    sharedConstantBuffer = value.GetConstantBuffer();
+
+    if (sharedVersion == value.GetVersion() && sharedWorld)
+        return 0;
+
+    world = value.GetWorld();
+    view = value.GetView();
+    projection = value.GetProjection();
+    worldView = value.GetWorldView();
+
+    sharedVersion = value.GetVersion();
+    sharedWorld = true;
+    sharedWorldViewProj = value.GetWorldViewProj();
+    sharedWorldInverse[0] = value.GetWorldInverse(0);
+    sharedWorldInverse[1] = value.GetWorldInverse(1);
+    sharedWorldInverse[2] = value.GetWorldInverse(2);
+    sharedEyePosition = value.GetEyePosition();
+
+    return EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
@@ -41,9 +242,16 @@ _Use_decl_annotations_ void EffectMatrices::SetConstants(int& dirtyFlags, XMMATR
 {
     if (dirtyFlags & EffectDirtyFlags::WorldViewProj)
     {
-        worldView = XMMatrixMultiply(world, view);
+        if (sharedVersion && sharedWorld)
+        {
+            worldViewProjConstant = sharedWorldViewProj;
+        }
+        else
+        {
+            worldView = XMMatrixMultiply(world, view);
 
-        worldViewProjConstant = XMMatrixTranspose(XMMatrixMultiply(worldView, projection));
+            worldViewProjConstant = XMMatrixTranspose(XMMatrixMultiply(worldView, projection));
+        }
 
         dirtyFlags &= ~EffectDirtyFlags::WorldViewProj;
         dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
@@ -51,6 +259,58 @@ _Use_decl_annotations_ void EffectMatrices::SetConstants(int& dirtyFlags, XMMATR
 }
 
 
+// Lazily recomputes the world and world inverse transpose matrices.
+_Use_decl_annotations_
+void EffectMatrices::SetWorldConstants(int& dirtyFlags, XMMATRIX& worldConstant, XMVECTOR worldInverseTransposeConstant[3]) const
+{
+    if (dirtyFlags & EffectDirtyFlags::WorldInverseTranspose)
+    {
+        worldConstant = XMMatrixTranspose(world);
+
+        if (sharedVersion && sharedWorld)
+        {
+            worldInverseTransposeConstant[0] = sharedWorldInverse[0];
+            worldInverseTransposeConstant[1] = sharedWorldInverse[1];
+            worldInverseTransposeConstant[2] = sharedWorldInverse[2];
+        }
+        else
+        {
+            const XMMATRIX worldInverse = XMMatrixInverse(nullptr, world);
+
+            worldInverseTransposeConstant[0] = worldInverse.r[0];
+            worldInverseTransposeConstant[1] = worldInverse.r[1];
+            worldInverseTransposeConstant[2] = worldInverse.r[2];
+        }
+
+        dirtyFlags &= ~EffectDirtyFlags::WorldInverseTranspose;
+        dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
+    }
+}
+
+
+// Lazily recomputes the eye position vector.
+_Use_decl_annotations_
+void EffectMatrices::SetEyePositionConstant(int& dirtyFlags, XMVECTOR& eyePositionConstant) const
+{
+    if (dirtyFlags & EffectDirtyFlags::EyePosition)
+    {
+        if (sharedVersion)
+        {
+            eyePositionConstant = sharedEyePosition;
+        }
+        else
+        {
+            const XMMATRIX viewInverse = XMMatrixInverse(nullptr, view);
+
+            eyePositionConstant = viewInverse.r[3];
+        }
+
+        dirtyFlags &= ~EffectDirtyFlags::EyePosition;
+        dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
+    }
+}
+
+
 // Constructor initializes default fog settings.
 EffectFog::EffectFog() noexcept :
     enabled(false),
@@ -186,30 +446,10 @@ void EffectLights::SetConstants(int& dirtyFlags, EffectMatrices const& matrices,
     if (lightingEnabled)
     {
         // World inverse transpose matrix.
-        if (dirtyFlags & EffectDirtyFlags::WorldInverseTranspose)
-        {
-            worldConstant = XMMatrixTranspose(matrices.world);
-
-            const XMMATRIX worldInverse = XMMatrixInverse(nullptr, matrices.world);
-
-            worldInverseTransposeConstant[0] = worldInverse.r[0];
-            worldInverseTransposeConstant[1] = worldInverse.r[1];
-            worldInverseTransposeConstant[2] = worldInverse.r[2];
-
-            dirtyFlags &= ~EffectDirtyFlags::WorldInverseTranspose;
-            dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
-        }
+        matrices.SetWorldConstants(dirtyFlags, worldConstant, worldInverseTransposeConstant);
 
         // Eye position vector.
-        if (dirtyFlags & EffectDirtyFlags::EyePosition)
-        {
-            XMMATRIX viewInverse = XMMatrixInverse(nullptr, matrices.view);
-
-            eyePositionConstant = viewInverse.r[3];
-
-            dirtyFlags &= ~EffectDirtyFlags::EyePosition;
-            dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
-        }
+        matrices.SetEyePositionConstant(dirtyFlags, eyePositionConstant);
     }
 
     // Material color parameters. The desired lighting model is:
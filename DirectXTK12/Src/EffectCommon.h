@@ -17,6 +17,8 @@
 #include "AlignedNew.h"
 #include "DescriptorHeap.h"
 #include "GraphicsMemory.h"
+#include "CommandListStateCache.h"
+#include "PipelineStateCache.h"
 #include "DirectXHelpers.h"
 #include "RenderTargetState.h"
 
@@ -50,8 +52,24 @@ namespace DirectX
         constexpr int FogVector = 0x20;
         constexpr int FogEnable = 0x40;
         constexpr int AlphaTest = 0x80;
+
+        // The values kept in the Transforms constant buffer rather than the effect's own.
+        constexpr int Transforms = WorldViewProj | WorldInverseTranspose | EyePosition;
     }
 
+    // Constant buffer layout of the transforms uploaded by SharedEffectMatrices, which the built-in effects keep
+    // apart from their other constants and bind at b2. Must match the Transforms cbuffer in the shaders!
+    struct EffectTransformConstants
+    {
+        XMMATRIX world;
+        XMVECTOR worldInverseTranspose[3];
+        XMMATRIX worldViewProj;
+        XMVECTOR eyePosition;
+    };
+
+    static_assert((sizeof(EffectTransformConstants) % 16) == 0, "CB size not padded correctly");
+
+
     // Helper stores matrix parameter values, and computes derived matrices.
     struct EffectMatrices
     {
@@ -62,7 +80,27 @@ namespace DirectX
         XMMATRIX projection;
         XMMATRIX worldView;
 
+        // Version of the SharedEffectMatrices the values below were copied from, or zero once the view or
+        // projection has been set on the effect directly, in which case the derived values are computed from
+        // the above. Setting only the world keeps the shared view and projection, and clears sharedWorld.
+        uint64_t sharedVersion;
+        bool sharedWorld;
+        XMMATRIX sharedWorldViewProj;
+        XMVECTOR sharedWorldInverse[3];
+        XMVECTOR sharedEyePosition;
+
+        // The shared block's uploaded transforms, or zero if it has none for its current values or the
+        // effect has its own world.
+        D3D12_GPU_VIRTUAL_ADDRESS sharedConstantBuffer;
+
+        // Returns the dirty flags to set, which are none if the shared matrices haven't changed.
+        int SetShared(SharedEffectMatrices const& value) noexcept;
+        void ClearShared() noexcept { sharedVersion = 0; sharedWorld = false; sharedConstantBuffer = 0; }
+        void XM_CALLCONV SetWorld(FXMMATRIX value) noexcept { world = value; sharedWorld = false; sharedConstantBuffer = 0; }
+
         void SetConstants(_Inout_ int& dirtyFlags, _Inout_ XMMATRIX& worldViewProjConstant);
+        void SetWorldConstants(_Inout_ int& dirtyFlags, _Inout_ XMMATRIX& worldConstant, _Inout_updates_(3) XMVECTOR worldInverseTransposeConstant[3]) const;
+        void SetEyePositionConstant(_Inout_ int& dirtyFlags, _Inout_ XMVECTOR& eyePositionConstant) const;
     };
 
 
@@ -120,23 +158,32 @@ namespace DirectX
         static void EnableDefaultLighting(_In_ IEffectLights* effect);
     };
 
-    // Factory for lazily instantiating shared root signatures.
+    // Factory for lazily instantiating shared root signatures, with the device's pipeline state cache.
     class EffectDeviceResources
     {
     public:
-        EffectDeviceResources(_In_ ID3D12Device* device) noexcept
-            : mDevice(device)
+        EffectDeviceResources(_In_ ID3D12Device* device)
+            : mDevice(device),
+            mPipelineStateCache(device)
         {
         }
 
         ID3D12RootSignature* DemandCreateRootSig(_Inout_ Microsoft::WRL::ComPtr<ID3D12RootSignature>& rootSig, D3D12_ROOT_SIGNATURE_DESC const& desc);
 
+        PipelineStateCache& GetPipelineStateCache() noexcept { return mPipelineStateCache; }
+
     protected:
         Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
 
+        PipelineStateCache mPipelineStateCache;
+
         std::mutex mMutex;
     };
 
+    // The allocation context the caller supplied with the command list, if any.
+    inline GraphicsMemoryContext* GetGraphicsMemory(_In_ ID3D12GraphicsCommandList*) noexcept { return nullptr; }
+    inline GraphicsMemoryContext* GetGraphicsMemory(_In_ CommandListStateCache* commandList) noexcept { return commandList->GetGraphicsMemory(); }
+
     // Templated base class provides functionality common to all the built-in effects.
     template<typename Traits>
     class EffectBase : public AlignedNew<typename Traits::ConstantBufferType>
@@ -147,21 +194,32 @@ namespace DirectX
        // Constructor.
         EffectBase(_In_ ID3D12Device* device)
             : constants{},
+            transforms{},
             dirtyFlags(INT_MAX),
             mRootSignature(nullptr),
+            mTransformFlags(0),
             mDeviceResources(deviceResourcesPool.DemandCreate(device))
         {
             // Initialize the constant buffer data
             mConstantBuffer = GraphicsMemory::Get(device).AllocateConstant(constants);
         }
 
+        // Uploads from the caller's allocation context if it supplied one, else from the shared GraphicsMemory.
+        template<typename T>
+        GraphicsResource AllocateConstant(T const& data, _In_opt_ GraphicsMemoryContext* graphicsMemory)
+        {
+            return (graphicsMemory)
+                ? graphicsMemory->AllocateConstant(data)
+                : GraphicsMemory::Get(mDeviceResources->GetDevice()).AllocateConstant(data);
+        }
+
         // Commits constants to the constant buffer memory
-        void UpdateConstants()
+        void UpdateConstants(_In_opt_ GraphicsMemoryContext* graphicsMemory = nullptr)
         {
             // Make sure the constant buffer is up to date.
             if (dirtyFlags & EffectDirtyFlags::ConstantBuffer)
             {
-                mConstantBuffer = GraphicsMemory::Get(mDeviceResources->GetDevice()).AllocateConstant(constants);
+                mConstantBuffer = AllocateConstant(constants, graphicsMemory);
 
                 dirtyFlags &= ~EffectDirtyFlags::ConstantBuffer;
             }
@@ -172,6 +230,31 @@ namespace DirectX
             return mConstantBuffer.GpuAddress();
         }
 
+        // Computes the transforms apart from the other constants, so a change to one doesn't upload the other,
+        // and returns the buffer to bind at b2: the shared matrices' one if the effect is using it, else its own.
+        // Call before the fog, which reads matrices.worldView.
+        D3D12_GPU_VIRTUAL_ADDRESS UpdateTransforms(_In_opt_ GraphicsMemoryContext* graphicsMemory = nullptr)
+        {
+            mTransformFlags |= dirtyFlags & EffectDirtyFlags::Transforms;
+            dirtyFlags &= ~EffectDirtyFlags::Transforms;
+
+            matrices.SetConstants(mTransformFlags, transforms.worldViewProj);
+            matrices.SetWorldConstants(mTransformFlags, transforms.world, transforms.worldInverseTranspose);
+            matrices.SetEyePositionConstant(mTransformFlags, transforms.eyePosition);
+
+            if (matrices.sharedConstantBuffer)
+                return matrices.sharedConstantBuffer;
+
+            if (mTransformFlags & EffectDirtyFlags::ConstantBuffer)
+            {
+                mTransforms = AllocateConstant(transforms, graphicsMemory);
+
+                mTransformFlags &= ~EffectDirtyFlags::ConstantBuffer;
+            }
+
+            return mTransforms.GpuAddress();
+        }
+
         ID3D12RootSignature* GetRootSignature(int slot, CD3DX12_ROOT_SIGNATURE_DESC const& rootSig)
         {
             return mDeviceResources->GetRootSignature(slot, rootSig);
@@ -182,7 +265,33 @@ namespace DirectX
             return mDeviceResources->GetDevice();
         }
 
+        ID3D12PipelineState* GetPipelineState() const noexcept
+        {
+            return mPipelineState.Get();
+        }
+
+        ID3D12RootSignature* GetRootSignature() const noexcept
+        {
+            return mRootSignature;
+        }
+
+        // Takes the pipeline state from the device-wide cache, so effects with the same shaders and
+        // pipeline description share one instead of each compiling their own.
+        void CreatePipelineState(
+            EffectPipelineStateDescription const& pipelineDescription,
+            D3D12_SHADER_BYTECODE const& vertexShader,
+            D3D12_SHADER_BYTECODE const& pixelShader)
+        {
+            mDeviceResources->GetPipelineStateCache().GetPipelineState(
+                pipelineDescription,
+                mRootSignature,
+                vertexShader,
+                pixelShader,
+                mPipelineState.ReleaseAndGetAddressOf());
+        }
+
         // Fields.
+        EffectTransformConstants transforms;
         EffectMatrices matrices;
         EffectFog fog;
         int dirtyFlags;
@@ -207,11 +316,15 @@ namespace DirectX
         // D3D constant buffer holds a copy of the same data as the public 'constants' field.
         GraphicsResource mConstantBuffer;
 
+        // ... and the one for 'transforms', with the flags of the values not yet uploaded to it.
+        GraphicsResource mTransforms;
+        int mTransformFlags;
+
         // Only one of these helpers is allocated per D3D device, even if there are multiple effect instances.
         class DeviceResources : public EffectDeviceResources
         {
         public:
-            DeviceResources(_In_ ID3D12Device* device) noexcept
+            DeviceResources(_In_ ID3D12Device* device)
                 : EffectDeviceResources(device),
                 mRootSignature{}
             { }
@@ -106,6 +106,8 @@ private:
     EffectCache  mEffectCacheNormalMap;
     EffectCache  mEffectCacheNormalMapSkinned;
 
+    // Guards the caches. Effects are built outside the lock, so if two threads create the same
+    // effect at once, the first one inserted is returned to both.
     std::mutex mutex;
 };
 
@@ -182,11 +184,12 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
 
             if (mSharing && !info.name.empty())
             {
-                const uint32_t hash = derivedPSD.ComputeHash();
+                const uint64_t hash = derivedPSD.ComputeHash64();
                 cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+                std::lock_guard<std::mutex> lock(mutex);
                 auto it = mEffectCacheNormalMapSkinned.find(cacheName);
-                if (mSharing && it != mEffectCacheNormalMapSkinned.end())
+                if (it != mEffectCacheNormalMapSkinned.end())
                 {
                     return it->second;
                 }
@@ -216,8 +219,7 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
             if (mSharing && !info.name.empty())
             {
                 std::lock_guard<std::mutex> lock(mutex);
-                EffectCache::value_type v(cacheName, effect);
-                mEffectCacheNormalMapSkinned.insert(v);
+                return mEffectCacheNormalMapSkinned.emplace(cacheName, effect).first->second;
             }
 
             return std::move(effect);
@@ -227,11 +229,12 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
             // SkinnedEffect
             if (mSharing && !info.name.empty())
             {
-                const uint32_t hash = derivedPSD.ComputeHash();
+                const uint64_t hash = derivedPSD.ComputeHash64();
                 cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+                std::lock_guard<std::mutex> lock(mutex);
                 auto it = mEffectCacheSkinning.find(cacheName);
-                if (mSharing && it != mEffectCacheSkinning.end())
+                if (it != mEffectCacheSkinning.end())
                 {
                     return it->second;
                 }
@@ -251,8 +254,7 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
             if (mSharing && !info.name.empty())
             {
                 std::lock_guard<std::mutex> lock(mutex);
-                EffectCache::value_type v(cacheName, effect);
-                mEffectCacheSkinning.insert(v);
+                return mEffectCacheSkinning.emplace(cacheName, effect).first->second;
             }
 
             return std::move(effect);
@@ -270,11 +272,12 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
 
         if (mSharing && !info.name.empty())
         {
-            const uint32_t hash = derivedPSD.ComputeHash();
+            const uint64_t hash = derivedPSD.ComputeHash64();
             cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = mEffectCacheDualTexture.find(cacheName);
-            if (mSharing && it != mEffectCacheDualTexture.end())
+            if (it != mEffectCacheDualTexture.end())
             {
                 return it->second;
             }
@@ -329,8 +332,7 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
         if (mSharing && !info.name.empty())
         {
             std::lock_guard<std::mutex> lock(mutex);
-            EffectCache::value_type v(cacheName, effect);
-            mEffectCacheDualTexture.insert(v);
+            return mEffectCacheDualTexture.emplace(cacheName, effect).first->second;
         }
 
         return std::move(effect);
@@ -367,11 +369,12 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
 
         if (mSharing && !info.name.empty())
         {
-            const uint32_t hash = derivedPSD.ComputeHash();
+            const uint64_t hash = derivedPSD.ComputeHash64();
             cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = mEffectCacheNormalMap.find(cacheName);
-            if (mSharing && it != mEffectCacheNormalMap.end())
+            if (it != mEffectCacheNormalMap.end())
             {
                 return it->second;
             }
@@ -401,8 +404,7 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
         if (mSharing && !info.name.empty())
         {
             std::lock_guard<std::mutex> lock(mutex);
-            EffectCache::value_type v(cacheName, effect);
-            mEffectCacheNormalMap.insert(v);
+            return mEffectCacheNormalMap.emplace(cacheName, effect).first->second;
         }
 
         return std::move(effect);
@@ -440,11 +442,12 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
         // BasicEffect
         if (mSharing && !info.name.empty())
         {
-            const uint32_t hash = derivedPSD.ComputeHash();
+            const uint64_t hash = derivedPSD.ComputeHash64();
             cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = mEffectCache.find(cacheName);
-            if (mSharing && it != mEffectCache.end())
+            if (it != mEffectCache.end())
             {
                 return it->second;
             }
@@ -464,8 +467,7 @@ std::shared_ptr<IEffect> EffectFactory::Impl::CreateEffect(
         if (mSharing && !info.name.empty())
         {
             std::lock_guard<std::mutex> lock(mutex);
-            EffectCache::value_type v(cacheName, effect);
-            mEffectCache.insert(v);
+            return mEffectCache.emplace(cacheName, effect).first->second;
         }
 
         return std::move(effect);
@@ -11,6 +11,7 @@
 #include "EffectPipelineStateDescription.h"
 
 #include "DirectXHelpers.h"
+#include "Hash64.h"
 #include "PlatformHelpers.h"
 
 
@@ -84,6 +85,83 @@ uint32_t EffectPipelineStateDescription::ComputeHash() const noexcept
 }
 
 
+uint64_t EffectPipelineStateDescription::ComputeHash64() const noexcept
+{
+    Hash64 hash;
+
+    hash.Add(inputLayout.NumElements);
+    for (UINT j = 0; j < inputLayout.NumElements; ++j)
+    {
+        const auto& element = inputLayout.pInputElementDescs[j];
+        hash.AddString(element.SemanticName);
+        hash.Add(element.SemanticIndex);
+        hash.Add(element.Format);
+        hash.Add(element.InputSlot);
+        hash.Add(element.AlignedByteOffset);
+        hash.Add(element.InputSlotClass);
+        hash.Add(element.InstanceDataStepRate);
+    }
+
+    hash.Add(blendDesc.AlphaToCoverageEnable);
+    hash.Add(blendDesc.IndependentBlendEnable);
+    for (const auto& rt : blendDesc.RenderTarget)
+    {
+        hash.Add(rt.BlendEnable);
+        hash.Add(rt.LogicOpEnable);
+        hash.Add(rt.SrcBlend);
+        hash.Add(rt.DestBlend);
+        hash.Add(rt.BlendOp);
+        hash.Add(rt.SrcBlendAlpha);
+        hash.Add(rt.DestBlendAlpha);
+        hash.Add(rt.BlendOpAlpha);
+        hash.Add(rt.LogicOp);
+        hash.Add(rt.RenderTargetWriteMask);
+    }
+
+    hash.Add(depthStencilDesc.DepthEnable);
+    hash.Add(depthStencilDesc.DepthWriteMask);
+    hash.Add(depthStencilDesc.DepthFunc);
+    hash.Add(depthStencilDesc.StencilEnable);
+    hash.Add(depthStencilDesc.StencilReadMask);
+    hash.Add(depthStencilDesc.StencilWriteMask);
+    for (const auto& face : { depthStencilDesc.FrontFace, depthStencilDesc.BackFace })
+    {
+        hash.Add(face.StencilFailOp);
+        hash.Add(face.StencilDepthFailOp);
+        hash.Add(face.StencilPassOp);
+        hash.Add(face.StencilFunc);
+    }
+
+    hash.Add(rasterizerDesc.FillMode);
+    hash.Add(rasterizerDesc.CullMode);
+    hash.Add(rasterizerDesc.FrontCounterClockwise);
+    hash.Add(rasterizerDesc.DepthBias);
+    hash.Add(rasterizerDesc.DepthBiasClamp);
+    hash.Add(rasterizerDesc.SlopeScaledDepthBias);
+    hash.Add(rasterizerDesc.DepthClipEnable);
+    hash.Add(rasterizerDesc.MultisampleEnable);
+    hash.Add(rasterizerDesc.AntialiasedLineEnable);
+    hash.Add(rasterizerDesc.ForcedSampleCount);
+    hash.Add(rasterizerDesc.ConservativeRaster);
+
+    hash.Add(renderTargetState.sampleMask);
+    hash.Add(renderTargetState.numRenderTargets);
+    for (auto format : renderTargetState.rtvFormats)
+    {
+        hash.Add(format);
+    }
+    hash.Add(renderTargetState.dsvFormat);
+    hash.Add(renderTargetState.sampleDesc.Count);
+    hash.Add(renderTargetState.sampleDesc.Quality);
+    hash.Add(renderTargetState.nodeMask);
+
+    hash.Add(primitiveTopology);
+    hash.Add(stripCutValue);
+
+    return hash.Finalize();
+}
+
+
 void EffectPipelineStateDescription::CreatePipelineState(
     _In_ ID3D12Device* device,
     _In_ ID3D12RootSignature* rootSignature,
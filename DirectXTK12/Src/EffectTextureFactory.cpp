@@ -71,6 +71,14 @@ public:
 
     size_t CreateTexture(_In_z_ const wchar_t* name, int descriptorSlot);
 
+    void DecodeTexture(
+        _In_z_ const wchar_t* fullName,
+        bool isdds,
+        DDS_LOADER_FLAGS loadFlags,
+        TextureCacheEntry& textureEntry,
+        std::unique_ptr<uint8_t[]>& decodedData,
+        std::vector<D3D12_SUBRESOURCE_DATA>& subresources);
+
     void ReleaseCache();
     void SetSharing(bool enabled) noexcept { mSharing = enabled; }
     void EnableForceSRGB(bool forceSRGB) noexcept { mForceSRGB = forceSRGB; }
@@ -101,15 +109,21 @@ size_t EffectTextureFactory::Impl::CreateTexture(_In_z_ const wchar_t* name, int
     if (!name)
         throw std::invalid_argument("name required for CreateTexture");
 
-    auto it = mTextureCache.find(name);
-
     TextureCacheEntry textureEntry = {};
+    bool cached = false;
 
-    if (mSharing && it != mTextureCache.end())
+    if (mSharing)
     {
-        textureEntry = it->second;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = mTextureCache.find(name);
+        if (it != mTextureCache.end())
+        {
+            textureEntry = it->second;
+            cached = true;
+        }
     }
-    else
+
+    if (!cached)
     {
         wchar_t fullName[MAX_PATH] = {};
         wcscpy_s(fullName, mPath);
@@ -137,58 +151,93 @@ size_t EffectTextureFactory::Impl::CreateTexture(_In_z_ const wchar_t* name, int
         if (mAutoGenMips)
             loadFlags |= DDS_LOADER_MIP_AUTOGEN;
 
-        if (isdds)
+        // Decode without holding any lock, so several threads can load textures at once.
+        std::unique_ptr<uint8_t[]> decodedData;
+        std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+        DecodeTexture(fullName, isdds, loadFlags, textureEntry, decodedData, subresources);
+
+        if (loadFlags & DDS_LOADER_MIP_AUTOGEN)
         {
-            HRESULT hr = CreateDDSTextureFromFileEx(
-                mDevice.Get(),
-                mResourceUploadBatch,
-                fullName,
-                0u,
-                D3D12_RESOURCE_FLAG_NONE,
-                loadFlags,
-                textureEntry.mResource.ReleaseAndGetAddressOf(),
-                nullptr,
-                &textureEntry.mIsCubeMap);
-            if (FAILED(hr))
+        #if defined(_MSC_VER) || !defined(_WIN32)
+            const auto desc = textureEntry.mResource->GetDesc();
+        #else
+            D3D12_RESOURCE_DESC tmpDesc;
+            const auto& desc = *textureEntry.mResource->GetDesc(&tmpDesc);
+        #endif
+            if (!mResourceUploadBatch.IsSupportedForGenerateMips(desc.Format))
             {
-                DebugTrace("ERROR: CreateDDSTextureFromFile failed (%08X) for '%ls'\n",
-                    static_cast<unsigned int>(hr), fullName);
-                throw std::runtime_error("EffectTextureFactory::CreateDDSTextureFromFile");
+                DebugTrace("WARNING: Autogen of mips ignored (device doesn't support this format (%d) or trying to use a copy queue)\n", static_cast<int>(desc.Format));
+                loadFlags &= ~DDS_LOADER_MIP_AUTOGEN;
+
+                // Keep the decoded image, and only replace the texture if it reserved mips that won't be generated.
+                const size_t arraySize = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1u : desc.DepthOrArraySize;
+                const size_t numberOfPlanes = D3D12GetFormatPlaneCount(mDevice.Get(), desc.Format);
+                const size_t mipLevels = subresources.size() / (arraySize * numberOfPlanes);
+                if (mipLevels > 0 && mipLevels != desc.MipLevels)
+                {
+                    auto texDesc = desc;
+                    texDesc.MipLevels = static_cast<UINT16>(mipLevels);
+
+                    const CD3DX12_HEAP_PROPERTIES defaultHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
+
+                    ThrowIfFailed(mDevice->CreateCommittedResource(
+                        &defaultHeapProperties,
+                        D3D12_HEAP_FLAG_NONE,
+                        &texDesc,
+                        c_initialCopyTargetState,
+                        nullptr,
+                        IID_GRAPHICS_PPV_ARGS(textureEntry.mResource.ReleaseAndGetAddressOf())));
+
+                #if defined(_DEBUG) || defined(PROFILE)
+                    textureEntry.mResource->SetName(fullName);
+                #endif
+                }
             }
         }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Another thread may have finished the same texture while this one was decoding.
+        auto it = mSharing ? mTextureCache.find(name) : mTextureCache.end();
+        if (it != mTextureCache.end())
+        {
+            textureEntry = it->second;
+        }
         else
         {
-            static_assert(static_cast<int>(DDS_LOADER_DEFAULT) == static_cast<int>(WIC_LOADER_DEFAULT), "DDS/WIC Load flags mismatch");
-            static_assert(static_cast<int>(DDS_LOADER_FORCE_SRGB) == static_cast<int>(WIC_LOADER_FORCE_SRGB), "DDS/WIC Load flags mismatch");
-            static_assert(static_cast<int>(DDS_LOADER_MIP_AUTOGEN) == static_cast<int>(WIC_LOADER_MIP_AUTOGEN), "DDS/WIC Load flags mismatch");
-            static_assert(static_cast<int>(DDS_LOADER_MIP_RESERVE) == static_cast<int>(WIC_LOADER_MIP_RESERVE), "DDS/WIC Load flags mismatch");
-
-            textureEntry.mIsCubeMap = false;
-
-            HRESULT hr = CreateWICTextureFromFileEx(
-                mDevice.Get(),
-                mResourceUploadBatch,
-                fullName,
-                0u,
-                D3D12_RESOURCE_FLAG_NONE,
-                static_cast<WIC_LOADER_FLAGS>(loadFlags),
-                textureEntry.mResource.ReleaseAndGetAddressOf());
-            if (FAILED(hr))
+            // ResourceUploadBatch records into a single command list, so uploads are serialized.
+            mResourceUploadBatch.Upload(
+                textureEntry.mResource.Get(),
+                0,
+                subresources.data(),
+                static_cast<UINT>(subresources.size()));
+
+            mResourceUploadBatch.Transition(
+                textureEntry.mResource.Get(),
+                D3D12_RESOURCE_STATE_COPY_DEST,
+                D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+            // If it's missing mips, let's generate them
+        #if defined(_MSC_VER) || !defined(_WIN32)
+            const size_t mipLevels = textureEntry.mResource->GetDesc().MipLevels;
+        #else
+            D3D12_RESOURCE_DESC tmpDesc;
+            const size_t mipLevels = textureEntry.mResource->GetDesc(&tmpDesc)->MipLevels;
+        #endif
+
+            if ((loadFlags & DDS_LOADER_MIP_AUTOGEN) && subresources.size() != mipLevels)
             {
-                DebugTrace("ERROR: CreateWICTextureFromFile failed (%08X) for '%ls'\n",
-                    static_cast<unsigned int>(hr), fullName);
-                throw std::runtime_error("EffectTextureFactory::CreateWICTextureFromFile");
+                mResourceUploadBatch.GenerateMips(textureEntry.mResource.Get());
             }
-        }
 
-        std::lock_guard<std::mutex> lock(mutex);
-        textureEntry.slot = mResources.size();
-        if (mSharing)
-        {
-            TextureCache::value_type v(name, textureEntry);
-            mTextureCache.insert(v);
+            textureEntry.slot = mResources.size();
+            if (mSharing)
+            {
+                TextureCache::value_type v(name, textureEntry);
+                mTextureCache.insert(v);
+            }
+            mResources.push_back(textureEntry);
         }
-        mResources.push_back(textureEntry);
     }
 
     assert(textureEntry.mResource != nullptr);
@@ -200,6 +249,66 @@ size_t EffectTextureFactory::Impl::CreateTexture(_In_z_ const wchar_t* name, int
     return textureEntry.slot;
 }
 
+_Use_decl_annotations_
+void EffectTextureFactory::Impl::DecodeTexture(
+    const wchar_t* fullName,
+    bool isdds,
+    DDS_LOADER_FLAGS loadFlags,
+    TextureCacheEntry& textureEntry,
+    std::unique_ptr<uint8_t[]>& decodedData,
+    std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+    subresources.clear();
+
+    if (isdds)
+    {
+        HRESULT hr = LoadDDSTextureFromFileEx(
+            mDevice.Get(),
+            fullName,
+            0u,
+            D3D12_RESOURCE_FLAG_NONE,
+            loadFlags,
+            textureEntry.mResource.ReleaseAndGetAddressOf(),
+            decodedData,
+            subresources,
+            nullptr,
+            &textureEntry.mIsCubeMap);
+        if (FAILED(hr))
+        {
+            DebugTrace("ERROR: LoadDDSTextureFromFile failed (%08X) for '%ls'\n",
+                static_cast<unsigned int>(hr), fullName);
+            throw std::runtime_error("EffectTextureFactory::LoadDDSTextureFromFile");
+        }
+    }
+    else
+    {
+        static_assert(static_cast<int>(DDS_LOADER_DEFAULT) == static_cast<int>(WIC_LOADER_DEFAULT), "DDS/WIC Load flags mismatch");
+        static_assert(static_cast<int>(DDS_LOADER_FORCE_SRGB) == static_cast<int>(WIC_LOADER_FORCE_SRGB), "DDS/WIC Load flags mismatch");
+        static_assert(static_cast<int>(DDS_LOADER_MIP_AUTOGEN) == static_cast<int>(WIC_LOADER_MIP_AUTOGEN), "DDS/WIC Load flags mismatch");
+        static_assert(static_cast<int>(DDS_LOADER_MIP_RESERVE) == static_cast<int>(WIC_LOADER_MIP_RESERVE), "DDS/WIC Load flags mismatch");
+
+        textureEntry.mIsCubeMap = false;
+
+        subresources.resize(1);
+
+        HRESULT hr = LoadWICTextureFromFileEx(
+            mDevice.Get(),
+            fullName,
+            0u,
+            D3D12_RESOURCE_FLAG_NONE,
+            static_cast<WIC_LOADER_FLAGS>(loadFlags),
+            textureEntry.mResource.ReleaseAndGetAddressOf(),
+            decodedData,
+            subresources[0]);
+        if (FAILED(hr))
+        {
+            DebugTrace("ERROR: LoadWICTextureFromFile failed (%08X) for '%ls'\n",
+                static_cast<unsigned int>(hr), fullName);
+            throw std::runtime_error("EffectTextureFactory::LoadWICTextureFromFile");
+        }
+    }
+}
+
 void EffectTextureFactory::Impl::ReleaseCache()
 {
     std::lock_guard<std::mutex> lock(mutex);
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -29,14 +30,8 @@ namespace
         XMVECTOR lightDirection[IEffectLights::MaxDirectionalLights];
         XMVECTOR lightDiffuseColor[IEffectLights::MaxDirectionalLights];
 
-        XMVECTOR eyePosition;
-
         XMVECTOR fogColor;
         XMVECTOR fogVector;
-
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(EnvironmentMapEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -70,6 +65,7 @@ public:
         CubemapSRV,
         CubemapSampler,
         ConstantBuffer,
+        ConstantBufferTransforms,
         RootParameterCount
     };
 
@@ -82,7 +78,8 @@ public:
 
     int GetPipelineStatePermutation(EnvironmentMapEffect::Mapping mapping, uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 };
 
 
@@ -382,6 +379,7 @@ EnvironmentMapEffect::Impl::Impl(
 
         CD3DX12_ROOT_PARAMETER rootParameters[RootParameterIndex::RootParameterCount] = {};
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         // Texture 1
         const CD3DX12_DESCRIPTOR_RANGE textureDescriptor(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
@@ -436,12 +434,10 @@ EnvironmentMapEffect::Impl::Impl(
     assert(pi >= 0 && pi < EnvironmentMapEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < EnvironmentMapEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<EnvironmentMapEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<EnvironmentMapEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<EnvironmentMapEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"EnvironmentMapEffect");
 }
@@ -511,16 +507,18 @@ int EnvironmentMapEffect::Impl::GetPipelineStatePermutation(
 
 
 // Sets our state onto the D3D device.
-void EnvironmentMapEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void EnvironmentMapEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
 
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
 
-    lights.SetConstants(dirtyFlags, matrices, constants.world, constants.worldInverseTranspose, constants.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
+    lights.SetConstants(dirtyFlags, matrices, transforms.world, transforms.worldInverseTranspose, transforms.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
     // Set the resources and state
     commandList->SetGraphicsRootSignature(mRootSignature);
@@ -545,6 +543,7 @@ void EnvironmentMapEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandLi
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -575,10 +574,35 @@ void EnvironmentMapEffect::Apply(
 }
 
 
+void EnvironmentMapEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* EnvironmentMapEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* EnvironmentMapEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE EnvironmentMapEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->texture;
+}
+
+
 // Camera settings.
 void XM_CALLCONV EnvironmentMapEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -587,6 +611,7 @@ void XM_CALLCONV EnvironmentMapEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV EnvironmentMapEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -595,6 +620,7 @@ void XM_CALLCONV EnvironmentMapEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV EnvironmentMapEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -605,11 +631,18 @@ void XM_CALLCONV EnvironmentMapEffect::SetMatrices(FXMMATRIX world, CXMMATRIX vi
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void EnvironmentMapEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings.
 void XM_CALLCONV EnvironmentMapEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "GraphicsMemory.h"
+#include "DirectXHelpers.h"
 #include "PlatformHelpers.h"
 #include "LinearAllocator.h"
 
@@ -28,11 +29,37 @@ namespace
     constexpr size_t AllocatorIndexShift = 12; // start block sizes at 4KB
     constexpr size_t AllocatorPoolCount = 21; // allocation sizes up to 2GB supported
     constexpr size_t PoolIndexScale = 1; // multiply the allocation size this amount to push large values into the next bucket
+    constexpr size_t ContextPoolIndex = 0; // allocation contexts take their MinPageSize pages from the sub-4k pool
+    constexpr size_t TotalMemoryHysteresis = 8; // over maxTotalMemory, trim to 1/8th below it so the next frames don't trim again
 
     static_assert((1 << AllocatorIndexShift) == MinAllocSize, "1 << AllocatorIndexShift must == MinPageSize (in KiB)");
     static_assert((MinPageSize & (MinPageSize - 1)) == 0, "MinPageSize size must be a power of 2");
     static_assert((MinAllocSize & (MinAllocSize - 1)) == 0, "MinAllocSize size must be a power of 2");
     static_assert(MinAllocSize >= (4 * 1024), "MinAllocSize size must be greater than 4K");
+    static_assert(GraphicsMemoryFragmentation::PoolCount == AllocatorPoolCount, "GraphicsMemoryFragmentation needs an entry per pool");
+    static_assert(GraphicsMemory::TAG_COMPUTE + 1 == GraphicsMemoryFragmentation::TagCount, "GraphicsMemoryFragmentation needs an entry per tag");
+
+    using TagCounters = std::array<GraphicsMemoryTagStatistics, GraphicsMemoryFragmentation::TagCount>;
+
+    inline void CountAllocation(TagCounters& counters, uint32_t tag, size_t size, size_t alignmentBytes) noexcept
+    {
+        auto& counter = counters[(tag < counters.size()) ? tag : GraphicsMemory::TAG_GENERIC];
+        counter.allocations++;
+        counter.bytes += size;
+        counter.alignmentBytes += alignmentBytes;
+    }
+
+    // Adds src into dest, and clears src.
+    inline void MergeCounters(TagCounters& dest, TagCounters& src) noexcept
+    {
+        for (size_t i = 0; i < dest.size(); ++i)
+        {
+            dest[i].allocations += src[i].allocations;
+            dest[i].bytes += src[i].bytes;
+            dest[i].alignmentBytes += src[i].alignmentBytes;
+            src[i] = {};
+        }
+    }
 
     constexpr size_t NextPow2(size_t x) noexcept
     {
@@ -95,10 +122,23 @@ namespace
     public:
         DeviceAllocator(_In_ ID3D12Device* device) noexcept(false)
             : mDevice(device)
+            , mFenceValue(0)
+            , mLastCommitPages(0)
+            , mLastCommitSignals(0)
+            , mTrimmedPages(0)
+            , mFrameTags{}
+            , mLastFrameTags{}
         {
             if (!device)
                 throw std::invalid_argument("Invalid device parameter");
 
+            ThrowIfFailed(device->CreateFence(
+                0,
+                D3D12_FENCE_FLAG_NONE,
+                IID_GRAPHICS_PPV_ARGS(mFence.ReleaseAndGetAddressOf())));
+
+            SetDebugObjectName(mFence.Get(), L"GraphicsMemory");
+
             for (size_t i = 0; i < mPools.size(); ++i)
             {
                 size_t pageSize = GetPageSizeFromPoolIndex(i);
@@ -119,13 +159,25 @@ namespace
         {
             const ScopedLock lock(mMutex);
 
+            // Must wait for all pending fences!
+            for (auto& allocator : mPools)
+            {
+                if (allocator)
+                {
+                    while (allocator->CommittedPageCount() > 0)
+                    {
+                        allocator->RetirePendingPages(mFence->GetCompletedValue());
+                    }
+                }
+            }
+
             for (auto& allocator : mPools)
             {
                 allocator.reset();
             }
         }
 
-        GraphicsResource Alloc(_In_ size_t size, _In_ size_t alignment)
+        GraphicsResource Alloc(_In_ size_t size, _In_ size_t alignment, uint32_t tag)
         {
             ScopedLock lock(mMutex);
 
@@ -140,14 +192,23 @@ namespace
             assert(poolSize < MinPageSize || poolSize == allocator->PageSize());
 
             auto page = allocator->FindPageForAlloc(size, alignment);
+            if (!page && TrimUnusedPages(0) > 0)
+            {
+                // Out of memory for a new page, so retry after freeing the pages the other pools kept for reuse
+                page = allocator->FindPageForAlloc(size, alignment);
+            }
+
             if (!page)
             {
                 DebugTrace("GraphicsMemory failed to allocate page (%zu requested bytes, %zu alignment)\n", size, alignment);
                 throw std::bad_alloc();
             }
 
+            const size_t bytesUsed = page->BytesUsed();
             size_t offset = page->Suballocate(size, alignment);
 
+            CountAllocation(mFrameTags, tag, size, offset - bytesUsed);
+
             // Return the information to the user
             return GraphicsResource(
                 page,
@@ -158,19 +219,96 @@ namespace
                 size);
         }
 
-        // Submit page fences to the command queue
+        // Hands back an allocation context's page, if it has one, and gives it a fresh one.
+        // The context's tag counters are added to the frame's, and cleared.
+        LinearAllocatorPage* SwapContextPage(_In_opt_ LinearAllocatorPage* page, TagCounters& tags)
+        {
+            ScopedLock lock(mMutex);
+
+            MergeCounters(mFrameTags, tags);
+
+            auto& allocator = mPools[ContextPoolIndex];
+            if (page)
+            {
+                allocator->ReturnPage(page);
+            }
+
+            auto newPage = allocator->AcquirePage();
+            if (!newPage && TrimUnusedPages(0) > 0)
+            {
+                newPage = allocator->AcquirePage();
+            }
+
+            if (!newPage)
+            {
+                DebugTrace("GraphicsMemory failed to allocate page for an allocation context\n");
+                throw std::bad_alloc();
+            }
+
+            return newPage;
+        }
+
+        void ReturnContextPage(_In_ LinearAllocatorPage* page, TagCounters& tags)
+        {
+            ScopedLock lock(mMutex);
+
+            MergeCounters(mFrameTags, tags);
+
+            mPools[ContextPoolIndex]->ReturnPage(page);
+        }
+
+        // Submit page fences to the command queue. All the pages committed since the last call
+        // share one fence value, so this is a single Signal however many pages there are.
         void KickFences(_In_ ID3D12CommandQueue* commandQueue)
         {
             ScopedLock lock(mMutex);
 
+            const uint64_t completedValue = mFence->GetCompletedValue();
+            const uint64_t fenceValue = mFenceValue + 1;
+
+            size_t fencedPages = 0;
             for (auto& i : mPools)
             {
                 if (i)
                 {
-                    i->RetirePendingPages();
-                    i->FenceCommittedPages(commandQueue);
+                    i->RetirePendingPages(completedValue);
+                    fencedPages += i->FenceCommittedPages(fenceValue);
                 }
             }
+
+            mLastCommitPages = fencedPages;
+            mLastCommitSignals = 0;
+
+            if (fencedPages > 0)
+            {
+                ThrowIfFailed(commandQueue->Signal(mFence.Get(), fenceValue));
+                mFenceValue = fenceValue;
+                mLastCommitSignals = 1;
+            }
+
+            mLastFrameTags = mFrameTags;
+            mFrameTags = {};
+
+            // Apply the budget now that the pages the GPU is done with are back in the unused lists
+            size_t totalMemory = 0;
+            size_t unusedMemory = 0;
+            for (auto& i : mPools)
+            {
+                totalMemory += i->TotalMemoryUsage();
+                unusedMemory += i->UnusedMemoryUsage();
+            }
+
+            size_t maxUnusedMemory = mBudget.maxUnusedMemory;
+            if (totalMemory > mBudget.maxTotalMemory)
+            {
+                // Free only what it takes to get below the limit, with some headroom, rather than every
+                // unused page; a frame that needs them again would otherwise recreate them all.
+                const size_t lowWaterMark = mBudget.maxTotalMemory - mBudget.maxTotalMemory / TotalMemoryHysteresis;
+                const size_t excess = totalMemory - lowWaterMark;
+                maxUnusedMemory = std::min(maxUnusedMemory, (unusedMemory > excess) ? unusedMemory - excess : 0);
+            }
+
+            TrimUnusedPages(maxUnusedMemory);
         }
 
         void GarbageCollect()
@@ -191,6 +329,9 @@ namespace
             size_t totalPageCount = 0;
             size_t committedMemoryUsage = 0;
             size_t totalMemoryUsage = 0;
+            size_t usedMemoryUsage = 0;
+            size_t activeMemoryUsage = 0;
+            size_t unusedMemoryUsage = 0;
 
             ScopedLock lock(mMutex);
 
@@ -198,9 +339,14 @@ namespace
             {
                 if (i)
                 {
+                    size_t activePages = 0;
+                    usedMemoryUsage += i->GetPageUsage(activePages, nullptr, 0);
+                    activeMemoryUsage += activePages * i->PageSize();
+
                     totalPageCount += i->TotalPageCount();
                     committedMemoryUsage += i->CommittedMemoryUsage();
                     totalMemoryUsage += i->TotalMemoryUsage();
+                    unusedMemoryUsage += i->UnusedMemoryUsage();
                 }
             }
 
@@ -208,6 +354,50 @@ namespace
             stats.committedMemory = committedMemoryUsage;
             stats.totalMemory = totalMemoryUsage;
             stats.totalPages = totalPageCount;
+            stats.lastCommitFencedPages = mLastCommitPages;
+            stats.lastCommitSignals = mLastCommitSignals;
+            stats.usedMemory = usedMemoryUsage;
+            stats.slackMemory = activeMemoryUsage - usedMemoryUsage;
+            stats.unusedMemory = unusedMemoryUsage;
+            stats.trimmedPages = mTrimmedPages;
+        }
+
+        void GetFragmentation(GraphicsMemoryFragmentation& stats) const
+        {
+            stats = {};
+
+            ScopedLock lock(mMutex);
+
+            for (size_t j = 0; j < mPools.size(); ++j)
+            {
+                auto& pool = stats.pools[j];
+                const auto& allocator = mPools[j];
+
+                pool.pageSize = allocator->PageSize();
+                pool.totalPages = allocator->TotalPageCount();
+                pool.pendingPages = allocator->CommittedPageCount();
+                pool.ownedPages = allocator->OwnedPageCount();
+                pool.unusedPages = allocator->UnusedPageCount();
+                pool.usedBytes = allocator->GetPageUsage(pool.activePages, stats.histogram, GraphicsMemoryFragmentation::HistogramBuckets);
+                pool.slackBytes = pool.activePages * pool.pageSize - pool.usedBytes;
+            }
+
+            for (size_t j = 0; j < mLastFrameTags.size(); ++j)
+            {
+                stats.tags[j] = mLastFrameTags[j];
+            }
+        }
+
+        void SetBudget(const GraphicsMemoryBudget& budget)
+        {
+            ScopedLock lock(mMutex);
+            mBudget = budget;
+        }
+
+        GraphicsMemoryBudget GetBudget() const
+        {
+            ScopedLock lock(mMutex);
+            return mBudget;
         }
 
     #if !(defined(_XBOX_ONE) && defined(_TITLE)) && !defined(_GAMING_XBOX)
@@ -215,8 +405,40 @@ namespace
     #endif
 
     private:
+        // Frees unused pages, largest first, until no more than maxBytes of them are left.
+        // Returns the number of pages freed. Call with the lock held.
+        size_t TrimUnusedPages(size_t maxBytes) noexcept
+        {
+            size_t unusedBytes = 0;
+            for (auto& i : mPools)
+            {
+                unusedBytes += i->UnusedMemoryUsage();
+            }
+
+            size_t numFreed = 0;
+            for (auto it = mPools.rbegin(); it != mPools.rend() && unusedBytes > maxBytes; ++it)
+            {
+                const size_t pageSize = (*it)->PageSize();
+                const size_t excessPages = (unusedBytes - maxBytes + pageSize - 1) / pageSize;
+                const size_t freed = (*it)->TrimUnusedPages(excessPages);
+                unusedBytes -= freed * pageSize;
+                numFreed += freed;
+            }
+
+            mTrimmedPages += numFreed;
+            return numFreed;
+        }
+
         ComPtr<ID3D12Device> mDevice;
         std::array<std::unique_ptr<LinearAllocator>, AllocatorPoolCount> mPools;
+        ComPtr<ID3D12Fence> mFence;
+        uint64_t mFenceValue;
+        size_t mLastCommitPages;
+        size_t mLastCommitSignals;
+        size_t mTrimmedPages;
+        GraphicsMemoryBudget mBudget;
+        TagCounters mFrameTags;
+        TagCounters mLastFrameTags;
         mutable std::mutex mMutex;
     };
 
@@ -285,9 +507,9 @@ public:
     #endif
     }
 
-    GraphicsResource Allocate(size_t size, size_t alignment)
+    GraphicsResource Allocate(size_t size, size_t alignment, uint32_t tag)
     {
-        return mDeviceAllocator->Alloc(size, alignment);
+        return mDeviceAllocator->Alloc(size, alignment, tag);
     }
 
     void Commit(_In_ ID3D12CommandQueue* commandQueue)
@@ -300,6 +522,11 @@ public:
         mDeviceAllocator->GarbageCollect();
     }
 
+    DeviceAllocator* GetDeviceAllocator() const noexcept
+    {
+        return mDeviceAllocator.get();
+    }
+
     void GetStatistics(GraphicsMemoryStatistics& stats)
     {
         mDeviceAllocator->GetStatistics(stats);
@@ -330,6 +557,21 @@ public:
         m_peakPages = 0;
     }
 
+    void GetFragmentation(GraphicsMemoryFragmentation& stats)
+    {
+        mDeviceAllocator->GetFragmentation(stats);
+    }
+
+    void SetBudget(const GraphicsMemoryBudget& budget)
+    {
+        mDeviceAllocator->SetBudget(budget);
+    }
+
+    GraphicsMemoryBudget GetBudget() const
+    {
+        return mDeviceAllocator->GetBudget();
+    }
+
     GraphicsMemory* mOwner;
 #if (defined(_XBOX_ONE) && defined(_TITLE)) || defined(_GAMING_XBOX)
     static GraphicsMemory::Impl* s_graphicsMemory;
@@ -385,10 +627,10 @@ GraphicsMemory& GraphicsMemory::operator= (GraphicsMemory&& moveFrom) noexcept
 GraphicsMemory::~GraphicsMemory() = default;
 
 
-GraphicsResource GraphicsMemory::AllocateImpl(size_t size, size_t alignment)
+GraphicsResource GraphicsMemory::AllocateImpl(size_t size, size_t alignment, uint32_t tag)
 {
     assert(alignment >= 4); // Should use at least DWORD alignment
-    return pImpl->Allocate(size, alignment);
+    return pImpl->Allocate(size, alignment, tag);
 }
 
 
@@ -415,6 +657,23 @@ void GraphicsMemory::ResetStatistics()
     pImpl->ResetStatistics();
 }
 
+GraphicsMemoryFragmentation GraphicsMemory::GetFragmentation()
+{
+    GraphicsMemoryFragmentation stats;
+    pImpl->GetFragmentation(stats);
+    return stats;
+}
+
+void GraphicsMemory::SetBudget(const GraphicsMemoryBudget& budget)
+{
+    pImpl->SetBudget(budget);
+}
+
+GraphicsMemoryBudget GraphicsMemory::GetBudget()
+{
+    return pImpl->GetBudget();
+}
+
 #if (defined(_XBOX_ONE) && defined(_TITLE)) || defined(_GAMING_XBOX)
 GraphicsMemory& GraphicsMemory::Get(_In_opt_ ID3D12Device*)
 {
@@ -449,6 +708,101 @@ GraphicsMemory& GraphicsMemory::Get(_In_opt_ ID3D12Device* device)
 }
 #endif
 
+//--------------------------------------------------------------------------------------
+// GraphicsMemoryContext
+//--------------------------------------------------------------------------------------
+
+class GraphicsMemoryContext::Impl
+{
+public:
+    explicit Impl(_In_ DeviceAllocator* allocator) noexcept
+        : mAllocator(allocator)
+        , mPage(nullptr)
+        , mTags{}
+    {
+        assert(allocator != nullptr);
+    }
+
+    Impl(Impl&&) = delete;
+    Impl& operator= (Impl&&) = delete;
+
+    Impl(Impl const&) = delete;
+    Impl& operator= (Impl const&) = delete;
+
+    ~Impl()
+    {
+        Flush();
+    }
+
+    GraphicsResource Allocate(size_t size, size_t alignment, uint32_t tag)
+    {
+        // Anything that would need a bigger page than the context's goes to the shared pools.
+        if (NextPow2((alignment + size) * PoolIndexScale) >= MinPageSize)
+        {
+            return mAllocator->Alloc(size, alignment, tag);
+        }
+
+        if (!mPage || AlignUp(mPage->BytesUsed(), alignment) + size > mPage->Size())
+        {
+            auto page = mPage;
+            mPage = nullptr;
+            mPage = mAllocator->SwapContextPage(page, mTags);
+        }
+
+        const size_t bytesUsed = mPage->BytesUsed();
+        const size_t offset = mPage->Suballocate(size, alignment);
+
+        CountAllocation(mTags, tag, size, offset - bytesUsed);
+
+        return GraphicsResource(
+            mPage,
+            mPage->GpuAddress() + offset,
+            mPage->UploadResource(),
+            static_cast<BYTE*>(mPage->BaseMemory()) + offset,
+            offset,
+            size);
+    }
+
+    void Flush()
+    {
+        if (mPage)
+        {
+            mAllocator->ReturnContextPage(mPage, mTags);
+            mPage = nullptr;
+        }
+    }
+
+private:
+    DeviceAllocator*        mAllocator;
+    LinearAllocatorPage*    mPage;
+    TagCounters             mTags;  // Allocations not yet reported to the device allocator
+};
+
+
+GraphicsMemoryContext::GraphicsMemoryContext(_In_opt_ ID3D12Device* device)
+    : pImpl(std::make_unique<Impl>(GraphicsMemory::Get(device).pImpl->GetDeviceAllocator()))
+{
+}
+
+
+GraphicsMemoryContext::GraphicsMemoryContext(GraphicsMemoryContext&&) noexcept = default;
+GraphicsMemoryContext& GraphicsMemoryContext::operator= (GraphicsMemoryContext&&) noexcept = default;
+GraphicsMemoryContext::~GraphicsMemoryContext() = default;
+
+
+GraphicsResource GraphicsMemoryContext::AllocateImpl(size_t size, size_t alignment, uint32_t tag)
+{
+    assert(alignment >= 4); // Should use at least DWORD alignment
+    return pImpl->Allocate(size, alignment, tag);
+}
+
+
+void GraphicsMemoryContext::Flush()
+{
+    pImpl->Flush();
+}
+
+
 #ifdef USING_PIX_CUSTOM_MEMORY_EVENTS
 __declspec(allocator)
 void* GraphicsMemory::ReportCustomMemoryAlloc(void* pMem, size_t size, UINT64 metadata)
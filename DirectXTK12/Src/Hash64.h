@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: Hash64.h
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+namespace DirectX
+{
+    // Incremental 64-bit hash using the MurmurHash64A mixing steps, a word at a time. Values are
+    // added one field at a time, so the result never depends on structure padding or pointers
+    // and is stable between runs, builds and machines of the same endianness.
+    class Hash64
+    {
+    public:
+        explicit Hash64(uint64_t seed = 0) noexcept
+            : mHash(seed ^ c_Seed)
+        {
+        }
+
+        template<typename T>
+        void Add(T value) noexcept
+        {
+            static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "Add takes integer or enum values");
+            AddWord(static_cast<uint64_t>(value));
+        }
+
+        void Add(float value) noexcept
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            AddWord(bits);
+        }
+
+        // The length is hashed too, so adjacent byte ranges can't run into each other.
+        void AddBytes(_In_reads_bytes_(size) const void* data, size_t size) noexcept
+        {
+            AddWord(size);
+
+            auto bytes = static_cast<const uint8_t*>(data);
+            for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t))
+            {
+                uint64_t word;
+                memcpy(&word, bytes, sizeof(word));
+                AddWord(word);
+            }
+
+            if (size > 0)
+            {
+                uint64_t word = 0;
+                memcpy(&word, bytes, size);
+                AddWord(word);
+            }
+        }
+
+        void AddString(_In_opt_z_ const char* str) noexcept
+        {
+            AddBytes(str, str ? strlen(str) : 0);
+        }
+
+        uint64_t Finalize() const noexcept
+        {
+            uint64_t hash = mHash;
+            hash ^= hash >> 47;
+            hash *= c_Multiplier;
+            hash ^= hash >> 47;
+            return hash;
+        }
+
+    private:
+        static constexpr uint64_t c_Multiplier = 0xc6a4a7935bd1e995ull;
+        static constexpr uint64_t c_Seed = 0x9e3779b97f4a7c15ull;
+
+        void AddWord(uint64_t word) noexcept
+        {
+            word *= c_Multiplier;
+            word ^= word >> 47;
+            word *= c_Multiplier;
+
+            mHash ^= word;
+            mHash *= c_Multiplier;
+        }
+
+        uint64_t mHash;
+    };
+}
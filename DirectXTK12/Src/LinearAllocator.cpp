@@ -22,6 +22,13 @@
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
+namespace
+{
+    // The used list only grows until the next fence, and the pages further down it are almost
+    // always full, so the search for space is limited to the most recent few.
+    constexpr size_t MaxPagesSearched = 4;
+}
+
 LinearAllocatorPage::LinearAllocatorPage() noexcept
     : pPrevPage(nullptr)
     , pNextPage(nullptr)
@@ -66,11 +73,14 @@ LinearAllocator::LinearAllocator(
     _In_ size_t preallocateBytes) noexcept(false)
     : m_pendingPages(nullptr)
     , m_usedPages(nullptr)
+    , m_usedPagesTail(nullptr)
     , m_unusedPages(nullptr)
+    , m_ownedPages(nullptr)
     , m_increment(pageSize)
     , m_numPending(0)
+    , m_numOwned(0)
+    , m_numUnused(0)
     , m_totalPages(0)
-    , m_fenceCount(0)
     , m_device(pDevice)
 {
     assert(pDevice != nullptr);
@@ -88,30 +98,26 @@ LinearAllocator::LinearAllocator(
             throw std::bad_alloc();
         }
     }
-
-    ThrowIfFailed(pDevice->CreateFence(
-        0,
-        D3D12_FENCE_FLAG_NONE,
-        IID_GRAPHICS_PPV_ARGS(m_fence.ReleaseAndGetAddressOf())));
 }
 
 LinearAllocator::~LinearAllocator()
 {
-    // Must wait for all pending fences!
-    while (m_pendingPages != nullptr)
-    {
-        RetirePendingPages();
-    }
-
+    // The owner of the fence must wait for all pending fences!
     assert(m_pendingPages == nullptr);
 
+    // Allocation contexts should have returned their pages by now.
+    assert(m_ownedPages == nullptr);
+
     // Return all the memory
     FreePages(m_unusedPages);
     FreePages(m_usedPages);
+    FreePages(m_ownedPages);
 
     m_pendingPages = nullptr;
     m_usedPages = nullptr;
+    m_usedPagesTail = nullptr;
     m_unusedPages = nullptr;
+    m_ownedPages = nullptr;
     m_increment = 0;
 }
 
@@ -135,17 +141,62 @@ LinearAllocatorPage* LinearAllocator::FindPageForAlloc(_In_ size_t size, _In_ si
     return page;
 }
 
+LinearAllocatorPage* LinearAllocator::AcquirePage()
+{
+    auto page = m_unusedPages;
+    if (!page)
+    {
+        page = GetNewPage();
+        if (!page)
+        {
+            return nullptr;
+        }
+    }
+
+    assert(m_numUnused > 0);
+    m_numUnused--;
+
+    UnlinkPage(page);
+    LinkPage(page, m_ownedPages);
+    m_numOwned++;
+
+    ResetPage(page);
+
+    page->AddRef();
+    return page;
+}
+
+void LinearAllocator::ReturnPage(_In_ LinearAllocatorPage* page) noexcept
+{
+    assert(page != nullptr);
+    assert(m_numOwned > 0);
+    m_numOwned--;
+
+    // A returned page is usually close to full, so it goes behind the shared pages still being
+    // filled rather than pushing them out of the few that FindPageForAlloc searches.
+    UnlinkPage(page);
+    AppendUsedPage(page);
+
+    // The allocator still holds its own reference, so this never frees the page.
+    assert(page->RefCount() > 1);
+    page->Release();
+}
+
 // Call this after you submit your work to the driver.
-void LinearAllocator::FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue)
+size_t LinearAllocator::FenceCommittedPages(uint64_t fenceValue)
 {
     // No pending pages
     if (m_usedPages == nullptr)
-        return;
+        return 0;
+
+    assert(m_pendingEpochs.empty() || m_pendingEpochs.back().fenceValue <= fenceValue);
 
     // For all the used pages, fence them
-    UINT numReady = 0;
+    size_t numReady = 0;
     LinearAllocatorPage* readyPages = nullptr;
+    LinearAllocatorPage* lastReadyPage = nullptr;
     LinearAllocatorPage* unreadyPages = nullptr;
+    LinearAllocatorPage* lastUnreadyPage = nullptr;
     LinearAllocatorPage* nextPage = nullptr;
     for (auto page = m_usedPages; page != nullptr; page = nextPage)
     {
@@ -157,14 +208,13 @@ void LinearAllocator::FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue)
         // This implies the allocator is the only remaining reference to the page, and therefore the memory is ready for re-use.
         if (page->RefCount() == 1)
         {
-            // Signal the fence
             numReady++;
-            page->mPendingFence = ++m_fenceCount;
-            ThrowIfFailed(commandQueue->Signal(m_fence.Get(), m_fenceCount));
+            page->mPendingFence = fenceValue;
 
             // Link to the ready pages list
             page->pNextPage = readyPages;
             if (readyPages) readyPages->pPrevPage = page;
+            else lastReadyPage = page;
             readyPages = page;
         }
         else
@@ -172,58 +222,144 @@ void LinearAllocator::FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue)
             // Link to the unready list
             page->pNextPage = unreadyPages;
             if (unreadyPages) unreadyPages->pPrevPage = page;
+            else lastUnreadyPage = page;
             unreadyPages = page;
         }
     }
 
     // Replace the used pages list with the new unready list
     m_usedPages = unreadyPages;
+    m_usedPagesTail = lastUnreadyPage;
 
-    // Append all those pages from the ready list to the pending list
+    // Append all those pages from the ready list to the end of the pending list, as a new epoch
     if (numReady > 0)
     {
+        if (m_pendingEpochs.empty())
+        {
+            assert(m_pendingPages == nullptr);
+            m_pendingPages = readyPages;
+        }
+        else
+        {
+            auto tail = m_pendingEpochs.back().lastPage;
+            assert(tail->pNextPage == nullptr);
+            tail->pNextPage = readyPages;
+            readyPages->pPrevPage = tail;
+        }
+
+        m_pendingEpochs.push_back({ fenceValue, lastReadyPage, numReady });
         m_numPending += numReady;
-        LinkPageChain(readyPages, m_pendingPages);
     }
 
 #if VALIDATE_LISTS
     ValidatePageLists();
 #endif
+
+    return numReady;
 }
 
 // Call this once a frame after all of your driver submissions.
 // (immediately before or after Present-time)
-void LinearAllocator::RetirePendingPages() noexcept
+void LinearAllocator::RetirePendingPages(uint64_t completedFenceValue) noexcept
 {
-    const uint64_t fenceValue = m_fence->GetCompletedValue();
-
-    // For each page that we know has a fence pending, check it. If the fence has passed,
-    // we can mark the page for re-use.
-    auto page = m_pendingPages;
-    while (page != nullptr)
+    // The epochs are in fence order, so the ones the GPU has finished with are all at the front.
+    size_t numEpochs = 0;
+    size_t numPages = 0;
+    LinearAllocatorPage* lastPage = nullptr;
+    for (; numEpochs < m_pendingEpochs.size(); ++numEpochs)
     {
-        auto nextPage = page->pNextPage;
+        const auto& epoch = m_pendingEpochs[numEpochs];
+        if (completedFenceValue < epoch.fenceValue)
+            break;
 
-        assert(page->mPendingFence != 0);
+        numPages += epoch.pageCount;
+        lastPage = epoch.lastPage;
+    }
 
-        if (fenceValue >= page->mPendingFence)
-        {
-            // Fence has passed. It is safe to use this page again.
-            ReleasePage(page);
-        }
+    if (!numEpochs)
+        return;
 
-        page = nextPage;
-    }
+    m_pendingEpochs.erase(m_pendingEpochs.begin(), m_pendingEpochs.begin() + static_cast<ptrdiff_t>(numEpochs));
+
+    // Fence has passed. It is safe to use these pages again, so move the whole run to the unused
+    // list. Their offsets are reset when they're next handed out.
+    auto firstPage = m_pendingPages;
+    m_pendingPages = lastPage->pNextPage;
+    if (m_pendingPages)
+        m_pendingPages->pPrevPage = nullptr;
+
+    lastPage->pNextPage = m_unusedPages;
+    if (m_unusedPages)
+        m_unusedPages->pPrevPage = lastPage;
+    m_unusedPages = firstPage;
+
+    assert(m_numPending >= numPages);
+    m_numPending -= numPages;
+    m_numUnused += numPages;
+
+#if VALIDATE_LISTS
+    ValidatePageLists();
+#endif
 }
 
 void LinearAllocator::Shrink() noexcept
 {
     FreePages(m_unusedPages);
     m_unusedPages = nullptr;
+    m_numUnused = 0;
+
+#if VALIDATE_LISTS
+    ValidatePageLists();
+#endif
+}
+
+size_t LinearAllocator::TrimUnusedPages(size_t maxPages) noexcept
+{
+    size_t numFreed = 0;
+    while (m_unusedPages != nullptr && numFreed < maxPages)
+    {
+        auto page = m_unusedPages;
+        m_unusedPages = page->pNextPage;
+        if (m_unusedPages)
+            m_unusedPages->pPrevPage = nullptr;
+
+        page->pNextPage = nullptr;
+        FreePages(page);
+        numFreed++;
+    }
+
+    assert(m_numUnused >= numFreed);
+    m_numUnused -= numFreed;
 
 #if VALIDATE_LISTS
     ValidatePageLists();
 #endif
+
+    return numFreed;
+}
+
+_Use_decl_annotations_
+size_t LinearAllocator::GetPageUsage(size_t& pageCount, size_t* histogram, size_t bucketCount) const noexcept
+{
+    size_t usedBytes = 0;
+    pageCount = 0;
+
+    for (auto list : { m_usedPages, m_pendingPages })
+    {
+        for (auto page = list; page != nullptr; page = page->pNextPage)
+        {
+            usedBytes += page->mOffset;
+            pageCount++;
+
+            if (histogram && bucketCount > 0)
+            {
+                auto bucket = static_cast<size_t>(double(page->mOffset) * double(bucketCount) / double(m_increment));
+                histogram[std::min(bucket, bucketCount - 1)]++;
+            }
+        }
+    }
+
+    return usedBytes;
 }
 
 LinearAllocatorPage* LinearAllocator::GetCleanPageForAlloc()
@@ -241,10 +377,13 @@ LinearAllocatorPage* LinearAllocator::GetCleanPageForAlloc()
     }
 
     // Mark this page as used
+    assert(m_numUnused > 0);
+    m_numUnused--;
+
     UnlinkPage(page);
     LinkPage(page, m_usedPages);
 
-    assert(page->mOffset == 0);
+    ResetPage(page);
 
     return page;
 }
@@ -274,7 +413,8 @@ LinearAllocatorPage* LinearAllocator::FindPageForAlloc(
     size_t sizeBytes,
     size_t alignment) noexcept
 {
-    for (auto page = list; page != nullptr; page = page->pNextPage)
+    size_t searched = 0;
+    for (auto page = list; page != nullptr && searched < MaxPagesSearched; page = page->pNextPage, ++searched)
     {
         const size_t offset = AlignUp(page->mOffset, alignment);
         if (offset + sizeBytes <= m_increment)
@@ -326,6 +466,7 @@ LinearAllocatorPage* LinearAllocator::GetNewPage()
     page->pNextPage = m_unusedPages;
     if (m_unusedPages) m_unusedPages->pPrevPage = page;
     m_unusedPages = page;
+    m_numUnused++;
     m_totalPages++;
 
 #if VALIDATE_LISTS
@@ -347,9 +488,13 @@ void LinearAllocator::UnlinkPage(LinearAllocatorPage* page) noexcept
         m_usedPages = page->pNextPage;
     else if (page == m_pendingPages)
         m_pendingPages = page->pNextPage;
+    else if (page == m_ownedPages)
+        m_ownedPages = page->pNextPage;
 
     if (page->pNextPage)
         page->pNextPage->pPrevPage = page->pPrevPage;
+    else if (page == m_usedPagesTail)
+        m_usedPagesTail = page->pPrevPage;
 
     page->pNextPage = nullptr;
     page->pPrevPage = nullptr;
@@ -359,7 +504,7 @@ void LinearAllocator::UnlinkPage(LinearAllocatorPage* page) noexcept
 #endif
 }
 
-void LinearAllocator::LinkPageChain(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept
+void LinearAllocator::LinkPage(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept
 {
 #if VALIDATE_LISTS
     // Walk the chain and ensure it's not in the list twice
@@ -368,16 +513,15 @@ void LinearAllocator::LinkPageChain(LinearAllocatorPage* page, LinearAllocatorPa
         assert(cur != page);
     }
 #endif
+    assert(page->pNextPage == nullptr);
     assert(page->pPrevPage == nullptr);
     assert(list == nullptr || list->pPrevPage == nullptr);
 
-    // Follow chain to the end and append
-    LinearAllocatorPage* lastPage = nullptr;
-    for (lastPage = page; lastPage->pNextPage != nullptr; lastPage = lastPage->pNextPage) {}
-
-    lastPage->pNextPage = list;
+    page->pNextPage = list;
     if (list)
-        list->pPrevPage = lastPage;
+        list->pPrevPage = page;
+    else if (&list == &m_usedPages)
+        m_usedPagesTail = page;
 
     list = page;
 
@@ -386,37 +530,31 @@ void LinearAllocator::LinkPageChain(LinearAllocatorPage* page, LinearAllocatorPa
 #endif
 }
 
-void LinearAllocator::LinkPage(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept
+void LinearAllocator::AppendUsedPage(LinearAllocatorPage* page) noexcept
 {
-#if VALIDATE_LISTS
-    // Walk the chain and ensure it's not in the list twice
-    for (LinearAllocatorPage* cur = list; cur != nullptr; cur = cur->pNextPage)
+    if (!m_usedPages)
     {
-        assert(cur != page);
+        LinkPage(page, m_usedPages);
+        return;
     }
-#endif
+
     assert(page->pNextPage == nullptr);
     assert(page->pPrevPage == nullptr);
-    assert(list == nullptr || list->pPrevPage == nullptr);
-
-    page->pNextPage = list;
-    if (list)
-        list->pPrevPage = page;
+    assert(m_usedPagesTail != nullptr && m_usedPagesTail->pNextPage == nullptr);
 
-    list = page;
+    m_usedPagesTail->pNextPage = page;
+    page->pPrevPage = m_usedPagesTail;
+    m_usedPagesTail = page;
 
 #if VALIDATE_LISTS
     ValidatePageLists();
 #endif
 }
 
-void LinearAllocator::ReleasePage(LinearAllocatorPage* page) noexcept
+void LinearAllocator::ResetPage(LinearAllocatorPage* page) noexcept
 {
-    assert(m_numPending > 0);
-    m_numPending--;
-
-    UnlinkPage(page);
-    LinkPage(page, m_unusedPages);
+    if (page->mOffset == 0)
+        return;
 
     // Reset the page offset (effectively erasing the memory)
     page->mOffset = 0;
@@ -424,10 +562,6 @@ void LinearAllocator::ReleasePage(LinearAllocatorPage* page) noexcept
 #ifdef _DEBUG
     memset(page->mMemory, 0, m_increment);
 #endif
-
-#if VALIDATE_LISTS
-    ValidatePageLists();
-#endif
 }
 
 void LinearAllocator::FreePages(LinearAllocatorPage* page) noexcept
@@ -463,6 +597,15 @@ void LinearAllocator::ValidatePageLists()
     ValidateList(m_pendingPages);
     ValidateList(m_usedPages);
     ValidateList(m_unusedPages);
+
+    auto tail = m_usedPages;
+    while (tail && tail->pNextPage)
+        tail = tail->pNextPage;
+    if (tail != m_usedPagesTail)
+    {
+        throw std::runtime_error("Broken used pages tail");
+    }
+    ValidateList(m_ownedPages);
 }
 #endif
 
@@ -482,10 +625,10 @@ void LinearAllocator::SetDebugName(const wchar_t* name)
     m_debugName = name;
 
     // Rename existing pages
-    m_fence->SetName(name);
     SetPageDebugName(m_pendingPages);
     SetPageDebugName(m_usedPages);
     SetPageDebugName(m_unusedPages);
+    SetPageDebugName(m_ownedPages);
 }
 
 void LinearAllocator::SetPageDebugName(LinearAllocatorPage* list) noexcept
@@ -17,22 +17,21 @@
 // This class is NOT thread safe. You should protect this with the appropriate sync
 // primitives or, even better, use one linear allocator per thread.
 //
-// Pages are freed once the GPU is done with them. As such, you need to specify when a
-// page is in use and when it is no longer in use. Use RetirePages to prompt the
-// allocator to check if pages are no longer being used by the GPU. Use InsertFences to
-// mark all used pages as in-use by the GPU, removing them from the available pages
-// list. It is recommended you call RetirePages and InsertFences once a frame, usually
-// just before Present().
+// A page can also be handed out whole with AcquirePage, for a single thread to bump allocate
+// from without any locking. Such pages are kept off the used list, so neither FindPageForAlloc
+// nor FenceCommittedPages touches them until they come back through ReturnPage.
 //
-// Why is RetirePages decoupled from InsertFences? It's possible that you might want to
-// reclaim pages more frequently than locking used pages. For example, if you find the
-// allocator is burning through pages too quickly you can call RetirePages to reclaim
-// some that the GPU has finished with. However, this adds additional CPU overhead so it
-// is left to you to decide. In most cases this is sufficient:
+// Pages are freed once the GPU is done with them. As such, you need to specify when a
+// page is in use and when it is no longer in use. FenceCommittedPages marks all the used
+// pages that nothing references anymore as in-use by the GPU until the given fence value,
+// as one epoch. The caller owns the fence and signals that value once, however many
+// pages or allocators were fenced. RetirePendingPages then takes back every epoch the
+// fence has passed, splicing each epoch's pages onto the unused list at once. In most
+// cases this is sufficient, once a frame:
 //
-//      allocator.RetirePages();
-//      allocator.InsertFences( pContext, 0 );
-//      Present(...);
+//      allocator.RetirePendingPages(fence->GetCompletedValue());
+//      if (allocator.FenceCommittedPages(fenceValue))
+//          commandQueue->Signal(fence, fenceValue++);
 //
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
@@ -43,6 +42,7 @@
 #pragma once
 
 #include <atomic>
+#include <vector>
 
 
 namespace DirectX
@@ -108,21 +108,42 @@ namespace DirectX
 
         LinearAllocatorPage* FindPageForAlloc(_In_ size_t requestedSize, _In_ size_t alignment);
 
+        // Hands out a clean page for the caller's exclusive use, with a reference held for the caller.
+        LinearAllocatorPage* AcquirePage();
+
+        // Takes back a page from AcquirePage and releases the caller's reference. The page joins the
+        // end of the used pages, and is fenced once nothing else references it.
+        void ReturnPage(_In_ LinearAllocatorPage* page) noexcept;
+
         // Call this at least once a frame to check if pages have become available.
-        void RetirePendingPages() noexcept;
+        void RetirePendingPages(uint64_t completedFenceValue) noexcept;
 
-        // Call this after you submit your work to the driver.
-        // (e.g. immediately before Present.)
-        void FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue);
+        // Call this after you submit your work to the driver (e.g. immediately before Present),
+        // then signal fenceValue if any pages were fenced. Returns the number of pages fenced.
+        size_t FenceCommittedPages(uint64_t fenceValue);
 
         // Throws away all currently unused pages
         void Shrink() noexcept;
 
+        // Throws away up to maxPages unused pages. Returns the number of pages freed.
+        size_t TrimUnusedPages(size_t maxPages) noexcept;
+
+        // Returns the bytes suballocated from the pages being filled or in flight, and counts each of
+        // those pages in histogram by how full it is. Pages held by allocation contexts are skipped,
+        // as their contexts fill them without a lock.
+        size_t GetPageUsage(
+            _Out_ size_t& pageCount,
+            _Inout_updates_(bucketCount) size_t* histogram,
+            size_t bucketCount) const noexcept;
+
         // Statistics
         size_t CommittedPageCount() const noexcept { return m_numPending; }
+        size_t OwnedPageCount() const noexcept { return m_numOwned; }
+        size_t UnusedPageCount() const noexcept { return m_numUnused; }
         size_t TotalPageCount() const noexcept { return m_totalPages; }
         size_t CommittedMemoryUsage() const noexcept { return m_numPending * m_increment; }
         size_t TotalMemoryUsage() const noexcept { return m_totalPages * m_increment; }
+        size_t UnusedMemoryUsage() const noexcept { return m_numUnused * m_increment; }
         size_t PageSize() const noexcept { return m_increment; }
 
     #if defined(_DEBUG) || defined(PROFILE)
@@ -133,15 +154,27 @@ namespace DirectX
     #endif
 
     private:
+        // A run of the pending list fenced by one FenceCommittedPages call. The list is kept oldest
+        // first, so each epoch's pages start where the previous epoch's end.
+        struct PendingEpoch
+        {
+            uint64_t                            fenceValue;
+            LinearAllocatorPage*                lastPage;
+            size_t                              pageCount;
+        };
+
         LinearAllocatorPage*                    m_pendingPages; // Pages in use by the GPU
         LinearAllocatorPage*                    m_usedPages;    // Pages to be submitted to the GPU
+        LinearAllocatorPage*                    m_usedPagesTail; // Last of m_usedPages, for ReturnPage
         LinearAllocatorPage*                    m_unusedPages;  // Pages not being used right now
+        LinearAllocatorPage*                    m_ownedPages;   // Pages handed out by AcquirePage
         size_t                                  m_increment;
         size_t                                  m_numPending;
+        size_t                                  m_numOwned;
+        size_t                                  m_numUnused;
         size_t                                  m_totalPages;
-        uint64_t                                m_fenceCount;
+        std::vector<PendingEpoch>               m_pendingEpochs;
         Microsoft::WRL::ComPtr<ID3D12Device>    m_device;
-        Microsoft::WRL::ComPtr<ID3D12Fence>     m_fence;
 
         LinearAllocatorPage* GetPageForAlloc(size_t sizeBytes, size_t alignment);
         LinearAllocatorPage* GetCleanPageForAlloc();
@@ -152,8 +185,8 @@ namespace DirectX
 
         void UnlinkPage(LinearAllocatorPage* page) noexcept;
         void LinkPage(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept;
-        void LinkPageChain(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept;
-        void ReleasePage(LinearAllocatorPage* page) noexcept;
+        void AppendUsedPage(LinearAllocatorPage* page) noexcept;
+        void ResetPage(LinearAllocatorPage* page) noexcept;
         void FreePages(LinearAllocatorPage* list) noexcept;
 
     #if defined(_DEBUG) || defined(PROFILE)
@@ -10,14 +10,17 @@
 #include "pch.h"
 #include "Model.h"
 
+#include "CommandListStateCache.h"
 #include "CommonStates.h"
 #include "DescriptorHeap.h"
 #include "DirectXHelpers.h"
 #include "Effects.h"
+#include "Hash64.h"
 #include "PlatformHelpers.h"
 #include "ResourceUploadBatch.h"
 
 using namespace DirectX;
+using Microsoft::WRL::ComPtr;
 
 #if !defined(_CPPRTTI) && !defined(__GXX_RTTI)
 #error Model requires RTTI
@@ -39,7 +42,9 @@ ModelMeshPart::ModelMeshPart(uint32_t ipartIndex) noexcept :
     indexBufferSize(0),
     vertexBufferSize(0),
     primitiveType(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST),
-    indexFormat(DXGI_FORMAT_R16_UINT)
+    indexFormat(DXGI_FORMAT_R16_UINT),
+    staticIndexBufferOffset(0),
+    staticVertexBufferOffset(0)
 {
 }
 
@@ -49,42 +54,59 @@ ModelMeshPart::~ModelMeshPart()
 }
 
 
-_Use_decl_annotations_
-void ModelMeshPart::Draw(_In_ ID3D12GraphicsCommandList* commandList) const
+namespace
 {
-    if (!indexBufferSize || !vertexBufferSize)
+    // Shared by the command list and state cache draw paths.
+    template<typename TCommandList>
+    void DrawPart(const ModelMeshPart& part, _In_ TCommandList* commandList, uint32_t instanceCount, uint32_t startInstance)
     {
-        DebugTrace("ERROR: Model part missing values for vertex and/or index buffer size (indexBufferSize %u, vertexBufferSize %u)!\n", indexBufferSize, vertexBufferSize);
-        throw std::runtime_error("ModelMeshPart");
-    }
+        if (!part.indexBufferSize || !part.vertexBufferSize)
+        {
+            DebugTrace("ERROR: Model part missing values for vertex and/or index buffer size (indexBufferSize %u, vertexBufferSize %u)!\n", part.indexBufferSize, part.vertexBufferSize);
+            throw std::runtime_error("ModelMeshPart");
+        }
 
-    if (!staticIndexBuffer && !indexBuffer)
-    {
-        DebugTrace("ERROR: Model part missing index buffer!\n");
-        throw std::runtime_error("ModelMeshPart");
-    }
+        if (!part.staticIndexBuffer && !part.indexBuffer)
+        {
+            DebugTrace("ERROR: Model part missing index buffer!\n");
+            throw std::runtime_error("ModelMeshPart");
+        }
 
-    if (!staticVertexBuffer && !vertexBuffer)
-    {
-        DebugTrace("ERROR: Model part missing vertex buffer!\n");
-        throw std::runtime_error("ModelMeshPart");
+        if (!part.staticVertexBuffer && !part.vertexBuffer)
+        {
+            DebugTrace("ERROR: Model part missing vertex buffer!\n");
+            throw std::runtime_error("ModelMeshPart");
+        }
+
+        D3D12_VERTEX_BUFFER_VIEW vbv;
+        vbv.BufferLocation = part.staticVertexBuffer ? (part.staticVertexBuffer->GetGPUVirtualAddress() + part.staticVertexBufferOffset) : part.vertexBuffer.GpuAddress();
+        vbv.StrideInBytes = part.vertexStride;
+        vbv.SizeInBytes = part.vertexBufferSize;
+        commandList->IASetVertexBuffers(0, 1, &vbv);
+
+        D3D12_INDEX_BUFFER_VIEW ibv;
+        ibv.BufferLocation = part.staticIndexBuffer ? (part.staticIndexBuffer->GetGPUVirtualAddress() + part.staticIndexBufferOffset) : part.indexBuffer.GpuAddress();
+        ibv.SizeInBytes = part.indexBufferSize;
+        ibv.Format = part.indexFormat;
+        commandList->IASetIndexBuffer(&ibv);
+
+        commandList->IASetPrimitiveTopology(part.primitiveType);
+
+        commandList->DrawIndexedInstanced(part.indexCount, instanceCount, part.startIndex, part.vertexOffset, startInstance);
     }
+}
 
-    D3D12_VERTEX_BUFFER_VIEW vbv;
-    vbv.BufferLocation = staticVertexBuffer ? staticVertexBuffer->GetGPUVirtualAddress() : vertexBuffer.GpuAddress();
-    vbv.StrideInBytes = vertexStride;
-    vbv.SizeInBytes = vertexBufferSize;
-    commandList->IASetVertexBuffers(0, 1, &vbv);
 
-    D3D12_INDEX_BUFFER_VIEW ibv;
-    ibv.BufferLocation = staticIndexBuffer ? staticIndexBuffer->GetGPUVirtualAddress() : indexBuffer.GpuAddress();
-    ibv.SizeInBytes = indexBufferSize;
-    ibv.Format = indexFormat;
-    commandList->IASetIndexBuffer(&ibv);
+_Use_decl_annotations_
+void ModelMeshPart::Draw(ID3D12GraphicsCommandList* commandList) const
+{
+    DrawPart(*this, commandList, 1, 0);
+}
 
-    commandList->IASetPrimitiveTopology(primitiveType);
 
-    commandList->DrawIndexedInstanced(indexCount, 1, startIndex, vertexOffset, 0);
+void ModelMeshPart::Draw(CommandListStateCache& commandList) const
+{
+    DrawPart(*this, &commandList, 1, 0);
 }
 
 
@@ -94,39 +116,16 @@ void ModelMeshPart::DrawInstanced(
     uint32_t instanceCount,
     uint32_t startInstance) const
 {
-    if (!indexBufferSize || !vertexBufferSize)
-    {
-        DebugTrace("ERROR: Model part missing values for vertex and/or index buffer size (indexBufferSize %u, vertexBufferSize %u)!\n", indexBufferSize, vertexBufferSize);
-        throw std::runtime_error("ModelMeshPart");
-    }
-
-    if (!staticIndexBuffer && !indexBuffer)
-    {
-        DebugTrace("ERROR: Model part missing index buffer!\n");
-        throw std::runtime_error("ModelMeshPart");
-    }
-
-    if (!staticVertexBuffer && !vertexBuffer)
-    {
-        DebugTrace("ERROR: Model part missing vertex buffer!\n");
-        throw std::runtime_error("ModelMeshPart");
-    }
-
-    D3D12_VERTEX_BUFFER_VIEW vbv;
-    vbv.BufferLocation = staticVertexBuffer ? staticVertexBuffer->GetGPUVirtualAddress() : vertexBuffer.GpuAddress();
-    vbv.StrideInBytes = vertexStride;
-    vbv.SizeInBytes = vertexBufferSize;
-    commandList->IASetVertexBuffers(0, 1, &vbv);
-
-    D3D12_INDEX_BUFFER_VIEW ibv;
-    ibv.BufferLocation = staticIndexBuffer ? staticIndexBuffer->GetGPUVirtualAddress() : indexBuffer.GpuAddress();
-    ibv.SizeInBytes = indexBufferSize;
-    ibv.Format = indexFormat;
-    commandList->IASetIndexBuffer(&ibv);
+    DrawPart(*this, commandList, instanceCount, startInstance);
+}
 
-    commandList->IASetPrimitiveTopology(primitiveType);
 
-    commandList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, vertexOffset, startInstance);
+void ModelMeshPart::DrawInstanced(
+    CommandListStateCache& commandList,
+    uint32_t instanceCount,
+    uint32_t startInstance) const
+{
+    DrawPart(*this, &commandList, instanceCount, startInstance);
 }
 
 
@@ -227,7 +226,98 @@ void ModelMesh::DrawAlpha(_In_ ID3D12GraphicsCommandList* commandList, ModelMesh
 // Model
 //--------------------------------------------------------------------------------------
 
-Model::Model() noexcept
+namespace
+{
+    constexpr size_t c_ArenaAlignment = 16;
+
+    // Packs upload buffers into a few large default heap buffers. Sources are identified
+    // by their upload memory, so a buffer shared by several parts is only stored once.
+    class GeometryArena
+    {
+    public:
+        struct Placement
+        {
+            size_t                  block;
+            uint64_t                offset;
+            SharedGraphicsResource  source;
+        };
+
+        explicit GeometryArena(uint64_t blockSize) noexcept :
+            mBlockSize(blockSize)
+        {
+        }
+
+        // Returns the placement for a source buffer, assigning one on first use
+        const Placement& Place(const SharedGraphicsResource& source)
+        {
+            auto it = mPlacements.find(source.Memory());
+            if (it != mPlacements.end())
+                return it->second;
+
+            const uint64_t size = source.Size();
+            uint64_t offset = mBlockUsed.empty() ? 0 : AlignUp(mBlockUsed.back(), c_ArenaAlignment);
+            if (mBlockUsed.empty() || (mBlockUsed.back() > 0 && (offset + size) > mBlockSize))
+            {
+                // Buffers larger than the block size get a block of their own
+                mBlockUsed.push_back(0);
+                offset = 0;
+            }
+
+            mBlockUsed.back() = offset + size;
+
+            return mPlacements.emplace(source.Memory(), Placement{ mBlockUsed.size() - 1, offset, source }).first->second;
+        }
+
+        // Creates the default heap buffers and records the copies from upload memory
+        void Create(
+            _In_ ID3D12Device* device,
+            ResourceUploadBatch& resourceUploadBatch,
+            D3D12_RESOURCE_STATES stateAfter)
+        {
+            const CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+
+            mBlocks.resize(mBlockUsed.size());
+            for (size_t j = 0; j < mBlockUsed.size(); ++j)
+            {
+                auto const desc = CD3DX12_RESOURCE_DESC::Buffer(mBlockUsed[j]);
+
+                ThrowIfFailed(device->CreateCommittedResource(
+                    &heapProperties,
+                    D3D12_HEAP_FLAG_NONE,
+                    &desc,
+                    c_initialCopyTargetState,
+                    nullptr,
+                    IID_GRAPHICS_PPV_ARGS(mBlocks[j].ReleaseAndGetAddressOf())
+                ));
+
+                SetDebugObjectName(mBlocks[j].Get(), L"ModelGeometryArena");
+            }
+
+            for (const auto& it : mPlacements)
+            {
+                resourceUploadBatch.Upload(mBlocks[it.second.block].Get(), it.second.offset, it.second.source);
+            }
+
+            for (const auto& block : mBlocks)
+            {
+                resourceUploadBatch.Transition(block.Get(), D3D12_RESOURCE_STATE_COPY_DEST, stateAfter);
+            }
+        }
+
+        ID3D12Resource* GetBlock(size_t index) const noexcept { return mBlocks[index].Get(); }
+
+    private:
+        uint64_t                                        mBlockSize;
+        std::vector<uint64_t>                           mBlockUsed;
+        std::vector<ComPtr<ID3D12Resource>>             mBlocks;
+        std::unordered_map<const void*, Placement>      mPlacements;
+    };
+}
+
+Model::Model() noexcept :
+    boneOrderCount(0),
+    boneOrderComplete(false),
+    cullMeshCount(0)
 {
 }
 
@@ -240,7 +330,14 @@ Model::Model(Model const& other) :
     materials(other.materials),
     textureNames(other.textureNames),
     bones(other.bones),
-    name(other.name)
+    name(other.name),
+    boneOrder(other.boneOrder),
+    boneOrderCount(other.boneOrderCount),
+    boneOrderComplete(other.boneOrderComplete),
+    cullNodes(other.cullNodes),
+    cullUnbounded(other.cullUnbounded),
+    cullSkinned(other.cullSkinned),
+    cullMeshCount(other.cullMeshCount)
 {
     const size_t nbones = other.bones.size();
     if (nbones > 0)
@@ -270,6 +367,13 @@ Model& Model::operator= (Model const& rhs)
         std::swap(boneMatrices, tmp.boneMatrices);
         std::swap(invBindPoseMatrices, tmp.invBindPoseMatrices);
         std::swap(name, tmp.name);
+        std::swap(boneOrder, tmp.boneOrder);
+        std::swap(boneOrderCount, tmp.boneOrderCount);
+        std::swap(boneOrderComplete, tmp.boneOrderComplete);
+        std::swap(cullNodes, tmp.cullNodes);
+        std::swap(cullUnbounded, tmp.cullUnbounded);
+        std::swap(cullSkinned, tmp.cullSkinned);
+        std::swap(cullMeshCount, tmp.cullMeshCount);
     }
     return *this;
 }
@@ -337,10 +441,12 @@ void Model::LoadStaticBuffers(
 
     const CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
 
-    for (auto it = uniqueParts.cbegin(); it != uniqueParts.cend(); ++it)
-    {
-        auto part = *it;
+    // Parts that reference the same upload memory share one static resource
+    std::unordered_map<const void*, ComPtr<ID3D12Resource>> staticVBs;
+    std::unordered_map<const void*, ComPtr<ID3D12Resource>> staticIBs;
 
+    for (auto part : uniqueParts)
+    {
         // Convert dynamic VB to static VB
         if (!part->staticVertexBuffer)
         {
@@ -352,45 +458,31 @@ void Model::LoadStaticBuffers(
 
             part->vertexBufferSize = static_cast<uint32_t>(part->vertexBuffer.Size());
 
-            auto const desc = CD3DX12_RESOURCE_DESC::Buffer(part->vertexBuffer.Size());
-
-            ThrowIfFailed(device->CreateCommittedResource(
-                &heapProperties,
-                D3D12_HEAP_FLAG_NONE,
-                &desc,
-                c_initialCopyTargetState,
-                nullptr,
-                IID_GRAPHICS_PPV_ARGS(part->staticVertexBuffer.GetAddressOf())
-            ));
-
-            SetDebugObjectName(part->staticVertexBuffer.Get(), L"ModelMeshPart");
-
-            resourceUploadBatch.Upload(part->staticVertexBuffer.Get(), part->vertexBuffer);
-
-            resourceUploadBatch.Transition(part->staticVertexBuffer.Get(),
-                D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-
-            // Scan for any other part with the same vertex buffer for sharing
-            for (auto sit = std::next(it); sit != uniqueParts.cend(); ++sit)
+            auto& staticVB = staticVBs[part->vertexBuffer.Memory()];
+            if (!staticVB)
             {
-                auto sharePart = *sit;
-                assert(sharePart != part);
+                auto const desc = CD3DX12_RESOURCE_DESC::Buffer(part->vertexBuffer.Size());
 
-                if (sharePart->staticVertexBuffer)
-                    continue;
+                ThrowIfFailed(device->CreateCommittedResource(
+                    &heapProperties,
+                    D3D12_HEAP_FLAG_NONE,
+                    &desc,
+                    c_initialCopyTargetState,
+                    nullptr,
+                    IID_GRAPHICS_PPV_ARGS(staticVB.GetAddressOf())
+                ));
 
-                if (sharePart->vertexBuffer == part->vertexBuffer)
-                {
-                    sharePart->vertexBufferSize = part->vertexBufferSize;
-                    sharePart->staticVertexBuffer = part->staticVertexBuffer;
+                SetDebugObjectName(staticVB.Get(), L"ModelMeshPart");
 
-                    if (!keepMemory)
-                    {
-                        sharePart->vertexBuffer.Reset();
-                    }
-                }
+                resourceUploadBatch.Upload(staticVB.Get(), part->vertexBuffer);
+
+                resourceUploadBatch.Transition(staticVB.Get(),
+                    D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
             }
 
+            part->staticVertexBuffer = staticVB;
+            part->staticVertexBufferOffset = 0;
+
             if (!keepMemory)
             {
                 part->vertexBuffer.Reset();
@@ -408,45 +500,120 @@ void Model::LoadStaticBuffers(
 
             part->indexBufferSize = static_cast<uint32_t>(part->indexBuffer.Size());
 
-            auto const desc = CD3DX12_RESOURCE_DESC::Buffer(part->indexBuffer.Size());
+            auto& staticIB = staticIBs[part->indexBuffer.Memory()];
+            if (!staticIB)
+            {
+                auto const desc = CD3DX12_RESOURCE_DESC::Buffer(part->indexBuffer.Size());
 
-            ThrowIfFailed(device->CreateCommittedResource(
-                &heapProperties,
-                D3D12_HEAP_FLAG_NONE,
-                &desc,
-                c_initialCopyTargetState,
-                nullptr,
-                IID_GRAPHICS_PPV_ARGS(part->staticIndexBuffer.GetAddressOf())
-            ));
+                ThrowIfFailed(device->CreateCommittedResource(
+                    &heapProperties,
+                    D3D12_HEAP_FLAG_NONE,
+                    &desc,
+                    c_initialCopyTargetState,
+                    nullptr,
+                    IID_GRAPHICS_PPV_ARGS(staticIB.GetAddressOf())
+                ));
 
-            SetDebugObjectName(part->staticIndexBuffer.Get(), L"ModelMeshPart");
+                SetDebugObjectName(staticIB.Get(), L"ModelMeshPart");
 
-            resourceUploadBatch.Upload(part->staticIndexBuffer.Get(), part->indexBuffer);
+                resourceUploadBatch.Upload(staticIB.Get(), part->indexBuffer);
 
-            resourceUploadBatch.Transition(part->staticIndexBuffer.Get(),
-                D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+                resourceUploadBatch.Transition(staticIB.Get(),
+                    D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+            }
+
+            part->staticIndexBuffer = staticIB;
+            part->staticIndexBufferOffset = 0;
 
-            // Scan for any other part with the same index buffer for sharing
-            for (auto sit = std::next(it); sit != uniqueParts.cend(); ++sit)
+            if (!keepMemory)
             {
-                auto sharePart = *sit;
-                assert(sharePart != part);
+                part->indexBuffer.Reset();
+            }
+        }
+    }
+}
 
-                if (sharePart->staticIndexBuffer)
-                    continue;
 
-                if (sharePart->indexBuffer == part->indexBuffer)
-                {
-                    sharePart->indexBufferSize = part->indexBufferSize;
-                    sharePart->staticIndexBuffer = part->staticIndexBuffer;
+// Load VB/IB resources for static geometry, packing them into a few large buffers.
+_Use_decl_annotations_
+void Model::LoadStaticBuffersArena(
+    ID3D12Device* device,
+    ResourceUploadBatch& resourceUploadBatch,
+    bool keepMemory,
+    uint64_t blockSize)
+{
+    if (!blockSize)
+        throw std::invalid_argument("LoadStaticBuffersArena");
 
-                    if (!keepMemory)
-                    {
-                        sharePart->indexBuffer.Reset();
-                    }
-                }
+    // Gather all unique parts that still need static buffers
+    std::set<ModelMeshPart*> uniqueParts;
+    for (const auto& mesh : meshes)
+    {
+        for (const auto& part : mesh->opaqueMeshParts)
+        {
+            uniqueParts.insert(part.get());
+        }
+        for (const auto& part : mesh->alphaMeshParts)
+        {
+            uniqueParts.insert(part.get());
+        }
+    }
+
+    GeometryArena vbArena(blockSize);
+    GeometryArena ibArena(blockSize);
+
+    for (auto part : uniqueParts)
+    {
+        if (!part->staticVertexBuffer)
+        {
+            if (!part->vertexBuffer)
+            {
+                DebugTrace("ERROR: Model part missing vertex buffer!\n");
+                throw std::runtime_error("ModelMeshPart");
             }
 
+            std::ignore = vbArena.Place(part->vertexBuffer);
+        }
+
+        if (!part->staticIndexBuffer)
+        {
+            if (!part->indexBuffer)
+            {
+                DebugTrace("ERROR: Model part missing index buffer!\n");
+                throw std::runtime_error("ModelMeshPart");
+            }
+
+            std::ignore = ibArena.Place(part->indexBuffer);
+        }
+    }
+
+    vbArena.Create(device, resourceUploadBatch, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    ibArena.Create(device, resourceUploadBatch, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+
+    for (auto part : uniqueParts)
+    {
+        if (!part->staticVertexBuffer)
+        {
+            auto const& placement = vbArena.Place(part->vertexBuffer);
+
+            part->vertexBufferSize = static_cast<uint32_t>(part->vertexBuffer.Size());
+            part->staticVertexBuffer = vbArena.GetBlock(placement.block);
+            part->staticVertexBufferOffset = placement.offset;
+
+            if (!keepMemory)
+            {
+                part->vertexBuffer.Reset();
+            }
+        }
+
+        if (!part->staticIndexBuffer)
+        {
+            auto const& placement = ibArena.Place(part->indexBuffer);
+
+            part->indexBufferSize = static_cast<uint32_t>(part->indexBuffer.Size());
+            part->staticIndexBuffer = ibArena.GetBlock(placement.block);
+            part->staticIndexBufferOffset = placement.offset;
+
             if (!keepMemory)
             {
                 part->indexBuffer.Reset();
@@ -525,6 +692,222 @@ Model::EffectCollection Model::CreateEffects(
 }
 
 
+namespace
+{
+    using InputLayoutCollection = ModelMeshPart::InputLayoutCollection;
+
+    uint64_t HashEffectKey(uint32_t materialIndex, _In_opt_ const InputLayoutCollection* layout) noexcept
+    {
+        Hash64 hash;
+        hash.Add(materialIndex);
+        hash.Add(layout ? layout->size() : 0);
+        if (layout)
+        {
+            for (const auto& element : *layout)
+            {
+                hash.AddString(element.SemanticName);
+                hash.Add(element.SemanticIndex);
+                hash.Add(element.Format);
+                hash.Add(element.InputSlot);
+                hash.Add(element.AlignedByteOffset);
+                hash.Add(element.InputSlotClass);
+                hash.Add(element.InstanceDataStepRate);
+            }
+        }
+        return hash.Finalize();
+    }
+
+    bool SameInputLayout(_In_opt_ const InputLayoutCollection* a, _In_opt_ const InputLayoutCollection* b) noexcept
+    {
+        if (a == b)
+            return true;
+
+        if (!a || !b || a->size() != b->size())
+            return false;
+
+        for (size_t j = 0; j < a->size(); ++j)
+        {
+            const auto& ea = (*a)[j];
+            const auto& eb = (*b)[j];
+            if (ea.SemanticIndex != eb.SemanticIndex
+                || ea.Format != eb.Format
+                || ea.InputSlot != eb.InputSlot
+                || ea.AlignedByteOffset != eb.AlignedByteOffset
+                || ea.InputSlotClass != eb.InputSlotClass
+                || ea.InstanceDataStepRate != eb.InstanceDataStepRate)
+                return false;
+
+            if (ea.SemanticName != eb.SemanticName
+                && (!ea.SemanticName || !eb.SemanticName || strcmp(ea.SemanticName, eb.SemanticName) != 0))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+
+// Create effects for each mesh piece, creating the distinct ones across several threads.
+Model::EffectCollection Model::CreateEffectsParallel(
+    IEffectFactory& fxFactory,
+    const EffectPipelineStateDescription& opaquePipelineState,
+    const EffectPipelineStateDescription& alphaPipelineState,
+    int textureDescriptorOffset,
+    int samplerDescriptorOffset,
+    unsigned int threadCount) const
+{
+    if (materials.empty())
+    {
+        DebugTrace("ERROR: Model has no material information to create effects!\n");
+        throw std::runtime_error("CreateEffectsParallel");
+    }
+
+    EffectCollection effects;
+
+    // Gather the parts that need an effect, and count the number of parts
+    std::vector<const ModelMeshPart*> parts;
+    uint32_t partCount = 0;
+    for (const auto& mesh : meshes)
+    {
+        assert(mesh != nullptr);
+
+        for (const auto* collection : { &mesh->opaqueMeshParts, &mesh->alphaMeshParts })
+        {
+            for (const auto& part : *collection)
+            {
+                assert(part != nullptr);
+
+                partCount = std::max(part->partIndex + 1, partCount);
+
+                if (part->materialIndex != uint32_t(-1))
+                    parts.push_back(part.get());
+            }
+        }
+    }
+
+    if (partCount == 0)
+        return effects;
+
+    effects.resize(partCount);
+
+    // The material also picks between the opaque and alpha pipeline descriptions, so parts with the same
+    // material and input layout always get identical effects. Only the first part of each such group is
+    // passed to the factory.
+    std::vector<const ModelMeshPart*> unique;
+    std::vector<size_t> partEffect(parts.size());
+    {
+        std::unordered_multimap<uint64_t, size_t> lookup;
+        lookup.reserve(parts.size());
+
+        for (size_t j = 0; j < parts.size(); ++j)
+        {
+            const auto* part = parts[j];
+            const uint64_t key = HashEffectKey(part->materialIndex, part->vbDecl.get());
+
+            size_t index = unique.size();
+            auto range = lookup.equal_range(key);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                const auto* other = unique[it->second];
+                if (other->materialIndex == part->materialIndex && SameInputLayout(other->vbDecl.get(), part->vbDecl.get()))
+                {
+                    index = it->second;
+                    break;
+                }
+            }
+
+            if (index == unique.size())
+            {
+                lookup.emplace(key, index);
+                unique.push_back(part);
+            }
+
+            partEffect[j] = index;
+        }
+    }
+
+    std::vector<std::shared_ptr<IEffect>> uniqueEffects(unique.size());
+
+    const size_t count = unique.size();
+    std::atomic<size_t> next(0);
+    auto createEffects = [&]()
+    {
+        for (;;)
+        {
+            const size_t index = next++;
+            if (index >= count)
+                break;
+
+            try
+            {
+                uniqueEffects[index] = CreateEffectForMeshPart(fxFactory, opaquePipelineState, alphaPipelineState, textureDescriptorOffset, samplerDescriptorOffset, unique[index]);
+            }
+            catch (...)
+            {
+                // Stop the other threads picking up more work.
+                next = count;
+                throw;
+            }
+        }
+    };
+
+    if (!threadCount)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const size_t threads = std::min<size_t>(threadCount, count);
+
+    // The calling thread does its share of the work too. Futures from std::async block on destruction,
+    // so every worker has finished before anything it references goes away.
+    std::vector<std::future<void>> tasks;
+    if (threads > 1)
+    {
+        tasks.reserve(threads - 1);
+        for (size_t j = 1; j < threads; ++j)
+        {
+            tasks.emplace_back(std::async(std::launch::async, createEffects));
+        }
+    }
+
+    std::exception_ptr error;
+    try
+    {
+        createEffects();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    for (auto& task : tasks)
+    {
+        try
+        {
+            task.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+
+    for (size_t j = 0; j < parts.size(); ++j)
+    {
+        // If this fires, you have multiple parts with the same unique ID
+        assert(effects[parts[j]->partIndex] == nullptr);
+
+        effects[parts[j]->partIndex] = uniqueEffects[partEffect[j]];
+    }
+
+    return effects;
+}
+
+
 // Private helper for creating an effect for a mesh part.
 _Use_decl_annotations_
 std::shared_ptr<IEffect> Model::CreateEffectForMeshPart(
@@ -588,6 +971,12 @@ void Model::CopyAbsoluteBoneTransformsTo(
         throw std::runtime_error("Model is missing bones");
     }
 
+    if (boneOrderCount == bones.size())
+    {
+        ComputeAbsoluteOrdered(nbones, boneMatrices.get(), boneTransforms);
+        return;
+    }
+
     memset(boneTransforms, 0, sizeof(XMMATRIX) * nbones);
 
     const XMMATRIX id = XMMatrixIdentity();
@@ -618,6 +1007,12 @@ void Model::CopyAbsoluteBoneTransforms(
         throw std::runtime_error("Model is missing bones");
     }
 
+    if (boneOrderCount == bones.size())
+    {
+        ComputeAbsoluteOrdered(nbones, inBoneTransforms, outBoneTransforms);
+        return;
+    }
+
     memset(outBoneTransforms, 0, sizeof(XMMATRIX) * nbones);
 
     const XMMATRIX id = XMMatrixIdentity();
@@ -626,6 +1021,131 @@ void Model::CopyAbsoluteBoneTransforms(
 }
 
 
+// Compute using bone hierarchy for a batch of instances.
+_Use_decl_annotations_
+void Model::CopyAbsoluteBoneTransforms(
+    size_t ninstances,
+    size_t nbones,
+    const XMMATRIX* inBoneTransforms,
+    XMMATRIX* outBoneTransforms) const
+{
+    if (!ninstances || !nbones || !inBoneTransforms || !outBoneTransforms)
+    {
+        throw std::invalid_argument("Bone transforms arrays required");
+    }
+
+    if (nbones < bones.size())
+    {
+        throw std::invalid_argument("Bone transforms arrays are too small");
+    }
+
+    if (bones.empty())
+    {
+        throw std::runtime_error("Model is missing bones");
+    }
+
+    if (boneOrderCount != bones.size())
+    {
+        for (size_t j = 0; j < ninstances; ++j)
+        {
+            CopyAbsoluteBoneTransforms(nbones, inBoneTransforms + j * nbones, outBoneTransforms + j * nbones);
+        }
+        return;
+    }
+
+    for (size_t j = 0; j < ninstances; ++j)
+    {
+        ComputeAbsoluteOrdered(nbones, inBoneTransforms + j * nbones, outBoneTransforms + j * nbones);
+    }
+}
+
+
+// Validate the bone graph and flatten it into a parents-first evaluation order.
+void Model::UpdateBoneOrder()
+{
+    boneOrder.clear();
+    boneOrderCount = 0;
+    boneOrderComplete = false;
+
+    const size_t nbones = bones.size();
+    if (!nbones)
+        return;
+
+    std::vector<BoneOrder> order;
+    order.reserve(nbones);
+
+    std::vector<uint8_t> reached(nbones, 0);
+    size_t nreached = 0;
+
+    // Same walk as ComputeAbsolute: siblings share the parent transform, children use the bone's own.
+    std::vector<BoneOrder> pending;
+    pending.reserve(nbones);
+    pending.push_back({ 0, ModelBone::c_Invalid });
+
+    while (!pending.empty())
+    {
+        const BoneOrder it = pending.back();
+        pending.pop_back();
+
+        if (it.index == ModelBone::c_Invalid || it.index >= nbones)
+            continue;
+
+        if (order.size() >= nbones)
+        {
+            DebugTrace("ERROR: Model::UpdateBoneOrder encountered a cycle in the bones!\n");
+            throw std::runtime_error("Model bones form an invalid graph");
+        }
+
+        order.push_back(it);
+
+        if (!reached[it.index])
+        {
+            reached[it.index] = 1;
+            ++nreached;
+        }
+
+        pending.push_back({ bones[it.index].childIndex, it.index });
+        pending.push_back({ bones[it.index].siblingIndex, it.parent });
+    }
+
+    boneOrder = std::move(order);
+    boneOrderCount = nbones;
+    boneOrderComplete = (nreached == nbones) && (boneOrder.size() == nbones);
+}
+
+
+// Private helper for computing hierarchical transforms in one pass over the flattened bones.
+_Use_decl_annotations_
+void Model::ComputeAbsoluteOrdered(
+    size_t nbones,
+    const XMMATRIX* inBoneTransforms,
+    XMMATRIX* outBoneTransforms) const noexcept
+{
+    assert(inBoneTransforms != nullptr && outBoneTransforms != nullptr);
+    assert(nbones >= bones.size());
+
+    // Bones the walk never reaches stay zero.
+    if (boneOrderComplete)
+    {
+        if (nbones > bones.size())
+        {
+            memset(outBoneTransforms + bones.size(), 0, sizeof(XMMATRIX) * (nbones - bones.size()));
+        }
+    }
+    else
+    {
+        memset(outBoneTransforms, 0, sizeof(XMMATRIX) * nbones);
+    }
+
+    for (const auto& it : boneOrder)
+    {
+        const XMMATRIX local = inBoneTransforms[it.index];
+        outBoneTransforms[it.index] = (it.parent == ModelBone::c_Invalid)
+            ? local : XMMatrixMultiply(local, outBoneTransforms[it.parent]);
+    }
+}
+
+
 // Private helper for computing hierarchical transforms using bones via recursion.
 _Use_decl_annotations_
 void Model::ComputeAbsolute(
@@ -735,6 +1255,48 @@ void XM_CALLCONV Model::UpdateEffectMatrices(
 }
 
 
+void XM_CALLCONV Model::UpdateEffectMatrices(
+    ResolvedEffectCollection& effects,
+    FXMMATRIX world,
+    CXMMATRIX view,
+    CXMMATRIX proj)
+{
+    for (auto& fx : effects)
+    {
+        if (fx.matrices)
+        {
+            fx.matrices->SetMatrices(world, view, proj);
+        }
+    }
+}
+
+
+void Model::UpdateEffectMatrices(
+    ResolvedEffectCollection& effects,
+    const SharedEffectMatrices& matrices)
+{
+    for (auto& fx : effects)
+    {
+        if (fx.matrices)
+        {
+            fx.matrices->SetSharedMatrices(matrices);
+        }
+    }
+}
+
+
+Model::ResolvedEffectCollection Model::ResolveEffects(const EffectCollection& effects)
+{
+    ResolvedEffectCollection result;
+    result.reserve(effects.size());
+    for (const auto& fx : effects)
+    {
+        result.emplace_back(fx);
+    }
+    return result;
+}
+
+
 // Transition static VB/IB resources (if applicable).
 void Model::Transition(
     _In_ ID3D12GraphicsCommandList* commandList,
@@ -746,88 +1308,250 @@ void Model::Transition(
     UINT count = 0;
     D3D12_RESOURCE_BARRIER barrier[64] = {};
 
+    // Static buffers can be shared by many parts, but each resource must only be transitioned once
+    std::set<ID3D12Resource*> visited;
+
+    auto addBarrier = [&](ID3D12Resource* resource, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+    {
+        if (stateBefore == stateAfter || !resource)
+            return;
+
+        if (!visited.insert(resource).second)
+            return;
+
+        assert(count < std::size(barrier));
+        _Analysis_assume_(count < std::size(barrier));
+
+        barrier[count].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier[count].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        barrier[count].Transition.pResource = resource;
+        barrier[count].Transition.StateBefore = stateBefore;
+        barrier[count].Transition.StateAfter = stateAfter;
+        ++count;
+
+        if (count >= std::size(barrier))
+        {
+            commandList->ResourceBarrier(count, barrier);
+            count = 0;
+        }
+    };
+
     for (auto& mit : meshes)
     {
         for (auto& pit : mit->opaqueMeshParts)
         {
-            assert(count < std::size(barrier));
-            _Analysis_assume_(count < std::size(barrier));
+            addBarrier(pit->staticIndexBuffer.Get(), stateBeforeIB, stateAfterIB);
+            addBarrier(pit->staticVertexBuffer.Get(), stateBeforeVB, stateAfterVB);
+        }
 
-            if (stateBeforeIB != stateAfterIB && pit->staticIndexBuffer)
-            {
-                barrier[count].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-                barrier[count].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-                barrier[count].Transition.pResource = pit->staticIndexBuffer.Get();
-                barrier[count].Transition.StateBefore = stateBeforeIB;
-                barrier[count].Transition.StateAfter = stateAfterIB;
-                ++count;
-
-                if (count >= std::size(barrier))
-                {
-                    commandList->ResourceBarrier(count, barrier);
-                    count = 0;
-                }
-            }
+        for (auto& pit : mit->alphaMeshParts)
+        {
+            addBarrier(pit->staticIndexBuffer.Get(), stateBeforeIB, stateAfterIB);
+            addBarrier(pit->staticVertexBuffer.Get(), stateBeforeVB, stateAfterVB);
+        }
+    }
+
+    if (count > 0)
+    {
+        commandList->ResourceBarrier(count, barrier);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// ModelSkinningContext
+//--------------------------------------------------------------------------------------
 
-            if (stateBeforeVB != stateAfterVB && pit->staticVertexBuffer)
+ModelSkinningContext::ModelSkinningContext() noexcept :
+    mModel(nullptr),
+    mSlotCount(0),
+    mDirectSlot(c_NoSlot),
+    mRequiredBones(0)
+{
+}
+
+_Use_decl_annotations_
+ModelSkinningContext::ModelSkinningContext(ID3D12Device* device, const Model& model) :
+    mModel(nullptr),
+    mSlotCount(0),
+    mDirectSlot(c_NoSlot),
+    mRequiredBones(0)
+{
+    Reset(device, model);
+}
+
+
+// Assigns a palette slot to every mesh that skins and validates its influences.
+_Use_decl_annotations_
+void ModelSkinningContext::Reset(ID3D12Device* device, const Model& model)
+{
+    if (!device)
+    {
+        throw std::invalid_argument("Direct3D device is null");
+    }
+
+    auto hasSkinnedParts = [&](const ModelMesh& mesh) noexcept -> bool
+    {
+        for (const auto* parts : { &mesh.opaqueMeshParts, &mesh.alphaMeshParts })
+        {
+            for (const auto& part : *parts)
             {
-                barrier[count].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-                barrier[count].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-                barrier[count].Transition.pResource = pit->staticVertexBuffer.Get();
-                barrier[count].Transition.StateBefore = stateBeforeVB;
-                barrier[count].Transition.StateAfter = stateAfterVB;
-                ++count;
-
-                if (count >= std::size(barrier))
-                {
-                    commandList->ResourceBarrier(count, barrier);
-                    count = 0;
-                }
+                if (part->materialIndex < model.materials.size() && model.materials[part->materialIndex].enableSkinning)
+                    return true;
             }
         }
+        return false;
+    };
 
-        for (auto& pit : mit->alphaMeshParts)
+    std::vector<MeshPalette> meshPalettes;
+    meshPalettes.reserve(model.meshes.size());
+
+    std::vector<uint32_t> influences;
+    size_t requiredBones = 0;
+    size_t slotCount = 0;
+    size_t directSlot = c_NoSlot;
+
+    for (const auto& it : model.meshes)
+    {
+        auto mesh = it.get();
+        assert(mesh != nullptr);
+
+        const size_t count = mesh->boneInfluences.size();
+        if (count > IEffectSkinning::MaxBones)
         {
-            assert(count < std::size(barrier));
-            _Analysis_assume_(count < std::size(barrier));
+            throw std::runtime_error("Too many bones for skinning");
+        }
+
+        MeshPalette palette = { influences.size(), count, c_NoSlot };
 
-            if (stateBeforeIB != stateAfterIB && pit->staticIndexBuffer)
+        if (hasSkinnedParts(*mesh))
+        {
+            if (count > 0)
             {
-                barrier[count].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-                barrier[count].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-                barrier[count].Transition.pResource = pit->staticIndexBuffer.Get();
-                barrier[count].Transition.StateBefore = stateBeforeIB;
-                barrier[count].Transition.StateAfter = stateAfterIB;
-                ++count;
-
-                if (count >= std::size(barrier))
-                {
-                    commandList->ResourceBarrier(count, barrier);
-                    count = 0;
-                }
+                palette.slot = slotCount++;
             }
-
-            if (stateBeforeVB != stateAfterVB && pit->staticVertexBuffer)
+            else
             {
-                barrier[count].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-                barrier[count].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-                barrier[count].Transition.pResource = pit->staticVertexBuffer.Get();
-                barrier[count].Transition.StateBefore = stateBeforeVB;
-                barrier[count].Transition.StateAfter = stateAfterVB;
-                ++count;
-
-                if (count >= std::size(barrier))
+                if (directSlot == c_NoSlot)
                 {
-                    commandList->ResourceBarrier(count, barrier);
-                    count = 0;
+                    directSlot = slotCount++;
                 }
+                palette.slot = directSlot;
             }
         }
+
+        for (auto bone : mesh->boneInfluences)
+        {
+            requiredBones = std::max<size_t>(requiredBones, size_t(bone) + 1);
+            influences.push_back(bone);
+        }
+
+        meshPalettes.emplace_back(palette);
     }
 
-    if (count > 0)
+    mDevice = device;
+    mModel = &model;
+    mMeshes = std::move(meshPalettes);
+    mInfluences = std::move(influences);
+    mSlotCount = slotCount;
+    mDirectSlot = directSlot;
+    mRequiredBones = requiredBones;
+    mPalettes.Reset();
+}
+
+
+namespace
+{
+    inline void XM_CALLCONV StoreBone(_Out_writes_(3) XMVECTOR* dest, FXMMATRIX value) noexcept
     {
-        commandList->ResourceBarrier(count, barrier);
+    #if DIRECTX_MATH_VERSION >= 313
+        XMStoreFloat3x4A(reinterpret_cast<XMFLOAT3X4A*>(dest), value);
+    #else
+        // Xbox One XDK has an older version of DirectXMath
+        const XMMATRIX boneMatrix = XMMatrixTranspose(value);
+
+        dest[0] = boneMatrix.r[0];
+        dest[1] = boneMatrix.r[1];
+        dest[2] = boneMatrix.r[2];
+    #endif
+    }
+
+    // Unused entries are set to identity, like the effects' own palettes.
+    inline void ClearBones(_Out_writes_(count * 3) XMVECTOR* dest, size_t count) noexcept
+    {
+        for (size_t j = 0; j < count; ++j, dest += 3)
+        {
+            dest[0] = g_XMIdentityR0;
+            dest[1] = g_XMIdentityR1;
+            dest[2] = g_XMIdentityR2;
+        }
+    }
+}
+
+_Use_decl_annotations_
+void ModelSkinningContext::Update(size_t nbones, const XMMATRIX* boneTransforms)
+{
+    UpdateImpl(nullptr, nbones, boneTransforms);
+}
+
+
+_Use_decl_annotations_
+void ModelSkinningContext::Update(CommandListStateCache& commandList, size_t nbones, const XMMATRIX* boneTransforms)
+{
+    UpdateImpl(commandList.GetGraphicsMemory(), nbones, boneTransforms);
+}
+
+
+_Use_decl_annotations_
+void ModelSkinningContext::UpdateImpl(GraphicsMemoryContext* graphicsMemory, size_t nbones, const XMMATRIX* boneTransforms)
+{
+    if (!mModel)
+    {
+        throw std::runtime_error("ModelSkinningContext not initialized");
+    }
+
+    if (!mSlotCount)
+        return;
+
+    if (!boneTransforms || nbones < mRequiredBones)
+    {
+        throw std::runtime_error("Invalid bone influence index");
+    }
+
+    if (mDirectSlot != c_NoSlot && nbones > IEffectSkinning::MaxBones)
+    {
+        throw std::runtime_error("Too many bones for skinning");
+    }
+
+    const size_t size = mSlotCount * c_SlotSize;
+    mPalettes = (graphicsMemory)
+        ? graphicsMemory->Allocate(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, GraphicsMemory::TAG_CONSTANT)
+        : GraphicsMemory::Get(mDevice.Get()).Allocate(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, GraphicsMemory::TAG_CONSTANT);
+
+    auto base = static_cast<uint8_t*>(mPalettes.Memory());
+
+    if (mDirectSlot != c_NoSlot)
+    {
+        auto dest = reinterpret_cast<XMVECTOR*>(base + mDirectSlot * c_SlotSize);
+        for (size_t j = 0; j < nbones; ++j)
+        {
+            StoreBone(dest + j * 3, boneTransforms[j]);
+        }
+        ClearBones(dest + nbones * 3, IEffectSkinning::MaxBones - nbones);
+    }
+
+    for (const auto& it : mMeshes)
+    {
+        if (it.slot == c_NoSlot || it.slot == mDirectSlot)
+            continue;
+
+        auto dest = reinterpret_cast<XMVECTOR*>(base + it.slot * c_SlotSize);
+        const uint32_t* influences = mInfluences.data() + it.offset;
+        for (size_t j = 0; j < it.count; ++j)
+        {
+            StoreBone(dest + j * 3, boneTransforms[influences[j]]);
+        }
+        ClearBones(dest + it.count * 3, IEffectSkinning::MaxBones - it.count);
     }
 }
 
@@ -0,0 +1,479 @@
+//--------------------------------------------------------------------------------------
+// File: ModelCulling.cpp
+//
+// Frustum culling of model meshes against a four-wide bounding sphere hierarchy.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "Effects.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Frustum planes splatted for testing four spheres at once. A point is inside when
+    // x * nx + y * ny + z * nz + d >= 0 for all six planes.
+    struct FrustumPlanes
+    {
+        XMVECTOR nx[6];
+        XMVECTOR ny[6];
+        XMVECTOR nz[6];
+        XMVECTOR d[6];
+    };
+
+    // Extracts the clip planes of a D3D-style (0 <= z <= w) projection, in the space the matrix transforms from.
+    void XM_CALLCONV ExtractPlanes(FXMMATRIX m, FrustumPlanes& planes) noexcept
+    {
+        const XMMATRIX t = XMMatrixTranspose(m);
+
+        const XMVECTOR p[6] =
+        {
+            XMVectorAdd(t.r[3], t.r[0]),        // left
+            XMVectorSubtract(t.r[3], t.r[0]),   // right
+            XMVectorAdd(t.r[3], t.r[1]),        // bottom
+            XMVectorSubtract(t.r[3], t.r[1]),   // top
+            t.r[2],                             // near
+            XMVectorSubtract(t.r[3], t.r[2]),   // far
+        };
+
+        for (size_t j = 0; j < 6; ++j)
+        {
+            const XMVECTOR n = XMPlaneNormalize(p[j]);
+            planes.nx[j] = XMVectorSplatX(n);
+            planes.ny[j] = XMVectorSplatY(n);
+            planes.nz[j] = XMVectorSplatZ(n);
+            planes.d[j] = XMVectorSplatW(n);
+        }
+    }
+
+    // Tests four spheres (one per lane). 'visible' lanes intersect the frustum, 'contained' lanes are entirely inside it.
+    inline void XM_CALLCONV TestSpheres(
+        const FrustumPlanes& planes,
+        FXMVECTOR cx, FXMVECTOR cy, FXMVECTOR cz, GXMVECTOR radius,
+        XMVECTOR& visible, XMVECTOR& contained) noexcept
+    {
+        const XMVECTOR negRadius = XMVectorNegate(radius);
+
+        XMVECTOR in = XMVectorTrueInt();
+        XMVECTOR all = XMVectorTrueInt();
+        for (size_t j = 0; j < 6; ++j)
+        {
+            XMVECTOR dist = XMVectorMultiplyAdd(cx, planes.nx[j], planes.d[j]);
+            dist = XMVectorMultiplyAdd(cy, planes.ny[j], dist);
+            dist = XMVectorMultiplyAdd(cz, planes.nz[j], dist);
+
+            in = XMVectorAndInt(in, XMVectorGreaterOrEqual(dist, negRadius));
+            all = XMVectorAndInt(all, XMVectorGreaterOrEqual(dist, radius));
+        }
+
+        visible = in;
+        contained = XMVectorAndInt(all, in);
+    }
+
+    inline float MaxScale(CXMMATRIX m) noexcept
+    {
+        const XMVECTOR sx = XMVector3LengthSq(m.r[0]);
+        const XMVECTOR sy = XMVector3LengthSq(m.r[1]);
+        const XMVECTOR sz = XMVector3LengthSq(m.r[2]);
+        return sqrtf(XMVectorGetX(XMVectorMax(sx, XMVectorMax(sy, sz))));
+    }
+
+    struct BuildItem
+    {
+        BoundingSphere  sphere;
+        uint32_t        mesh;
+    };
+
+    BoundingSphere MergeSpheres(const BuildItem* first, const BuildItem* last) noexcept
+    {
+        assert(first != last);
+        BoundingSphere result = first->sphere;
+        for (auto it = first + 1; it != last; ++it)
+        {
+            BoundingSphere::CreateMerged(result, result, it->sphere);
+        }
+        return result;
+    }
+
+    // Sorts the range along the axis where the sphere centers spread the most and returns the midpoint.
+    BuildItem* SplitRange(BuildItem* first, BuildItem* last) noexcept
+    {
+        XMVECTOR vmin = g_XMFltMax;
+        XMVECTOR vmax = XMVectorNegate(g_XMFltMax);
+        for (auto it = first; it != last; ++it)
+        {
+            const XMVECTOR c = XMLoadFloat3(&it->sphere.Center);
+            vmin = XMVectorMin(vmin, c);
+            vmax = XMVectorMax(vmax, c);
+        }
+
+        XMFLOAT3 extent;
+        XMStoreFloat3(&extent, XMVectorSubtract(vmax, vmin));
+
+        int axis = 0;
+        if (extent.y > extent.x && extent.y >= extent.z)
+            axis = 1;
+        else if (extent.z > extent.x && extent.z > extent.y)
+            axis = 2;
+
+        auto mid = first + (last - first) / 2;
+        std::nth_element(first, mid, last, [axis](const BuildItem& a, const BuildItem& b) noexcept
+            {
+                const float* ca = &a.sphere.Center.x;
+                const float* cb = &b.sphere.Center.x;
+                return ca[axis] < cb[axis];
+            });
+        return mid;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Builds the culling hierarchy. Each node holds up to four children; ranges of four or
+// fewer meshes become leaves, larger ones are split into quarters along their widest axis.
+void Model::UpdateCullingBounds()
+{
+    cullNodes.clear();
+    cullUnbounded.clear();
+    cullSkinned.clear();
+    cullMeshCount = 0;
+
+    if (meshes.size() >= c_CullLeaf)
+    {
+        throw std::runtime_error("Too many meshes for culling");
+    }
+
+    std::vector<uint8_t> skinned(meshes.size(), 0);
+    std::vector<uint32_t> unbounded;
+
+    std::vector<BuildItem> items;
+    items.reserve(meshes.size());
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        auto mesh = meshes[i].get();
+        assert(mesh != nullptr);
+
+        bool skins = !mesh->boneInfluences.empty();
+        for (const auto* parts : { &mesh->opaqueMeshParts, &mesh->alphaMeshParts })
+        {
+            for (const auto& part : *parts)
+            {
+                if (part->materialIndex < materials.size() && materials[part->materialIndex].enableSkinning)
+                    skins = true;
+            }
+        }
+        skinned[i] = skins ? 1 : 0;
+
+        // Skinned meshes can't be bounded from the bind pose, so they are kept out of the hierarchy like
+        // meshes without bounds, as the bone Cull does.
+        if (skins || !(mesh->boundingSphere.Radius > 0.f))
+        {
+            unbounded.push_back(static_cast<uint32_t>(i));
+            continue;
+        }
+
+        items.emplace_back(BuildItem{ mesh->boundingSphere, static_cast<uint32_t>(i) });
+    }
+
+    std::vector<CullNode> nodes;
+
+    if (!items.empty())
+    {
+        struct Pending
+        {
+            uint32_t    node;
+            BuildItem*  first;
+            BuildItem*  last;
+        };
+
+        std::vector<Pending> stack;
+
+        nodes.emplace_back();
+        stack.push_back({ 0, items.data(), items.data() + items.size() });
+
+        while (!stack.empty())
+        {
+            const Pending work = stack.back();
+            stack.pop_back();
+
+            BuildItem* groups[5] = {};
+            size_t ngroups = 0;
+
+            const auto count = work.last - work.first;
+            if (count <= 4)
+            {
+                for (auto it = work.first; it != work.last; ++it)
+                    groups[ngroups++] = it;
+                groups[ngroups] = work.last;
+            }
+            else
+            {
+                auto mid = SplitRange(work.first, work.last);
+                groups[0] = work.first;
+                groups[1] = SplitRange(work.first, mid);
+                groups[2] = mid;
+                groups[3] = SplitRange(mid, work.last);
+                groups[4] = work.last;
+                ngroups = 4;
+            }
+
+            float cx[4] = {}, cy[4] = {}, cz[4] = {};
+            float radius[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            uint32_t children[4] = { c_CullEmpty, c_CullEmpty, c_CullEmpty, c_CullEmpty };
+
+            for (size_t j = 0; j < ngroups; ++j)
+            {
+                const BuildItem* first = groups[j];
+                const BuildItem* last = groups[j + 1];
+                if (first == last)
+                    continue;
+
+                const BoundingSphere bounds = MergeSpheres(first, last);
+                cx[j] = bounds.Center.x;
+                cy[j] = bounds.Center.y;
+                cz[j] = bounds.Center.z;
+                radius[j] = bounds.Radius;
+
+                if (last - first == 1)
+                {
+                    children[j] = first->mesh | c_CullLeaf;
+                }
+                else
+                {
+                    children[j] = static_cast<uint32_t>(nodes.size());
+                    nodes.emplace_back();
+                    stack.push_back({ children[j], groups[j], groups[j + 1] });
+                }
+            }
+
+            auto& node = nodes[work.node];
+            node.centerX = XMFLOAT4(cx);
+            node.centerY = XMFLOAT4(cy);
+            node.centerZ = XMFLOAT4(cz);
+            node.radius = XMFLOAT4(radius);
+            memcpy(node.children, children, sizeof(children));
+        }
+    }
+
+    cullNodes = std::move(nodes);
+    cullUnbounded = std::move(unbounded);
+    cullSkinned = std::move(skinned);
+    cullMeshCount = meshes.size();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Culls against the hierarchy. The planes are taken from world * viewProjection, so the
+// spheres are tested in model space and the hierarchy never has to be transformed.
+_Use_decl_annotations_
+void XM_CALLCONV Model::Cull(
+    FXMMATRIX world,
+    CXMMATRIX viewProjection,
+    ModelVisibility& visibility) const
+{
+    const size_t nmeshes = meshes.size();
+
+    visibility.visible.assign(nmeshes, 0);
+    visibility.visibleCount = 0;
+    visibility.culledCount = 0;
+    visibility.spheresTested = 0;
+
+    if (cullMeshCount != nmeshes)
+    {
+        DebugTrace("WARNING: Model::Cull called without UpdateCullingBounds; drawing all meshes\n");
+        visibility.visible.assign(nmeshes, 1);
+        visibility.visibleCount = nmeshes;
+        return;
+    }
+
+    for (auto mesh : cullUnbounded)
+    {
+        visibility.visible[mesh] = 1;
+    }
+
+    if (!cullNodes.empty())
+    {
+        FrustumPlanes planes;
+        ExtractPlanes(XMMatrixMultiply(world, viewProjection), planes);
+
+        // Node index, with c_CullLeaf set if the whole subtree is already known to be inside.
+        std::vector<uint32_t> stack;
+        stack.reserve(64);
+        stack.push_back(0);
+
+        while (!stack.empty())
+        {
+            const uint32_t entry = stack.back();
+            stack.pop_back();
+
+            const bool accept = (entry & c_CullLeaf) != 0;
+            const CullNode& node = cullNodes[entry & ~c_CullLeaf];
+
+            uint32_t visibleMask[4] = { 1, 1, 1, 1 };
+            uint32_t containedMask[4] = { 1, 1, 1, 1 };
+
+            if (!accept)
+            {
+                XMVECTOR visible, contained;
+                TestSpheres(planes,
+                    XMLoadFloat4(&node.centerX), XMLoadFloat4(&node.centerY), XMLoadFloat4(&node.centerZ),
+                    XMLoadFloat4(&node.radius),
+                    visible, contained);
+
+                XMStoreInt4(visibleMask, visible);
+                XMStoreInt4(containedMask, contained);
+
+                for (size_t j = 0; j < 4; ++j)
+                {
+                    if (node.children[j] != c_CullEmpty)
+                        ++visibility.spheresTested;
+                }
+            }
+
+            for (size_t j = 0; j < 4; ++j)
+            {
+                const uint32_t child = node.children[j];
+                if (child == c_CullEmpty || !visibleMask[j])
+                    continue;
+
+                if (child & c_CullLeaf)
+                {
+                    visibility.visible[child & ~c_CullLeaf] = 1;
+                }
+                else
+                {
+                    stack.push_back(containedMask[j] ? (child | c_CullLeaf) : child);
+                }
+            }
+        }
+    }
+
+    for (auto v : visibility.visible)
+    {
+        visibility.visibleCount += v;
+    }
+    visibility.culledCount = nmeshes - visibility.visibleCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Culls each mesh with its bone transform applied, four meshes per test. Bone transforms
+// move meshes independently, so the hierarchy isn't used here.
+_Use_decl_annotations_
+void XM_CALLCONV Model::Cull(
+    size_t nbones,
+    const XMMATRIX* boneTransforms,
+    FXMMATRIX world,
+    CXMMATRIX viewProjection,
+    ModelVisibility& visibility) const
+{
+    assert(nbones > 0 && boneTransforms != nullptr);
+
+    const size_t nmeshes = meshes.size();
+
+    visibility.visible.assign(nmeshes, 0);
+    visibility.visibleCount = 0;
+    visibility.culledCount = 0;
+    visibility.spheresTested = 0;
+
+    FrustumPlanes planes;
+    ExtractPlanes(viewProjection, planes);
+
+    const float worldScale = MaxScale(world);
+
+    XM_ALIGNED_DATA(16) float cx[4];
+    XM_ALIGNED_DATA(16) float cy[4];
+    XM_ALIGNED_DATA(16) float cz[4];
+    XM_ALIGNED_DATA(16) float radius[4];
+    uint32_t batch[4] = {};
+    size_t nbatch = 0;
+
+    auto flush = [&]()
+    {
+        for (size_t j = nbatch; j < 4; ++j)
+        {
+            cx[j] = cy[j] = cz[j] = 0.f;
+            radius[j] = -FLT_MAX;
+        }
+
+        XMVECTOR visible, contained;
+        TestSpheres(planes, XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(cx)),
+            XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(cy)),
+            XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(cz)),
+            XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(radius)),
+            visible, contained);
+
+        uint32_t visibleMask[4];
+        XMStoreInt4(visibleMask, visible);
+
+        for (size_t j = 0; j < nbatch; ++j)
+        {
+            if (visibleMask[j])
+                visibility.visible[batch[j]] = 1;
+        }
+
+        visibility.spheresTested += nbatch;
+        nbatch = 0;
+    };
+
+    const bool haveFlags = (cullMeshCount == nmeshes);
+
+    for (size_t i = 0; i < nmeshes; ++i)
+    {
+        auto mesh = meshes[i].get();
+        assert(mesh != nullptr);
+
+        const bool skins = haveFlags ? (cullSkinned[i] != 0) : !mesh->boneInfluences.empty();
+        if (skins || !(mesh->boundingSphere.Radius > 0.f))
+        {
+            visibility.visible[i] = 1;
+            continue;
+        }
+
+        XMVECTOR center = XMLoadFloat3(&mesh->boundingSphere.Center);
+        float scale = worldScale;
+        if (mesh->boneIndex != ModelBone::c_Invalid && mesh->boneIndex < nbones)
+        {
+            const XMMATRIX local = XMMatrixMultiply(boneTransforms[mesh->boneIndex], world);
+            center = XMVector3Transform(center, local);
+            scale = MaxScale(local);
+        }
+        else
+        {
+            center = XMVector3Transform(center, world);
+        }
+
+        XMFLOAT3 c;
+        XMStoreFloat3(&c, center);
+        cx[nbatch] = c.x;
+        cy[nbatch] = c.y;
+        cz[nbatch] = c.z;
+        radius[nbatch] = mesh->boundingSphere.Radius * scale;
+        batch[nbatch] = static_cast<uint32_t>(i);
+
+        if (++nbatch == 4)
+        {
+            flush();
+        }
+    }
+
+    if (nbatch > 0)
+    {
+        flush();
+    }
+
+    for (auto v : visibility.visible)
+    {
+        visibility.visibleCount += v;
+    }
+    visibility.culledCount = nmeshes - visibility.visibleCount;
+}
@@ -0,0 +1,130 @@
+//--------------------------------------------------------------------------------------
+// File: ModelFileView.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    struct view_deleter { void operator()(const void* p) noexcept { if (p) UnmapViewOfFile(p); } };
+
+    using ScopedView = std::unique_ptr<const void, view_deleter>;
+}
+
+
+// Internal ModelFileView implementation class.
+class ModelFileView::Impl
+{
+public:
+    explicit Impl(_In_z_ const wchar_t* szFileName) :
+        mSize(0),
+        mFileName(szFileName)
+    {
+        // Open the file.
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+        ScopedHandle hFile(safe_handle(CreateFile2(
+            szFileName,
+            GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING,
+            nullptr)));
+#else
+        ScopedHandle hFile(safe_handle(CreateFileW(
+            szFileName,
+            GENERIC_READ, FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+            nullptr)));
+#endif
+
+        if (!hFile)
+        {
+            DebugTrace("ERROR: ModelFileView failed (%08X) to open '%ls'\n",
+                static_cast<unsigned int>(HRESULT_FROM_WIN32(GetLastError())), szFileName);
+            throw std::runtime_error("ModelFileView");
+        }
+
+        // Get the file size.
+        FILE_STANDARD_INFO fileInfo;
+        if (!GetFileInformationByHandleEx(hFile.get(), FileStandardInfo, &fileInfo, sizeof(fileInfo)))
+        {
+            throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "GetFileInformationByHandleEx");
+        }
+
+        if (!fileInfo.EndOfFile.QuadPart)
+            throw std::runtime_error("ModelFileView: file is empty");
+
+#ifndef _WIN64
+        // File is too big for a 32-bit view, so reject mapping.
+        if (fileInfo.EndOfFile.HighPart > 0)
+            throw std::runtime_error("ModelFileView: file is too large for this platform");
+#endif
+
+        // Map the entire file read-only. The mapping object keeps the file open after the handle is closed.
+        ScopedHandle hMapping(CreateFileMappingW(hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (!hMapping)
+        {
+            throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateFileMappingW");
+        }
+
+        mView.reset(MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0));
+        if (!mView)
+        {
+            throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "MapViewOfFile");
+        }
+
+        mSize = static_cast<size_t>(fileInfo.EndOfFile.QuadPart);
+    }
+
+    const uint8_t* GetData() const noexcept { return static_cast<const uint8_t*>(mView.get()); }
+    size_t GetSize() const noexcept { return mSize; }
+    const wchar_t* GetFileName() const noexcept { return mFileName.c_str(); }
+
+private:
+    ScopedView      mView;
+    size_t          mSize;
+    std::wstring    mFileName;
+};
+
+
+// Public constructor.
+_Use_decl_annotations_
+ModelFileView::ModelFileView(const wchar_t* szFileName)
+{
+    if (!szFileName)
+        throw std::invalid_argument("ModelFileView");
+
+    pImpl = std::make_unique<Impl>(szFileName);
+}
+
+
+ModelFileView::ModelFileView(ModelFileView&&) noexcept = default;
+ModelFileView& ModelFileView::operator= (ModelFileView&&) noexcept = default;
+ModelFileView::~ModelFileView() = default;
+
+
+// Public accessors.
+const uint8_t* ModelFileView::GetData() const noexcept
+{
+    return pImpl ? pImpl->GetData() : nullptr;
+}
+
+
+size_t ModelFileView::GetSize() const noexcept
+{
+    return pImpl ? pImpl->GetSize() : 0;
+}
+
+
+const wchar_t* ModelFileView::GetFileName() const noexcept
+{
+    return pImpl ? pImpl->GetFileName() : nullptr;
+}
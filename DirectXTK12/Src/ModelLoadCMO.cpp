@@ -754,6 +754,8 @@ std::unique_ptr<Model> DirectX::Model::CreateFromCMO(
             std::swap(model->boneMatrices, transforms);
             std::swap(model->invBindPoseMatrices, invTransforms);
 
+            model->UpdateBoneOrder();
+
             // Animation Clips
             if (animsOffset)
             {
@@ -965,6 +967,8 @@ std::unique_ptr<Model> DirectX::Model::CreateFromCMO(
         model->textureNames[static_cast<size_t>(texture->second)] = texture->first;
     }
 
+    model->UpdateCullingBounds();
+
     return model;
 }
 
@@ -982,17 +986,9 @@ std::unique_ptr<Model> DirectX::Model::CreateFromCMO(
         *animsOffset = 0;
     }
 
-    size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile(szFileName, data, &dataSize);
-    if (FAILED(hr))
-    {
-        DebugTrace("ERROR: CreateFromCMO failed (%08X) loading '%ls'\n",
-            static_cast<unsigned int>(hr), szFileName);
-        throw std::runtime_error("CreateFromCMO");
-    }
+    const ModelFileView fileView(szFileName);
 
-    auto model = CreateFromCMO(device, data.get(), dataSize, flags, animsOffset);
+    auto model = CreateFromCMO(device, fileView.GetData(), fileView.GetSize(), flags, animsOffset);
 
     model->name = szFileName;
 
@@ -0,0 +1,463 @@
+//--------------------------------------------------------------------------------------
+// File: ModelLoadDTKMODEL.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "Effects.h"
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+#include "DTKModel.h"
+
+using namespace DirectX;
+
+static_assert(sizeof(wchar_t) == sizeof(uint16_t), "DTKMODEL strings are UTF-16");
+
+namespace
+{
+    const char* const s_semanticNames[DTKMODEL::SEMANTIC_COUNT] =
+    {
+        "SV_Position",
+        "NORMAL",
+        "COLOR",
+        "TANGENT",
+        "BINORMAL",
+        "TEXCOORD",
+        "BLENDINDICES",
+        "BLENDWEIGHT",
+    };
+
+    template<typename T>
+    const T* GetSection(
+        _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize,
+        const DTKMODEL::DTKMODEL_SECTION& section)
+    {
+        if (!section.Count)
+            return nullptr;
+
+        if (section.Offset > dataSize
+            || section.Count > ((dataSize - section.Offset) / sizeof(T)))
+            throw std::runtime_error("End of file");
+
+        if (section.Offset % alignof(T))
+            throw std::runtime_error("Misaligned section in DTKMODEL");
+
+        return reinterpret_cast<const T*>(meshData + section.Offset);
+    }
+
+    class StringPool
+    {
+    public:
+        StringPool(const wchar_t* strings, uint64_t count) noexcept :
+            mStrings(strings),
+            mCount(count)
+        {
+        }
+
+        std::wstring Get(const DTKMODEL::DTKMODEL_STRING& str) const
+        {
+            if (!str.Length)
+                return std::wstring();
+
+            if (uint64_t(str.Offset) + uint64_t(str.Length) > mCount)
+                throw std::out_of_range("Invalid string in DTKMODEL");
+
+            return std::wstring(mStrings + str.Offset, str.Length);
+        }
+
+    private:
+        const wchar_t*  mStrings;
+        uint64_t        mCount;
+    };
+
+    inline XMMATRIX LoadMatrix(const float* m) noexcept
+    {
+        return XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(m));
+    }
+
+    // The views and draw for a part are built from these values as-is, so they must stay inside the
+    // buffers they reference.
+    void ValidateMeshPart(
+        const DTKMODEL::DTKMODEL_MESH_PART& ph,
+        const DTKMODEL::DTKMODEL_BUFFER& ib,
+        const DTKMODEL::DTKMODEL_BUFFER& vb)
+    {
+        if (ib.Type != DTKMODEL::BUFFER_INDEX || vb.Type != DTKMODEL::BUFFER_VERTEX)
+            throw std::runtime_error("Invalid buffer type found in mesh part");
+
+        uint64_t indexSize;
+        switch (ph.IndexFormat)
+        {
+        case DXGI_FORMAT_R16_UINT: indexSize = sizeof(uint16_t); break;
+        case DXGI_FORMAT_R32_UINT: indexSize = sizeof(uint32_t); break;
+        default:
+            throw std::runtime_error("Invalid index format found in mesh part");
+        }
+
+        switch (ph.PrimitiveType)
+        {
+        case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:
+        case D3D_PRIMITIVE_TOPOLOGY_LINELIST:
+        case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:
+        case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:
+        case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP:
+        case D3D_PRIMITIVE_TOPOLOGY_LINELIST_ADJ:
+        case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ:
+        case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ:
+        case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP_ADJ:
+            break;
+
+        default:
+            throw std::runtime_error("Unknown primitive type");
+        }
+
+        if (!ph.IndexBufferSize || ph.IndexBufferSize > ib.SizeBytes
+            || !ph.VertexBufferSize || ph.VertexBufferSize > vb.SizeBytes)
+            throw std::runtime_error("Invalid buffer size found in mesh part");
+
+        if ((uint64_t(ph.StartIndex) + uint64_t(ph.IndexCount)) * indexSize > ph.IndexBufferSize)
+            throw std::runtime_error("Invalid index range found in mesh part");
+
+        if (!ph.VertexStride || ph.VertexStride > D3D12_REQ_MULTI_ELEMENT_STRUCTURE_SIZE_IN_BYTES
+            || ph.VertexOffset < 0
+            || (uint64_t(ph.VertexOffset) + uint64_t(ph.VertexCount)) * ph.VertexStride > ph.VertexBufferSize)
+            throw std::runtime_error("Invalid vertex range found in mesh part");
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromDTKMODEL(
+    ID3D12Device* device,
+    const uint8_t* meshData, size_t dataSize,
+    ModelLoaderFlags flags)
+{
+    if (!meshData)
+        throw std::invalid_argument("meshData cannot be null");
+
+    // File Header
+    if (dataSize < sizeof(DTKMODEL::DTKMODEL_HEADER))
+        throw std::runtime_error("End of file");
+    auto header = reinterpret_cast<const DTKMODEL::DTKMODEL_HEADER*>(meshData);
+
+    if (header->Magic != DTKMODEL::DTKMODEL_MAGIC)
+        throw std::runtime_error("Not a DTKMODEL file");
+
+    if (header->Version != DTKMODEL::DTKMODEL_FILE_VERSION)
+    {
+        DebugTrace("ERROR: DTKMODEL version %u is not supported (expected %u)\n", header->Version, DTKMODEL::DTKMODEL_FILE_VERSION);
+        throw std::runtime_error("Not a supported DTKMODEL file");
+    }
+
+    if (header->HeaderSize != sizeof(DTKMODEL::DTKMODEL_HEADER)
+        || header->FileSize > dataSize)
+        throw std::runtime_error("Invalid DTKMODEL header");
+
+    if (!header->Meshes.Count || header->Meshes.Count > UINT32_MAX
+        || header->MeshParts.Count > UINT32_MAX
+        || header->Buffers.Count > UINT32_MAX
+        || header->Bones.Count > UINT32_MAX)
+        throw std::runtime_error("Invalid DTKMODEL header");
+
+    auto bufferArray = GetSection<DTKMODEL::DTKMODEL_BUFFER>(meshData, dataSize, header->Buffers);
+    auto layoutArray = GetSection<DTKMODEL::DTKMODEL_INPUT_LAYOUT>(meshData, dataSize, header->InputLayouts);
+    auto elementArray = GetSection<DTKMODEL::DTKMODEL_INPUT_ELEMENT>(meshData, dataSize, header->InputElements);
+    auto meshArray = GetSection<DTKMODEL::DTKMODEL_MESH>(meshData, dataSize, header->Meshes);
+    auto partArray = GetSection<DTKMODEL::DTKMODEL_MESH_PART>(meshData, dataSize, header->MeshParts);
+    auto influenceArray = GetSection<uint32_t>(meshData, dataSize, header->BoneInfluences);
+    auto materialArray = GetSection<DTKMODEL::DTKMODEL_MATERIAL>(meshData, dataSize, header->Materials);
+    auto textureArray = GetSection<DTKMODEL::DTKMODEL_STRING>(meshData, dataSize, header->Textures);
+    auto boneArray = GetSection<DTKMODEL::DTKMODEL_BONE>(meshData, dataSize, header->Bones);
+    auto boneMatrixArray = GetSection<float[16]>(meshData, dataSize, header->BoneMatrices);
+    auto invBindPoseArray = GetSection<float[16]>(meshData, dataSize, header->InvBindPoseMatrices);
+
+    const StringPool strings(GetSection<wchar_t>(meshData, dataSize, header->Strings), header->Strings.Count);
+
+    if (header->Data.Offset > dataSize
+        || header->Data.Count > (dataSize - header->Data.Offset))
+        throw std::runtime_error("End of file");
+
+    if (header->Data.Offset % DTKMODEL::DATA_ALIGNMENT)
+        throw std::runtime_error("Misaligned data in DTKMODEL");
+
+    const uint8_t* bufferData = meshData + header->Data.Offset;
+
+    // Input layouts
+    std::vector<std::shared_ptr<ModelMeshPart::InputLayoutCollection>> vbDecls;
+    vbDecls.resize(static_cast<size_t>(header->InputLayouts.Count));
+    for (size_t j = 0; j < vbDecls.size(); ++j)
+    {
+        const auto& layout = layoutArray[j];
+
+        if (uint64_t(layout.FirstElement) + uint64_t(layout.NumElements) > header->InputElements.Count
+            || layout.NumElements > D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT)
+            throw std::out_of_range("Invalid input layout in DTKMODEL");
+
+        auto decl = std::make_shared<ModelMeshPart::InputLayoutCollection>();
+        decl->reserve(layout.NumElements);
+        for (size_t k = 0; k < layout.NumElements; ++k)
+        {
+            const auto& element = elementArray[layout.FirstElement + k];
+            if (element.Semantic >= DTKMODEL::SEMANTIC_COUNT)
+                throw std::out_of_range("Invalid input element semantic in DTKMODEL");
+
+            const D3D12_INPUT_ELEMENT_DESC desc =
+            {
+                s_semanticNames[element.Semantic],
+                element.SemanticIndex,
+                static_cast<DXGI_FORMAT>(element.Format),
+                element.InputSlot,
+                element.AlignedByteOffset,
+                static_cast<D3D12_INPUT_CLASSIFICATION>(element.InputSlotClass),
+                element.InstanceDataStepRate
+            };
+            decl->push_back(desc);
+        }
+
+        vbDecls[j] = std::move(decl);
+    }
+
+    // Vertex & index buffers are copied as-is into upload memory
+    std::vector<SharedGraphicsResource> buffers;
+    buffers.resize(static_cast<size_t>(header->Buffers.Count));
+    for (size_t j = 0; j < buffers.size(); ++j)
+    {
+        const auto& bh = bufferArray[j];
+
+        if (!bh.SizeBytes)
+            throw std::runtime_error("Empty buffer in DTKMODEL");
+
+        if (!(flags & ModelLoader_AllowLargeModels))
+        {
+            if (bh.SizeBytes > (D3D12_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM * 1024u * 1024u))
+                throw std::runtime_error((bh.Type == DTKMODEL::BUFFER_INDEX) ? "IB too large for DirectX 12" : "VB too large for DirectX 12");
+        }
+
+        if (bh.DataOffset > header->Data.Count
+            || bh.SizeBytes > (header->Data.Count - bh.DataOffset))
+            throw std::runtime_error("End of file");
+
+        buffers[j] = GraphicsMemory::Get(device).Allocate(bh.SizeBytes, 16,
+            (bh.Type == DTKMODEL::BUFFER_INDEX) ? GraphicsMemory::TAG_INDEX : GraphicsMemory::TAG_VERTEX);
+        memcpy(buffers[j].Memory(), bufferData + bh.DataOffset, bh.SizeBytes);
+    }
+
+    // Materials
+    auto model = std::make_unique<Model>();
+
+    model->materials.resize(static_cast<size_t>(header->Materials.Count));
+    for (size_t j = 0; j < model->materials.size(); ++j)
+    {
+        const auto& mh = materialArray[j];
+        auto& m = model->materials[j];
+
+        m.name = strings.Get(mh.Name);
+        m.perVertexColor = (mh.Flags & DTKMODEL::MATERIAL_PER_VERTEX_COLOR) != 0;
+        m.enableSkinning = (mh.Flags & DTKMODEL::MATERIAL_SKINNING) != 0 && !(flags & ModelLoader_DisableSkinning);
+        m.enableDualTexture = (mh.Flags & DTKMODEL::MATERIAL_DUAL_TEXTURE) != 0;
+        m.enableNormalMaps = (mh.Flags & DTKMODEL::MATERIAL_NORMAL_MAPS) != 0;
+        m.biasedVertexNormals = (mh.Flags & DTKMODEL::MATERIAL_BIASED_VERTEX_NORMALS) != 0;
+        m.specularPower = mh.SpecularPower;
+        m.alphaValue = mh.Alpha;
+        m.ambientColor = XMFLOAT3(mh.Ambient);
+        m.diffuseColor = XMFLOAT3(mh.Diffuse);
+        m.specularColor = XMFLOAT3(mh.Specular);
+        m.emissiveColor = XMFLOAT3(mh.Emissive);
+        m.diffuseTextureIndex = mh.DiffuseTexture;
+        m.specularTextureIndex = mh.SpecularTexture;
+        m.normalTextureIndex = mh.NormalTexture;
+        m.emissiveTextureIndex = mh.EmissiveTexture;
+        m.samplerIndex = mh.SamplerIndex;
+        m.samplerIndex2 = mh.SamplerIndex2;
+    }
+
+    model->textureNames.resize(static_cast<size_t>(header->Textures.Count));
+    for (size_t j = 0; j < model->textureNames.size(); ++j)
+    {
+        model->textureNames[j] = strings.Get(textureArray[j]);
+    }
+
+    // Meshes
+    const bool includeBones = (flags & ModelLoader_IncludeBones) != 0;
+
+    model->meshes.reserve(static_cast<size_t>(header->Meshes.Count));
+    for (size_t meshIndex = 0; meshIndex < header->Meshes.Count; ++meshIndex)
+    {
+        const auto& mh = meshArray[meshIndex];
+
+        auto mesh = std::make_shared<ModelMesh>();
+        mesh->name = strings.Get(mh.Name);
+        mesh->boundingSphere.Center = XMFLOAT3(mh.BoundingSphere);
+        mesh->boundingSphere.Radius = mh.BoundingSphere[3];
+        mesh->boundingBox.Center = XMFLOAT3(mh.BoxCenter);
+        mesh->boundingBox.Extents = XMFLOAT3(mh.BoxExtents);
+
+        if (includeBones)
+        {
+            if (mh.BoneIndex != DTKMODEL::INVALID_INDEX && mh.BoneIndex >= header->Bones.Count)
+                throw std::out_of_range("Invalid bone index found in mesh data");
+
+            mesh->boneIndex = mh.BoneIndex;
+
+            if (mh.NumBoneInfluences > 0)
+            {
+                if (uint64_t(mh.FirstBoneInfluence) + uint64_t(mh.NumBoneInfluences) > header->BoneInfluences.Count)
+                    throw std::runtime_error("End of file");
+
+                mesh->boneInfluences.assign(influenceArray + mh.FirstBoneInfluence,
+                    influenceArray + mh.FirstBoneInfluence + mh.NumBoneInfluences);
+            }
+        }
+
+        const uint64_t numParts = uint64_t(mh.NumOpaqueParts) + uint64_t(mh.NumAlphaParts);
+        if (uint64_t(mh.FirstPart) + numParts > header->MeshParts.Count)
+            throw std::out_of_range("Invalid mesh part range in DTKMODEL");
+
+        for (uint32_t j = 0; j < numParts; ++j)
+        {
+            const auto& ph = partArray[mh.FirstPart + j];
+
+            if (ph.MaterialIndex >= header->Materials.Count && header->Materials.Count > 0)
+                throw std::out_of_range("Invalid material index found in mesh part");
+
+            if (ph.InputLayout >= vbDecls.size()
+                || ph.VertexBuffer >= buffers.size()
+                || ph.IndexBuffer >= buffers.size())
+                throw std::out_of_range("Invalid mesh part in DTKMODEL");
+
+            ValidateMeshPart(ph, bufferArray[ph.IndexBuffer], bufferArray[ph.VertexBuffer]);
+
+            auto part = new ModelMeshPart(ph.PartIndex);
+            part->materialIndex = ph.MaterialIndex;
+            part->indexCount = ph.IndexCount;
+            part->startIndex = ph.StartIndex;
+            part->vertexOffset = ph.VertexOffset;
+            part->vertexStride = ph.VertexStride;
+            part->vertexCount = ph.VertexCount;
+            part->indexBufferSize = ph.IndexBufferSize;
+            part->vertexBufferSize = ph.VertexBufferSize;
+            part->primitiveType = static_cast<D3D_PRIMITIVE_TOPOLOGY>(ph.PrimitiveType);
+            part->indexFormat = static_cast<DXGI_FORMAT>(ph.IndexFormat);
+            part->indexBuffer = buffers[ph.IndexBuffer];
+            part->vertexBuffer = buffers[ph.VertexBuffer];
+            part->vbDecl = vbDecls[ph.InputLayout];
+
+            if (j < mh.NumOpaqueParts)
+            {
+                mesh->opaqueMeshParts.emplace_back(part);
+            }
+            else
+            {
+                mesh->alphaMeshParts.emplace_back(part);
+            }
+        }
+
+        model->meshes.emplace_back(mesh);
+    }
+
+    // Bones, bind pose and its inverse are stored already computed
+    if (includeBones && header->Bones.Count > 0)
+    {
+        const auto nbones = static_cast<size_t>(header->Bones.Count);
+
+        ModelBone::Collection bones;
+        bones.reserve(nbones);
+        for (size_t j = 0; j < nbones; ++j)
+        {
+            const auto& bh = boneArray[j];
+
+            if ((bh.ParentIndex != ModelBone::c_Invalid && bh.ParentIndex >= nbones)
+                || (bh.ChildIndex != ModelBone::c_Invalid && bh.ChildIndex >= nbones)
+                || (bh.SiblingIndex != ModelBone::c_Invalid && bh.SiblingIndex >= nbones))
+                throw std::out_of_range("Invalid bone index found in bone data");
+
+            ModelBone bone(bh.ParentIndex, bh.ChildIndex, bh.SiblingIndex);
+            bone.name = strings.Get(bh.Name);
+            bones.emplace_back(bone);
+        }
+
+        std::swap(model->bones, bones);
+
+        if (header->BoneMatrices.Count == nbones)
+        {
+            auto transforms = ModelBone::MakeArray(nbones);
+            for (size_t j = 0; j < nbones; ++j)
+            {
+                transforms[j] = LoadMatrix(boneMatrixArray[j]);
+            }
+            std::swap(model->boneMatrices, transforms);
+        }
+
+        if (header->InvBindPoseMatrices.Count == nbones)
+        {
+            auto invTransforms = ModelBone::MakeArray(nbones);
+            for (size_t j = 0; j < nbones; ++j)
+            {
+                invTransforms[j] = LoadMatrix(invBindPoseArray[j]);
+            }
+            std::swap(model->invBindPoseMatrices, invTransforms);
+        }
+
+        model->UpdateBoneOrder();
+    }
+
+    model->name = strings.Get(header->Name);
+
+    model->UpdateCullingBounds();
+
+    return model;
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromDTKMODEL(
+    ID3D12Device* device,
+    const wchar_t* szFileName,
+    ModelLoaderFlags flags)
+{
+    const ModelFileView fileView(szFileName);
+
+    return CreateFromDTKMODEL(device, fileView, flags);
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromDTKMODEL(
+    ID3D12Device* device,
+    const ModelFileView& fileView,
+    ModelLoaderFlags flags)
+{
+    auto model = CreateFromDTKMODEL(device, fileView.GetData(), fileView.GetSize(), flags);
+
+    model->name = fileView.GetFileName();
+
+    return model;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adapters for /Zc:wchar_t- clients
+
+#if defined(_MSC_VER) && !defined(_NATIVE_WCHAR_T_DEFINED)
+
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromDTKMODEL(
+    ID3D12Device* device,
+    const __wchar_t* szFileName,
+    ModelLoaderFlags flags)
+{
+    return CreateFromDTKMODEL(device, reinterpret_cast<const unsigned short*>(szFileName), flags);
+}
+
+#endif
@@ -555,6 +555,18 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
     std::vector<ModelMaterialInfo> materials;
     materials.resize(header->NumMaterials);
 
+    // Materials are initialized on first use, and again only if a later subset uses a different vertex format
+    constexpr unsigned int c_MaterialUninitialized = UINT32_MAX;
+    std::vector<unsigned int> materialInitFlags;
+    materialInitFlags.resize(header->NumMaterials, c_MaterialUninitialized);
+
+    // Each VB/IB in the file is copied to upload memory once and shared by all the parts that reference it
+    std::vector<SharedGraphicsResource> vbData;
+    vbData.resize(header->NumVertexBuffers);
+
+    std::vector<SharedGraphicsResource> ibData;
+    ibData.resize(header->NumIndexBuffers);
+
     std::map<std::wstring, int> textureDictionary;
 
     auto model = std::make_unique<Model>();
@@ -646,22 +658,27 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
             auto& mat = materials[subset.MaterialID];
 
             const size_t vi = mh.VertexBuffers[0];
-            if (materialArray_v2)
-            {
-                InitMaterial(
-                    materialArray_v2[subset.MaterialID],
-                    materialFlags[vi],
-                    mat,
-                    textureDictionary);
-            }
-            else
+            if (materialInitFlags[subset.MaterialID] != materialFlags[vi])
             {
-                InitMaterial(
-                    materialArray[subset.MaterialID],
-                    materialFlags[vi],
-                    mat,
-                    textureDictionary,
-                    (flags & ModelLoader_MaterialColorsSRGB) != 0);
+                if (materialArray_v2)
+                {
+                    InitMaterial(
+                        materialArray_v2[subset.MaterialID],
+                        materialFlags[vi],
+                        mat,
+                        textureDictionary);
+                }
+                else
+                {
+                    InitMaterial(
+                        materialArray[subset.MaterialID],
+                        materialFlags[vi],
+                        mat,
+                        textureDictionary,
+                        (flags & ModelLoader_MaterialColorsSRGB) != 0);
+                }
+
+                materialInitFlags[subset.MaterialID] = materialFlags[vi];
             }
 
             auto part = new ModelMeshPart(partCount++);
@@ -678,18 +695,30 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
             part->indexFormat = (ibArray[mh.IndexBuffer].IndexType == DXUT::IT_32BIT) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 
             // Vertex data
-            auto verts = bufferData + (vh.DataOffset - bufferDataOffset);
-            auto const vbytes = static_cast<size_t>(vh.SizeBytes);
+            auto& vb = vbData[vi];
+            if (!vb)
+            {
+                auto verts = bufferData + (vh.DataOffset - bufferDataOffset);
+                auto const vbytes = static_cast<size_t>(vh.SizeBytes);
+                vb = GraphicsMemory::Get(device).Allocate(vbytes, 16, GraphicsMemory::TAG_VERTEX);
+                memcpy(vb.Memory(), verts, vbytes);
+            }
+
             part->vertexBufferSize = static_cast<uint32_t>(vh.SizeBytes);
-            part->vertexBuffer = GraphicsMemory::Get(device).Allocate(vbytes, 16, GraphicsMemory::TAG_VERTEX);
-            memcpy(part->vertexBuffer.Memory(), verts, vbytes);
+            part->vertexBuffer = vb;
 
             // Index data
-            auto indices = bufferData + (ih.DataOffset - bufferDataOffset);
-            auto const ibytes = static_cast<size_t>(ih.SizeBytes);
+            auto& ib = ibData[mh.IndexBuffer];
+            if (!ib)
+            {
+                auto indices = bufferData + (ih.DataOffset - bufferDataOffset);
+                auto const ibytes = static_cast<size_t>(ih.SizeBytes);
+                ib = GraphicsMemory::Get(device).Allocate(ibytes, 16, GraphicsMemory::TAG_INDEX);
+                memcpy(ib.Memory(), indices, ibytes);
+            }
+
             part->indexBufferSize = static_cast<uint32_t>(ih.SizeBytes);
-            part->indexBuffer = GraphicsMemory::Get(device).Allocate(ibytes, 16, GraphicsMemory::TAG_INDEX);
-            memcpy(part->indexBuffer.Memory(), indices, ibytes);
+            part->indexBuffer = ib;
 
             part->materialIndex = subset.MaterialID;
             part->vbDecl = vbDecls[mh.VertexBuffers[0]];
@@ -764,8 +793,12 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
 
         std::swap(model->boneMatrices, transforms);
         std::swap(model->invBindPoseMatrices, invBoneTransforms);
+
+        model->UpdateBoneOrder();
     }
 
+    model->UpdateCullingBounds();
+
     return model;
 }
 
@@ -777,19 +810,23 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
     const wchar_t* szFileName,
     ModelLoaderFlags flags)
 {
-    size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile(szFileName, data, &dataSize);
-    if (FAILED(hr))
-    {
-        DebugTrace("ERROR: CreateFromSDKMESH failed (%08X) loading '%ls'\n",
-            static_cast<unsigned int>(hr), szFileName);
-        throw std::runtime_error("CreateFromSDKMESH");
-    }
+    const ModelFileView fileView(szFileName);
+
+    return CreateFromSDKMESH(device, fileView, flags);
+}
 
-    auto model = CreateFromSDKMESH(device, data.get(), dataSize, flags);
 
-    model->name = szFileName;
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH(
+    ID3D12Device* device,
+    const ModelFileView& fileView,
+    ModelLoaderFlags flags)
+{
+    // Headers are validated in place and buffer data is copied straight from the mapping into upload memory.
+    auto model = CreateFromSDKMESH(device, fileView.GetData(), fileView.GetSize(), flags);
+
+    model->name = fileView.GetFileName();
 
     return model;
 }
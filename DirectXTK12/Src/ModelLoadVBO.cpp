@@ -126,6 +126,8 @@ std::unique_ptr<Model> DirectX::Model::CreateFromVBO(
     auto model = std::make_unique<Model>();
     model->meshes.emplace_back(mesh);
 
+    model->UpdateCullingBounds();
+
     return model;
 }
 
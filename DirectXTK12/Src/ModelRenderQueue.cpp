@@ -0,0 +1,373 @@
+//--------------------------------------------------------------------------------------
+// File: ModelRenderQueue.cpp
+//
+// Sorted submission of model mesh parts.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "CommandListStateCache.h"
+#include "Effects.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Per-item state, stored as StateCount values per item.
+    enum StateIndex
+    {
+        PipelineState,
+        RootSignature,
+        Texture,
+        VertexBuffer,
+        IndexBuffer,
+        StateCount
+    };
+
+    // Opaque sort key layout, most significant first. Ordinals that don't fit saturate, which only costs sort quality.
+    constexpr unsigned c_PipelineStateBits = 16;
+    constexpr unsigned c_RootSignatureBits = 8;
+    constexpr unsigned c_TextureBits = 20;
+    constexpr unsigned c_BufferBits = 20;
+
+    static_assert(c_PipelineStateBits + c_RootSignatureBits + c_TextureBits + c_BufferBits == 64, "Sort key must fill 64 bits");
+
+    void GetState(const ModelMeshPart& part, IEffect* effect, IEffectPipelineState* ipipeline, _Out_writes_(StateCount) uint64_t* state)
+    {
+        if (ipipeline)
+        {
+            state[PipelineState] = reinterpret_cast<uintptr_t>(ipipeline->GetPipelineState());
+            state[RootSignature] = reinterpret_cast<uintptr_t>(ipipeline->GetRootSignature());
+            state[Texture] = ipipeline->GetPrimaryTexture().ptr;
+        }
+        else
+        {
+            // Nothing is known about custom effects, so each instance is its own state.
+            state[PipelineState] = reinterpret_cast<uintptr_t>(effect);
+            state[RootSignature] = 0;
+            state[Texture] = 0;
+        }
+
+        state[VertexBuffer] = part.staticVertexBuffer
+            ? (part.staticVertexBuffer->GetGPUVirtualAddress() + part.staticVertexBufferOffset)
+            : part.vertexBuffer.GpuAddress();
+        state[IndexBuffer] = part.staticIndexBuffer
+            ? (part.staticIndexBuffer->GetGPUVirtualAddress() + part.staticIndexBufferOffset)
+            : part.indexBuffer.GpuAddress();
+    }
+
+    void CountChanges(
+        _In_reads_(StateCount) const uint64_t* prev,
+        _In_reads_(StateCount) const uint64_t* state,
+        ModelRenderQueue::StateChanges& changes) noexcept
+    {
+        if (!prev || prev[PipelineState] != state[PipelineState])
+            ++changes.pipelineState;
+        if (!prev || prev[RootSignature] != state[RootSignature])
+            ++changes.rootSignature;
+        if (!prev || prev[Texture] != state[Texture])
+            ++changes.texture;
+        if (!prev || prev[VertexBuffer] != state[VertexBuffer])
+            ++changes.vertexBuffer;
+        if (!prev || prev[IndexBuffer] != state[IndexBuffer])
+            ++changes.indexBuffer;
+    }
+
+    // Dense ordinals for the distinct values of one state, so they pack into a few key bits.
+    class Ordinals
+    {
+    public:
+        void Build(const std::vector<uint64_t>& states, size_t index, size_t count)
+        {
+            mValues.clear();
+            mValues.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                mValues.push_back(states[i * StateCount + index]);
+            }
+            std::sort(mValues.begin(), mValues.end());
+            mValues.erase(std::unique(mValues.begin(), mValues.end()), mValues.end());
+        }
+
+        uint64_t Get(uint64_t value, unsigned bits) const noexcept
+        {
+            auto it = std::lower_bound(mValues.cbegin(), mValues.cend(), value);
+            const auto ordinal = static_cast<uint64_t>(it - mValues.cbegin());
+            const uint64_t limit = (uint64_t(1) << bits) - 1;
+            return std::min(ordinal, limit);
+        }
+
+    private:
+        std::vector<uint64_t> mValues;
+    };
+
+    // Maps a float to an unsigned key with the same ordering.
+    inline uint64_t SortableFloat(float value) noexcept
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        return bits;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+ModelRenderQueue::ModelRenderQueue() noexcept :
+    mStatistics{}
+{
+}
+
+
+void ModelRenderQueue::Clear() noexcept
+{
+    mWorlds.clear();
+    mOpaque.clear();
+    mAlpha.clear();
+    mStatistics = {};
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV ModelRenderQueue::Add(
+    const ModelMeshPart& part,
+    const ResolvedEffect& effect,
+    bool alpha,
+    const BoundingSphere& bounds,
+    FXMMATRIX world)
+{
+    const XMVECTOR center = XMVector3Transform(XMLoadFloat3(&bounds.Center), world);
+    AddItem(part, effect.get(), effect.matrices, effect.pipelineState, alpha, AddWorld(world), center);
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV ModelRenderQueue::Add(
+    const ModelMeshPart& part,
+    IEffect* effect,
+    bool alpha,
+    const BoundingSphere& bounds,
+    FXMMATRIX world)
+{
+    const XMVECTOR center = XMVector3Transform(XMLoadFloat3(&bounds.Center), world);
+    AddItem(part, effect,
+        dynamic_cast<IEffectMatrices*>(effect), dynamic_cast<IEffectPipelineState*>(effect),
+        alpha, AddWorld(world), center);
+}
+
+
+uint32_t XM_CALLCONV ModelRenderQueue::AddWorld(FXMMATRIX world)
+{
+    if (mWorlds.size() >= c_NoWorld)
+        throw std::runtime_error("ModelRenderQueue");
+
+    const auto index = static_cast<uint32_t>(mWorlds.size());
+    mWorlds.emplace_back();
+    XMStoreFloat4x4(&mWorlds.back(), world);
+    return index;
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV ModelRenderQueue::AddItem(
+    const ModelMeshPart& part,
+    IEffect* effect,
+    IEffectMatrices* matrices,
+    IEffectPipelineState* pipelineState,
+    bool alpha,
+    uint32_t worldIndex,
+    FXMVECTOR center)
+{
+    if (!effect)
+        throw std::invalid_argument("ModelRenderQueue requires an effect for every part");
+
+    Item item = { &part, effect, matrices, pipelineState, worldIndex, {} };
+    XMStoreFloat3(&item.center, center);
+
+    auto& items = alpha ? mAlpha : mOpaque;
+    if (items.size() >= UINT32_MAX)
+        throw std::runtime_error("ModelRenderQueue");
+
+    items.emplace_back(item);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Opaque parts are sorted on a 64-bit key of pipeline state, root signature, texture and
+// vertex buffer ordinals; alpha parts on view depth, farthest first. Both use the same
+// stable LSD radix sort, so ties keep the order the parts were added in.
+_Use_decl_annotations_
+void XM_CALLCONV ModelRenderQueue::Sort(FXMMATRIX view, bool rhcoords)
+{
+    const size_t nopaque = mOpaque.size();
+    const size_t nalpha = mAlpha.size();
+    const size_t total = nopaque + nalpha;
+
+    mStatistics = {};
+    mStatistics.opaqueCount = nopaque;
+    mStatistics.alphaCount = nalpha;
+
+    if (!total)
+        return;
+
+    // Gather the state of every item, opaque then alpha, which is also the unsorted draw order.
+    mStates.resize(total * StateCount);
+    for (size_t i = 0; i < total; ++i)
+    {
+        const Item& item = (i < nopaque) ? mOpaque[i] : mAlpha[i - nopaque];
+        uint64_t* state = &mStates[i * StateCount];
+        GetState(*item.part, item.effect, item.pipelineState, state);
+        CountChanges(i ? state - StateCount : nullptr, state, mStatistics.unsorted);
+    }
+
+    mSortScratch.resize(std::max(nopaque, nalpha) * 2);
+
+    // Radix sorts the first count entries of mSortScratch, using the second half as the ping-pong buffer.
+    auto radixSort = [this](size_t count)
+    {
+        SortEntry* src = mSortScratch.data();
+        SortEntry* dst = src + count;
+
+        for (unsigned shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[256] = {};
+            for (size_t i = 0; i < count; ++i)
+            {
+                ++histogram[(src[i].key >> shift) & 0xff];
+            }
+
+            // Every key has the same digit, so this pass wouldn't move anything.
+            if (histogram[(src[0].key >> shift) & 0xff] == count)
+                continue;
+
+            size_t offset = 0;
+            for (auto& bucket : histogram)
+            {
+                const size_t n = bucket;
+                bucket = offset;
+                offset += n;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                dst[histogram[(src[i].key >> shift) & 0xff]++] = src[i];
+            }
+
+            std::swap(src, dst);
+        }
+
+        if (src != mSortScratch.data())
+        {
+            std::copy(src, src + count, mSortScratch.data());
+        }
+    };
+
+    // Applies the sorted order in mSortScratch to items and counts the resulting state changes.
+    const uint64_t* prev = nullptr;
+    auto reorder = [&](std::vector<Item>& items, size_t stateBase)
+    {
+        const size_t count = items.size();
+        mScratchItems.clear();
+        mScratchItems.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t index = mSortScratch[i].index;
+            mScratchItems.push_back(items[index]);
+
+            const uint64_t* state = &mStates[(stateBase + index) * StateCount];
+            CountChanges(prev, state, mStatistics.sorted);
+            prev = state;
+        }
+        std::swap(items, mScratchItems);
+    };
+
+    if (nopaque > 0)
+    {
+        Ordinals pipelineStates, rootSignatures, textures, buffers;
+        pipelineStates.Build(mStates, PipelineState, nopaque);
+        rootSignatures.Build(mStates, RootSignature, nopaque);
+        textures.Build(mStates, Texture, nopaque);
+        buffers.Build(mStates, VertexBuffer, nopaque);
+
+        for (size_t i = 0; i < nopaque; ++i)
+        {
+            const uint64_t* state = &mStates[i * StateCount];
+
+            uint64_t key = pipelineStates.Get(state[PipelineState], c_PipelineStateBits);
+            key = (key << c_RootSignatureBits) | rootSignatures.Get(state[RootSignature], c_RootSignatureBits);
+            key = (key << c_TextureBits) | textures.Get(state[Texture], c_TextureBits);
+            key = (key << c_BufferBits) | buffers.Get(state[VertexBuffer], c_BufferBits);
+
+            mSortScratch[i] = { key, static_cast<uint32_t>(i) };
+        }
+
+        radixSort(nopaque);
+        reorder(mOpaque, 0);
+    }
+
+    if (nalpha > 0)
+    {
+        for (size_t i = 0; i < nalpha; ++i)
+        {
+            const XMVECTOR viewPos = XMVector3Transform(XMLoadFloat3(&mAlpha[i].center), view);
+            const float z = XMVectorGetZ(viewPos);
+            const float depth = rhcoords ? -z : z;
+
+            // Inverted so the farthest part sorts first.
+            mSortScratch[i] = { ~SortableFloat(depth) & 0xffffffffu, static_cast<uint32_t>(i) };
+        }
+
+        radixSort(nalpha);
+        reorder(mAlpha, nopaque);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void ModelRenderQueue::Submit(ID3D12GraphicsCommandList* commandList)
+{
+    CommandListStateCache cache(commandList);
+    Submit(cache);
+}
+
+
+void ModelRenderQueue::Submit(CommandListStateCache& commandList)
+{
+    const auto before = commandList.GetStatistics();
+
+    const IEffect* lastEffect = nullptr;
+    uint32_t lastWorld = c_NoWorld;
+
+    for (const auto* items : { &mOpaque, &mAlpha })
+    {
+        for (const auto& item : *items)
+        {
+            // Effects only need the world matrix again when they're drawn with a different one.
+            if (item.world != c_NoWorld && (item.effect != lastEffect || item.world != lastWorld))
+            {
+                if (item.matrices)
+                {
+                    item.matrices->SetWorld(XMLoadFloat4x4(&mWorlds[item.world]));
+                }
+            }
+
+            lastEffect = item.effect;
+            lastWorld = item.world;
+
+            item.effect->Apply(commandList);
+            item.part->Draw(commandList);
+        }
+    }
+
+    const auto& after = commandList.GetStatistics();
+    mStatistics.callsIssued = after.TotalIssued() - before.TotalIssued();
+    mStatistics.callsSkipped = after.TotalSkipped() - before.TotalSkipped();
+}
@@ -0,0 +1,453 @@
+//--------------------------------------------------------------------------------------
+// File: ModelSaveDTKMODEL.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "PlatformHelpers.h"
+#include "LoaderHelpers.h"
+
+#include "DTKModel.h"
+
+using namespace DirectX;
+using namespace DirectX::LoaderHelpers;
+
+namespace
+{
+    constexpr uint64_t AlignUp(uint64_t value) noexcept
+    {
+        return (value + (DTKMODEL::DATA_ALIGNMENT - 1)) & ~uint64_t(DTKMODEL::DATA_ALIGNMENT - 1);
+    }
+
+    uint32_t GetSemantic(_In_z_ const char* name)
+    {
+        static const char* const s_names[DTKMODEL::SEMANTIC_COUNT] =
+        {
+            "SV_Position",
+            "NORMAL",
+            "COLOR",
+            "TANGENT",
+            "BINORMAL",
+            "TEXCOORD",
+            "BLENDINDICES",
+            "BLENDWEIGHT",
+        };
+
+        for (uint32_t j = 0; j < DTKMODEL::SEMANTIC_COUNT; ++j)
+        {
+            if (_stricmp(name, s_names[j]) == 0)
+                return j;
+        }
+
+        if (_stricmp(name, "POSITION") == 0)
+            return DTKMODEL::SEMANTIC_POSITION;
+
+        DebugTrace("ERROR: SaveToDTKMODEL does not support input element semantic '%s'\n", name);
+        throw std::runtime_error("SaveToDTKMODEL");
+    }
+
+    // Builds the tables and string pool in memory; buffer data is written straight from the model.
+    class DTKModelWriter
+    {
+    public:
+        DTKMODEL::DTKMODEL_STRING AddString(const std::wstring& str)
+        {
+            DTKMODEL::DTKMODEL_STRING result = {};
+            if (str.empty())
+                return result;
+
+            if (mStrings.size() + str.size() > UINT32_MAX)
+                throw std::runtime_error("SaveToDTKMODEL string pool too large");
+
+            result.Offset = static_cast<uint32_t>(mStrings.size());
+            result.Length = static_cast<uint32_t>(str.size());
+            mStrings.insert(mStrings.end(), str.cbegin(), str.cend());
+            return result;
+        }
+
+        uint32_t AddBuffer(const SharedGraphicsResource& buffer, uint32_t sizeBytes, DTKMODEL::BUFFER_TYPE type)
+        {
+            if (!buffer)
+                throw std::runtime_error("SaveToDTKMODEL requires VB/IB data in CPU memory");
+
+            auto it = mBufferMap.find(buffer.Memory());
+            if (it != mBufferMap.end())
+            {
+                auto& bh = mBuffers[it->second];
+                bh.SizeBytes = std::max(bh.SizeBytes, sizeBytes);
+                return it->second;
+            }
+
+            DTKMODEL::DTKMODEL_BUFFER bh = {};
+            bh.SizeBytes = sizeBytes;
+            bh.Type = type;
+
+            auto index = static_cast<uint32_t>(mBuffers.size());
+            mBuffers.push_back(bh);
+            mBufferSources.push_back(static_cast<const uint8_t*>(buffer.Memory()));
+            mBufferMap[buffer.Memory()] = index;
+            return index;
+        }
+
+        uint32_t AddInputLayout(const std::shared_ptr<ModelMeshPart::InputLayoutCollection>& decl)
+        {
+            if (!decl)
+                throw std::runtime_error("SaveToDTKMODEL requires an input layout for every mesh part");
+
+            auto it = mLayoutMap.find(decl.get());
+            if (it != mLayoutMap.end())
+                return it->second;
+
+            DTKMODEL::DTKMODEL_INPUT_LAYOUT layout = {};
+            layout.FirstElement = static_cast<uint32_t>(mElements.size());
+            layout.NumElements = static_cast<uint32_t>(decl->size());
+
+            for (const auto& desc : *decl)
+            {
+                DTKMODEL::DTKMODEL_INPUT_ELEMENT element = {};
+                element.Semantic = GetSemantic(desc.SemanticName);
+                element.SemanticIndex = desc.SemanticIndex;
+                element.Format = static_cast<uint32_t>(desc.Format);
+                element.InputSlot = desc.InputSlot;
+                element.AlignedByteOffset = desc.AlignedByteOffset;
+                element.InputSlotClass = static_cast<uint32_t>(desc.InputSlotClass);
+                element.InstanceDataStepRate = desc.InstanceDataStepRate;
+                mElements.push_back(element);
+            }
+
+            auto index = static_cast<uint32_t>(mLayouts.size());
+            mLayouts.push_back(layout);
+            mLayoutMap[decl.get()] = index;
+            return index;
+        }
+
+        void AddPart(const ModelMeshPart& part)
+        {
+            DTKMODEL::DTKMODEL_MESH_PART ph = {};
+            ph.PartIndex = part.partIndex;
+            ph.MaterialIndex = part.materialIndex;
+            ph.IndexCount = part.indexCount;
+            ph.StartIndex = part.startIndex;
+            ph.VertexOffset = part.vertexOffset;
+            ph.VertexStride = part.vertexStride;
+            ph.VertexCount = part.vertexCount;
+            ph.IndexBufferSize = part.indexBufferSize;
+            ph.VertexBufferSize = part.vertexBufferSize;
+            ph.PrimitiveType = static_cast<uint32_t>(part.primitiveType);
+            ph.IndexFormat = static_cast<uint32_t>(part.indexFormat);
+            ph.InputLayout = AddInputLayout(part.vbDecl);
+            ph.VertexBuffer = AddBuffer(part.vertexBuffer, part.vertexBufferSize, DTKMODEL::BUFFER_VERTEX);
+            ph.IndexBuffer = AddBuffer(part.indexBuffer, part.indexBufferSize, DTKMODEL::BUFFER_INDEX);
+            mParts.push_back(ph);
+        }
+
+        void AddMesh(const ModelMesh& mesh)
+        {
+            DTKMODEL::DTKMODEL_MESH mh = {};
+            mh.Name = AddString(mesh.name);
+            mh.BoundingSphere[0] = mesh.boundingSphere.Center.x;
+            mh.BoundingSphere[1] = mesh.boundingSphere.Center.y;
+            mh.BoundingSphere[2] = mesh.boundingSphere.Center.z;
+            mh.BoundingSphere[3] = mesh.boundingSphere.Radius;
+            mh.BoxCenter[0] = mesh.boundingBox.Center.x;
+            mh.BoxCenter[1] = mesh.boundingBox.Center.y;
+            mh.BoxCenter[2] = mesh.boundingBox.Center.z;
+            mh.BoxExtents[0] = mesh.boundingBox.Extents.x;
+            mh.BoxExtents[1] = mesh.boundingBox.Extents.y;
+            mh.BoxExtents[2] = mesh.boundingBox.Extents.z;
+            mh.BoneIndex = mesh.boneIndex;
+            mh.FirstBoneInfluence = static_cast<uint32_t>(mInfluences.size());
+            mh.NumBoneInfluences = static_cast<uint32_t>(mesh.boneInfluences.size());
+            mInfluences.insert(mInfluences.end(), mesh.boneInfluences.cbegin(), mesh.boneInfluences.cend());
+
+            mh.FirstPart = static_cast<uint32_t>(mParts.size());
+            mh.NumOpaqueParts = static_cast<uint32_t>(mesh.opaqueMeshParts.size());
+            mh.NumAlphaParts = static_cast<uint32_t>(mesh.alphaMeshParts.size());
+            for (const auto& part : mesh.opaqueMeshParts)
+            {
+                AddPart(*part);
+            }
+            for (const auto& part : mesh.alphaMeshParts)
+            {
+                AddPart(*part);
+            }
+
+            mMeshes.push_back(mh);
+        }
+
+        void AddMaterial(const Model::ModelMaterialInfo& m)
+        {
+            DTKMODEL::DTKMODEL_MATERIAL mh = {};
+            mh.Name = AddString(m.name);
+            mh.Flags = (m.perVertexColor ? DTKMODEL::MATERIAL_PER_VERTEX_COLOR : 0u)
+                | (m.enableSkinning ? DTKMODEL::MATERIAL_SKINNING : 0u)
+                | (m.enableDualTexture ? DTKMODEL::MATERIAL_DUAL_TEXTURE : 0u)
+                | (m.enableNormalMaps ? DTKMODEL::MATERIAL_NORMAL_MAPS : 0u)
+                | (m.biasedVertexNormals ? DTKMODEL::MATERIAL_BIASED_VERTEX_NORMALS : 0u);
+            mh.SpecularPower = m.specularPower;
+            mh.Alpha = m.alphaValue;
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(mh.Ambient), XMLoadFloat3(&m.ambientColor));
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(mh.Diffuse), XMLoadFloat3(&m.diffuseColor));
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(mh.Specular), XMLoadFloat3(&m.specularColor));
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(mh.Emissive), XMLoadFloat3(&m.emissiveColor));
+            mh.DiffuseTexture = m.diffuseTextureIndex;
+            mh.SpecularTexture = m.specularTextureIndex;
+            mh.NormalTexture = m.normalTextureIndex;
+            mh.EmissiveTexture = m.emissiveTextureIndex;
+            mh.SamplerIndex = m.samplerIndex;
+            mh.SamplerIndex2 = m.samplerIndex2;
+            mMaterials.push_back(mh);
+        }
+
+        void AddTexture(const std::wstring& name)
+        {
+            mTextures.push_back(AddString(name));
+        }
+
+        void AddBone(const ModelBone& bone)
+        {
+            DTKMODEL::DTKMODEL_BONE bh = {};
+            bh.ParentIndex = bone.parentIndex;
+            bh.ChildIndex = bone.childIndex;
+            bh.SiblingIndex = bone.siblingIndex;
+            bh.Name = AddString(bone.name);
+            mBones.push_back(bh);
+        }
+
+        void SetBoneMatrices(size_t nbones, _In_reads_opt_(nbones) const XMMATRIX* transforms, _In_reads_opt_(nbones) const XMMATRIX* invBindPose)
+        {
+            if (transforms)
+            {
+                mBoneMatrices.resize(nbones);
+                for (size_t j = 0; j < nbones; ++j)
+                {
+                    XMStoreFloat4x4(&mBoneMatrices[j], transforms[j]);
+                }
+            }
+
+            if (invBindPose)
+            {
+                mInvBindPose.resize(nbones);
+                for (size_t j = 0; j < nbones; ++j)
+                {
+                    XMStoreFloat4x4(&mInvBindPose[j], invBindPose[j]);
+                }
+            }
+        }
+
+        void Write(_In_z_ const wchar_t* szFileName, const std::wstring& name, uint32_t userData)
+        {
+            DTKMODEL::DTKMODEL_HEADER header = {};
+            header.Magic = DTKMODEL::DTKMODEL_MAGIC;
+            header.Version = DTKMODEL::DTKMODEL_FILE_VERSION;
+            header.HeaderSize = sizeof(DTKMODEL::DTKMODEL_HEADER);
+            header.UserData = userData;
+            header.Name = AddString(name);
+
+            // Lay out the file
+            uint64_t offset = AlignUp(sizeof(DTKMODEL::DTKMODEL_HEADER));
+            header.Buffers = Place(offset, mBuffers);
+            header.InputLayouts = Place(offset, mLayouts);
+            header.InputElements = Place(offset, mElements);
+            header.Meshes = Place(offset, mMeshes);
+            header.MeshParts = Place(offset, mParts);
+            header.BoneInfluences = Place(offset, mInfluences);
+            header.Materials = Place(offset, mMaterials);
+            header.Textures = Place(offset, mTextures);
+            header.Bones = Place(offset, mBones);
+            header.BoneMatrices = Place(offset, mBoneMatrices);
+            header.InvBindPoseMatrices = Place(offset, mInvBindPose);
+            header.Strings = Place(offset, mStrings);
+
+            header.Data.Offset = offset;
+
+            uint64_t dataOffset = 0;
+            for (auto& bh : mBuffers)
+            {
+                bh.DataOffset = dataOffset;
+                dataOffset = AlignUp(dataOffset + bh.SizeBytes);
+            }
+
+            header.Data.Count = dataOffset;
+            header.FileSize = header.Data.Offset + header.Data.Count;
+
+            // Create file
+        #if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+            ScopedHandle hFile(safe_handle(CreateFile2(
+                szFileName,
+                GENERIC_WRITE, 0, CREATE_ALWAYS,
+                nullptr)));
+        #else
+            ScopedHandle hFile(safe_handle(CreateFileW(
+                szFileName,
+                GENERIC_WRITE, 0,
+                nullptr,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                nullptr)));
+        #endif
+            if (!hFile)
+            {
+                DebugTrace("ERROR: SaveToDTKMODEL failed (%08X) to create '%ls'\n",
+                    static_cast<unsigned int>(HRESULT_FROM_WIN32(GetLastError())), szFileName);
+                throw std::runtime_error("SaveToDTKMODEL");
+            }
+
+            auto_delete_file delonfail(hFile.get());
+
+            mPosition = 0;
+            WriteBytes(hFile.get(), &header, sizeof(header));
+            WriteSection(hFile.get(), header.Buffers, mBuffers);
+            WriteSection(hFile.get(), header.InputLayouts, mLayouts);
+            WriteSection(hFile.get(), header.InputElements, mElements);
+            WriteSection(hFile.get(), header.Meshes, mMeshes);
+            WriteSection(hFile.get(), header.MeshParts, mParts);
+            WriteSection(hFile.get(), header.BoneInfluences, mInfluences);
+            WriteSection(hFile.get(), header.Materials, mMaterials);
+            WriteSection(hFile.get(), header.Textures, mTextures);
+            WriteSection(hFile.get(), header.Bones, mBones);
+            WriteSection(hFile.get(), header.BoneMatrices, mBoneMatrices);
+            WriteSection(hFile.get(), header.InvBindPoseMatrices, mInvBindPose);
+            WriteSection(hFile.get(), header.Strings, mStrings);
+
+            for (size_t j = 0; j < mBuffers.size(); ++j)
+            {
+                PadTo(hFile.get(), header.Data.Offset + mBuffers[j].DataOffset);
+                WriteBytes(hFile.get(), mBufferSources[j], mBuffers[j].SizeBytes);
+            }
+            PadTo(hFile.get(), header.FileSize);
+
+            delonfail.clear();
+        }
+
+    private:
+        template<typename T>
+        static DTKMODEL::DTKMODEL_SECTION Place(uint64_t& offset, const std::vector<T>& items) noexcept
+        {
+            DTKMODEL::DTKMODEL_SECTION section = {};
+            if (!items.empty())
+            {
+                section.Offset = offset;
+                section.Count = items.size();
+                offset = AlignUp(offset + sizeof(T) * items.size());
+            }
+            return section;
+        }
+
+        template<typename T>
+        void WriteSection(HANDLE hFile, const DTKMODEL::DTKMODEL_SECTION& section, const std::vector<T>& items)
+        {
+            if (items.empty())
+                return;
+
+            PadTo(hFile, section.Offset);
+            WriteBytes(hFile, items.data(), sizeof(T) * items.size());
+        }
+
+        void PadTo(HANDLE hFile, uint64_t offset)
+        {
+            static const uint8_t s_zeros[DTKMODEL::DATA_ALIGNMENT] = {};
+
+            assert(offset >= mPosition && (offset - mPosition) <= DTKMODEL::DATA_ALIGNMENT);
+            if (offset > mPosition)
+            {
+                WriteBytes(hFile, s_zeros, static_cast<size_t>(offset - mPosition));
+            }
+        }
+
+        void WriteBytes(HANDLE hFile, _In_reads_bytes_(size) const void* data, size_t size)
+        {
+            auto ptr = static_cast<const uint8_t*>(data);
+            while (size > 0)
+            {
+                const auto chunk = static_cast<DWORD>(std::min<size_t>(size, UINT32_MAX));
+
+                DWORD bytesWritten = 0;
+                if (!WriteFile(hFile, ptr, chunk, &bytesWritten, nullptr) || bytesWritten != chunk)
+                {
+                    throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "WriteFile");
+                }
+
+                ptr += chunk;
+                size -= chunk;
+                mPosition += chunk;
+            }
+        }
+
+        std::vector<DTKMODEL::DTKMODEL_BUFFER>          mBuffers;
+        std::vector<const uint8_t*>                     mBufferSources;
+        std::map<const void*, uint32_t>                 mBufferMap;
+        std::vector<DTKMODEL::DTKMODEL_INPUT_LAYOUT>    mLayouts;
+        std::vector<DTKMODEL::DTKMODEL_INPUT_ELEMENT>   mElements;
+        std::map<const void*, uint32_t>                 mLayoutMap;
+        std::vector<DTKMODEL::DTKMODEL_MESH>            mMeshes;
+        std::vector<DTKMODEL::DTKMODEL_MESH_PART>       mParts;
+        std::vector<uint32_t>                           mInfluences;
+        std::vector<DTKMODEL::DTKMODEL_MATERIAL>        mMaterials;
+        std::vector<DTKMODEL::DTKMODEL_STRING>          mTextures;
+        std::vector<DTKMODEL::DTKMODEL_BONE>            mBones;
+        std::vector<XMFLOAT4X4>                         mBoneMatrices;
+        std::vector<XMFLOAT4X4>                         mInvBindPose;
+        std::vector<wchar_t>                            mStrings;
+        uint64_t                                        mPosition = 0;
+    };
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void Model::SaveToDTKMODEL(const wchar_t* szFileName, uint32_t userData) const
+{
+    if (!szFileName)
+        throw std::invalid_argument("SaveToDTKMODEL");
+
+    if (meshes.empty())
+        throw std::runtime_error("SaveToDTKMODEL requires at least one mesh");
+
+    DTKModelWriter writer;
+
+    for (const auto& mesh : meshes)
+    {
+        writer.AddMesh(*mesh);
+    }
+
+    for (const auto& m : materials)
+    {
+        writer.AddMaterial(m);
+    }
+
+    for (const auto& tex : textureNames)
+    {
+        writer.AddTexture(tex);
+    }
+
+    for (const auto& bone : bones)
+    {
+        writer.AddBone(bone);
+    }
+
+    writer.SetBoneMatrices(bones.size(),
+        bones.empty() ? nullptr : boneMatrices.get(),
+        bones.empty() ? nullptr : invBindPoseMatrices.get());
+
+    writer.Write(szFileName, name, userData);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adapters for /Zc:wchar_t- clients
+
+#if defined(_MSC_VER) && !defined(_NATIVE_WCHAR_T_DEFINED)
+
+_Use_decl_annotations_
+void Model::SaveToDTKMODEL(const __wchar_t* szFileName, uint32_t userData) const
+{
+    SaveToDTKMODEL(reinterpret_cast<const unsigned short*>(szFileName), userData);
+}
+
+#endif
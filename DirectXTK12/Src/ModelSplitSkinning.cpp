@@ -0,0 +1,467 @@
+//--------------------------------------------------------------------------------------
+// File: ModelSplitSkinning.cpp
+//
+// Splits skinned meshes whose bone palette is larger than the skinning effects support.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+
+#include "Effects.h"
+#include "GraphicsMemory.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    constexpr uint32_t c_NoInfluence = uint32_t(-1);
+    constexpr size_t c_MaxInfluences = 4;
+
+    struct BlendElement
+    {
+        uint32_t offset;
+        uint32_t componentSize;     // 0 if the format isn't understood
+        bool     isFloat;
+    };
+
+    BlendElement GetBlendElement(const D3D12_INPUT_ELEMENT_DESC& desc) noexcept
+    {
+        BlendElement result = { desc.AlignedByteOffset, 0, false };
+
+        switch (desc.Format)
+        {
+        case DXGI_FORMAT_R8G8B8A8_UINT:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+            result.componentSize = 1;
+            break;
+
+        case DXGI_FORMAT_R16G16B16A16_UINT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            result.componentSize = 2;
+            break;
+
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            result.componentSize = 2;
+            result.isFloat = true;
+            break;
+
+        case DXGI_FORMAT_R32G32B32A32_UINT:
+            result.componentSize = 4;
+            break;
+
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            result.componentSize = 4;
+            result.isFloat = true;
+            break;
+
+        default:
+            break;
+        }
+
+        return result;
+    }
+
+    uint32_t ReadComponent(const uint8_t* ptr, uint32_t componentSize) noexcept
+    {
+        switch (componentSize)
+        {
+        case 1: return *ptr;
+        case 2: { uint16_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+        default: { uint32_t v; memcpy(&v, ptr, sizeof(v)); return v; }
+        }
+    }
+
+    void WriteComponent(uint8_t* ptr, uint32_t componentSize, uint32_t value) noexcept
+    {
+        switch (componentSize)
+        {
+        case 1: *ptr = static_cast<uint8_t>(value); break;
+        case 2: { auto v = static_cast<uint16_t>(value); memcpy(ptr, &v, sizeof(v)); } break;
+        default: memcpy(ptr, &value, sizeof(value)); break;
+        }
+    }
+
+    // Palette slots used by one vertex; zero-weight influences are skipped.
+    size_t GetInfluences(
+        const uint8_t* vertex,
+        const BlendElement& indices,
+        const BlendElement* weights,
+        uint32_t(&slots)[c_MaxInfluences]) noexcept
+    {
+        size_t count = 0;
+        for (size_t j = 0; j < c_MaxInfluences; ++j)
+        {
+            if (weights && weights->componentSize)
+            {
+                uint32_t weight = ReadComponent(vertex + weights->offset + j * weights->componentSize, weights->componentSize);
+                if (weights->isFloat)
+                {
+                    // Ignore the sign bit so -0 counts as zero.
+                    weight &= (weights->componentSize == 2) ? 0x7fffu : 0x7fffffffu;
+                }
+
+                if (!weight)
+                {
+                    slots[j] = c_NoInfluence;
+                    continue;
+                }
+            }
+
+            slots[j] = ReadComponent(vertex + indices.offset + j * indices.componentSize, indices.componentSize);
+            ++count;
+        }
+        return count;
+    }
+
+    // A run of triangles from one part that fits in a single palette.
+    struct PaletteGroup
+    {
+        std::vector<uint32_t> slots;        // Source palette slots, in new palette order
+        std::vector<uint32_t> triangles;
+    };
+}
+
+
+// Splits skinned meshes whose palette exceeds maxBones into meshes with smaller palettes.
+_Use_decl_annotations_
+size_t Model::SplitSkinnedMeshes(ID3D12Device* device, size_t maxBones)
+{
+    if (!device)
+    {
+        throw std::invalid_argument("Direct3D device is null");
+    }
+
+    // A single triangle can reference up to 12 bones.
+    if (maxBones < 3 * c_MaxInfluences || maxBones > IEffectSkinning::MaxBones)
+    {
+        throw std::invalid_argument("maxBones is out of range");
+    }
+
+    uint32_t nextPartIndex = 0;
+    for (const auto& mesh : meshes)
+    {
+        for (const auto& part : mesh->opaqueMeshParts)
+            nextPartIndex = std::max(part->partIndex + 1, nextPartIndex);
+        for (const auto& part : mesh->alphaMeshParts)
+            nextPartIndex = std::max(part->partIndex + 1, nextPartIndex);
+    }
+
+    ModelMesh::Collection result;
+    result.reserve(meshes.size());
+
+    size_t nsplit = 0;
+
+    for (const auto& mesh : meshes)
+    {
+        assert(mesh != nullptr);
+
+        // Without influences the vertex blend indices address the model bones directly.
+        const size_t paletteSize = mesh->boneInfluences.empty() ? bones.size() : mesh->boneInfluences.size();
+        if (paletteSize <= maxBones)
+        {
+            result.push_back(mesh);
+            continue;
+        }
+
+        // Parts that don't skin stay with a copy of the original mesh.
+        auto baseMesh = std::make_shared<ModelMesh>();
+        baseMesh->boundingSphere = mesh->boundingSphere;
+        baseMesh->boundingBox = mesh->boundingBox;
+        baseMesh->boneIndex = mesh->boneIndex;
+        baseMesh->boneInfluences = mesh->boneInfluences;
+        baseMesh->name = mesh->name;
+
+        std::vector<std::shared_ptr<ModelMesh>> splitMeshes;
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const bool alpha = (pass != 0);
+            const auto& parts = alpha ? mesh->alphaMeshParts : mesh->opaqueMeshParts;
+
+            for (const auto& part : parts)
+            {
+                assert(part != nullptr);
+
+                const D3D12_INPUT_ELEMENT_DESC* indicesDesc = nullptr;
+                const D3D12_INPUT_ELEMENT_DESC* weightsDesc = nullptr;
+                if (part->vbDecl)
+                {
+                    for (const auto& desc : *part->vbDecl)
+                    {
+                        if (!desc.SemanticName || desc.InputSlot != 0)
+                            continue;
+
+                        if (!_stricmp(desc.SemanticName, "BLENDINDICES"))
+                            indicesDesc = &desc;
+                        else if (!_stricmp(desc.SemanticName, "BLENDWEIGHT"))
+                            weightsDesc = &desc;
+                    }
+                }
+
+                const bool skinned = indicesDesc != nullptr
+                    && (part->materialIndex >= materials.size() || materials[part->materialIndex].enableSkinning);
+
+                if (!skinned)
+                {
+                    auto copy = std::make_unique<ModelMeshPart>(*part);
+                    (alpha ? baseMesh->alphaMeshParts : baseMesh->opaqueMeshParts).emplace_back(std::move(copy));
+                    continue;
+                }
+
+                const BlendElement indices = GetBlendElement(*indicesDesc);
+                if (!indices.componentSize || indices.isFloat)
+                {
+                    DebugTrace("ERROR: Model::SplitSkinnedMeshes does not support blend index format %u\n", indicesDesc->Format);
+                    throw std::runtime_error("SplitSkinnedMeshes");
+                }
+
+                const BlendElement weights = weightsDesc ? GetBlendElement(*weightsDesc) : BlendElement{};
+
+                if (part->primitiveType != D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+                {
+                    DebugTrace("ERROR: Model::SplitSkinnedMeshes only supports triangle lists\n");
+                    throw std::runtime_error("SplitSkinnedMeshes");
+                }
+
+                if (!part->vertexBuffer || !part->indexBuffer)
+                {
+                    DebugTrace("ERROR: Model::SplitSkinnedMeshes requires CPU-side vertex and index buffers (call it before LoadStaticBuffers)\n");
+                    throw std::runtime_error("SplitSkinnedMeshes");
+                }
+
+                const size_t indexSize = (part->indexFormat == DXGI_FORMAT_R32_UINT) ? sizeof(uint32_t) : sizeof(uint16_t);
+                const size_t stride = part->vertexStride;
+                const size_t nverts = stride ? (part->vertexBufferSize / stride) : 0;
+
+                if (!stride || (indices.offset + c_MaxInfluences * indices.componentSize) > stride
+                    || (weightsDesc && weights.componentSize && (weights.offset + c_MaxInfluences * weights.componentSize) > stride))
+                {
+                    throw std::runtime_error("Invalid vertex layout for skinning");
+                }
+
+                if ((uint64_t(part->startIndex) + part->indexCount) * indexSize > part->indexBufferSize
+                    || (part->indexCount % 3) != 0)
+                {
+                    throw std::runtime_error("Invalid index range for skinning");
+                }
+
+                auto ib = static_cast<const uint8_t*>(part->indexBuffer.Memory()) + size_t(part->startIndex) * indexSize;
+                auto vb = static_cast<const uint8_t*>(part->vertexBuffer.Memory());
+
+                auto getVertex = [&](size_t i) -> size_t
+                {
+                    const uint32_t index = (indexSize == sizeof(uint32_t))
+                        ? reinterpret_cast<const uint32_t*>(ib)[i]
+                        : reinterpret_cast<const uint16_t*>(ib)[i];
+
+                    const int64_t vertex = int64_t(index) + part->vertexOffset;
+                    if (vertex < 0 || uint64_t(vertex) >= nverts)
+                        throw std::runtime_error("Invalid vertex index for skinning");
+
+                    return static_cast<size_t>(vertex);
+                };
+
+                // Greedily assign triangles to palettes of up to maxBones entries.
+                std::vector<PaletteGroup> groups;
+                std::vector<uint32_t> slotToLocal(paletteSize, c_NoInfluence);
+
+                const size_t ntris = part->indexCount / 3;
+                for (size_t tri = 0; tri < ntris; ++tri)
+                {
+                    uint32_t triSlots[3 * c_MaxInfluences];
+                    size_t nslots = 0;
+
+                    for (size_t v = 0; v < 3; ++v)
+                    {
+                        uint32_t slots[c_MaxInfluences];
+                        GetInfluences(vb + getVertex(tri * 3 + v) * stride, indices, weightsDesc ? &weights : nullptr, slots);
+
+                        for (auto slot : slots)
+                        {
+                            if (slot == c_NoInfluence)
+                                continue;
+
+                            if (slot >= paletteSize)
+                                throw std::runtime_error("Invalid bone influence index");
+
+                            if (std::find(triSlots, triSlots + nslots, slot) == triSlots + nslots)
+                                triSlots[nslots++] = slot;
+                        }
+                    }
+
+                    size_t added = 0;
+                    if (!groups.empty())
+                    {
+                        for (size_t j = 0; j < nslots; ++j)
+                        {
+                            if (slotToLocal[triSlots[j]] == c_NoInfluence)
+                                ++added;
+                        }
+                    }
+
+                    if (groups.empty() || groups.back().slots.size() + added > maxBones)
+                    {
+                        if (!groups.empty())
+                        {
+                            for (auto slot : groups.back().slots)
+                                slotToLocal[slot] = c_NoInfluence;
+                        }
+
+                        groups.emplace_back();
+                    }
+
+                    auto& group = groups.back();
+                    for (size_t j = 0; j < nslots; ++j)
+                    {
+                        if (slotToLocal[triSlots[j]] == c_NoInfluence)
+                        {
+                            slotToLocal[triSlots[j]] = static_cast<uint32_t>(group.slots.size());
+                            group.slots.push_back(triSlots[j]);
+                        }
+                    }
+
+                    group.triangles.push_back(static_cast<uint32_t>(tri));
+                }
+
+                // Build a compacted VB/IB with remapped blend indices for each group.
+                std::vector<uint32_t> vertexToLocal(nverts, c_NoInfluence);
+                std::fill(slotToLocal.begin(), slotToLocal.end(), c_NoInfluence);
+
+                bool firstGroup = true;
+                for (const auto& group : groups)
+                {
+                    for (size_t j = 0; j < group.slots.size(); ++j)
+                        slotToLocal[group.slots[j]] = static_cast<uint32_t>(j);
+
+                    std::vector<uint32_t> groupVerts;
+                    std::vector<uint32_t> groupIndices;
+                    groupIndices.reserve(group.triangles.size() * 3);
+
+                    for (auto tri : group.triangles)
+                    {
+                        for (size_t v = 0; v < 3; ++v)
+                        {
+                            const size_t vertex = getVertex(size_t(tri) * 3 + v);
+                            if (vertexToLocal[vertex] == c_NoInfluence)
+                            {
+                                vertexToLocal[vertex] = static_cast<uint32_t>(groupVerts.size());
+                                groupVerts.push_back(static_cast<uint32_t>(vertex));
+                            }
+                            groupIndices.push_back(vertexToLocal[vertex]);
+                        }
+                    }
+
+                    const bool use32 = groupVerts.size() > UINT16_MAX;
+                    const size_t newIndexSize = use32 ? sizeof(uint32_t) : sizeof(uint16_t);
+
+                    const uint64_t vbytes = uint64_t(groupVerts.size()) * stride;
+                    const uint64_t ibytes = uint64_t(groupIndices.size()) * newIndexSize;
+                    if (vbytes > UINT32_MAX || ibytes > UINT32_MAX)
+                        throw std::runtime_error("Split mesh part is too large");
+
+                    auto newVB = GraphicsMemory::Get(device).Allocate(static_cast<size_t>(vbytes), 16, GraphicsMemory::TAG_VERTEX);
+                    auto newIB = GraphicsMemory::Get(device).Allocate(static_cast<size_t>(ibytes), 16, GraphicsMemory::TAG_INDEX);
+
+                    auto dstVB = static_cast<uint8_t*>(newVB.Memory());
+                    for (size_t j = 0; j < groupVerts.size(); ++j)
+                    {
+                        uint8_t* dst = dstVB + j * stride;
+                        memcpy(dst, vb + size_t(groupVerts[j]) * stride, stride);
+
+                        uint32_t slots[c_MaxInfluences];
+                        GetInfluences(dst, indices, weightsDesc ? &weights : nullptr, slots);
+
+                        for (size_t k = 0; k < c_MaxInfluences; ++k)
+                        {
+                            const uint32_t local = (slots[k] == c_NoInfluence) ? 0 : slotToLocal[slots[k]];
+                            assert(local != c_NoInfluence);
+                            WriteComponent(dst + indices.offset + k * indices.componentSize, indices.componentSize, local);
+                        }
+                    }
+
+                    auto dstIB = newIB.Memory();
+                    if (use32)
+                    {
+                        memcpy(dstIB, groupIndices.data(), static_cast<size_t>(ibytes));
+                    }
+                    else
+                    {
+                        auto dst16 = static_cast<uint16_t*>(dstIB);
+                        for (size_t j = 0; j < groupIndices.size(); ++j)
+                            dst16[j] = static_cast<uint16_t>(groupIndices[j]);
+                    }
+
+                    for (auto vertex : groupVerts)
+                        vertexToLocal[vertex] = c_NoInfluence;
+                    for (auto slot : group.slots)
+                        slotToLocal[slot] = c_NoInfluence;
+
+                    auto newPart = std::make_unique<ModelMeshPart>(*part);
+                    newPart->partIndex = firstGroup ? part->partIndex : nextPartIndex++;
+                    newPart->indexCount = static_cast<uint32_t>(groupIndices.size());
+                    newPart->startIndex = 0;
+                    newPart->vertexOffset = 0;
+                    newPart->vertexCount = static_cast<uint32_t>(groupVerts.size());
+                    newPart->indexBufferSize = static_cast<uint32_t>(ibytes);
+                    newPart->vertexBufferSize = static_cast<uint32_t>(vbytes);
+                    newPart->indexFormat = use32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+                    newPart->indexBuffer = std::move(newIB);
+                    newPart->vertexBuffer = std::move(newVB);
+                    newPart->staticIndexBuffer.Reset();
+                    newPart->staticVertexBuffer.Reset();
+                    newPart->staticIndexBufferOffset = 0;
+                    newPart->staticVertexBufferOffset = 0;
+                    firstGroup = false;
+
+                    auto newMesh = std::make_shared<ModelMesh>();
+                    newMesh->boundingSphere = mesh->boundingSphere;
+                    newMesh->boundingBox = mesh->boundingBox;
+                    newMesh->boneIndex = mesh->boneIndex;
+                    newMesh->name = mesh->name;
+                    newMesh->boneInfluences.reserve(group.slots.size());
+                    for (auto slot : group.slots)
+                    {
+                        newMesh->boneInfluences.push_back(mesh->boneInfluences.empty() ? slot : mesh->boneInfluences[slot]);
+                    }
+
+                    (alpha ? newMesh->alphaMeshParts : newMesh->opaqueMeshParts).emplace_back(std::move(newPart));
+                    splitMeshes.emplace_back(std::move(newMesh));
+                }
+            }
+        }
+
+        if (splitMeshes.empty())
+        {
+            // Nothing in this mesh skins, so the palette size doesn't matter.
+            result.push_back(mesh);
+            continue;
+        }
+
+        if (!baseMesh->opaqueMeshParts.empty() || !baseMesh->alphaMeshParts.empty())
+        {
+            result.emplace_back(std::move(baseMesh));
+        }
+
+        for (auto& it : splitMeshes)
+        {
+            result.emplace_back(std::move(it));
+        }
+
+        ++nsplit;
+    }
+
+    meshes = std::move(result);
+
+    if (nsplit > 0)
+    {
+        UpdateCullingBounds();
+    }
+
+    return nsplit;
+}
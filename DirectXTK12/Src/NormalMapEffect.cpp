@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 namespace DirectX
 {
@@ -33,14 +34,8 @@ namespace
         XMVECTOR lightDiffuseColor[IEffectLights::MaxDirectionalLights];
         XMVECTOR lightSpecularColor[IEffectLights::MaxDirectionalLights];
 
-        XMVECTOR eyePosition;
-
         XMVECTOR fogColor;
         XMVECTOR fogVector;
-
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
     };
 
     static_assert((sizeof(NormalMapEffectConstants) % 16) == 0, "CB size not padded correctly");
@@ -84,6 +79,7 @@ public:
         TextureSampler,
         ConstantBuffer,
         ConstantBufferBones,
+        ConstantBufferTransforms,
         TextureSpecularSRV,
         RootParameterCount
     };
@@ -100,9 +96,11 @@ public:
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 
     BoneConstants boneConstants;
+    D3D12_GPU_VIRTUAL_ADDRESS bonePalette;
 
 private:
     GraphicsResource mBones;
@@ -406,7 +404,8 @@ NormalMapEffect::Impl::Impl(
     normal{},
     specular{},
     sampler{},
-    boneConstants{}
+    boneConstants{},
+    bonePalette(0)
 {
     static_assert(static_cast<int>(std::size(EffectBase<NormalMapEffectTraits>::VertexShaderIndices)) == NormalMapEffectTraits::ShaderPermutationCount, "array/max mismatch");
     static_assert(static_cast<int>(std::size(EffectBase<NormalMapEffectTraits>::VertexShaderBytecode)) == NormalMapEffectTraits::VertexShaderCount, "array/max mismatch");
@@ -471,6 +470,7 @@ void NormalMapEffect::Impl::Initialize(
         rootParameters[RootParameterIndex::TextureSampler].InitAsDescriptorTable(1, &textureSampler, D3D12_SHADER_VISIBILITY_PIXEL);
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
         rootParameters[RootParameterIndex::ConstantBufferBones].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc = {};
 
@@ -507,12 +507,10 @@ void NormalMapEffect::Impl::Initialize(
     assert(pi >= 0 && pi < NormalMapEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < NormalMapEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<NormalMapEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<NormalMapEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<NormalMapEffectTraits>::PixelShaderBytecode[pi]);
 
     if (enableSkinning)
     {
@@ -571,20 +569,22 @@ int NormalMapEffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) con
 
 
 // Sets our state onto the D3D device.
-void NormalMapEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void NormalMapEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
-    lights.SetConstants(dirtyFlags, matrices, constants.world, constants.worldInverseTranspose, constants.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
+    lights.SetConstants(dirtyFlags, matrices, transforms.world, transforms.worldInverseTranspose, transforms.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
-    if (weightsPerVertex > 0)
+    if (weightsPerVertex > 0 && !bonePalette)
     {
         if (dirtyFlags & EffectDirtyFlags::ConstantBufferBones)
         {
-            mBones = GraphicsMemory::Get(GetDevice()).AllocateConstant(boneConstants);
+            mBones = AllocateConstant(boneConstants, graphicsMemory);
             dirtyFlags &= ~EffectDirtyFlags::ConstantBufferBones;
         }
     }
@@ -617,8 +617,13 @@ void NormalMapEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
     // Set constants
     auto const cbuffer = GetConstantBufferGpuAddress();
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, cbuffer);
-    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferBones,
-        (weightsPerVertex > 0) ? mBones.GpuAddress() : cbuffer);
+    D3D12_GPU_VIRTUAL_ADDRESS bones = cbuffer;
+    if (weightsPerVertex > 0)
+    {
+        bones = (bonePalette) ? bonePalette : mBones.GpuAddress();
+    }
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferBones, bones);
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -651,10 +656,35 @@ void NormalMapEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void NormalMapEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* NormalMapEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* NormalMapEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE NormalMapEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->texture;
+}
+
+
 // Camera settings
 void XM_CALLCONV NormalMapEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -663,6 +693,7 @@ void XM_CALLCONV NormalMapEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV NormalMapEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -671,6 +702,7 @@ void XM_CALLCONV NormalMapEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV NormalMapEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -681,11 +713,18 @@ void XM_CALLCONV NormalMapEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, C
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void NormalMapEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings
 void XM_CALLCONV NormalMapEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -872,6 +911,7 @@ void SkinnedNormalMapEffect::SetBoneTransforms(_In_reads_(count) XMMATRIX const*
     #endif
     }
 
+    pImpl->bonePalette = 0;
     pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
 }
 
@@ -887,5 +927,13 @@ void SkinnedNormalMapEffect::ResetBoneTransforms()
         boneConstant[i][2] = g_XMIdentityR2;
     }
 
+    pImpl->bonePalette = 0;
     pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
 }
+
+
+bool SkinnedNormalMapEffect::SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette)
+{
+    pImpl->bonePalette = palette;
+    return true;
+}
@@ -9,6 +9,7 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
 
 namespace DirectX
 {
@@ -25,10 +26,6 @@ namespace
     // Constant buffer layout. Must match the shader!
     struct PBREffectConstants
     {
-        XMVECTOR eyePosition;
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
         XMMATRIX prevWorldViewProj; // for velocity generation
 
         XMVECTOR lightDirection[IEffectLights::MaxDirectionalLights];
@@ -91,6 +88,7 @@ public:
         RadianceSampler,
         ConstantBuffer,
         ConstantBufferBones,
+        ConstantBufferTransforms,
         RootParametersCount
     };
 
@@ -102,11 +100,13 @@ public:
 
     XMVECTOR lightColor[MaxDirectionalLights];
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
     BoneConstants boneConstants;
+    D3D12_GPU_VIRTUAL_ADDRESS bonePalette;
 
 private:
     GraphicsResource mBones;
@@ -302,7 +302,8 @@ PBREffect::Impl::Impl(_In_ ID3D12Device* device)
     emissiveMap(false),
     descriptors{},
     lightColor{},
-    boneConstants{}
+    boneConstants{},
+    bonePalette(0)
 {
     static_assert(static_cast<int>(std::size(EffectBase<PBREffectTraits>::VertexShaderIndices)) == PBREffectTraits::ShaderPermutationCount, "array/max mismatch");
     static_assert(static_cast<int>(std::size(EffectBase<PBREffectTraits>::VertexShaderBytecode)) == PBREffectTraits::VertexShaderCount, "array/max mismatch");
@@ -411,6 +412,7 @@ void PBREffect::Impl::Initialize(
 
         rootParameters[ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
         rootParameters[RootParameterIndex::ConstantBufferBones].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc;
         rsigDesc.Init(static_cast<UINT>(std::size(rootParameters)), rootParameters, 0, nullptr, rootSignatureFlags);
@@ -448,12 +450,10 @@ void PBREffect::Impl::Initialize(
     assert(pi >= 0 && pi < PBREffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < PBREffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<PBREffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<PBREffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.ReleaseAndGetAddressOf());
+        EffectBase<PBREffectTraits>::PixelShaderBytecode[pi]);
 
     if (enableSkinning)
     {
@@ -509,48 +509,24 @@ int PBREffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) const noe
 
 
 // Sets our state onto the D3D device.
-void PBREffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void PBREffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Store old wvp for velocity calculation in shader
-    constants.prevWorldViewProj = constants.worldViewProj;
+    constants.prevWorldViewProj = transforms.worldViewProj;
 
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
-
-    // World inverse transpose matrix.
-    if (dirtyFlags & EffectDirtyFlags::WorldInverseTranspose)
-    {
-        constants.world = XMMatrixTranspose(matrices.world);
-
-        const XMMATRIX worldInverse = XMMatrixInverse(nullptr, matrices.world);
-
-        constants.worldInverseTranspose[0] = worldInverse.r[0];
-        constants.worldInverseTranspose[1] = worldInverse.r[1];
-        constants.worldInverseTranspose[2] = worldInverse.r[2];
-
-        dirtyFlags &= ~EffectDirtyFlags::WorldInverseTranspose;
-        dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
-    }
-
-    // Eye position vector.
-    if (dirtyFlags & EffectDirtyFlags::EyePosition)
-    {
-        const XMMATRIX viewInverse = XMMatrixInverse(nullptr, matrices.view);
-
-        constants.eyePosition = viewInverse.r[3];
-
-        dirtyFlags &= ~EffectDirtyFlags::EyePosition;
-        dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
-    }
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
 
     // Set constants to GPU
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
 
-    if (weightsPerVertex > 0)
+    if (weightsPerVertex > 0 && !bonePalette)
     {
         if (dirtyFlags & EffectDirtyFlags::ConstantBufferBones)
         {
-            mBones = GraphicsMemory::Get(GetDevice()).AllocateConstant(boneConstants);
+            mBones = AllocateConstant(boneConstants, graphicsMemory);
             dirtyFlags &= ~EffectDirtyFlags::ConstantBufferBones;
         }
     }
@@ -637,8 +613,13 @@ void PBREffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
     // Set constants
     auto const cbuffer = GetConstantBufferGpuAddress();
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, cbuffer);
-    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferBones,
-        (weightsPerVertex > 0) ? mBones.GpuAddress() : cbuffer);
+    D3D12_GPU_VIRTUAL_ADDRESS bones = cbuffer;
+    if (weightsPerVertex > 0)
+    {
+        bones = (bonePalette) ? bonePalette : mBones.GpuAddress();
+    }
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferBones, bones);
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -671,10 +652,35 @@ void PBREffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void PBREffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* PBREffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* PBREffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE PBREffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->textureEnabled ? pImpl->descriptors[Impl::RootParameterIndex::AlbedoTexture] : D3D12_GPU_DESCRIPTOR_HANDLE{};
+}
+
+
 // Camera settings.
 void XM_CALLCONV PBREffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose;
 }
@@ -683,6 +689,7 @@ void XM_CALLCONV PBREffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV PBREffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition;
 }
@@ -691,6 +698,7 @@ void XM_CALLCONV PBREffect::SetView(FXMMATRIX value)
 void XM_CALLCONV PBREffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -701,11 +709,18 @@ void XM_CALLCONV PBREffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXMMATR
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition;
 }
 
 
+void PBREffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Light settings
 void XM_CALLCONV PBREffect::SetAmbientLightColor(FXMVECTOR)
 {
@@ -891,6 +906,7 @@ void SkinnedPBREffect::SetBoneTransforms(_In_reads_(count) XMMATRIX const* value
     #endif
     }
 
+    pImpl->bonePalette = 0;
     pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
 }
 
@@ -906,5 +922,13 @@ void SkinnedPBREffect::ResetBoneTransforms()
         boneConstant[i][2] = g_XMIdentityR2;
     }
 
+    pImpl->bonePalette = 0;
     pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
 }
+
+
+bool SkinnedPBREffect::SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette)
+{
+    pImpl->bonePalette = palette;
+    return true;
+}
@@ -118,6 +118,8 @@ private:
     EffectCache  mEffectCache;
     EffectCache  mEffectCacheSkinning;
 
+    // Guards the caches. Effects are built outside the lock, so if two threads create the same
+    // effect at once, the first one inserted is returned to both.
     std::mutex mutex;
 };
 
@@ -166,11 +168,12 @@ std::shared_ptr<IEffect> PBREffectFactory::Impl::CreateEffect(
         std::wstring cacheName;
         if (mSharing && !info.name.empty())
         {
-            const uint32_t hash = derivedPSD.ComputeHash();
+            const uint64_t hash = derivedPSD.ComputeHash64();
             cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = mEffectCacheSkinning.find(cacheName);
-            if (mSharing && it != mEffectCacheSkinning.end())
+            if (it != mEffectCacheSkinning.end())
             {
                 return it->second;
             }
@@ -185,8 +188,7 @@ std::shared_ptr<IEffect> PBREffectFactory::Impl::CreateEffect(
         if (mSharing && !info.name.empty())
         {
             std::lock_guard<std::mutex> lock(mutex);
-            EffectCache::value_type v(cacheName, effect);
-            mEffectCacheSkinning.insert(v);
+            return mEffectCacheSkinning.emplace(cacheName, effect).first->second;
         }
 
         return std::move(effect);
@@ -202,11 +204,12 @@ std::shared_ptr<IEffect> PBREffectFactory::Impl::CreateEffect(
         std::wstring cacheName;
         if (mSharing && !info.name.empty())
         {
-            const uint32_t hash = derivedPSD.ComputeHash();
+            const uint64_t hash = derivedPSD.ComputeHash64();
             cacheName = std::to_wstring(effectflags) + info.name + std::to_wstring(hash);
 
+            std::lock_guard<std::mutex> lock(mutex);
             auto it = mEffectCache.find(cacheName);
-            if (mSharing && it != mEffectCache.end())
+            if (it != mEffectCache.end())
             {
                 return it->second;
             }
@@ -221,8 +224,7 @@ std::shared_ptr<IEffect> PBREffectFactory::Impl::CreateEffect(
         if (mSharing && !info.name.empty())
         {
             std::lock_guard<std::mutex> lock(mutex);
-            EffectCache::value_type v(cacheName, effect);
-            mEffectCache.insert(v);
+            return mEffectCache.emplace(cacheName, effect).first->second;
         }
 
         return std::move(effect);
@@ -0,0 +1,600 @@
+//--------------------------------------------------------------------------------------
+// File: PipelineStateCache.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "PipelineStateCache.h"
+
+#include "BinaryReader.h"
+#include "Hash64.h"
+#include "LoaderHelpers.h"
+#include "PlatformHelpers.h"
+#include "SharedResourcePool.h"
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // The disk cache file is this header followed by the serialized pipeline library. D3D rejects
+    // a library written by another adapter or driver version when it is reloaded.
+    struct DiskCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    constexpr uint32_t c_DiskCacheMagic = 0x504B5444; // "DTKP"
+
+    // Bump when the pipeline names or file layout change, which discards existing files.
+    constexpr uint32_t c_DiskCacheVersion = 1;
+
+    static_assert(sizeof(DiskCacheHeader) == 24, "Mismatch with file layout");
+
+    inline void Append(std::string& key, _In_reads_bytes_(size) const void* data, size_t size)
+    {
+        key.append(static_cast<const char*>(data), size);
+    }
+
+    template<typename T>
+    inline void AppendValue(std::string& key, const T& value)
+    {
+        Append(key, &value, sizeof(T));
+    }
+
+    constexpr size_t c_DigestOffset = 4;
+    constexpr size_t c_DigestSize = 16;
+
+    // DXBC and DXIL containers start with a fourcc and a digest of their contents, which identifies the
+    // shader wherever its bytecode lives. Returns null for anything else, or a container without a digest.
+    const uint8_t* GetShaderDigest(const D3D12_SHADER_BYTECODE& shader) noexcept
+    {
+        static const uint8_t s_noDigest[c_DigestSize] = {};
+
+        auto bytecode = static_cast<const uint8_t*>(shader.pShaderBytecode);
+        if (bytecode
+            && shader.BytecodeLength >= c_DigestOffset + c_DigestSize
+            && memcmp(bytecode, "DXBC", 4) == 0
+            && memcmp(bytecode + c_DigestOffset, s_noDigest, c_DigestSize) != 0)
+        {
+            return bytecode + c_DigestOffset;
+        }
+
+        return nullptr;
+    }
+
+    // Shaders without a digest are identified by their address.
+    void AppendShader(std::string& key, const D3D12_SHADER_BYTECODE& shader)
+    {
+        AppendValue(key, shader.BytecodeLength);
+
+        auto digest = GetShaderDigest(shader);
+        if (digest)
+        {
+            key.push_back('D');
+            Append(key, digest, c_DigestSize);
+        }
+        else
+        {
+            key.push_back('A');
+            AppendValue(key, shader.pShaderBytecode);
+        }
+    }
+
+    // Disk cache entries outlive the process, so shaders without a digest are identified by their bytecode.
+    void HashShader(Hash64& hash, const D3D12_SHADER_BYTECODE& shader) noexcept
+    {
+        auto digest = GetShaderDigest(shader);
+        if (digest)
+        {
+            hash.Add(shader.BytecodeLength);
+            hash.AddBytes(digest, c_DigestSize);
+        }
+        else
+        {
+            hash.AddBytes(shader.pShaderBytecode, shader.pShaderBytecode ? shader.BytecodeLength : 0);
+        }
+    }
+
+    // The root signature isn't part of the name, as only its address is known here. If two pipelines
+    // differ only in root signature, D3D refuses to load the stored one for the other, which is then
+    // compiled as usual.
+    void MakeDiskCacheName(
+        const EffectPipelineStateDescription& description,
+        const D3D12_SHADER_BYTECODE& vertexShader,
+        const D3D12_SHADER_BYTECODE& pixelShader,
+        _Out_writes_(17) wchar_t* name) noexcept
+    {
+        Hash64 hash;
+        HashShader(hash, vertexShader);
+        HashShader(hash, pixelShader);
+        hash.Add(description.ComputeHash64());
+
+        swprintf_s(name, 17, L"%016llX", static_cast<unsigned long long>(hash.Finalize()));
+    }
+
+    // The state structures are compared as raw bytes, like ComputeHash does. Stale padding can only
+    // cause a miss, never a false match. The input layout is compared by the contents of its elements.
+    std::string MakeKey(
+        const EffectPipelineStateDescription& description,
+        ID3D12RootSignature* rootSignature,
+        const D3D12_SHADER_BYTECODE& vertexShader,
+        const D3D12_SHADER_BYTECODE& pixelShader)
+    {
+        std::string key;
+        key.reserve(1024);
+
+        AppendShader(key, vertexShader);
+        AppendShader(key, pixelShader);
+        AppendValue(key, rootSignature);
+
+        AppendValue(key, description.blendDesc);
+        AppendValue(key, description.depthStencilDesc);
+        AppendValue(key, description.rasterizerDesc);
+        AppendValue(key, description.renderTargetState);
+        AppendValue(key, description.primitiveTopology);
+        AppendValue(key, description.stripCutValue);
+
+        const auto& inputLayout = description.inputLayout;
+        AppendValue(key, inputLayout.NumElements);
+        for (UINT j = 0; j < inputLayout.NumElements; ++j)
+        {
+            const auto& element = inputLayout.pInputElementDescs[j];
+
+            if (element.SemanticName)
+            {
+                key.append(element.SemanticName);
+            }
+            key.push_back('\0');
+
+            AppendValue(key, element.SemanticIndex);
+            AppendValue(key, element.Format);
+            AppendValue(key, element.InputSlot);
+            AppendValue(key, element.AlignedByteOffset);
+            AppendValue(key, element.InputSlotClass);
+            AppendValue(key, element.InstanceDataStepRate);
+        }
+
+        return key;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Internal PipelineStateCache implementation class. Only one of these is allocated per D3D device.
+class PipelineStateCache::Impl
+{
+public:
+    explicit Impl(_In_ ID3D12Device* device)
+        : mDevice(device),
+        mHits(0),
+        mMisses(0),
+        mDiskLoads(0),
+        mDiskStores(0),
+        mLibraryDirty(false)
+    {
+    }
+
+    void GetPipelineState(
+        const EffectPipelineStateDescription& description,
+        _In_ ID3D12RootSignature* rootSignature,
+        const D3D12_SHADER_BYTECODE& vertexShader,
+        const D3D12_SHADER_BYTECODE& pixelShader,
+        _Outptr_ ID3D12PipelineState** pPipelineState);
+
+    Statistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        return Statistics{ mHits, mMisses, mDiskLoads, mDiskStores, mCache.size() };
+    }
+
+    void ResetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        mHits = mMisses = mDiskLoads = mDiskStores = 0;
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        mCache.clear();
+    }
+
+    bool OpenDiskCache(_In_z_ const wchar_t* fileName);
+    HRESULT SaveDiskCache();
+
+    static SharedResourcePool<ID3D12Device*, Impl> instancePool;
+
+private:
+    struct Entry
+    {
+        ComPtr<ID3D12PipelineState> pipelineState;
+
+        // Keeps the root signature's address from being reused while it is part of a key.
+        ComPtr<ID3D12RootSignature> rootSignature;
+    };
+
+    void LoadFromLibrary(
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc,
+        _In_z_ const wchar_t* name,
+        _Outptr_result_maybenull_ ID3D12PipelineState** pPipelineState);
+    void StoreToLibrary(_In_z_ const wchar_t* name, _In_ ID3D12PipelineState* pipelineState);
+
+    ComPtr<ID3D12Device> mDevice;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string, Entry> mCache;
+    size_t mHits;
+    size_t mMisses;
+    size_t mDiskLoads;
+    size_t mDiskStores;
+
+    // The library reads from the loaded file data for as long as it exists, so it is declared after it.
+    std::mutex mLibraryMutex;
+    std::wstring mLibraryFileName;
+    std::unique_ptr<uint8_t[]> mLibraryData;
+    ComPtr<ID3D12PipelineLibrary> mLibrary;
+    bool mLibraryDirty;
+};
+
+
+// Global pool of per-device PipelineStateCache resources.
+SharedResourcePool<ID3D12Device*, PipelineStateCache::Impl> PipelineStateCache::Impl::instancePool;
+
+
+_Use_decl_annotations_
+void PipelineStateCache::Impl::GetPipelineState(
+    const EffectPipelineStateDescription& description,
+    ID3D12RootSignature* rootSignature,
+    const D3D12_SHADER_BYTECODE& vertexShader,
+    const D3D12_SHADER_BYTECODE& pixelShader,
+    ID3D12PipelineState** pPipelineState)
+{
+    if (!pPipelineState)
+        throw std::invalid_argument("PipelineStateCache");
+
+    *pPipelineState = nullptr;
+
+    if (!rootSignature)
+        throw std::invalid_argument("PipelineStateCache requires a root signature");
+
+    auto key = MakeKey(description, rootSignature, vertexShader, pixelShader);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto it = mCache.find(key);
+        if (it != mCache.end())
+        {
+            ++mHits;
+            ThrowIfFailed(it->second.pipelineState.CopyTo(pPipelineState));
+            return;
+        }
+
+        ++mMisses;
+    }
+
+    // Load or compile without holding the lock, so other threads can look up or create other pipeline states.
+    ComPtr<ID3D12PipelineState> pipelineState;
+
+    wchar_t name[17] = {};
+    bool useLibrary;
+    {
+        std::lock_guard<std::mutex> lock(mLibraryMutex);
+        useLibrary = (mLibrary != nullptr);
+    }
+
+    if (useLibrary)
+    {
+    #if defined(_MSC_VER) || !defined(_WIN32)
+        auto psoDesc = description.GetDesc();
+    #else
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC tmpPSODesc;
+        auto& psoDesc = *description.GetDesc(&tmpPSODesc);
+    #endif
+
+        psoDesc.pRootSignature = rootSignature;
+        psoDesc.VS = vertexShader;
+        psoDesc.PS = pixelShader;
+
+        MakeDiskCacheName(description, vertexShader, pixelShader, name);
+        LoadFromLibrary(psoDesc, name, pipelineState.GetAddressOf());
+    }
+
+    if (!pipelineState)
+    {
+        description.CreatePipelineState(mDevice.Get(), rootSignature, vertexShader, pixelShader, pipelineState.GetAddressOf());
+
+        if (useLibrary)
+        {
+            StoreToLibrary(name, pipelineState.Get());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // If another thread created the same pipeline state in the meantime, use theirs so it is still shared.
+    auto result = mCache.emplace(std::move(key), Entry{ pipelineState, rootSignature });
+
+    ThrowIfFailed(result.first->second.pipelineState.CopyTo(pPipelineState));
+}
+
+
+_Use_decl_annotations_
+void PipelineStateCache::Impl::LoadFromLibrary(
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc,
+    const wchar_t* name,
+    ID3D12PipelineState** pPipelineState)
+{
+    *pPipelineState = nullptr;
+
+    std::lock_guard<std::mutex> lock(mLibraryMutex);
+
+    if (!mLibrary)
+        return;
+
+    // Fails with E_INVALIDARG if the name isn't in the library or was stored with a different description.
+    if (SUCCEEDED(mLibrary->LoadGraphicsPipeline(name, &psoDesc, IID_GRAPHICS_PPV_ARGS(pPipelineState))))
+    {
+        std::lock_guard<std::mutex> statsLock(mMutex);
+        ++mDiskLoads;
+    }
+}
+
+
+_Use_decl_annotations_
+void PipelineStateCache::Impl::StoreToLibrary(const wchar_t* name, ID3D12PipelineState* pipelineState)
+{
+    std::lock_guard<std::mutex> lock(mLibraryMutex);
+
+    if (!mLibrary)
+        return;
+
+    // A name that is already taken means the stored pipeline didn't match; the compiled one isn't persisted.
+    if (SUCCEEDED(mLibrary->StorePipeline(name, pipelineState)))
+    {
+        mLibraryDirty = true;
+
+        std::lock_guard<std::mutex> statsLock(mMutex);
+        ++mDiskStores;
+    }
+}
+
+
+_Use_decl_annotations_
+bool PipelineStateCache::Impl::OpenDiskCache(const wchar_t* fileName)
+{
+    if (!fileName || !*fileName)
+        throw std::invalid_argument("OpenDiskCache requires a file name");
+
+    std::lock_guard<std::mutex> lock(mLibraryMutex);
+
+    mLibrary.Reset();
+    mLibraryData.reset();
+    mLibraryDirty = false;
+    mLibraryFileName.clear();
+
+#if (defined(_XBOX_ONE) && defined(_TITLE)) || defined(_GAMING_XBOX)
+    // Pipeline compiles are cheap with the precompiled shaders used on Xbox.
+    return false;
+#else
+    ComPtr<ID3D12Device1> device1;
+    if (FAILED(mDevice.As(&device1)))
+        return false;
+
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+    if (SUCCEEDED(BinaryReader::ReadEntireFile(fileName, data, &dataSize)))
+    {
+        const char* reason = nullptr;
+        DiskCacheHeader header = {};
+        if (dataSize < sizeof(header))
+        {
+            reason = "truncated";
+        }
+        else
+        {
+            memcpy(&header, data.get(), sizeof(header));
+
+            if (header.magic != c_DiskCacheMagic)
+            {
+                reason = "not a pipeline cache";
+            }
+            else if (header.version != c_DiskCacheVersion)
+            {
+                reason = "older version";
+            }
+            else if (header.dataSize != dataSize - sizeof(header))
+            {
+                reason = "truncated";
+            }
+            else
+            {
+                Hash64 hash;
+                hash.AddBytes(data.get() + sizeof(header), static_cast<size_t>(header.dataSize));
+                if (hash.Finalize() != header.dataHash)
+                {
+                    reason = "corrupt";
+                }
+            }
+        }
+
+        if (!reason)
+        {
+            mLibraryData = std::move(data);
+
+            // Fails with D3D12_ERROR_ADAPTER_NOT_FOUND or D3D12_ERROR_DRIVER_VERSION_MISMATCH when the
+            // library was written on another adapter or driver.
+            const HRESULT hr = device1->CreatePipelineLibrary(
+                mLibraryData.get() + sizeof(header),
+                static_cast<size_t>(header.dataSize),
+                IID_GRAPHICS_PPV_ARGS(mLibrary.ReleaseAndGetAddressOf()));
+            if (FAILED(hr))
+            {
+                DebugTrace("INFO: PipelineStateCache discarding '%ls' (%08X)\n", fileName, static_cast<unsigned int>(hr));
+                mLibrary.Reset();
+                mLibraryData.reset();
+            }
+        }
+        else
+        {
+            DebugTrace("INFO: PipelineStateCache discarding '%ls' (%s)\n", fileName, reason);
+        }
+    }
+
+    if (!mLibrary)
+    {
+        const HRESULT hr = device1->CreatePipelineLibrary(nullptr, 0, IID_GRAPHICS_PPV_ARGS(mLibrary.ReleaseAndGetAddressOf()));
+        if (FAILED(hr))
+        {
+            // DXGI_ERROR_UNSUPPORTED if the driver doesn't support pipeline libraries.
+            DebugTrace("INFO: PipelineStateCache disk cache not available (%08X)\n", static_cast<unsigned int>(hr));
+            mLibrary.Reset();
+            return false;
+        }
+
+        // Write a valid file for this adapter and driver on the next save.
+        mLibraryDirty = true;
+    }
+
+    mLibraryFileName = fileName;
+    return true;
+#endif
+}
+
+
+HRESULT PipelineStateCache::Impl::SaveDiskCache()
+{
+    std::lock_guard<std::mutex> lock(mLibraryMutex);
+
+    if (!mLibrary || !mLibraryDirty)
+        return S_FALSE;
+
+    const size_t librarySize = mLibrary->GetSerializedSize();
+
+    std::unique_ptr<uint8_t[]> data(new (std::nothrow) uint8_t[sizeof(DiskCacheHeader) + librarySize]);
+    if (!data)
+        return E_OUTOFMEMORY;
+
+    HRESULT hr = mLibrary->Serialize(data.get() + sizeof(DiskCacheHeader), librarySize);
+    if (FAILED(hr))
+        return hr;
+
+    Hash64 hash;
+    hash.AddBytes(data.get() + sizeof(DiskCacheHeader), librarySize);
+
+    DiskCacheHeader header = {};
+    header.magic = c_DiskCacheMagic;
+    header.version = c_DiskCacheVersion;
+    header.dataSize = librarySize;
+    header.dataHash = hash.Finalize();
+    memcpy(data.get(), &header, sizeof(header));
+
+    const size_t fileSize = sizeof(header) + librarySize;
+    if (fileSize > UINT32_MAX)
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    ScopedHandle hFile(safe_handle(CreateFile2(
+        mLibraryFileName.c_str(),
+        GENERIC_WRITE, 0, CREATE_ALWAYS,
+        nullptr)));
+#else
+    ScopedHandle hFile(safe_handle(CreateFileW(
+        mLibraryFileName.c_str(),
+        GENERIC_WRITE, 0,
+        nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+        nullptr)));
+#endif
+    if (!hFile)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    // A partial file would only be discarded on load, but don't leave one behind.
+    LoaderHelpers::auto_delete_file delonfail(hFile.get());
+
+    DWORD bytesWritten = 0;
+    if (!WriteFile(hFile.get(), data.get(), static_cast<DWORD>(fileSize), &bytesWritten, nullptr))
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    if (bytesWritten != fileSize)
+        return E_FAIL;
+
+    delonfail.clear();
+
+    mLibraryDirty = false;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// PipelineStateCache
+//--------------------------------------------------------------------------------------
+
+// Public constructor.
+_Use_decl_annotations_
+PipelineStateCache::PipelineStateCache(ID3D12Device* device)
+{
+    if (!device)
+        throw std::invalid_argument("Direct3D device is null");
+
+    pImpl = Impl::instancePool.DemandCreate(device);
+}
+
+
+PipelineStateCache::PipelineStateCache(PipelineStateCache&&) noexcept = default;
+PipelineStateCache& PipelineStateCache::operator= (PipelineStateCache&&) noexcept = default;
+PipelineStateCache::~PipelineStateCache() = default;
+
+
+_Use_decl_annotations_
+void PipelineStateCache::GetPipelineState(
+    const EffectPipelineStateDescription& description,
+    ID3D12RootSignature* rootSignature,
+    const D3D12_SHADER_BYTECODE& vertexShader,
+    const D3D12_SHADER_BYTECODE& pixelShader,
+    ID3D12PipelineState** pPipelineState)
+{
+    pImpl->GetPipelineState(description, rootSignature, vertexShader, pixelShader, pPipelineState);
+}
+
+
+PipelineStateCache::Statistics PipelineStateCache::GetStatistics() const
+{
+    return pImpl->GetStatistics();
+}
+
+
+void PipelineStateCache::ResetStatistics()
+{
+    pImpl->ResetStatistics();
+}
+
+
+void PipelineStateCache::Clear()
+{
+    pImpl->Clear();
+}
+
+
+_Use_decl_annotations_
+bool PipelineStateCache::OpenDiskCache(const wchar_t* fileName)
+{
+    return pImpl->OpenDiskCache(fileName);
+}
+
+
+HRESULT PipelineStateCache::SaveDiskCache()
+{
+    return pImpl->SaveDiskCache();
+}
@@ -13,6 +13,7 @@
 #include "DirectXHelpers.h"
 #include "LoaderHelpers.h"
 #include "PlatformHelpers.h"
+#include "SharedResourcePool.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -290,14 +291,123 @@ namespace
             return pso;
         }
     };
+
+    constexpr size_t c_StagingChunkSize = 4 * 1024 * 1024;
+    constexpr size_t c_MaxRetainedStaging = 64 * 1024 * 1024;
+
+    struct StagingChunk
+    {
+        ComPtr<ID3D12Resource>  resource;
+        size_t                  size;
+    };
+
+    // Upload heap buffers shared by all the batches for a device. A batch suballocates its copies
+    // from the chunks it takes, and hands them back once the GPU has finished with the batch, so
+    // loading hundreds of textures only creates a handful of upload heaps.
+    class StagingPool
+    {
+    public:
+        explicit StagingPool(_In_ ID3D12Device* device) noexcept
+            : mDevice(device)
+            , mRetained(0)
+        {
+        }
+
+        StagingPool(StagingPool&&) = delete;
+        StagingPool& operator= (StagingPool&&) = delete;
+
+        StagingPool(StagingPool const&) = delete;
+        StagingPool& operator= (StagingPool const&) = delete;
+
+        // Returns a free chunk of at least size bytes, but not so much bigger it wastes memory.
+        StagingChunk Acquire(size_t size)
+        {
+            size = AlignUp(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+
+                auto best = mFree.end();
+                for (auto it = mFree.begin(); it != mFree.end(); ++it)
+                {
+                    if (it->size >= size && it->size / 2 <= size
+                        && (best == mFree.end() || it->size < best->size))
+                    {
+                        best = it;
+                    }
+                }
+
+                if (best != mFree.end())
+                {
+                    StagingChunk chunk = std::move(*best);
+                    mFree.erase(best);
+                    mRetained -= chunk.size;
+                    return chunk;
+                }
+            }
+
+            const CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
+            auto const resDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+
+            StagingChunk chunk = { nullptr, size };
+            ThrowIfFailed(mDevice->CreateCommittedResource(
+                &heapProps,
+                D3D12_HEAP_FLAG_NONE,
+                &resDesc,
+                D3D12_RESOURCE_STATE_GENERIC_READ,
+                nullptr, // D3D12_CLEAR_VALUE* pOptimizedClearValue
+                IID_GRAPHICS_PPV_ARGS(chunk.resource.GetAddressOf())));
+
+            SetDebugObjectName(chunk.resource.Get(), L"ResourceUploadBatch Staging");
+
+            return chunk;
+        }
+
+        // Takes back chunks the GPU is done with, keeping at most maxRetained bytes of them for reuse.
+        void Release(std::vector<StagingChunk>& chunks, size_t maxRetained)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            for (auto& chunk : chunks)
+            {
+                mRetained += chunk.size;
+                mFree.emplace_back(std::move(chunk));
+            }
+            chunks.clear();
+
+            // Drop the largest chunks first, since they're the least likely to be needed again.
+            if (mRetained > maxRetained)
+            {
+                std::sort(mFree.begin(), mFree.end(),
+                    [](const StagingChunk& a, const StagingChunk& b) noexcept { return a.size < b.size; });
+
+                while (mRetained > maxRetained)
+                {
+                    mRetained -= mFree.back().size;
+                    mFree.pop_back();
+                }
+            }
+        }
+
+    private:
+        ComPtr<ID3D12Device>        mDevice;
+        std::vector<StagingChunk>   mFree;
+        size_t                      mRetained;
+        std::mutex                  mMutex;
+    };
 } // anonymous namespace
 
 class ResourceUploadBatch::Impl
 {
 public:
     Impl(
-        _In_ ID3D12Device* device) noexcept
+        _In_ ID3D12Device* device) noexcept(false)
         : mDevice(device)
+        , mStagingPool(stagingPools.DemandCreate(device))
+        , mStagingOffset(0)
+        , mStagingBytes(0)
+        , mStagingBudget(0)
+        , mStreamingFenceValue(0)
         , mCommandType(D3D12_COMMAND_LIST_TYPE_DIRECT)
         , mInBeginEndBlock(false)
         , mTypedUAVLoadAdditionalFormats(false)
@@ -361,23 +471,16 @@ public:
             subresourceIndexStart,
             numSubresources);
 
-        const CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
-        auto const resDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadSize);
-
-        // Create a temporary buffer
-        ComPtr<ID3D12Resource> scratchResource = nullptr;
-        ThrowIfFailed(mDevice->CreateCommittedResource(
-            &heapProps,
-            D3D12_HEAP_FLAG_NONE,
-            &resDesc,
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr, // D3D12_CLEAR_VALUE* pOptimizedClearValue
-            IID_GRAPHICS_PPV_ARGS(scratchResource.GetAddressOf())));
+    #ifndef _WIN64
+        if (uploadSize > SIZE_MAX)
+            throw std::overflow_error("Upload is too large for the staging memory");
+    #endif
 
-        SetDebugObjectName(scratchResource.Get(), L"ResourceUploadBatch Temporary");
+        size_t stagingOffset = 0;
+        auto stagingResource = AllocateStaging(static_cast<size_t>(uploadSize), stagingOffset);
 
         // Submit resource copy to command list
-        UpdateSubresources(mList.Get(), resource, scratchResource.Get(), 0, subresourceIndexStart, numSubresources,
+        const UINT64 copied = UpdateSubresources(mList.Get(), resource, stagingResource, stagingOffset, subresourceIndexStart, numSubresources,
         #if defined(_XBOX_ONE) && defined(_TITLE)
                     // Workaround for header constness issue
             const_cast<D3D12_SUBRESOURCE_DATA*>(subRes)
@@ -386,8 +489,8 @@ public:
         #endif
         );
 
-        // Remember this upload object for delayed release
-        mTrackedObjects.push_back(scratchResource);
+        if (!copied)
+            throw std::runtime_error("UpdateSubresources");
     }
 
     void Upload(
@@ -404,6 +507,30 @@ public:
         mTrackedMemoryResources.push_back(buffer);
     }
 
+    void Upload(
+        _In_ ID3D12Resource* resource,
+        uint64_t destinationOffset,
+        const SharedGraphicsResource& buffer)
+    {
+        if (!mInBeginEndBlock)
+            throw std::logic_error("Can't call Upload on a closed ResourceUploadBatch.");
+
+        // Submit resource copy to command list
+        mList->CopyBufferRegion(resource, destinationOffset, buffer.Resource(), buffer.ResourceOffset(), buffer.Size());
+
+        // Remember this upload resource for delayed release
+        mTrackedMemoryResources.push_back(buffer);
+    }
+
+    void SetStagingBudget(size_t budget, _In_opt_ ID3D12CommandQueue* commandQueue)
+    {
+        if (budget > 0 && !commandQueue)
+            throw std::invalid_argument("A staging budget needs the command queue to stream to");
+
+        mStagingBudget = (commandQueue) ? budget : 0;
+        mStreamingQueue = commandQueue;
+    }
+
     // Asynchronously generate mips from a resource.
     // Resource must be in the PIXEL_SHADER_RESOURCE state
     void GenerateMips(_In_ ID3D12Resource* resource)
@@ -564,6 +691,9 @@ public:
         uploadBatch->GpuCompleteEvent.reset(gpuCompletedEvent);
         std::swap(mTrackedObjects, uploadBatch->TrackedObjects);
         std::swap(mTrackedMemoryResources, uploadBatch->TrackedMemoryResources);
+        std::swap(mStagingChunks, uploadBatch->StagingChunks);
+        uploadBatch->Staging = mStagingPool;
+        uploadBatch->MaxRetainedStaging = std::max(c_MaxRetainedStaging, mStagingBudget);
 
         // Kick off a thread that waits for the upload to complete on the GPU timeline.
         // Let the thread run autonomously, but provide a future the user can wait on.
@@ -583,6 +713,9 @@ public:
                     }
                 }
 
+                // The staging memory can be reused by later batches
+                uploadBatch->Staging->Release(uploadBatch->StagingChunks, uploadBatch->MaxRetainedStaging);
+
                 // Delete the batch
                 // Because the vectors contain smart-pointers, their destructors will
                 // fire and the resources will be released.
@@ -594,10 +727,13 @@ public:
         mInBeginEndBlock = false;
         mList.Reset();
         mCmdAlloc.Reset();
+        mStagingOffset = 0;
+        mStagingBytes = 0;
 
         // Swap above should have cleared these
         assert(mTrackedObjects.empty());
         assert(mTrackedMemoryResources.empty());
+        assert(mStagingChunks.empty());
 
         return future;
     }
@@ -631,6 +767,71 @@ public:
     }
 
 private:
+    // Suballocates staging memory for a copy, returning the buffer and the offset into it.
+    ID3D12Resource* AllocateStaging(size_t size, _Out_ size_t& offset)
+    {
+        if (!mStagingChunks.empty())
+        {
+            const auto& chunk = mStagingChunks.back();
+            const size_t alignedOffset = AlignUp(mStagingOffset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+            if (alignedOffset <= chunk.size && size <= chunk.size - alignedOffset)
+            {
+                offset = alignedOffset;
+                mStagingOffset = alignedOffset + size;
+                return chunk.resource.Get();
+            }
+        }
+
+        const size_t chunkSize = std::max(size, c_StagingChunkSize);
+
+        // Over budget, so stream out the work recorded so far and recycle its staging memory.
+        if (mStagingBudget > 0 && !mStagingChunks.empty() && mStagingBytes + chunkSize > mStagingBudget)
+        {
+            Flush();
+        }
+
+        auto chunk = mStagingPool->Acquire(chunkSize);
+        mStagingBytes += chunk.size;
+        mStagingChunks.emplace_back(std::move(chunk));
+
+        offset = 0;
+        mStagingOffset = size;
+        return mStagingChunks.back().resource.Get();
+    }
+
+    // Submits the work recorded so far to the streaming queue and waits for the GPU to finish it,
+    // then carries on recording the batch from an empty command list.
+    void Flush()
+    {
+        assert(mStreamingQueue);
+
+        ThrowIfFailed(mList->Close());
+        mStreamingQueue->ExecuteCommandLists(1, CommandListCast(mList.GetAddressOf()));
+
+        if (!mStreamingFence)
+        {
+            ThrowIfFailed(mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_GRAPHICS_PPV_ARGS(mStreamingFence.ReleaseAndGetAddressOf())));
+
+            SetDebugObjectName(mStreamingFence.Get(), L"ResourceUploadBatch Streaming");
+        }
+
+        ++mStreamingFenceValue;
+        ThrowIfFailed(mStreamingQueue->Signal(mStreamingFence.Get(), mStreamingFenceValue));
+
+        // A null event blocks until the fence is reached
+        ThrowIfFailed(mStreamingFence->SetEventOnCompletion(mStreamingFenceValue, nullptr));
+
+        mStagingPool->Release(mStagingChunks, std::max(c_MaxRetainedStaging, mStagingBudget));
+        mStagingOffset = 0;
+        mStagingBytes = 0;
+
+        mTrackedObjects.clear();
+        mTrackedMemoryResources.clear();
+
+        ThrowIfFailed(mCmdAlloc->Reset());
+        ThrowIfFailed(mList->Reset(mCmdAlloc.Get(), nullptr));
+    }
+
     // Resource is UAV compatible
     void GenerateMips_UnorderedAccessPath(
         _In_ ID3D12Resource* resource)
@@ -1038,11 +1239,14 @@ private:
     {
         std::vector<ComPtr<ID3D12DeviceChild>>  TrackedObjects;
         std::vector<SharedGraphicsResource>     TrackedMemoryResources;
+        std::vector<StagingChunk>               StagingChunks;
+        std::shared_ptr<StagingPool>            Staging;
+        size_t                                  MaxRetainedStaging;
         ComPtr<ID3D12GraphicsCommandList>       CommandList;
         ComPtr<ID3D12Fence>                     Fence;
         ScopedHandle                            GpuCompleteEvent;
 
-        UploadBatch() noexcept {}
+        UploadBatch() noexcept : MaxRetainedStaging(0) {}
     };
 
     ComPtr<ID3D12Device>                        mDevice;
@@ -1053,6 +1257,17 @@ private:
     std::vector<ComPtr<ID3D12DeviceChild>>      mTrackedObjects;
     std::vector<SharedGraphicsResource>         mTrackedMemoryResources;
 
+    std::shared_ptr<StagingPool>                mStagingPool;
+    std::vector<StagingChunk>                   mStagingChunks; // Filled in order; copies go in the last one
+    size_t                                      mStagingOffset;
+    size_t                                      mStagingBytes;
+    size_t                                      mStagingBudget;
+    ComPtr<ID3D12CommandQueue>                  mStreamingQueue;
+    ComPtr<ID3D12Fence>                         mStreamingFence;
+    uint64_t                                    mStreamingFenceValue;
+
+    static SharedResourcePool<ID3D12Device*, StagingPool> stagingPools;
+
     D3D12_COMMAND_LIST_TYPE                     mCommandType;
     bool                                        mInBeginEndBlock;
     bool                                        mTypedUAVLoadAdditionalFormats;
@@ -1060,6 +1275,9 @@ private:
 };
 
 
+SharedResourcePool<ID3D12Device*, StagingPool> ResourceUploadBatch::Impl::stagingPools;
+
+
 
 // Public constructor.
 ResourceUploadBatch::ResourceUploadBatch(_In_ ID3D12Device* device) noexcept(false)
@@ -1100,6 +1318,23 @@ void ResourceUploadBatch::Upload(
 }
 
 
+void ResourceUploadBatch::Upload(
+    _In_ ID3D12Resource* resource,
+    uint64_t destinationOffset,
+    const SharedGraphicsResource& buffer
+)
+{
+    pImpl->Upload(resource, destinationOffset, buffer);
+}
+
+
+
+_Use_decl_annotations_
+void ResourceUploadBatch::SetStagingBudget(size_t budget, ID3D12CommandQueue* commandQueue)
+{
+    pImpl->SetStagingBudget(budget, commandQueue);
+}
+
 
 void ResourceUploadBatch::GenerateMips(_In_ ID3D12Resource* resource)
 {
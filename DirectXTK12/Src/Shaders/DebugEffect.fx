@@ -9,10 +9,14 @@ cbuffer Parameters : register(b0)
     float3 AmbientDown              : packoffset(c0);
     float  Alpha                    : packoffset(c0.w);
     float3 AmbientRange             : packoffset(c1);
+};
 
-    float4x4 World                  : packoffset(c2);
-    float3x3 WorldInverseTranspose  : packoffset(c6);
-    float4x4 WorldViewProj          : packoffset(c9);
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
 
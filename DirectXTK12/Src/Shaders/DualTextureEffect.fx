@@ -16,7 +16,14 @@ cbuffer Parameters : register(b0)
     float4   DiffuseColor   : packoffset(c0);
     float3   FogColor       : packoffset(c1);
     float4   FogVector      : packoffset(c2);
-    float4x4 WorldViewProj  : packoffset(c3);
+};
+
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
 
@@ -25,14 +25,16 @@ cbuffer Parameters : register(b0)
     float3 LightDirection[3]        : packoffset(c4);
     float3 LightDiffuseColor[3]     : packoffset(c7);
 
-    float3 EyePosition              : packoffset(c10);
-
-    float3 FogColor                 : packoffset(c11);
-    float4 FogVector                : packoffset(c12);
+    float3 FogColor                 : packoffset(c10);
+    float4 FogVector                : packoffset(c11);
+};
 
-    float4x4 World                  : packoffset(c13);
-    float3x3 WorldInverseTranspose  : packoffset(c17);
-    float4x4 WorldViewProj          : packoffset(c20);
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
 
@@ -21,14 +21,16 @@ cbuffer Parameters : register(b0)
     float3 LightDiffuseColor[3]     : packoffset(c6);
     float3 LightSpecularColor[3]    : packoffset(c9);
 
-    float3 EyePosition              : packoffset(c12);
-
-    float3 FogColor                 : packoffset(c13);
-    float4 FogVector                : packoffset(c14);
+    float3 FogColor                 : packoffset(c12);
+    float4 FogVector                : packoffset(c13);
+};
 
-    float4x4 World                  : packoffset(c15);
-    float3x3 WorldInverseTranspose  : packoffset(c19);
-    float4x4 WorldViewProj          : packoffset(c22);
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
 cbuffer SkinningParameters : register(b1)
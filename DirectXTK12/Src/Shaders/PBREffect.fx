@@ -18,25 +18,29 @@ sampler IBLSampler     : register(s1);
 
 cbuffer Constants : register(b0)
 {
-    float3   EyePosition            : packoffset(c0);
-    float4x4 World                  : packoffset(c1);
-    float3x3 WorldInverseTranspose  : packoffset(c5);
-    float4x4 WorldViewProj          : packoffset(c8);
-    float4x4 PrevWorldViewProj      : packoffset(c12);
+    float4x4 PrevWorldViewProj      : packoffset(c0);
 
-    float3 LightDirection[3]        : packoffset(c16);
-    float3 LightColor[3]            : packoffset(c19);   // "Specular and diffuse light" in PBR
+    float3 LightDirection[3]        : packoffset(c4);
+    float3 LightColor[3]            : packoffset(c7);    // "Specular and diffuse light" in PBR
 
-    float3 ConstantAlbedo           : packoffset(c22);   // Constant values if not a textured effect
-    float  Alpha                    : packoffset(c22.w);
-    float  ConstantMetallic         : packoffset(c23.x);
-    float  ConstantRoughness        : packoffset(c23.y);
+    float3 ConstantAlbedo           : packoffset(c10);   // Constant values if not a textured effect
+    float  Alpha                    : packoffset(c10.w);
+    float  ConstantMetallic         : packoffset(c11.x);
+    float  ConstantRoughness        : packoffset(c11.y);
 
-    int NumRadianceMipLevels        : packoffset(c23.z);
+    int NumRadianceMipLevels        : packoffset(c11.z);
 
     // Size of render target
-    float TargetWidth : packoffset(c23.w);
-    float TargetHeight : packoffset(c24.x);
+    float TargetWidth : packoffset(c11.w);
+    float TargetHeight : packoffset(c12.x);
+};
+
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
 cbuffer SkinningParameters : register(b1)
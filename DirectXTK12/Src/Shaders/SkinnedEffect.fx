@@ -19,18 +19,23 @@ cbuffer Parameters : register(b0)
     float3 LightDiffuseColor[3]     : packoffset(c6);
     float3 LightSpecularColor[3]    : packoffset(c9);
 
-    float3 EyePosition              : packoffset(c12);
-
-    float3 FogColor                 : packoffset(c13);
-    float4 FogVector                : packoffset(c14);
-
-    float4x4 World                  : packoffset(c15);
-    float3x3 WorldInverseTranspose  : packoffset(c19);
-    float4x4 WorldViewProj          : packoffset(c22);
+    float3 FogColor                 : packoffset(c12);
+    float4 FogVector                : packoffset(c13);
+};
 
-    float4x3 Bones[72]              : packoffset(c26);
+cbuffer Transforms : register(b2)
+{
+    float4x4 World                  : packoffset(c0);
+    float3x3 WorldInverseTranspose  : packoffset(c4);
+    float4x4 WorldViewProj          : packoffset(c7);
+    float3   EyePosition            : packoffset(c11);
 };
 
+cbuffer SkinningParameters : register(b1)
+{
+    float4x3 Bones[72];
+}
+
 
 #include "Structures.fxh"
 #include "Common.fxh"
@@ -41,7 +46,7 @@ cbuffer Parameters : register(b0)
 
 
 // Vertex shader: vertex lighting, one bone.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingOneBone(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -56,7 +61,7 @@ VSOutputTx VSSkinnedVertexLightingOneBone(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingOneBoneBn(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -75,7 +80,7 @@ VSOutputTx VSSkinnedVertexLightingOneBoneBn(VSInputNmTxWeights vin)
 
 
 // Vertex shader: vertex lighting, two bones.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingTwoBones(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -90,7 +95,7 @@ VSOutputTx VSSkinnedVertexLightingTwoBones(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingTwoBonesBn(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -109,7 +114,7 @@ VSOutputTx VSSkinnedVertexLightingTwoBonesBn(VSInputNmTxWeights vin)
 
 
 // Vertex shader: vertex lighting, four bones.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingFourBones(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -124,7 +129,7 @@ VSOutputTx VSSkinnedVertexLightingFourBones(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputTx VSSkinnedVertexLightingFourBonesBn(VSInputNmTxWeights vin)
 {
     VSOutputTx vout;
@@ -143,7 +148,7 @@ VSOutputTx VSSkinnedVertexLightingFourBonesBn(VSInputNmTxWeights vin)
 
 
 // Vertex shader: pixel lighting, one bone.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingOneBone(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -159,7 +164,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingOneBone(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingOneBoneBn(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -179,7 +184,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingOneBoneBn(VSInputNmTxWeights vin)
 
 
 // Vertex shader: pixel lighting, two bones.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingTwoBones(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -195,7 +200,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingTwoBones(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingTwoBonesBn(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -215,7 +220,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingTwoBonesBn(VSInputNmTxWeights vin)
 
 
 // Vertex shader: pixel lighting, four bones.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingFourBones(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -231,7 +236,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingFourBones(VSInputNmTxWeights vin)
     return vout;
 }
 
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 VSOutputPixelLightingTx VSSkinnedPixelLightingFourBonesBn(VSInputNmTxWeights vin)
 {
     VSOutputPixelLightingTx vout;
@@ -251,7 +256,7 @@ VSOutputPixelLightingTx VSSkinnedPixelLightingFourBonesBn(VSInputNmTxWeights vin
 
 
 // Pixel shader: vertex lighting.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 float4 PSSkinnedVertexLighting(PSInputTx pin) : SV_Target0
 {
     float4 color = Texture.Sample(Sampler, pin.TexCoord) * pin.Diffuse;
@@ -264,7 +269,7 @@ float4 PSSkinnedVertexLighting(PSInputTx pin) : SV_Target0
 
 
 // Pixel shader: vertex lighting, no fog.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 float4 PSSkinnedVertexLightingNoFog(PSInputTx pin) : SV_Target0
 {
     float4 color = Texture.Sample(Sampler, pin.TexCoord) * pin.Diffuse;
@@ -276,7 +281,7 @@ float4 PSSkinnedVertexLightingNoFog(PSInputTx pin) : SV_Target0
 
 
 // Pixel shader: pixel lighting.
-[RootSignature(MainRS)]
+[RootSignature(SkinnedRS)]
 float4 PSSkinnedPixelLighting(PSInputPixelLightingTx pin) : SV_Target0
 {
     float4 color = Texture.Sample(Sampler, pin.TexCoord) * pin.Diffuse;
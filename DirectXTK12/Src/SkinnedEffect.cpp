@@ -9,6 +9,15 @@
 
 #include "pch.h"
 #include "EffectCommon.h"
+#include "CommandListStateCache.h"
+
+namespace DirectX
+{
+    namespace EffectDirtyFlags
+    {
+        constexpr int ConstantBufferBones = 0x100000;
+    }
+}
 
 using namespace DirectX;
 
@@ -25,19 +34,19 @@ namespace
         XMVECTOR lightDiffuseColor[IEffectLights::MaxDirectionalLights];
         XMVECTOR lightSpecularColor[IEffectLights::MaxDirectionalLights];
 
-        XMVECTOR eyePosition;
-
         XMVECTOR fogColor;
         XMVECTOR fogVector;
+    };
 
-        XMMATRIX world;
-        XMVECTOR worldInverseTranspose[3];
-        XMMATRIX worldViewProj;
+    static_assert((sizeof(SkinnedEffectConstants) % 16) == 0, "CB size not padded correctly");
 
-        XMVECTOR bones[SkinnedEffect::MaxBones][3];
+    XM_ALIGNED_STRUCT(16) BoneConstants
+    {
+        XMVECTOR Bones[SkinnedEffect::MaxBones][3];
     };
 
-    static_assert((sizeof(SkinnedEffectConstants) % 16) == 0, "CB size not padded correctly");
+    static_assert((sizeof(BoneConstants) % 16) == 0, "CB size not padded correctly");
+    static_assert(sizeof(BoneConstants) == IEffectSkinning::BonePaletteSize, "Bone palette size mismatch");
 
 
     // Traits type describes our characteristics to the EffectBase template.
@@ -63,6 +72,8 @@ public:
         ConstantBuffer,
         TextureSRV,
         TextureSampler,
+        ConstantBufferBones,
+        ConstantBufferTransforms,
         RootParameterCount
     };
 
@@ -73,7 +84,14 @@ public:
 
     int GetPipelineStatePermutation(uint32_t effectFlags) const noexcept;
 
-    void Apply(_In_ ID3D12GraphicsCommandList* commandList);
+    template<typename TCommandList>
+    void Apply(_In_ TCommandList* commandList);
+
+    BoneConstants boneConstants;
+    D3D12_GPU_VIRTUAL_ADDRESS bonePalette;
+
+private:
+    GraphicsResource mBones;
 };
 
 
@@ -186,7 +204,9 @@ SkinnedEffect::Impl::Impl(
     const EffectPipelineStateDescription& pipelineDescription)
     : EffectBase(device),
     texture{},
-    sampler{}
+    sampler{},
+    boneConstants{},
+    bonePalette(0)
 {
     static_assert(static_cast<int>(std::size(EffectBase<SkinnedEffectTraits>::VertexShaderIndices)) == SkinnedEffectTraits::ShaderPermutationCount, "array/max mismatch");
     static_assert(static_cast<int>(std::size(EffectBase<SkinnedEffectTraits>::VertexShaderBytecode)) == SkinnedEffectTraits::VertexShaderCount, "array/max mismatch");
@@ -197,9 +217,9 @@ SkinnedEffect::Impl::Impl(
 
     for (int i = 0; i < MaxBones; i++)
     {
-        constants.bones[i][0] = g_XMIdentityR0;
-        constants.bones[i][1] = g_XMIdentityR1;
-        constants.bones[i][2] = g_XMIdentityR2;
+        boneConstants.Bones[i][0] = g_XMIdentityR0;
+        boneConstants.Bones[i][1] = g_XMIdentityR1;
+        boneConstants.Bones[i][2] = g_XMIdentityR2;
     }
 
     // Create root signature.
@@ -222,6 +242,8 @@ SkinnedEffect::Impl::Impl(
         rootParameters[RootParameterIndex::TextureSRV].InitAsDescriptorTable(1, &textureSrvDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
         rootParameters[RootParameterIndex::TextureSampler].InitAsDescriptorTable(1, &textureSamplerDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
         rootParameters[RootParameterIndex::ConstantBuffer].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[RootParameterIndex::ConstantBufferBones].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+        rootParameters[RootParameterIndex::ConstantBufferTransforms].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_ALL);
 
         CD3DX12_ROOT_SIGNATURE_DESC rsigDesc = {};
         rsigDesc.Init(static_cast<UINT>(std::size(rootParameters)), rootParameters, 0, nullptr, rootSignatureFlags);
@@ -256,12 +278,10 @@ SkinnedEffect::Impl::Impl(
     assert(pi >= 0 && pi < SkinnedEffectTraits::PixelShaderCount);
     _Analysis_assume_(pi >= 0 && pi < SkinnedEffectTraits::PixelShaderCount);
 
-    pipelineDescription.CreatePipelineState(
-        device,
-        mRootSignature,
+    CreatePipelineState(
+        pipelineDescription,
         EffectBase<SkinnedEffectTraits>::VertexShaderBytecode[vi],
-        EffectBase<SkinnedEffectTraits>::PixelShaderBytecode[pi],
-        mPipelineState.GetAddressOf());
+        EffectBase<SkinnedEffectTraits>::PixelShaderBytecode[pi]);
 
     SetDebugObjectName(mPipelineState.Get(), L"SkinnedEffect");
 }
@@ -294,14 +314,22 @@ int SkinnedEffect::Impl::GetPipelineStatePermutation(uint32_t effectFlags) const
 
 
 // Sets our state onto the D3D device.
-void SkinnedEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
+template<typename TCommandList>
+void SkinnedEffect::Impl::Apply(_In_ TCommandList* commandList)
 {
     // Compute derived parameter values.
-    matrices.SetConstants(dirtyFlags, constants.worldViewProj);
+    auto const graphicsMemory = GetGraphicsMemory(commandList);
+    auto const transformBuffer = UpdateTransforms(graphicsMemory);
     fog.SetConstants(dirtyFlags, matrices.worldView, constants.fogVector);
-    lights.SetConstants(dirtyFlags, matrices, constants.world, constants.worldInverseTranspose, constants.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
+    lights.SetConstants(dirtyFlags, matrices, transforms.world, transforms.worldInverseTranspose, transforms.eyePosition, constants.diffuseColor, constants.emissiveColor, true);
 
-    UpdateConstants();
+    UpdateConstants(graphicsMemory);
+
+    if (!bonePalette && (dirtyFlags & EffectDirtyFlags::ConstantBufferBones))
+    {
+        mBones = AllocateConstant(boneConstants, graphicsMemory);
+        dirtyFlags &= ~EffectDirtyFlags::ConstantBufferBones;
+    }
 
     // Set the root signature
     commandList->SetGraphicsRootSignature(mRootSignature);
@@ -319,6 +347,9 @@ void SkinnedEffect::Impl::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 
     // Set constants
     commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBuffer, GetConstantBufferGpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferBones,
+        (bonePalette) ? bonePalette : mBones.GpuAddress());
+    commandList->SetGraphicsRootConstantBufferView(RootParameterIndex::ConstantBufferTransforms, transformBuffer);
 
     // Set the pipeline state
     commandList->SetPipelineState(EffectBase::mPipelineState.Get());
@@ -347,10 +378,35 @@ void SkinnedEffect::Apply(_In_ ID3D12GraphicsCommandList* commandList)
 }
 
 
+void SkinnedEffect::Apply(CommandListStateCache& commandList)
+{
+    pImpl->Apply(&commandList);
+}
+
+
+// IEffectPipelineState methods.
+ID3D12PipelineState* SkinnedEffect::GetPipelineState() const noexcept
+{
+    return pImpl->GetPipelineState();
+}
+
+
+ID3D12RootSignature* SkinnedEffect::GetRootSignature() const noexcept
+{
+    return pImpl->GetRootSignature();
+}
+
+
+D3D12_GPU_DESCRIPTOR_HANDLE SkinnedEffect::GetPrimaryTexture() const noexcept
+{
+    return pImpl->texture;
+}
+
+
 // Camera settings.
 void XM_CALLCONV SkinnedEffect::SetWorld(FXMMATRIX value)
 {
-    pImpl->matrices.world = value;
+    pImpl->matrices.SetWorld(value);
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::FogVector;
 }
@@ -359,6 +415,7 @@ void XM_CALLCONV SkinnedEffect::SetWorld(FXMMATRIX value)
 void XM_CALLCONV SkinnedEffect::SetView(FXMMATRIX value)
 {
     pImpl->matrices.view = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
@@ -367,6 +424,7 @@ void XM_CALLCONV SkinnedEffect::SetView(FXMMATRIX value)
 void XM_CALLCONV SkinnedEffect::SetProjection(FXMMATRIX value)
 {
     pImpl->matrices.projection = value;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj;
 }
@@ -377,11 +435,18 @@ void XM_CALLCONV SkinnedEffect::SetMatrices(FXMMATRIX world, CXMMATRIX view, CXM
     pImpl->matrices.world = world;
     pImpl->matrices.view = view;
     pImpl->matrices.projection = projection;
+    pImpl->matrices.ClearShared();
 
     pImpl->dirtyFlags |= EffectDirtyFlags::WorldViewProj | EffectDirtyFlags::WorldInverseTranspose | EffectDirtyFlags::EyePosition | EffectDirtyFlags::FogVector;
 }
 
 
+void SkinnedEffect::SetSharedMatrices(const SharedEffectMatrices& value)
+{
+    pImpl->dirtyFlags |= pImpl->matrices.SetShared(value);
+}
+
+
 // Material settings.
 void XM_CALLCONV SkinnedEffect::SetDiffuseColor(FXMVECTOR value)
 {
@@ -527,7 +592,7 @@ void SkinnedEffect::SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, s
     if (count > MaxBones)
         throw std::invalid_argument("count parameter exceeds MaxBones");
 
-    auto boneConstant = pImpl->constants.bones;
+    auto boneConstant = pImpl->boneConstants.Bones;
 
     for (size_t i = 0; i < count; i++)
     {
@@ -543,13 +608,14 @@ void SkinnedEffect::SetBoneTransforms(_In_reads_(count) XMMATRIX const* value, s
     #endif
     }
 
-    pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
+    pImpl->bonePalette = 0;
+    pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
 }
 
 
 void SkinnedEffect::ResetBoneTransforms()
 {
-    auto boneConstant = pImpl->constants.bones;
+    auto boneConstant = pImpl->boneConstants.Bones;
 
     for (size_t i = 0; i < MaxBones; ++i)
     {
@@ -558,5 +624,13 @@ void SkinnedEffect::ResetBoneTransforms()
         boneConstant[i][2] = g_XMIdentityR2;
     }
 
-    pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBuffer;
+    pImpl->bonePalette = 0;
+    pImpl->dirtyFlags |= EffectDirtyFlags::ConstantBufferBones;
+}
+
+
+bool SkinnedEffect::SetBonePalette(D3D12_GPU_VIRTUAL_ADDRESS palette)
+{
+    pImpl->bonePalette = palette;
+    return true;
 }
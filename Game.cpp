@@ -13,8 +13,9 @@ extern bool g_HDRMode;
 #else
 #include "FindMedia.h"
 #endif
-#include "ReadData.h"
 #include "SDKMesh.h"
+#include "DTKModel.h"
+#include "BakedSource.h"
 
 extern void ExitGame() noexcept;
 
@@ -27,11 +28,19 @@ namespace
 {
     const XMVECTORF32 c_Gray = { 0.215861f, 0.215861f, 0.215861f, 1.f };
     const XMVECTORF32 c_CornflowerBlue = { 0.127438f, 0.300544f, 0.846873f, 1.f };
+
+    // Upload pages kept for reuse beyond this are freed at Commit, so pages used once while loading a model are given back.
+    constexpr size_t c_UnusedUploadBudget = 32 * 1024 * 1024;
+
+    // Model loads with more texture data than this stream their uploads through it in chunks.
+    constexpr size_t c_TextureStagingBudget = 256 * 1024 * 1024;
 }
 
 bool Game::s_render4k = false;
 
 Game::Game() noexcept(false) :
+    m_animTime(0.0),
+    m_modelDescriptorSlot(0),
     m_gridScale(10.f),
     m_fov(XM_PI / 4.f),
     m_zoom(1.f),
@@ -52,6 +61,8 @@ Game::Game() noexcept(false) :
     m_fpscamera(false),
     m_boneMode(false),
     m_skinning(false),
+    m_animPlaying(false),
+    m_prewarmEffects(true),
     m_toneMapMode(ToneMapPostProcess::Reinhard),
     m_selectFile(0),
     m_firstFile(0)
@@ -84,12 +95,25 @@ Game::Game() noexcept(false) :
     *m_szModelName = 0;
     *m_szStatus = 0;
     *m_szError = 0;
+    *m_szTimings = 0;
 
     m_defaultTextureName = L"default.dds";
 }
 
 Game::~Game()
 {
+    if (m_modelLoad)
+    {
+        m_modelLoad->result.wait();
+    }
+
+    StopEffectPrewarm();
+
+    if (m_pipelineStateCache)
+    {
+        std::ignore = m_pipelineStateCache->SaveDiskCache();
+    }
+
     if (m_deviceResources)
     {
         m_deviceResources->WaitForGpu();
@@ -144,8 +168,11 @@ void Game::Tick()
 // Updates the world.
 void Game::Update(DX::StepTimer const& timer)
 {
-    if (m_reloadModel)
-        LoadModel();
+    if (m_modelLoad && m_modelLoad->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        FinishModelLoad();
+
+    if (m_reloadModel && !m_modelLoad)
+        StartModelLoad();
 
     float elapsedTime = float(timer.GetElapsedSeconds());
 
@@ -177,7 +204,7 @@ void Game::Update(DX::StepTimer const& timer)
                 swprintf_s(m_szModelName, L"D:\\%ls", m_fileNames[m_selectFile].c_str());
                 m_selectFile = m_firstFile = 0;
                 m_fileNames.clear();
-                LoadModel();
+                m_reloadModel = true;
             }
             else if (gpad.IsBPressed())
             {
@@ -449,6 +476,19 @@ void Game::Update(DX::StepTimer const& timer)
         if (m_keyboardTracker.pressed.L)
             m_lighting = !m_lighting;
 
+        if (m_keyboardTracker.pressed.V)
+        {
+            m_prewarmEffects = !m_prewarmEffects;
+            if (m_prewarmEffects)
+            {
+                StartEffectPrewarm();
+            }
+            else
+            {
+                StopEffectPrewarm();
+            }
+        }
+
         if (m_keyboardTracker.pressed.H)
             m_showHud = !m_showHud;
 
@@ -466,6 +506,19 @@ void Game::Update(DX::StepTimer const& timer)
             PostMessage(m_deviceResources->GetWindow(), WM_USER, 0, 0);
         }
 
+        if (m_animation || m_animationCMO)
+        {
+            if (m_keyboardTracker.pressed.P)
+                m_animPlaying = !m_animPlaying;
+
+            // Scrubbing pauses playback
+            if (kb.OemComma || kb.OemPeriod)
+            {
+                m_animPlaying = false;
+                m_animTime += (kb.OemPeriod) ? elapsedTime : -elapsedTime;
+            }
+        }
+
         if (m_keyboardTracker.IsKeyPressed(Keyboard::Enter) && !kb.LeftAlt && !kb.RightAlt)
         {
             ++m_ibl;
@@ -551,6 +604,29 @@ void Game::Update(DX::StepTimer const& timer)
     }
 #endif
 
+    // Update animation
+    if (m_animation || m_animationCMO)
+    {
+        if (m_animPlaying)
+        {
+            m_animTime += timer.GetElapsedSeconds();
+        }
+
+        const double duration = (m_animation) ? m_animation->GetDuration() : m_animationCMO->GetDuration();
+        if (duration > 0.0)
+        {
+            m_animTime = fmod(m_animTime, duration);
+            if (m_animTime < 0.0)
+            {
+                m_animTime += duration;
+            }
+        }
+        else
+        {
+            m_animTime = 0.0;
+        }
+    }
+
     // Update camera
     Vector3 dir = Vector3::Transform((m_lhcoords) ? Vector3::Forward : Vector3::Backward, m_cameraRot);
     Vector3 up = Vector3::Transform(Vector3::Up, m_cameraRot);
@@ -650,6 +726,9 @@ void Game::Render()
         }
         else
         {
+            // Only the selected variant is drawn, so it's the only one that needs the IBL and matrices.
+            auto& effects = CreateEffectVariant(*m_effectVariants, *m_model, EffectVariantIndex(m_wireframe, m_ccw, m_lighting));
+
             {
                 auto radianceTex = m_resourceDescriptors->GetGpuHandle(Descriptors::RadianceIBL1 + m_ibl);
 
@@ -657,54 +736,11 @@ void Game::Render()
 
                 auto irradianceTex = m_resourceDescriptors->GetGpuHandle(Descriptors::IrradianceIBL1 + m_ibl);
 
-                for (auto& it : m_modelWireframe)
-                {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
-                    {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
-                    }
-                }
-                for (auto& it : m_modelCounterClockwise)
-                {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
-                    {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
-                    }
-                }
-                for (auto& it : m_modelClockwise)
+                for (auto& it : effects)
                 {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
+                    if (it.pbr)
                     {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
-                    }
-                }
-
-                // "Unlit" may contain PBR or Skinning so set them anyhow
-                for (auto& it : m_unlitWireframe)
-                {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
-                    {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
-                    }
-                }
-                for (auto& it : m_unlitCounterClockwise)
-                {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
-                    {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
-                    }
-                }
-                for (auto& it : m_unlitClockwise)
-                {
-                    auto pbr = dynamic_cast<PBREffect*>(it.get());
-                    if (pbr)
-                    {
-                        pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
+                        it.pbr->SetIBLTextures(radianceTex, diffuseDesc.MipLevels, irradianceTex, m_states->AnisotropicClamp());
                     }
                 }
             }
@@ -713,136 +749,80 @@ void Game::Render()
             {
                 const size_t nbones = m_model->bones.size();
                 assert(m_bones != 0);
-                m_model->CopyAbsoluteBoneTransformsTo(nbones, m_bones.get());
-                if (m_skinning)
+                if (m_animation)
                 {
-                    for (size_t j = 0; j < nbones; ++j)
-                    {
-                        m_bones[j] = XMMatrixMultiply(m_model->invBindPoseMatrices[j], m_bones[j]);
-                    }
-                }
-            }
-
-            Model::EffectCollection::const_iterator eit;
-            if (m_wireframe)
-            {
-                if (m_lighting)
-                {
-                    Model::UpdateEffectMatrices(m_modelWireframe, m_world, m_view, m_proj);
-                    if (m_skinning && !m_boneMode)
-                    {
-                        for (auto& it : m_modelWireframe)
-                        {
-                            auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                            if (skinning)
-                            {
-                                skinning->ResetBoneTransforms();
-                            }
-                        }
-                    }
-                    eit = m_modelWireframe.cbegin();
+                    m_model->CopyBoneTransformsTo(nbones, m_animBones.get());
+                    m_animation->Sample(m_animTime, nbones, m_animBones.get());
+                    m_model->CopyAbsoluteBoneTransforms(nbones, m_animBones.get(), m_bones.get());
                 }
                 else
                 {
-                    Model::UpdateEffectMatrices(m_unlitWireframe, m_world, m_view, m_proj);
-                    if (m_skinning && !m_boneMode)
-                    {
-                        for (auto& it : m_unlitWireframe)
-                        {
-                            auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                            if (skinning)
-                            {
-                                skinning->ResetBoneTransforms();
-                            }
-                        }
-                    }
-                    eit = m_unlitWireframe.cbegin();
-                }
-            }
-            else if (m_ccw)
-            {
-                if (m_lighting)
-                {
-                    Model::UpdateEffectMatrices(m_modelCounterClockwise, m_world, m_view, m_proj);
-                    if (m_skinning && !m_boneMode)
+                    if (m_animationCMO)
                     {
-                        for (auto& it : m_modelCounterClockwise)
-                        {
-                            auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                            if (skinning)
-                            {
-                                skinning->ResetBoneTransforms();
-                            }
-                        }
+                        m_animationCMO->Apply(m_animTime, *m_model);
                     }
-                    eit = m_modelCounterClockwise.cbegin();
+
+                    m_model->CopyAbsoluteBoneTransformsTo(nbones, m_bones.get());
                 }
-                else
+                if (m_skinning)
                 {
-                    Model::UpdateEffectMatrices(m_unlitCounterClockwise, m_world, m_view, m_proj);
-                    if (m_skinning && !m_boneMode)
+                    for (size_t j = 0; j < nbones; ++j)
                     {
-                        for (auto& it : m_unlitCounterClockwise)
-                        {
-                            auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                            if (skinning)
-                            {
-                                skinning->ResetBoneTransforms();
-                            }
-                        }
+                        m_bones[j] = XMMatrixMultiply(m_model->invBindPoseMatrices[j], m_bones[j]);
                     }
-                    eit = m_unlitCounterClockwise.cbegin();
                 }
             }
-            else if (m_lighting)
+
+            // The derived matrices are only recomputed, and the effects only take them, when the model or camera moves.
+            if (m_world != Matrix(m_sharedMatrices.GetWorld())
+                || m_view != Matrix(m_sharedMatrices.GetView())
+                || m_proj != Matrix(m_sharedMatrices.GetProjection()))
             {
-                Model::UpdateEffectMatrices(m_modelClockwise, m_world, m_view, m_proj);
-                if (m_skinning && !m_boneMode)
-                {
-                    for (auto& it : m_modelClockwise)
-                    {
-                        auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                        if (skinning)
-                        {
-                            skinning->ResetBoneTransforms();
-                        }
-                    }
-                }
-                eit = m_modelClockwise.cbegin();
+                m_sharedMatrices.SetMatrices(m_world, m_view, m_proj);
             }
-            else
+            // Effect, palette and shared matrix constants come from the render thread's own allocation context.
+            CommandListStateCache stateCache(commandList, m_renderMemory.get());
+
+            m_sharedMatrices.UpdateConstantBuffer(*m_renderMemory);
+            Model::UpdateEffectMatrices(effects, m_sharedMatrices);
+            if (m_skinning && !m_boneMode)
             {
-                Model::UpdateEffectMatrices(m_unlitClockwise, m_world, m_view, m_proj);
-                if (m_skinning && !m_boneMode)
+                for (auto& it : effects)
                 {
-                    for (auto& it : m_unlitClockwise)
+                    if (it.skinning)
                     {
-                        auto skinning = dynamic_cast<IEffectSkinning*>(it.get());
-                        if (skinning)
-                        {
-                            skinning->ResetBoneTransforms();
-                        }
+                        it.skinning->ResetBoneTransforms();
                     }
                 }
-                eit = m_unlitClockwise.cbegin();
             }
+            const auto eit = effects.cbegin();
+
+            const XMMATRIX viewProj = XMMatrixMultiply(m_view, m_proj);
+
+            m_renderQueue.Clear();
 
             if (m_boneMode)
             {
-                if (m_skinning)
+                m_model->Cull(m_model->bones.size(), m_bones.get(), m_world, viewProj, m_visibility);
+
+                if (m_skinning && m_skinningContext)
                 {
-                    m_model->DrawSkinned(commandList, m_model->bones.size(), m_bones.get(), m_world, eit);
+                    m_skinningContext->Draw(stateCache, m_model->bones.size(), m_bones.get(), m_world, eit, &m_visibility);
                 }
                 else
                 {
-                    m_model->Draw(commandList, m_model->bones.size(), m_bones.get(), m_world, eit);
+                    m_renderQueue.Add(*m_model, m_model->bones.size(), m_bones.get(), m_world, eit, &m_visibility);
                 }
             }
             else
             {
-                m_model->Draw(commandList, eit);
+                m_model->Cull(m_world, viewProj, m_visibility);
+                m_renderQueue.Add(*m_model, eit, &m_visibility);
             }
 
+            m_renderQueue.Sort(m_view, !m_lhcoords);
+            m_renderQueue.Submit(stateCache);
+
             if (*m_szStatus && m_showHud)
             {
                 m_spriteBatch->Begin(commandList);
@@ -906,6 +886,95 @@ void Game::Render()
                 wchar_t szMode[64] = {};
                 swprintf_s(szMode, L" %ls (Sensitivity: %8.4f)", (m_fpscamera) ? L"  FPS" : L"Orbit", m_sensitivity);
 
+                wchar_t szAnim[128] = {};
+                if (m_animation)
+                {
+                    swprintf_s(szAnim, L"Animation: %7.3f / %7.3f s   Keys: %u @ %u fps   Tracks: %Iu of %Iu   %ls",
+                        m_animTime, m_animation->GetDuration(),
+                        m_animation->GetKeyCount(), m_animation->GetFPS(),
+                        m_animation->GetBoundTrackCount(), m_animation->GetTrackCount(),
+                        m_animPlaying ? L"Playing" : L"Paused");
+                }
+                else if (m_animationCMO)
+                {
+                    swprintf_s(szAnim, L"Animation: %7.3f / %7.3f s   Keys: %Iu   Tracks: %Iu of %Iu   %ls   Clip: %ls",
+                        m_animTime, m_animationCMO->GetDuration(),
+                        m_animationCMO->GetKeyCount(),
+                        m_animationCMO->GetBoundTrackCount(), m_animationCMO->GetTrackCount(),
+                        m_animPlaying ? L"Playing" : L"Paused",
+                        m_animationCMO->GetName().c_str());
+                }
+
+                wchar_t szCull[128] = {};
+                swprintf_s(szCull, L"Meshes visible: %Iu  culled: %Iu  spheres tested: %Iu",
+                    m_visibility.visibleCount, m_visibility.culledCount, m_visibility.spheresTested);
+
+                const auto& queueStats = m_renderQueue.GetStatistics();
+                wchar_t szQueue[256] = {};
+                swprintf_s(szQueue, L"Draws: %Iu opaque  %Iu alpha   State changes (file order -> sorted): PSO %Iu -> %Iu  Root sig %Iu -> %Iu  Texture %Iu -> %Iu  VB %Iu -> %Iu   Calls: %Iu issued  %Iu skipped",
+                    queueStats.opaqueCount, queueStats.alphaCount,
+                    queueStats.unsorted.pipelineState, queueStats.sorted.pipelineState,
+                    queueStats.unsorted.rootSignature, queueStats.sorted.rootSignature,
+                    queueStats.unsorted.texture, queueStats.sorted.texture,
+                    queueStats.unsorted.vertexBuffer, queueStats.sorted.vertexBuffer,
+                    queueStats.callsIssued, queueStats.callsSkipped);
+
+                wchar_t szVariants[320] = {};
+                if (m_effectVariants)
+                {
+                    static const wchar_t* s_variantNames[EffectVariantCount] =
+                    {
+                        L"Lit CW", L"Unlit CW", L"Lit CCW", L"Unlit CCW", L"Lit wire", L"Unlit wire"
+                    };
+
+                    int len = swprintf_s(szVariants, L"Effect variants (ms / PSOs, pre-warm %ls):", m_prewarmEffects ? L"on" : L"off");
+                    for (size_t j = 0; j < EffectVariantCount && len > 0; ++j)
+                    {
+                        const auto& variant = m_effectVariants->variants[j];
+                        wchar_t* dest = szVariants + len;
+                        const size_t destSize = _countof(szVariants) - size_t(len);
+                        const int n = variant.ready
+                            ? swprintf_s(dest, destSize, L"  %ls %.1f / %Iu", s_variantNames[j], variant.createTime, variant.pipelineStates)
+                            : swprintf_s(dest, destSize, L"  %ls -", s_variantNames[j]);
+                        len = (n > 0) ? len + n : 0;
+                    }
+                }
+
+                const auto psoStats = m_pipelineStateCache->GetStatistics();
+                wchar_t szPSOs[160] = {};
+                swprintf_s(szPSOs, L"Pipeline state cache: %Iu PSOs   %Iu hits  %Iu misses (%Iu from disk, %Iu compiled)  %Iu saved to disk",
+                    psoStats.pipelineStates, psoStats.hits, psoStats.misses,
+                    psoStats.diskLoads, psoStats.misses - psoStats.diskLoads, psoStats.diskStores);
+
+                const auto memStats = m_graphicsMemory->GetStatistics();
+                wchar_t szMemory[128] = {};
+                swprintf_s(szMemory, L"Graphics memory: %.1f / %.1f MB in flight  %Iu pages   last commit %Iu pages fenced with %Iu signals",
+                    double(memStats.committedMemory) / (1024.0 * 1024.0), double(memStats.totalMemory) / (1024.0 * 1024.0),
+                    memStats.totalPages, memStats.lastCommitFencedPages, memStats.lastCommitSignals);
+
+                const auto frag = m_graphicsMemory->GetFragmentation();
+                wchar_t szFragmentation[320] = {};
+                {
+                    int len = swprintf_s(szFragmentation, L"Page fill (10%% steps):");
+                    for (size_t j = 0; j < GraphicsMemoryFragmentation::HistogramBuckets && len > 0; ++j)
+                    {
+                        const int n = swprintf_s(szFragmentation + len, _countof(szFragmentation) - size_t(len), L" %Iu", frag.histogram[j]);
+                        len = (n > 0) ? len + n : 0;
+                    }
+
+                    if (len > 0)
+                    {
+                        swprintf_s(szFragmentation + len, _countof(szFragmentation) - size_t(len),
+                            L"   slack %.1f MB  unused %.1f MB  trimmed %Iu pages   last frame: constants %Iu KB  vertices %Iu KB  indices %Iu KB  other %Iu KB",
+                            double(memStats.slackMemory) / (1024.0 * 1024.0), double(memStats.unusedMemory) / (1024.0 * 1024.0), memStats.trimmedPages,
+                            frag.tags[GraphicsMemory::TAG_CONSTANT].bytes / 1024,
+                            frag.tags[GraphicsMemory::TAG_VERTEX].bytes / 1024,
+                            frag.tags[GraphicsMemory::TAG_INDEX].bytes / 1024,
+                            (frag.tags[GraphicsMemory::TAG_GENERIC].bytes + frag.tags[GraphicsMemory::TAG_SPRITES].bytes
+                                + frag.tags[GraphicsMemory::TAG_TEXTURE].bytes + frag.tags[GraphicsMemory::TAG_COMPUTE].bytes) / 1024);
+                    }
+                }
+
                 Vector2 modeLen = m_fontConsolas->MeasureString(szMode);
 
                 float spacing = m_fontConsolas->GetLineSpacing();
@@ -916,6 +985,14 @@ void Game::Render()
                 m_fontConsolas->DrawString(m_spriteBatch.get(), m_szStatus, XMFLOAT2(float(rct.left), float(rct.top)), m_uiColor);
                 m_fontConsolas->DrawString(m_spriteBatch.get(), szCamera, XMFLOAT2(float(rct.left), float(rct.top + spacing)), m_uiColor);
                 m_fontConsolas->DrawString(m_spriteBatch.get(), szState, XMFLOAT2(float(rct.left), float(rct.top + spacing * 2.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), m_szTimings, XMFLOAT2(float(rct.left), float(rct.top + spacing * 3.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szAnim, XMFLOAT2(float(rct.left), float(rct.top + spacing * 4.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szCull, XMFLOAT2(float(rct.left), float(rct.top + spacing * 5.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szQueue, XMFLOAT2(float(rct.left), float(rct.top + spacing * 6.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szVariants, XMFLOAT2(float(rct.left), float(rct.top + spacing * 7.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szPSOs, XMFLOAT2(float(rct.left), float(rct.top + spacing * 8.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szMemory, XMFLOAT2(float(rct.left), float(rct.top + spacing * 9.f)), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szFragmentation, XMFLOAT2(float(rct.left), float(rct.top + spacing * 10.f)), m_uiColor);
                 if (m_usingGamepad)
                 {
                     m_fontConsolas->DrawString(m_spriteBatch.get(), szMode, XMFLOAT2(float(rct.right) - modeLen.x, float(rct.bottom) - modeLen.y), m_uiColor);
@@ -924,6 +1001,14 @@ void Game::Render()
                 m_fontConsolas->DrawString(m_spriteBatch.get(), m_szStatus, XMFLOAT2(0, 10), m_uiColor);
                 m_fontConsolas->DrawString(m_spriteBatch.get(), szCamera, XMFLOAT2(0, 10 + spacing), m_uiColor);
                 m_fontConsolas->DrawString(m_spriteBatch.get(), szState, XMFLOAT2(0, 10 + spacing * 2.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), m_szTimings, XMFLOAT2(0, 10 + spacing * 3.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szAnim, XMFLOAT2(0, 10 + spacing * 4.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szCull, XMFLOAT2(0, 10 + spacing * 5.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szQueue, XMFLOAT2(0, 10 + spacing * 6.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szVariants, XMFLOAT2(0, 10 + spacing * 7.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szPSOs, XMFLOAT2(0, 10 + spacing * 8.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szMemory, XMFLOAT2(0, 10 + spacing * 9.f), m_uiColor);
+                m_fontConsolas->DrawString(m_spriteBatch.get(), szFragmentation, XMFLOAT2(0, 10 + spacing * 10.f), m_uiColor);
                 if (m_usingGamepad)
                 {
                     m_fontConsolas->DrawString(m_spriteBatch.get(), szMode, XMFLOAT2(size.right - modeLen.x, size.bottom - modeLen.y), m_uiColor);
@@ -933,6 +1018,26 @@ void Game::Render()
                 m_spriteBatch->End();
             }
         }
+
+        if (m_modelLoad)
+        {
+            m_spriteBatch->Begin(commandList);
+
+            wchar_t szLoad[MAX_PATH + 64] = {};
+            swprintf_s(szLoad, L"%ls %ls (%d%%)", m_modelLoad->stage.load(), m_modelLoad->szModelName, m_modelLoad->progress.load());
+
+            float spacing = m_fontConsolas->GetLineSpacing();
+
+#ifdef XBOX
+            RECT rct = Viewport::ComputeTitleSafeArea(size.right, size.bottom);
+
+            m_fontConsolas->DrawString(m_spriteBatch.get(), szLoad, XMFLOAT2(float(rct.left), float(rct.bottom) - spacing), m_uiColor);
+#else
+            m_fontConsolas->DrawString(m_spriteBatch.get(), szLoad, XMFLOAT2(0, float(size.bottom) - spacing), m_uiColor);
+#endif
+
+            m_spriteBatch->End();
+        }
     }
 
     m_hdrScene->EndScene(commandList);
@@ -1079,6 +1184,12 @@ void Game::CreateDeviceDependentResources()
 
     m_graphicsMemory = std::make_unique<GraphicsMemory>(device);
 
+    GraphicsMemoryBudget budget;
+    budget.maxUnusedMemory = c_UnusedUploadBudget;
+    m_graphicsMemory->SetBudget(budget);
+
+    m_renderMemory = std::make_unique<GraphicsMemoryContext>(device);
+
     m_resourceDescriptors = std::make_unique<DescriptorPile>(device,
         Descriptors::Count,
         Descriptors::Reserve);
@@ -1092,6 +1203,25 @@ void Game::CreateDeviceDependentResources()
 
     m_states = std::make_unique<CommonStates>(device);
 
+    // Keeps the device's pipeline states alive between models, so reloading doesn't recompile them.
+    m_pipelineStateCache = std::make_unique<PipelineStateCache>(device);
+
+    // Likewise keeps the upload staging memory, which batches for the device share while any of them exists.
+    m_uploadStaging = std::make_unique<ResourceUploadBatch>(device);
+
+#ifdef PC
+    // Compiled pipelines are kept across runs too.
+    {
+        wchar_t cachePath[MAX_PATH] = {};
+        const DWORD len = GetTempPathW(MAX_PATH, cachePath);
+        if (len > 0 && len < MAX_PATH
+            && wcscat_s(cachePath, L"DirectXTKModelViewer.pipelines") == 0)
+        {
+            std::ignore = m_pipelineStateCache->OpenDiskCache(cachePath);
+        }
+    }
+#endif
+
     m_lineBatch = std::make_unique<PrimitiveBatch<VertexPositionColor>>(device);
 
     RenderTargetState rtState(m_deviceResources->GetBackBufferFormat(), DXGI_FORMAT_UNKNOWN);
@@ -1250,6 +1380,16 @@ void Game::CreateWindowSizeDependentResources()
 #ifdef LOSTDEVICE
 void Game::OnDeviceLost()
 {
+    if (m_modelLoad)
+    {
+        // Discard any load in progress; it will be restarted once the device is restored.
+        m_modelLoad->result.wait();
+        m_modelLoad.reset();
+        m_reloadModel = true;
+    }
+
+    StopEffectPrewarm();
+
     m_spriteBatch.reset();
     m_fontConsolas.reset();
     m_fontComic.reset();
@@ -1258,18 +1398,24 @@ void Game::OnDeviceLost()
     m_pbrFXFactory.reset();
     m_modelResources.reset();
     m_model.reset();
-    m_modelClockwise.clear();
-    m_modelCounterClockwise.clear();
-    m_modelWireframe.clear();
-    m_unlitClockwise.clear();
-    m_unlitCounterClockwise.clear();
-    m_unlitWireframe.clear();
+    m_effectVariants.reset();
     m_bones.reset();
+    m_skinningContext.reset();
+    m_renderQueue.Clear();
+    m_animBones.reset();
+    m_animation.reset();
+    m_animationCMO.reset();
 
     m_lineEffect.reset();
     m_lineBatch.reset();
 
     m_states.reset();
+    if (m_pipelineStateCache)
+    {
+        std::ignore = m_pipelineStateCache->SaveDiskCache();
+        m_pipelineStateCache.reset();
+    }
+    m_uploadStaging.reset();
 
     m_toneMapSaturate.reset();
     m_toneMapReinhard.reset();
@@ -1285,6 +1431,7 @@ void Game::OnDeviceLost()
 
     m_hdrScene->ReleaseDevice();
 
+    m_renderMemory.reset();
     m_graphicsMemory.reset();
 }
 
@@ -1297,37 +1444,230 @@ void Game::OnDeviceRestored()
 #endif
 #pragma endregion
 
-void Game::LoadModel()
+void Game::StartModelLoad()
 {
-    m_bones.reset();
-    m_modelClockwise.clear();
-    m_modelCounterClockwise.clear();
-    m_modelWireframe.clear();
-    m_unlitClockwise.clear();
-    m_unlitCounterClockwise.clear();
-    m_unlitWireframe.clear();
-    m_modelResources.reset();
-    m_model.reset();
-    m_fxFactory.reset();
-    m_pbrFXFactory.reset();
-
-    *m_szStatus = 0;
-    *m_szError = 0;
     m_reloadModel = false;
-    m_boneMode = false;
-    m_skinning = false;
+
+    m_modelLoad = std::make_unique<ModelLoadJob>();
+    wcscpy_s(m_modelLoad->szModelName, m_szModelName);
+    m_modelLoad->lighting = m_lighting;
+
+    // Load into whichever half of the model descriptor range the current model isn't using.
+    const size_t descriptorOffset = Descriptors::Reserve + (m_modelDescriptorSlot ^ 1) * c_ModelDescriptorSlotSize;
+
+    m_modelLoad->result = std::async(std::launch::async, &Game::LoadModel, this, std::ref(*m_modelLoad), descriptorOffset);
+}
+
+void Game::FinishModelLoad()
+{
+    std::unique_ptr<LoadedModel> loaded;
+    try
+    {
+        loaded = m_modelLoad->result.get();
+    }
+    catch (...)
+    {
+        wchar_t fname[_MAX_FNAME] = {};
+        wchar_t ext[_MAX_EXT] = {};
+        _wsplitpath_s(m_modelLoad->szModelName, nullptr, 0, nullptr, 0, fname, _MAX_FNAME, ext, _MAX_EXT);
+
+        loaded = std::make_unique<LoadedModel>();
+        swprintf_s(loaded->szError, L"Error loading model %ls%ls\n", fname, ext);
+    }
+
+    m_modelLoad.reset();
+
+    // The pre-warm worker is creating effects for the previous model.
+    StopEffectPrewarm();
+
+    // The previous model may still be referenced by frames in flight.
+    m_deviceResources->WaitForGpu();
+
+    if (loaded->model)
+    {
+        m_modelDescriptorSlot ^= 1;
+    }
+
+    m_fxFactory = std::move(loaded->fxFactory);
+    m_pbrFXFactory = std::move(loaded->pbrFXFactory);
+    m_modelResources = std::move(loaded->modelResources);
+    m_model = std::move(loaded->model);
+    m_effectVariants = std::move(loaded->effectVariants);
+    m_bones = std::move(loaded->bones);
+    m_skinningContext = std::move(loaded->skinningContext);
+    m_animation = std::move(loaded->animation);
+    m_animationCMO = std::move(loaded->animationCMO);
+    m_animBones.reset();
+    if (m_animation)
+    {
+        m_animBones = ModelBone::MakeArray(m_model->bones.size());
+    }
+    m_animTime = 0.0;
+    m_animPlaying = true;
+    m_skinning = loaded->skinning;
+    if (m_model)
+    {
+        m_ccw = loaded->ccw;
+    }
+
+    wcscpy_s(m_szStatus, loaded->szStatus);
+    wcscpy_s(m_szError, loaded->szError);
+    wcscpy_s(m_szTimings, loaded->szTimings);
+
+    m_wireframe = false;
+    m_boneMode = (m_animation || m_animationCMO);
     m_modelRot = Quaternion::Identity;
 
-    if (!*m_szModelName)
+    CameraHome();
+
+    StartEffectPrewarm();
+}
+
+
+size_t Game::EffectVariantIndex(bool wireframe, bool ccw, bool lighting) noexcept
+{
+    const size_t lit = wireframe ? LitWireframe : (ccw ? LitCounterClockwise : LitClockwise);
+    return lighting ? lit : lit + 1;
+}
+
+// Called from the loader, the pre-warm worker and Render; the first caller for a variant creates it.
+Model::ResolvedEffectCollection& Game::CreateEffectVariant(ModelEffectVariants& variants, const Model& model, size_t index)
+{
+    auto& variant = variants.variants[index];
+    if (variant.ready.load(std::memory_order_acquire))
+        return variant.effects;
+
+    std::lock_guard<std::mutex> lock(variants.mutex);
+    if (variant.ready.load(std::memory_order_relaxed))
+        return variant.effects;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const bool lighting = (index == LitClockwise || index == LitCounterClockwise || index == LitWireframe);
+
+    D3D12_RASTERIZER_DESC rasterizer = CommonStates::Wireframe;
+    if (index == LitClockwise || index == UnlitClockwise)
+    {
+        rasterizer = CommonStates::CullClockwise;
+    }
+    else if (index == LitCounterClockwise || index == UnlitCounterClockwise)
+    {
+        rasterizer = CommonStates::CullCounterClockwise;
+    }
+
+    auto device = m_deviceResources->GetD3DDevice();
+
+    RenderTargetState hdrState(m_hdrScene->GetFormat(), m_deviceResources->GetDepthBufferFormat());
+
+    if (variants.isvbo)
+    {
+        EffectPipelineStateDescription pd(
+            &VertexPositionNormalTexture::InputLayout,
+            CommonStates::Opaque,
+            CommonStates::DepthDefault,
+            rasterizer,
+            hdrState);
+
+        auto effect = std::make_shared<BasicEffect>(device, lighting ? EffectFlags::Lighting : EffectFlags::None, pd);
+        if (lighting)
+        {
+            effect->EnableDefaultLighting();
+        }
+        variant.effects.emplace_back(effect);
+    }
+    else
+    {
+        EffectPipelineStateDescription pd(
+            nullptr,
+            CommonStates::Opaque,
+            CommonStates::DepthDefault,
+            rasterizer,
+            hdrState);
+
+        EffectPipelineStateDescription pdAlpha(
+            nullptr,
+            CommonStates::AlphaBlend,
+            CommonStates::DepthDefault,
+            rasterizer,
+            hdrState);
+
+        if (variants.classicFactory)
+            variants.classicFactory->EnableLighting(lighting);
+        variant.effects = Model::ResolveEffects(model.CreateEffectsParallel(*variants.fxFactory, pd, pdAlpha, variants.textureOffset));
+    }
+
+    std::set<ID3D12PipelineState*> pipelineStates;
+    for (const auto& it : variant.effects)
+    {
+        if (it.pipelineState)
+        {
+            pipelineStates.insert(it.pipelineState->GetPipelineState());
+        }
+    }
+
+    variant.pipelineStates = pipelineStates.size();
+    variant.createTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    variant.ready.store(true, std::memory_order_release);
+
+    return variant.effects;
+}
+
+// Creates the variants that haven't been selected yet on a worker thread, so the first toggle to them doesn't hitch.
+void Game::StartEffectPrewarm()
+{
+    StopEffectPrewarm();
+
+    if (!m_prewarmEffects || !m_model || !m_effectVariants)
         return;
 
+    auto variants = m_effectVariants.get();
+    auto model = m_model.get();
+    variants->cancelPrewarm = false;
+
+    // A variant that fails to create is left for Render, which reports the error.
+    m_effectPrewarm = std::async(std::launch::async, [this, variants, model]()
+    {
+        for (size_t j = 0; j < EffectVariantCount && !variants->cancelPrewarm; ++j)
+        {
+            std::ignore = CreateEffectVariant(*variants, *model, j);
+        }
+    });
+}
+
+void Game::StopEffectPrewarm()
+{
+    if (!m_effectPrewarm.valid())
+        return;
+
+    if (m_effectVariants)
+    {
+        m_effectVariants->cancelPrewarm = true;
+    }
+
+    m_effectPrewarm.wait();
+    m_effectPrewarm = {};
+}
+
+// Runs on a worker thread; only touches the LoadedModel it returns and the job's progress.
+std::unique_ptr<Game::LoadedModel> Game::LoadModel(ModelLoadJob& job, size_t descriptorOffset)
+{
+    auto result = std::make_unique<LoadedModel>();
+
+    if (!*job.szModelName)
+        return result;
+
     auto device = m_deviceResources->GetD3DDevice();
 
     wchar_t drive[_MAX_DRIVE] = {};
     wchar_t path[MAX_PATH] = {};
     wchar_t ext[_MAX_EXT] = {};
     wchar_t fname[_MAX_FNAME] = {};
-    _wsplitpath_s(m_szModelName, drive, _MAX_DRIVE, path, MAX_PATH, fname, _MAX_FNAME, ext, _MAX_EXT);
+    _wsplitpath_s(job.szModelName, drive, _MAX_DRIVE, path, MAX_PATH, fname, _MAX_FNAME, ext, _MAX_EXT);
+
+    using clock = std::chrono::steady_clock;
+    const auto loadStart = clock::now();
+
+    job.stage = L"Loading geometry";
 
     bool isvbo = false;
     bool issdkmesh2 = false;
@@ -1335,51 +1675,133 @@ void Game::LoadModel()
     {
         if (_wcsicmp(ext, L".sdkmesh") == 0)
         {
-            auto modelBin = DX::ReadData(m_szModelName);
+            const ModelFileView modelFile(job.szModelName);
 
-            if (modelBin.size() >= sizeof(DXUT::SDKMESH_HEADER))
+            if (modelFile.GetSize() >= sizeof(DXUT::SDKMESH_HEADER))
             {
-                auto hdr = reinterpret_cast<const DXUT::SDKMESH_HEADER*>(modelBin.data());
+                auto hdr = reinterpret_cast<const DXUT::SDKMESH_HEADER*>(modelFile.GetData());
                 if (hdr->Version >= 200)
                 {
                     issdkmesh2 = true;
                 }
             }
 
-            m_model = Model::CreateFromSDKMESH(device, modelBin.data(), modelBin.size(), ModelLoader_IncludeBones);
-            m_ccw = true;
+            result->model = Model::CreateFromSDKMESH(device, modelFile, ModelLoader_IncludeBones);
+            result->ccw = true;
         }
         else if (_wcsicmp(ext, L".cmo") == 0)
         {
-            m_model = Model::CreateFromCMO(device, m_szModelName, ModelLoader_IncludeBones);
-            m_ccw = false;
+            const ModelFileView modelFile(job.szModelName);
+
+            size_t animsOffset = 0;
+            result->model = Model::CreateFromCMO(device, modelFile.GetData(), modelFile.GetSize(), ModelLoader_IncludeBones, &animsOffset);
+            result->model->name = job.szModelName;
+            result->ccw = false;
+
+            if (animsOffset && !result->model->bones.empty())
+            {
+                try
+                {
+                    auto animation = std::make_unique<DX::AnimationCMO>();
+                    animation->Load(modelFile.GetData(), modelFile.GetSize(), animsOffset);
+                    if (animation->Bind(*result->model))
+                    {
+                        result->animationCMO = std::move(animation);
+                    }
+                    else
+                    {
+                        OutputDebugStringW(L"WARNING: Animation clip does not match any of the model bones\n");
+                    }
+                }
+                catch (...)
+                {
+                    OutputDebugStringW(L"ERROR: Failed loading CMO animation clip\n");
+                }
+            }
         }
         else if (_wcsicmp(ext, L".vbo") == 0)
         {
             isvbo = true;
-            m_model = Model::CreateFromVBO(device, m_szModelName);
+            result->model = Model::CreateFromVBO(device, job.szModelName);
+        }
+        else if (_wcsicmp(ext, L".dtkmodel") == 0)
+        {
+            const ModelFileView modelFile(job.szModelName);
+
+            uint32_t source = BakedSource_Unknown;
+            if (modelFile.GetSize() >= sizeof(DTKMODEL::DTKMODEL_HEADER))
+            {
+                source = reinterpret_cast<const DTKMODEL::DTKMODEL_HEADER*>(modelFile.GetData())->UserData;
+            }
+
+            result->model = Model::CreateFromDTKMODEL(device, modelFile, ModelLoader_IncludeBones);
+            issdkmesh2 = (source == BakedSource_SDKMESH2);
+            isvbo = (source == BakedSource_VBO);
+            result->ccw = (source != BakedSource_CMO);
         }
         else
         {
-            swprintf_s(m_szError, L"Unknown file type %ls", ext);
-            m_model.reset();
-            *m_szStatus = 0;
+            swprintf_s(result->szError, L"Unknown file type %ls", ext);
+            result->model.reset();
+            *result->szStatus = 0;
         }
     }
     catch (...)
     {
-        swprintf_s(m_szError, L"Error loading model %ls%ls\n", fname, ext);
-        m_model.reset();
-        *m_szStatus = 0;
+        swprintf_s(result->szError, L"Error loading model %ls%ls\n", fname, ext);
+        result->model.reset();
+        *result->szStatus = 0;
     }
 
-    m_wireframe = false;
-
-    if (m_model)
+    if (result->model)
     {
-        if (!m_model->bones.empty())
+        if (!result->model->bones.empty())
         {
-            m_bones = ModelBone::MakeArray(m_model->bones.size());
+            // Skinned meshes that reference more bones than the effects support are drawn in pieces
+            try
+            {
+                const size_t nsplit = result->model->SplitSkinnedMeshes(device);
+                if (nsplit > 0)
+                {
+                    wchar_t buff[128] = {};
+                    swprintf_s(buff, L"INFO: Split %zu skinned mesh(es) to fit %zu bones\n", nsplit, size_t(IEffectSkinning::MaxBones));
+                    OutputDebugStringW(buff);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                OutputDebugStringA("WARNING: Failed to split skinned meshes: ");
+                OutputDebugStringA(e.what());
+                OutputDebugStringA("\n");
+            }
+
+            result->bones = ModelBone::MakeArray(result->model->bones.size());
+
+            // Pick up a keyframe clip saved next to the model, if any
+            wchar_t animName[MAX_PATH] = {};
+            _wmakepath_s(animName, drive, path, fname, L".sdkmesh_anim");
+            if (GetFileAttributesW(animName) != INVALID_FILE_ATTRIBUTES)
+            {
+                try
+                {
+                    auto animation = std::make_unique<DX::AnimationSDKMESH>();
+                    animation->Load(animName);
+                    if (animation->Bind(*result->model))
+                    {
+                        result->animation = std::move(animation);
+                    }
+                    else
+                    {
+                        OutputDebugStringW(L"WARNING: Animation does not match any of the model bones\n");
+                    }
+                }
+                catch (...)
+                {
+                    OutputDebugStringW(L"ERROR: Failed loading animation ");
+                    OutputDebugStringW(animName);
+                    OutputDebugStringW(L"\n");
+                }
+            }
         }
 
         // First check for 'missing' textures
@@ -1387,7 +1809,7 @@ void Game::LoadModel()
 
         if (!issdkmesh2)
         {
-            for (auto& it : m_model->materials)
+            for (auto& it : result->model->materials)
             {
                 if (it.enableSkinning || it.enableNormalMaps)
                 {
@@ -1395,8 +1817,8 @@ void Game::LoadModel()
                     {
                         if (defaultTex == -1)
                         {
-                            defaultTex = static_cast<int>(m_model->textureNames.size());
-                            m_model->textureNames.push_back(m_defaultTextureName);
+                            defaultTex = static_cast<int>(result->model->textureNames.size());
+                            result->model->textureNames.push_back(m_defaultTextureName);
                         }
 
                         it.diffuseTextureIndex = defaultTex;
@@ -1406,135 +1828,111 @@ void Game::LoadModel()
             }
         }
 
+        const auto parseDone = clock::now();
+
+        job.stage = L"Loading textures";
+        job.progress = 25;
+
         ResourceUploadBatch resourceUpload(device);
 
+        resourceUpload.SetStagingBudget(c_TextureStagingBudget, m_deviceResources->GetCommandQueue());
         resourceUpload.Begin();
 
-        m_model->LoadStaticBuffers(device, resourceUpload, true);
-
-        m_modelResources = std::make_unique<EffectTextureFactory>(device, resourceUpload, m_resourceDescriptors->Heap());
+        result->modelResources = std::make_unique<EffectTextureFactory>(device, resourceUpload, m_resourceDescriptors->Heap());
 
         if (!issdkmesh2)
         {
-            m_modelResources->EnableForceSRGB(true);
+            result->modelResources->EnableForceSRGB(true);
         }
 
         if (*drive || *path)
         {
             wchar_t dir[MAX_PATH] = {};
             _wmakepath_s(dir, drive, path, nullptr, nullptr);
-            m_modelResources->SetDirectory(dir);
+            result->modelResources->SetDirectory(dir);
         }
 
-        int txtOffset = Descriptors::Reserve;
+        const int txtOffset = static_cast<int>(descriptorOffset);
+
+        // Texture decodes start as soon as the names are known, on a pool of workers. The factory
+        // serializes the uploads into resourceUpload, so effects can be built here in the meantime;
+        // they only need the descriptor indices, not the textures themselves.
+        const auto& textureNames = result->model->textureNames;
+        const size_t textureCount = (textureNames.size() <= c_ModelDescriptorSlotSize) ? textureNames.size() : 0;
+        auto textureFactory = result->modelResources.get();
+
+        std::atomic<size_t> nextTexture(0);
+        auto loadTextures = [&, textureFactory]() -> clock::time_point
+        {
+            for (;;)
+            {
+                const size_t index = nextTexture++;
+                if (index >= textureCount)
+                    break;
+
+                try
+                {
+                    std::ignore = textureFactory->CreateTexture(textureNames[index].c_str(), txtOffset + static_cast<int>(index));
+                }
+                catch (...)
+                {
+                    // Stop the other workers picking up more work.
+                    nextTexture = textureCount;
+                    throw;
+                }
+            }
+            return clock::now();
+        };
+
+        const size_t textureThreads = std::min<size_t>(textureCount, std::max(1u, std::thread::hardware_concurrency()));
 
-        try
+        const auto texturesStart = clock::now();
+
+        // Futures from std::async block on destruction, so the workers are joined before anything they reference goes away.
+        std::vector<std::future<clock::time_point>> textureTasks;
+        textureTasks.reserve(textureThreads);
+        for (size_t j = 0; j < textureThreads; ++j)
         {
-            std::ignore = m_model->LoadTextures(*m_modelResources, txtOffset);
+            textureTasks.emplace_back(std::async(std::launch::async, loadTextures));
         }
-        catch (...)
+
+        if (textureNames.size() > c_ModelDescriptorSlotSize)
         {
-            swprintf_s(m_szError, L"Error loading textures for model %ls%ls\n", fname, ext);
-            m_model.reset();
-            m_modelResources.reset();
-            *m_szStatus = 0;
+            swprintf_s(result->szError, L"Error loading textures for model %ls%ls\n", fname, ext);
+            result->model.reset();
+            result->modelResources.reset();
+            *result->szStatus = 0;
         }
 
-        if (m_model)
+        const auto effectsStart = clock::now();
+
+        if (result->model)
         {
+            job.stage = L"Creating effects";
+            job.progress = 50;
+
             IEffectFactory* fxFactory = nullptr;
             EffectFactory* classicFactory = nullptr;
             if (issdkmesh2)
             {
-                m_pbrFXFactory = std::make_unique<PBREffectFactory>(m_modelResources->Heap(), m_states->Heap());
-                fxFactory = m_pbrFXFactory.get();
+                result->pbrFXFactory = std::make_unique<PBREffectFactory>(result->modelResources->Heap(), m_states->Heap());
+                fxFactory = result->pbrFXFactory.get();
             }
             else
             {
-                m_fxFactory = std::make_unique<EffectFactory>(m_modelResources->Heap(), m_states->Heap());
-                classicFactory = reinterpret_cast<EffectFactory*>(m_fxFactory.get());
-                fxFactory = m_fxFactory.get();
+                result->fxFactory = std::make_unique<EffectFactory>(result->modelResources->Heap(), m_states->Heap());
+                classicFactory = reinterpret_cast<EffectFactory*>(result->fxFactory.get());
+                fxFactory = result->fxFactory.get();
             }
 
-            RenderTargetState hdrState(m_hdrScene->GetFormat(), m_deviceResources->GetDepthBufferFormat());
-
-            if (isvbo)
-            {
-                EffectPipelineStateDescription pd(
-                    &VertexPositionNormalTexture::InputLayout,
-                    CommonStates::Opaque,
-                    CommonStates::DepthDefault,
-                    CommonStates::CullClockwise,
-                    hdrState);
-
-                auto effect = std::make_shared<BasicEffect>(device, EffectFlags::Lighting, pd);
-                effect->EnableDefaultLighting();
-                m_modelClockwise.push_back(effect);
-
-                effect = std::make_shared<BasicEffect>(device, EffectFlags::None, pd);
-                m_unlitClockwise.push_back(effect);
+            // Only the variant shown first is created here; the rest follow on demand or from the pre-warm worker.
+            result->effectVariants = std::make_unique<ModelEffectVariants>();
+            result->effectVariants->fxFactory = fxFactory;
+            result->effectVariants->classicFactory = classicFactory;
+            result->effectVariants->isvbo = isvbo;
+            result->effectVariants->textureOffset = txtOffset;
 
-                pd.rasterizerDesc = CommonStates::CullCounterClockwise;
-
-                effect = std::make_shared<BasicEffect>(device, EffectFlags::Lighting, pd);
-                effect->EnableDefaultLighting();
-                m_modelCounterClockwise.push_back(effect);
-
-                effect = std::make_shared<BasicEffect>(device, EffectFlags::None, pd);
-                m_unlitCounterClockwise.push_back(effect);
-
-                pd.rasterizerDesc = CommonStates::Wireframe;
-
-                effect = std::make_shared<BasicEffect>(device, EffectFlags::Lighting, pd);
-                effect->EnableDefaultLighting();
-                m_modelWireframe.push_back(effect);
-
-                effect = std::make_shared<BasicEffect>(device, EffectFlags::None, pd);
-                m_unlitWireframe.push_back(effect);
-            }
-            else
-            {
-                EffectPipelineStateDescription pd(
-                    nullptr,
-                    CommonStates::Opaque,
-                    CommonStates::DepthDefault,
-                    CommonStates::CullClockwise,
-                    hdrState);
-
-                EffectPipelineStateDescription pdAlpha(
-                    nullptr,
-                    CommonStates::AlphaBlend,
-                    CommonStates::DepthDefault,
-                    CommonStates::CullClockwise,
-                    hdrState);
-
-                m_modelClockwise = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-
-                if (classicFactory)
-                    classicFactory->EnableLighting(false);
-                m_unlitClockwise = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-
-                pd.rasterizerDesc = pdAlpha.rasterizerDesc = CommonStates::CullCounterClockwise;
-
-                if (classicFactory)
-                    classicFactory->EnableLighting(true);
-                m_modelCounterClockwise = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-
-                if (classicFactory)
-                    classicFactory->EnableLighting(false);
-                m_unlitCounterClockwise = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-
-                pd.rasterizerDesc = CommonStates::Wireframe;
-                pdAlpha.rasterizerDesc = CommonStates::Wireframe;
-                
-                if (classicFactory)
-                    classicFactory->EnableLighting(true);
-                m_modelWireframe = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-
-                if (classicFactory)
-                    classicFactory->EnableLighting(false);
-                m_unlitWireframe = m_model->CreateEffects(*fxFactory, pd, pdAlpha, txtOffset);
-            }
+            const auto& effects = CreateEffectVariant(*result->effectVariants, *result->model, EffectVariantIndex(false, result->ccw, job.lighting));
 
             // Compute mesh stats
             size_t nmeshes = 0;
@@ -1543,7 +1941,7 @@ void Game::LoadModel()
             size_t nsubsets = 0;
 
             std::set<void*> vbs;
-            for (auto it = m_model->meshes.cbegin(); it != m_model->meshes.cend(); ++it)
+            for (auto it = result->model->meshes.cbegin(); it != result->model->meshes.cend(); ++it)
             {
                 for (auto mit = (*it)->opaqueMeshParts.cbegin(); mit != (*it)->opaqueMeshParts.cend(); ++mit)
                 {
@@ -1566,34 +1964,100 @@ void Game::LoadModel()
 
             if (nmeshes > 1)
             {
-                swprintf_s(m_szStatus, L"Meshes: %6Iu   Verts: %6Iu   Faces: %6Iu   Subsets: %6Iu", nmeshes, nverts, nfaces, nsubsets);
+                swprintf_s(result->szStatus, L"Meshes: %6Iu   Verts: %6Iu   Faces: %6Iu   Subsets: %6Iu", nmeshes, nverts, nfaces, nsubsets);
             }
             else
             {
-                swprintf_s(m_szStatus, L"Verts: %6Iu   Faces: %6Iu   Subsets: %6Iu", nverts, nfaces, nsubsets);
+                swprintf_s(result->szStatus, L"Verts: %6Iu   Faces: %6Iu   Subsets: %6Iu", nverts, nfaces, nsubsets);
             }
 
-            for (const auto& it : m_modelClockwise)
+            for (const auto& it : effects)
             {
-                if (dynamic_cast<IEffectSkinning*>(it.get()) != nullptr)
+                if (it.skinning)
                 {
-                    m_skinning = true;
+                    result->skinning = true;
                     break;
                 }
 
-                if (m_skinning)
+                if (result->skinning)
                     break;
             }
+
+            if (result->skinning)
+            {
+                result->skinningContext = std::make_unique<ModelSkinningContext>(device, *result->model);
+            }
         }
 
-        auto uploadResourcesFinished = resourceUpload.End(m_deviceResources->GetCommandQueue());
+        const auto effectsDone = clock::now();
 
-        m_deviceResources->WaitForGpu();
+        auto texturesDone = texturesStart;
+        bool texturesFailed = false;
+        for (auto& task : textureTasks)
+        {
+            try
+            {
+                texturesDone = std::max(texturesDone, task.get());
+            }
+            catch (...)
+            {
+                texturesFailed = true;
+            }
+        }
+
+        if (texturesFailed)
+        {
+            swprintf_s(result->szError, L"Error loading textures for model %ls%ls\n", fname, ext);
+            result->model.reset();
+            result->modelResources.reset();
+            result->effectVariants.reset();
+            result->fxFactory.reset();
+            result->pbrFXFactory.reset();
+            *result->szStatus = 0;
+        }
+
+        job.stage = L"Uploading";
+        job.progress = 90;
+
+        const auto geometryStart = clock::now();
+
+        if (result->model)
+        {
+            result->model->LoadStaticBuffersArena(device, resourceUpload, true);
+        }
+
+        const auto geometryDone = clock::now();
+
+        auto uploadResourcesFinished = resourceUpload.End(m_deviceResources->GetCommandQueue());
 
         uploadResourcesFinished.wait();
+
+        const auto uploadDone = clock::now();
+
+        if (result->model)
+        {
+            auto ms = [](clock::time_point start, clock::time_point end) noexcept
+            {
+                return std::chrono::duration<double, std::milli>(end - start).count();
+            };
+
+            // Textures and effects overlap, so the stages don't add up to the total.
+            swprintf_s(result->szTimings, L"Load (ms): parse %.1f  textures %.1f (%Iu on %Iu threads)  effects (1 variant) %.1f  geometry %.1f  GPU upload %.1f  total %.1f",
+                ms(loadStart, parseDone),
+                ms(texturesStart, texturesDone), textureCount, textureThreads,
+                ms(effectsStart, effectsDone),
+                ms(geometryStart, geometryDone),
+                ms(geometryDone, uploadDone),
+                ms(loadStart, uploadDone));
+
+            OutputDebugStringW(result->szTimings);
+            OutputDebugStringW(L"\n");
+        }
     }
 
-    CameraHome();
+    job.progress = 100;
+
+    return result;
 }
 
 void Game::DrawGrid(ID3D12GraphicsCommandList *commandList)
@@ -1806,7 +2270,7 @@ void Game::EnumerateModelFiles()
 
     WIN32_FIND_DATA ffdata = {};
 
-    static const wchar_t* exts[] = { L"D:\\*.sdkmesh", L"D:\\*.cmo", L"D:\\*.vbo" };
+    static const wchar_t* exts[] = { L"D:\\*.sdkmesh", L"D:\\*.cmo", L"D:\\*.vbo", L"D:\\*.dtkmodel" };
 
     for (size_t j = 0; j < _countof(exts); ++j)
     {
@@ -10,6 +10,7 @@
 #include "StepTimer.h"
 #include "ArcBall.h"
 #include "RenderTexture.h"
+#include "Animation.h"
 
 #ifdef _GAMING_XBOX
 #define XBOX
@@ -90,7 +91,17 @@ private:
     void CreateDeviceDependentResources();
     void CreateWindowSizeDependentResources();
 
-    void LoadModel();
+    struct LoadedModel;
+    struct ModelLoadJob;
+    struct ModelEffectVariants;
+
+    void StartModelLoad();
+    void FinishModelLoad();
+    std::unique_ptr<LoadedModel> LoadModel(ModelLoadJob& job, size_t descriptorOffset);
+    static size_t EffectVariantIndex(bool wireframe, bool ccw, bool lighting) noexcept;
+    DirectX::Model::ResolvedEffectCollection& CreateEffectVariant(ModelEffectVariants& variants, const DirectX::Model& model, size_t index);
+    void StartEffectPrewarm();
+    void StopEffectPrewarm();
     void DrawGrid(ID3D12GraphicsCommandList *commandList);
     void DrawCross(ID3D12GraphicsCommandList *commandList);
 
@@ -116,9 +127,12 @@ private:
     DX::StepTimer                                   m_timer;
 
     std::unique_ptr<DirectX::GraphicsMemory>        m_graphicsMemory;
+    std::unique_ptr<DirectX::GraphicsMemoryContext> m_renderMemory;     // For the render thread's constants
     std::unique_ptr<DirectX::DescriptorPile>        m_resourceDescriptors;
     std::unique_ptr<DirectX::DescriptorHeap>        m_renderDescriptors;
     std::unique_ptr<DirectX::CommonStates>          m_states;
+    std::unique_ptr<DirectX::PipelineStateCache>    m_pipelineStateCache;
+    std::unique_ptr<DirectX::ResourceUploadBatch>   m_uploadStaging;
 
     std::unique_ptr<DirectX::BasicEffect>                                   m_lineEffect;
     std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionColor>>  m_lineBatch;
@@ -135,13 +149,80 @@ private:
     std::unique_ptr<DirectX::PBREffectFactory>      m_pbrFXFactory;
     std::unique_ptr<DirectX::EffectTextureFactory>  m_modelResources;
     std::unique_ptr<DirectX::Model>                 m_model;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_modelClockwise;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_modelCounterClockwise;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_modelWireframe;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_unlitWireframe;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_unlitClockwise;
-    std::vector<std::shared_ptr<DirectX::IEffect>>  m_unlitCounterClockwise;
+    std::unique_ptr<ModelEffectVariants>            m_effectVariants;
+    std::future<void>                               m_effectPrewarm;
     DirectX::ModelBone::TransformArray              m_bones;
+    std::unique_ptr<DirectX::ModelSkinningContext>  m_skinningContext;
+    DirectX::ModelVisibility                        m_visibility;
+    DirectX::ModelRenderQueue                       m_renderQueue;
+    DirectX::ModelBone::TransformArray              m_animBones;
+    std::unique_ptr<DX::AnimationSDKMESH>           m_animation;
+    std::unique_ptr<DX::AnimationCMO>               m_animationCMO;
+    double                                          m_animTime;
+
+    // Effects for each lighting, culling and fill mode combination.
+    enum EffectVariant : size_t
+    {
+        LitClockwise,
+        UnlitClockwise,
+        LitCounterClockwise,
+        UnlitCounterClockwise,
+        LitWireframe,
+        UnlitWireframe,
+        EffectVariantCount
+    };
+
+    // A variant is created the first time it is selected, or earlier by the pre-warm worker.
+    struct ModelEffectVariant
+    {
+        DirectX::Model::ResolvedEffectCollection        effects;
+        std::atomic<bool>                               ready{ false };
+        double                                          createTime = 0.0;   // ms
+        size_t                                          pipelineStates = 0;
+    };
+
+    struct ModelEffectVariants
+    {
+        DirectX::IEffectFactory*                        fxFactory = nullptr;
+        DirectX::EffectFactory*                         classicFactory = nullptr;
+        bool                                            isvbo = false;
+        int                                             textureOffset = 0;
+        std::mutex                                      mutex;  // Serializes creation, as EnableLighting is factory-wide state.
+        std::atomic<bool>                               cancelPrewarm{ false };
+        ModelEffectVariant                              variants[EffectVariantCount];
+    };
+
+    // Everything built for a model by the background loader, swapped in as a unit at a frame boundary.
+    struct LoadedModel
+    {
+        std::unique_ptr<DirectX::EffectFactory>         fxFactory;
+        std::unique_ptr<DirectX::PBREffectFactory>      pbrFXFactory;
+        std::unique_ptr<DirectX::EffectTextureFactory>  modelResources;
+        std::unique_ptr<DirectX::Model>                 model;
+        std::unique_ptr<ModelEffectVariants>            effectVariants;
+        DirectX::ModelBone::TransformArray              bones;
+        std::unique_ptr<DirectX::ModelSkinningContext>  skinningContext;
+        std::unique_ptr<DX::AnimationSDKMESH>           animation;
+        std::unique_ptr<DX::AnimationCMO>               animationCMO;
+        bool                                            ccw = true;
+        bool                                            skinning = false;
+        wchar_t                                         szStatus[512] = {};
+        wchar_t                                         szError[512] = {};
+        wchar_t                                         szTimings[256] = {};
+    };
+
+    // Model load running on a worker thread.
+    struct ModelLoadJob
+    {
+        wchar_t                                         szModelName[MAX_PATH] = {};
+        std::atomic<int>                                progress{ 0 };
+        std::atomic<const wchar_t*>                     stage{ L"" };
+        bool                                            lighting = true;
+        std::future<std::unique_ptr<LoadedModel>>       result;
+    };
+
+    std::unique_ptr<ModelLoadJob>                   m_modelLoad;
+    size_t                                          m_modelDescriptorSlot;
 
     std::unique_ptr<DirectX::SpriteBatch>           m_spriteBatch;
     std::unique_ptr<DirectX::SpriteFont>            m_fontConsolas;
@@ -166,9 +247,12 @@ private:
         IrradianceIBL2,
         IrradianceIBL3,
         Reserve,
-        Count = 1024
+        Count = 2048
     };
 
+    // Model textures alternate between two halves of the reserved range, so a model can load while the previous one renders.
+    static constexpr size_t c_ModelDescriptorSlotSize = (Descriptors::Count - Descriptors::Reserve) / 2;
+
     enum RTVDescriptors : size_t
     {
         HDRScene,
@@ -186,6 +270,7 @@ private:
     DirectX::SimpleMath::Matrix                     m_world;
     DirectX::SimpleMath::Matrix                     m_view;
     DirectX::SimpleMath::Matrix                     m_proj;
+    DirectX::SharedEffectMatrices                   m_sharedMatrices;
 
     DirectX::SimpleMath::Vector3                    m_cameraFocus;
     DirectX::SimpleMath::Vector3                    m_lastCameraPos;
@@ -217,12 +302,15 @@ private:
     bool                                            m_fpscamera;
     bool                                            m_boneMode;
     bool                                            m_skinning;
+    bool                                            m_animPlaying;
+    bool                                            m_prewarmEffects;
 
     int                                             m_toneMapMode;
 
     wchar_t                                         m_szModelName[MAX_PATH];
     wchar_t                                         m_szStatus[512];
     wchar_t                                         m_szError[512];
+    wchar_t                                         m_szTimings[256];
 
     ArcBall                                         m_ballCamera;
     ArcBall                                         m_ballModel;
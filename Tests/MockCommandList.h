@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------------
+// File: MockCommandList.h
+//
+// ID3D12GraphicsCommandList stand-in that records the state-setting calls made through
+// it instead of talking to a driver. Every other method is a no-op.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <d3d12.h>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace Tests
+{
+    class RecordingCommandList : public ID3D12GraphicsCommandList
+    {
+    public:
+        enum Method : uint32_t
+        {
+            Method_SetGraphicsRootSignature,
+            Method_SetPipelineState,
+            Method_SetGraphicsRootDescriptorTable,
+            Method_SetGraphicsRootConstantBufferView,
+            Method_IASetVertexBuffers,
+            Method_IASetIndexBuffer,
+            Method_IASetPrimitiveTopology,
+            Method_DrawIndexedInstanced,
+        };
+
+        struct Call
+        {
+            Method      method;
+            uint64_t    arg0;
+            uint64_t    arg1;
+        };
+
+        std::vector<Call> calls;
+
+        size_t Count(Method method) const noexcept
+        {
+            size_t count = 0;
+            for (const auto& call : calls)
+            {
+                if (call.method == method)
+                    ++count;
+            }
+            return count;
+        }
+
+        // Recorded calls
+        void STDMETHODCALLTYPE SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature) override
+        {
+            Record(Method_SetGraphicsRootSignature, reinterpret_cast<uintptr_t>(pRootSignature));
+        }
+
+        void STDMETHODCALLTYPE SetPipelineState(ID3D12PipelineState* pPipelineState) override
+        {
+            Record(Method_SetPipelineState, reinterpret_cast<uintptr_t>(pPipelineState));
+        }
+
+        void STDMETHODCALLTYPE SetGraphicsRootDescriptorTable(UINT RootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) override
+        {
+            Record(Method_SetGraphicsRootDescriptorTable, RootParameterIndex, BaseDescriptor.ptr);
+        }
+
+        void STDMETHODCALLTYPE SetGraphicsRootConstantBufferView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override
+        {
+            Record(Method_SetGraphicsRootConstantBufferView, RootParameterIndex, BufferLocation);
+        }
+
+        void STDMETHODCALLTYPE IASetVertexBuffers(UINT StartSlot, UINT NumViews, const D3D12_VERTEX_BUFFER_VIEW* pViews) override
+        {
+            Record(Method_IASetVertexBuffers, StartSlot, (pViews && NumViews > 0) ? pViews[0].BufferLocation : 0);
+        }
+
+        void STDMETHODCALLTYPE IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView) override
+        {
+            Record(Method_IASetIndexBuffer, pView ? pView->BufferLocation : 0);
+        }
+
+        void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) override
+        {
+            Record(Method_IASetPrimitiveTopology, static_cast<uint64_t>(PrimitiveTopology));
+        }
+
+        void STDMETHODCALLTYPE DrawIndexedInstanced(UINT IndexCountPerInstance, UINT, UINT, INT, UINT) override
+        {
+            Record(Method_DrawIndexedInstanced, IndexCountPerInstance);
+        }
+
+        // IUnknown
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** ppvObject) override
+        {
+            if (ppvObject)
+                *ppvObject = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+        // ID3D12Object
+        HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetName(LPCWSTR) override { return S_OK; }
+
+        // ID3D12DeviceChild
+        HRESULT STDMETHODCALLTYPE GetDevice(REFIID, void** ppvDevice) override
+        {
+            if (ppvDevice)
+                *ppvDevice = nullptr;
+            return E_NOTIMPL;
+        }
+
+        // ID3D12CommandList
+        D3D12_COMMAND_LIST_TYPE STDMETHODCALLTYPE GetType() override { return D3D12_COMMAND_LIST_TYPE_DIRECT; }
+
+        // ID3D12GraphicsCommandList, not recorded
+        HRESULT STDMETHODCALLTYPE Close() override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE Reset(ID3D12CommandAllocator*, ID3D12PipelineState*) override { return S_OK; }
+        void STDMETHODCALLTYPE ClearState(ID3D12PipelineState*) override {}
+        void STDMETHODCALLTYPE DrawInstanced(UINT, UINT, UINT, UINT) override {}
+        void STDMETHODCALLTYPE Dispatch(UINT, UINT, UINT) override {}
+        void STDMETHODCALLTYPE CopyBufferRegion(ID3D12Resource*, UINT64, ID3D12Resource*, UINT64, UINT64) override {}
+        void STDMETHODCALLTYPE CopyTextureRegion(const D3D12_TEXTURE_COPY_LOCATION*, UINT, UINT, UINT, const D3D12_TEXTURE_COPY_LOCATION*, const D3D12_BOX*) override {}
+        void STDMETHODCALLTYPE CopyResource(ID3D12Resource*, ID3D12Resource*) override {}
+        void STDMETHODCALLTYPE CopyTiles(ID3D12Resource*, const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*, ID3D12Resource*, UINT64, D3D12_TILE_COPY_FLAGS) override {}
+        void STDMETHODCALLTYPE ResolveSubresource(ID3D12Resource*, UINT, ID3D12Resource*, UINT, DXGI_FORMAT) override {}
+        void STDMETHODCALLTYPE RSSetViewports(UINT, const D3D12_VIEWPORT*) override {}
+        void STDMETHODCALLTYPE RSSetScissorRects(UINT, const D3D12_RECT*) override {}
+        void STDMETHODCALLTYPE OMSetBlendFactor(const FLOAT[4]) override {}
+        void STDMETHODCALLTYPE OMSetStencilRef(UINT) override {}
+        void STDMETHODCALLTYPE ResourceBarrier(UINT, const D3D12_RESOURCE_BARRIER*) override {}
+        void STDMETHODCALLTYPE ExecuteBundle(ID3D12GraphicsCommandList*) override {}
+        void STDMETHODCALLTYPE SetDescriptorHeaps(UINT, ID3D12DescriptorHeap* const*) override {}
+        void STDMETHODCALLTYPE SetComputeRootSignature(ID3D12RootSignature*) override {}
+        void STDMETHODCALLTYPE SetComputeRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE SetComputeRoot32BitConstant(UINT, UINT, UINT) override {}
+        void STDMETHODCALLTYPE SetGraphicsRoot32BitConstant(UINT, UINT, UINT) override {}
+        void STDMETHODCALLTYPE SetComputeRoot32BitConstants(UINT, UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE SetGraphicsRoot32BitConstants(UINT, UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE SetComputeRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override {}
+        void STDMETHODCALLTYPE SetComputeRootShaderResourceView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override {}
+        void STDMETHODCALLTYPE SetGraphicsRootShaderResourceView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override {}
+        void STDMETHODCALLTYPE SetComputeRootUnorderedAccessView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override {}
+        void STDMETHODCALLTYPE SetGraphicsRootUnorderedAccessView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override {}
+        void STDMETHODCALLTYPE SOSetTargets(UINT, UINT, const D3D12_STREAM_OUTPUT_BUFFER_VIEW*) override {}
+        void STDMETHODCALLTYPE OMSetRenderTargets(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE*, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE*) override {}
+        void STDMETHODCALLTYPE ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT*) override {}
+        void STDMETHODCALLTYPE ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, const FLOAT[4], UINT, const D3D12_RECT*) override {}
+        void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(D3D12_GPU_DESCRIPTOR_HANDLE, D3D12_CPU_DESCRIPTOR_HANDLE, ID3D12Resource*, const UINT[4], UINT, const D3D12_RECT*) override {}
+        void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(D3D12_GPU_DESCRIPTOR_HANDLE, D3D12_CPU_DESCRIPTOR_HANDLE, ID3D12Resource*, const FLOAT[4], UINT, const D3D12_RECT*) override {}
+        void STDMETHODCALLTYPE DiscardResource(ID3D12Resource*, const D3D12_DISCARD_REGION*) override {}
+        void STDMETHODCALLTYPE BeginQuery(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT) override {}
+        void STDMETHODCALLTYPE EndQuery(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT) override {}
+        void STDMETHODCALLTYPE ResolveQueryData(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT, UINT, ID3D12Resource*, UINT64) override {}
+        void STDMETHODCALLTYPE SetPredication(ID3D12Resource*, UINT64, D3D12_PREDICATION_OP) override {}
+        void STDMETHODCALLTYPE SetMarker(UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE BeginEvent(UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE EndEvent() override {}
+        void STDMETHODCALLTYPE ExecuteIndirect(ID3D12CommandSignature*, UINT, ID3D12Resource*, UINT64, ID3D12Resource*, UINT64) override {}
+
+    private:
+        void Record(Method method, uint64_t arg0, uint64_t arg1 = 0)
+        {
+            calls.push_back(Call{ method, arg0, arg1 });
+        }
+    };
+}
@@ -0,0 +1,286 @@
+//--------------------------------------------------------------------------------------
+// File: MockDevice.h
+//
+// ID3D12Device stand-in with just enough behavior for GraphicsMemory and LinearAllocator:
+// committed resources are plain heap memory with made-up GPU addresses, and fences
+// complete as soon as a queue signals them. Everything else fails or does nothing.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <d3d12.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace Tests
+{
+    // IUnknown and ID3D12Object for the mocks. Heap objects delete themselves on the last Release.
+    template<typename Base>
+    class MockObject : public Base
+    {
+    public:
+        MockObject() noexcept : mRefCount(1) {}
+
+        MockObject(MockObject const&) = delete;
+        MockObject& operator= (MockObject const&) = delete;
+
+        virtual ~MockObject() = default;
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+        {
+            if (!ppvObject)
+                return E_POINTER;
+
+            if (riid == __uuidof(Base) || riid == __uuidof(IUnknown))
+            {
+                *ppvObject = static_cast<Base*>(this);
+                AddRef();
+                return S_OK;
+            }
+
+            *ppvObject = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override
+        {
+            return static_cast<ULONG>(++mRefCount);
+        }
+
+        ULONG STDMETHODCALLTYPE Release() override
+        {
+            const auto count = --mRefCount;
+            if (count == 0)
+                delete this;
+            return static_cast<ULONG>(count);
+        }
+
+        HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE SetName(LPCWSTR) override { return S_OK; }
+
+    protected:
+        std::atomic<LONG> mRefCount;
+    };
+
+    template<typename Base>
+    class MockDeviceChild : public MockObject<Base>
+    {
+    public:
+        HRESULT STDMETHODCALLTYPE GetDevice(REFIID, void** ppvDevice) override
+        {
+            if (ppvDevice)
+                *ppvDevice = nullptr;
+            return E_NOTIMPL;
+        }
+    };
+
+    //----------------------------------------------------------------------------------
+    class MockResource : public MockDeviceChild<ID3D12Resource>
+    {
+    public:
+        MockResource(const D3D12_RESOURCE_DESC& desc, D3D12_GPU_VIRTUAL_ADDRESS gpuAddress) noexcept
+            : mDesc(desc)
+            , mGpuAddress(gpuAddress)
+            , mMemory(nullptr)
+        {
+        }
+
+        ~MockResource() override
+        {
+            free(mMemory);
+        }
+
+        HRESULT STDMETHODCALLTYPE Map(UINT, const D3D12_RANGE*, void** ppData) override
+        {
+            if (!ppData)
+                return E_INVALIDARG;
+
+            if (!mMemory)
+            {
+                mMemory = malloc(static_cast<size_t>(mDesc.Width));
+                if (!mMemory)
+                    return E_OUTOFMEMORY;
+            }
+
+            *ppData = mMemory;
+            return S_OK;
+        }
+
+        void STDMETHODCALLTYPE Unmap(UINT, const D3D12_RANGE*) override {}
+
+        D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() override { return mDesc; }
+        D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() override { return mGpuAddress; }
+
+        HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT, const D3D12_BOX*, const void*, UINT, UINT) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ReadFromSubresource(void*, UINT, UINT, UINT, const D3D12_BOX*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES*, D3D12_HEAP_FLAGS*) override { return E_NOTIMPL; }
+
+    private:
+        D3D12_RESOURCE_DESC         mDesc;
+        D3D12_GPU_VIRTUAL_ADDRESS   mGpuAddress;
+        void*                       mMemory;
+    };
+
+    //----------------------------------------------------------------------------------
+    class MockFence : public MockDeviceChild<ID3D12Fence>
+    {
+    public:
+        explicit MockFence(UINT64 initialValue) noexcept : mValue(initialValue) {}
+
+        UINT64 STDMETHODCALLTYPE GetCompletedValue() override { return mValue; }
+        HRESULT STDMETHODCALLTYPE SetEventOnCompletion(UINT64, HANDLE hEvent) override
+        {
+            // Every signal has completed already.
+            return (hEvent && !SetEvent(hEvent)) ? E_FAIL : S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE Signal(UINT64 Value) override
+        {
+            mValue = Value;
+            return S_OK;
+        }
+
+    private:
+        std::atomic<UINT64> mValue;
+    };
+
+    //----------------------------------------------------------------------------------
+    // Executes nothing; a Signal completes at once, as if the GPU were idle.
+    class MockCommandQueue : public MockDeviceChild<ID3D12CommandQueue>
+    {
+    public:
+        MockCommandQueue() noexcept : signalCount(0) {}
+
+        size_t signalCount;
+
+        HRESULT STDMETHODCALLTYPE Signal(ID3D12Fence* pFence, UINT64 Value) override
+        {
+            ++signalCount;
+            return pFence ? pFence->Signal(Value) : E_INVALIDARG;
+        }
+
+        void STDMETHODCALLTYPE UpdateTileMappings(ID3D12Resource*, UINT, const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*, ID3D12Heap*, UINT, const D3D12_TILE_RANGE_FLAGS*, const UINT*, const UINT*, D3D12_TILE_MAPPING_FLAGS) override {}
+        void STDMETHODCALLTYPE CopyTileMappings(ID3D12Resource*, const D3D12_TILED_RESOURCE_COORDINATE*, ID3D12Resource*, const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*, D3D12_TILE_MAPPING_FLAGS) override {}
+        void STDMETHODCALLTYPE ExecuteCommandLists(UINT, ID3D12CommandList* const*) override {}
+        void STDMETHODCALLTYPE SetMarker(UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE BeginEvent(UINT, const void*, UINT) override {}
+        void STDMETHODCALLTYPE EndEvent() override {}
+        HRESULT STDMETHODCALLTYPE Wait(ID3D12Fence*, UINT64) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE GetTimestampFrequency(UINT64*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetClockCalibration(UINT64*, UINT64*) override { return E_NOTIMPL; }
+
+        D3D12_COMMAND_QUEUE_DESC STDMETHODCALLTYPE GetDesc() override
+        {
+            D3D12_COMMAND_QUEUE_DESC desc = {};
+            desc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+            return desc;
+        }
+    };
+
+    //----------------------------------------------------------------------------------
+    // Only committed buffers and fences can be created. Declare it on the stack; the objects it
+    // creates are reference counted as usual.
+    class MockDevice : public MockObject<ID3D12Device>
+    {
+    public:
+        MockDevice() noexcept : resourceCount(0), mNextGpuAddress(0x100000000ull) {}
+
+        std::atomic<size_t> resourceCount;
+
+        HRESULT STDMETHODCALLTYPE CreateCommittedResource(
+            const D3D12_HEAP_PROPERTIES*,
+            D3D12_HEAP_FLAGS,
+            const D3D12_RESOURCE_DESC* pDesc,
+            D3D12_RESOURCE_STATES,
+            const D3D12_CLEAR_VALUE*,
+            REFIID riidResource,
+            void** ppvResource) override
+        {
+            if (!pDesc || !ppvResource)
+                return E_INVALIDARG;
+
+            if (pDesc->Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+                return E_NOTIMPL;
+
+            auto resource = new MockResource(*pDesc, mNextGpuAddress.fetch_add(pDesc->Width));
+            const HRESULT hr = resource->QueryInterface(riidResource, ppvResource);
+            resource->Release();
+
+            if (SUCCEEDED(hr))
+                ++resourceCount;
+            return hr;
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateFence(UINT64 InitialValue, D3D12_FENCE_FLAGS, REFIID riid, void** ppFence) override
+        {
+            if (!ppFence)
+                return E_INVALIDARG;
+
+            auto fence = new MockFence(InitialValue);
+            const HRESULT hr = fence->QueryInterface(riid, ppFence);
+            fence->Release();
+            return hr;
+        }
+
+        UINT STDMETHODCALLTYPE GetNodeCount() override { return 1; }
+        HRESULT STDMETHODCALLTYPE CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateCommandList(UINT, D3D12_COMMAND_LIST_TYPE, ID3D12CommandAllocator*, ID3D12PipelineState*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D12_FEATURE, void*, UINT) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        UINT STDMETHODCALLTYPE GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE) override { return 32; }
+        HRESULT STDMETHODCALLTYPE CreateRootSignature(UINT, const void*, SIZE_T, REFIID, void**) override { return E_NOTIMPL; }
+        void STDMETHODCALLTYPE CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CreateShaderResourceView(ID3D12Resource*, const D3D12_SHADER_RESOURCE_VIEW_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D12Resource*, ID3D12Resource*, const D3D12_UNORDERED_ACCESS_VIEW_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CreateRenderTargetView(ID3D12Resource*, const D3D12_RENDER_TARGET_VIEW_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CreateDepthStencilView(ID3D12Resource*, const D3D12_DEPTH_STENCIL_VIEW_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CreateSampler(const D3D12_SAMPLER_DESC*, D3D12_CPU_DESCRIPTOR_HANDLE) override {}
+        void STDMETHODCALLTYPE CopyDescriptors(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE*, const UINT*, UINT, const D3D12_CPU_DESCRIPTOR_HANDLE*, const UINT*, D3D12_DESCRIPTOR_HEAP_TYPE) override {}
+        void STDMETHODCALLTYPE CopyDescriptorsSimple(UINT, D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_DESCRIPTOR_HEAP_TYPE) override {}
+
+        D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE GetResourceAllocationInfo(UINT, UINT, const D3D12_RESOURCE_DESC*) override
+        {
+            return D3D12_RESOURCE_ALLOCATION_INFO{};
+        }
+
+        D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE GetCustomHeapProperties(UINT, D3D12_HEAP_TYPE) override
+        {
+            return D3D12_HEAP_PROPERTIES{};
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateHeap(const D3D12_HEAP_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreatePlacedResource(ID3D12Heap*, UINT64, const D3D12_RESOURCE_DESC*, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateReservedResource(const D3D12_RESOURCE_DESC*, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateSharedHandle(ID3D12DeviceChild*, const SECURITY_ATTRIBUTES*, DWORD, LPCWSTR, HANDLE*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE OpenSharedHandle(HANDLE, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE OpenSharedHandleByName(LPCWSTR, DWORD, HANDLE*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE MakeResident(UINT, ID3D12Pageable* const*) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE Evict(UINT, ID3D12Pageable* const*) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() override { return S_OK; }
+        void STDMETHODCALLTYPE GetCopyableFootprints(const D3D12_RESOURCE_DESC*, UINT, UINT, UINT64, D3D12_PLACED_SUBRESOURCE_FOOTPRINT*, UINT*, UINT64*, UINT64*) override {}
+        HRESULT STDMETHODCALLTYPE CreateQueryHeap(const D3D12_QUERY_HEAP_DESC*, REFIID, void**) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetStablePowerState(BOOL) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC*, ID3D12RootSignature*, REFIID, void**) override { return E_NOTIMPL; }
+        void STDMETHODCALLTYPE GetResourceTiling(ID3D12Resource*, UINT*, D3D12_PACKED_MIP_INFO*, D3D12_TILE_SHAPE*, UINT*, UINT, D3D12_SUBRESOURCE_TILING*) override {}
+
+        LUID STDMETHODCALLTYPE GetAdapterLuid() override
+        {
+            return LUID{};
+        }
+
+    private:
+        std::atomic<D3D12_GPU_VIRTUAL_ADDRESS> mNextGpuAddress;
+    };
+}
@@ -0,0 +1,233 @@
+//--------------------------------------------------------------------------------------
+// File: TestCommandListStateCache.cpp
+//
+// Checks which calls CommandListStateCache forwards to the command list and which it
+// filters out as redundant.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#include <d3d12.h>
+
+#include <cstdint>
+
+#include <CommandListStateCache.h>
+
+#include "MockCommandList.h"
+#include "TestHelpers.h"
+
+using namespace DirectX;
+using namespace Tests;
+
+namespace
+{
+    using Cache = CommandListStateCache;
+    using List = RecordingCommandList;
+
+    // The cache only compares these, so any distinct values will do.
+    template<typename T> T* FakeObject(uintptr_t value) noexcept
+    {
+        return reinterpret_cast<T*>(value);
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE Table(uint64_t ptr) noexcept
+    {
+        D3D12_GPU_DESCRIPTOR_HANDLE handle = {};
+        handle.ptr = ptr;
+        return handle;
+    }
+}
+
+// Repeating a call with the same arguments is skipped; changing an argument issues it.
+bool Test_CommandListStateCache_SkipsRedundantCalls()
+{
+    List list;
+    Cache cache(&list);
+
+    auto rs = FakeObject<ID3D12RootSignature>(0x1000);
+    auto pso1 = FakeObject<ID3D12PipelineState>(0x2000);
+    auto pso2 = FakeObject<ID3D12PipelineState>(0x3000);
+
+    cache.SetGraphicsRootSignature(rs);
+    cache.SetGraphicsRootSignature(rs);
+    cache.SetPipelineState(pso1);
+    cache.SetPipelineState(pso1);
+    cache.SetPipelineState(pso2);
+    cache.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cache.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cache.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    VERIFY(list.calls.size() == 5);
+    VERIFY(list.calls[0].method == List::Method_SetGraphicsRootSignature && list.calls[0].arg0 == 0x1000);
+    VERIFY(list.calls[1].method == List::Method_SetPipelineState && list.calls[1].arg0 == 0x2000);
+    VERIFY(list.calls[2].method == List::Method_SetPipelineState && list.calls[2].arg0 == 0x3000);
+    VERIFY(list.calls[3].method == List::Method_IASetPrimitiveTopology && list.calls[3].arg0 == uint64_t(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST));
+    VERIFY(list.calls[4].method == List::Method_IASetPrimitiveTopology && list.calls[4].arg0 == uint64_t(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP));
+
+    const auto& stats = cache.GetStatistics();
+    VERIFY(stats.issued[Cache::RootSignature] == 1 && stats.skipped[Cache::RootSignature] == 1);
+    VERIFY(stats.issued[Cache::PipelineState] == 2 && stats.skipped[Cache::PipelineState] == 1);
+    VERIFY(stats.issued[Cache::PrimitiveTopology] == 2 && stats.skipped[Cache::PrimitiveTopology] == 1);
+    VERIFY(stats.TotalIssued() == 5 && stats.TotalSkipped() == 3);
+
+    cache.ResetStatistics();
+    VERIFY(cache.GetStatistics().TotalIssued() == 0 && cache.GetStatistics().TotalSkipped() == 0);
+
+    return true;
+}
+
+// A different root signature forgets every root argument; the same one keeps them.
+bool Test_CommandListStateCache_RootSignatureInvalidatesRootArguments()
+{
+    List list;
+    Cache cache(&list);
+
+    auto rs1 = FakeObject<ID3D12RootSignature>(0x1000);
+    auto rs2 = FakeObject<ID3D12RootSignature>(0x1100);
+
+    cache.SetGraphicsRootSignature(rs1);
+    cache.SetGraphicsRootDescriptorTable(0, Table(0xA000));
+    cache.SetGraphicsRootConstantBufferView(1, 0xB000);
+    cache.SetGraphicsRootDescriptorTable(0, Table(0xA000));
+    cache.SetGraphicsRootConstantBufferView(1, 0xB000);
+    VERIFY(list.Count(List::Method_SetGraphicsRootDescriptorTable) == 1);
+    VERIFY(list.Count(List::Method_SetGraphicsRootConstantBufferView) == 1);
+
+    // Same root signature: skipped, and the root arguments are still known.
+    cache.SetGraphicsRootSignature(rs1);
+    cache.SetGraphicsRootDescriptorTable(0, Table(0xA000));
+    cache.SetGraphicsRootConstantBufferView(1, 0xB000);
+    VERIFY(list.Count(List::Method_SetGraphicsRootSignature) == 1);
+    VERIFY(list.Count(List::Method_SetGraphicsRootDescriptorTable) == 1);
+    VERIFY(list.Count(List::Method_SetGraphicsRootConstantBufferView) == 1);
+
+    // New root signature: the same arguments must be set again.
+    list.calls.clear();
+    cache.SetGraphicsRootSignature(rs2);
+    cache.SetGraphicsRootDescriptorTable(0, Table(0xA000));
+    cache.SetGraphicsRootConstantBufferView(1, 0xB000);
+    VERIFY(list.calls.size() == 3);
+    VERIFY(list.calls[0].method == List::Method_SetGraphicsRootSignature && list.calls[0].arg0 == 0x1100);
+    VERIFY(list.calls[1].method == List::Method_SetGraphicsRootDescriptorTable && list.calls[1].arg0 == 0 && list.calls[1].arg1 == 0xA000);
+    VERIFY(list.calls[2].method == List::Method_SetGraphicsRootConstantBufferView && list.calls[2].arg0 == 1 && list.calls[2].arg1 == 0xB000);
+
+    const auto& stats = cache.GetStatistics();
+    VERIFY(stats.issued[Cache::RootDescriptorTable] == 2 && stats.skipped[Cache::RootDescriptorTable] == 2);
+    VERIFY(stats.issued[Cache::RootConstantBufferView] == 2 && stats.skipped[Cache::RootConstantBufferView] == 2);
+
+    return true;
+}
+
+// A table and a CBV with the same value in the same slot are different bindings.
+bool Test_CommandListStateCache_RootArgumentKinds()
+{
+    List list;
+    Cache cache(&list);
+
+    cache.SetGraphicsRootSignature(FakeObject<ID3D12RootSignature>(0x1000));
+    cache.SetGraphicsRootDescriptorTable(2, Table(0xC000));
+    cache.SetGraphicsRootConstantBufferView(2, 0xC000);
+    cache.SetGraphicsRootDescriptorTable(2, Table(0xC000));
+    cache.SetGraphicsRootDescriptorTable(3, Table(0xC000));
+    VERIFY(list.Count(List::Method_SetGraphicsRootDescriptorTable) == 3);
+    VERIFY(list.Count(List::Method_SetGraphicsRootConstantBufferView) == 1);
+
+    // Root parameter indices beyond what the cache tracks are never filtered.
+    List list2;
+    Cache cache2(&list2);
+    cache2.SetGraphicsRootConstantBufferView(100, 0xD000);
+    cache2.SetGraphicsRootConstantBufferView(100, 0xD000);
+    VERIFY(list2.Count(List::Method_SetGraphicsRootConstantBufferView) == 2);
+
+    return true;
+}
+
+bool Test_CommandListStateCache_InputAssembler()
+{
+    List list;
+    Cache cache(&list);
+
+    D3D12_VERTEX_BUFFER_VIEW vb[2] = {};
+    vb[0].BufferLocation = 0x10000;
+    vb[0].SizeInBytes = 1024;
+    vb[0].StrideInBytes = 32;
+    vb[1].BufferLocation = 0x20000;
+    vb[1].SizeInBytes = 512;
+    vb[1].StrideInBytes = 16;
+
+    cache.IASetVertexBuffers(0, 2, vb);
+    cache.IASetVertexBuffers(0, 2, vb);
+    cache.IASetVertexBuffers(1, 1, &vb[1]);
+    VERIFY(list.Count(List::Method_IASetVertexBuffers) == 1);
+
+    // Any field of any slot differing issues the call.
+    vb[1].StrideInBytes = 20;
+    cache.IASetVertexBuffers(0, 2, vb);
+    VERIFY(list.Count(List::Method_IASetVertexBuffers) == 2);
+
+    // Unbinding is always issued, and the unbound slot no longer matches.
+    cache.IASetVertexBuffers(0, 1, nullptr);
+    cache.IASetVertexBuffers(0, 1, nullptr);
+    cache.IASetVertexBuffers(0, 1, vb);
+    VERIFY(list.Count(List::Method_IASetVertexBuffers) == 5);
+
+    D3D12_INDEX_BUFFER_VIEW ib = {};
+    ib.BufferLocation = 0x30000;
+    ib.SizeInBytes = 256;
+    ib.Format = DXGI_FORMAT_R16_UINT;
+
+    cache.IASetIndexBuffer(&ib);
+    cache.IASetIndexBuffer(&ib);
+    VERIFY(list.Count(List::Method_IASetIndexBuffer) == 1);
+
+    ib.Format = DXGI_FORMAT_R32_UINT;
+    cache.IASetIndexBuffer(&ib);
+    cache.IASetIndexBuffer(nullptr);
+    cache.IASetIndexBuffer(&ib);
+    VERIFY(list.Count(List::Method_IASetIndexBuffer) == 4);
+
+    const auto& stats = cache.GetStatistics();
+    VERIFY(stats.issued[Cache::VertexBuffers] == 5 && stats.skipped[Cache::VertexBuffers] == 2);
+    VERIFY(stats.issued[Cache::IndexBuffer] == 4 && stats.skipped[Cache::IndexBuffer] == 1);
+
+    return true;
+}
+
+// After Invalidate every call is issued again; draws are always forwarded.
+bool Test_CommandListStateCache_Invalidate()
+{
+    List list;
+    Cache cache(&list);
+
+    D3D12_VERTEX_BUFFER_VIEW vb = { 0x10000, 1024, 32 };
+    D3D12_INDEX_BUFFER_VIEW ib = { 0x30000, 256, DXGI_FORMAT_R16_UINT };
+
+    auto record = [&]()
+    {
+        cache.SetGraphicsRootSignature(FakeObject<ID3D12RootSignature>(0x1000));
+        cache.SetPipelineState(FakeObject<ID3D12PipelineState>(0x2000));
+        cache.SetGraphicsRootDescriptorTable(0, Table(0xA000));
+        cache.SetGraphicsRootConstantBufferView(1, 0xB000);
+        cache.IASetVertexBuffers(0, 1, &vb);
+        cache.IASetIndexBuffer(&ib);
+        cache.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        cache.DrawIndexedInstanced(36, 1, 0, 0, 0);
+    };
+
+    record();
+    VERIFY(list.calls.size() == 8);
+
+    record();
+    VERIFY(list.calls.size() == 9);
+    VERIFY(list.calls[8].method == List::Method_DrawIndexedInstanced);
+
+    cache.Invalidate();
+    record();
+    VERIFY(list.calls.size() == 17);
+
+    const auto& stats = cache.GetStatistics();
+    VERIFY(stats.TotalIssued() == 14 && stats.TotalSkipped() == 7);
+
+    return true;
+}
@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------------------
+// File: TestGraphicsMemory.cpp
+//
+// Runs GraphicsMemory and its per-thread allocation contexts on a mock device, checks the
+// memory budget, and times the shared pools against the contexts under contention.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#include <d3d12.h>
+
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <GraphicsMemory.h>
+
+#include "MockDevice.h"
+#include "TestHelpers.h"
+
+using namespace DirectX;
+using namespace Tests;
+
+namespace
+{
+    constexpr size_t c_BenchmarkAllocations = 10000;
+
+    struct Constants
+    {
+        float values[16];
+    };
+
+    // Runs work on every hardware thread at once, and returns how long they took in milliseconds.
+    // Returns a negative time if any of them failed.
+    template<typename Work>
+    double TimeThreads(size_t threadCount, Work&& work)
+    {
+        using clock = std::chrono::steady_clock;
+
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> start(false);
+
+        // Futures from std::async block on destruction, so the workers are joined even if one throws.
+        std::vector<std::future<bool>> tasks;
+        tasks.reserve(threadCount);
+        for (size_t j = 0; j < threadCount; ++j)
+        {
+            tasks.emplace_back(std::async(std::launch::async, [&, j]()
+            {
+                ++ready;
+                while (!start)
+                {
+                    std::this_thread::yield();
+                }
+                return work(j);
+            }));
+        }
+
+        while (ready < threadCount)
+        {
+            std::this_thread::yield();
+        }
+
+        const auto startTime = clock::now();
+        start = true;
+
+        bool succeeded = true;
+        for (auto& task : tasks)
+        {
+            if (!task.get())
+                succeeded = false;
+        }
+
+        const double time = std::chrono::duration<double, std::milli>(clock::now() - startTime).count();
+        return succeeded ? time : -1.0;
+    }
+
+    // Each allocation gets its own memory, aligned for a constant buffer, holding what was written.
+    template<typename Allocator>
+    bool AllocateConstants(Allocator& allocator, size_t thread)
+    {
+        Constants constants = {};
+        constants.values[0] = float(thread);
+
+        for (size_t j = 0; j < c_BenchmarkAllocations; ++j)
+        {
+            constants.values[1] = float(j);
+            auto alloc = allocator.AllocateConstant(constants);
+
+            if (!alloc.Memory()
+                || (alloc.GpuAddress() % D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT) != 0
+                || memcmp(alloc.Memory(), &constants, sizeof(constants)) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    size_t BenchmarkThreadCount() noexcept
+    {
+        return std::max<size_t>(2, std::thread::hardware_concurrency());
+    }
+}
+
+// Pages filled by contexts go back to the shared pools, and the GPU (here, the mock queue) gets
+// them back after the Commit that fences them.
+bool Test_GraphicsMemory_ContextsReturnPages()
+{
+    MockDevice device;
+    MockCommandQueue queue;
+
+    GraphicsMemory graphicsMemory(&device);
+
+    const size_t threadCount = BenchmarkThreadCount();
+    const double time = TimeThreads(threadCount, [&](size_t thread)
+    {
+        GraphicsMemoryContext context(&device);
+        return AllocateConstants(context, thread);
+    });
+    VERIFY(time >= 0.0);
+
+    auto stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.totalPages > 0);
+    VERIFY(stats.committedMemory == 0);
+
+    // The first Commit fences every page the contexts handed back, and the next takes them back.
+    graphicsMemory.Commit(&queue);
+    VERIFY(queue.signalCount == 1);
+    stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.committedMemory == stats.totalMemory);
+
+    graphicsMemory.Commit(&queue);
+    VERIFY(queue.signalCount == 1);
+    stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.committedMemory == 0);
+    VERIFY(stats.unusedMemory == stats.totalMemory);
+    VERIFY(device.resourceCount == stats.totalPages);
+
+    return true;
+}
+
+// Times the same constant buffer allocations from several threads at once, first through the
+// shared pools and then through a context per thread. Only fails if an allocation does.
+bool Test_GraphicsMemory_ContentionBenchmark()
+{
+    MockDevice device;
+    MockCommandQueue queue;
+
+    GraphicsMemory graphicsMemory(&device);
+
+    const size_t threadCount = BenchmarkThreadCount();
+
+    const double sharedTime = TimeThreads(threadCount, [&](size_t thread)
+    {
+        return AllocateConstants(graphicsMemory, thread);
+    });
+    VERIFY(sharedTime >= 0.0);
+    graphicsMemory.Commit(&queue);
+
+    const double contextTime = TimeThreads(threadCount, [&](size_t thread)
+    {
+        GraphicsMemoryContext context(&device);
+        return AllocateConstants(context, thread);
+    });
+    VERIFY(contextTime >= 0.0);
+    graphicsMemory.Commit(&queue);
+
+    printf("  %zu threads x %zu constants (ms): shared %.2f, per-thread contexts %.2f\n",
+        threadCount, c_BenchmarkAllocations, sharedTime, contextTime);
+
+    return true;
+}
+
+// Going over maxTotalMemory frees unused pages only until the total is back under the limit with
+// some headroom, and the Commits after that leave the remaining pages alone.
+bool Test_GraphicsMemory_TotalBudgetTrimsToLimit()
+{
+    MockDevice device;
+    MockCommandQueue queue;
+
+    GraphicsMemory graphicsMemory(&device);
+
+    constexpr size_t c_PageCount = 16;
+    for (size_t j = 0; j < c_PageCount; ++j)
+    {
+        auto alloc = graphicsMemory.Allocate(60 * 1024);
+        VERIFY(alloc.Memory() != nullptr);
+    }
+
+    auto stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.totalPages == c_PageCount);
+
+    GraphicsMemoryBudget budget;
+    budget.maxTotalMemory = stats.totalMemory / 2;
+    graphicsMemory.SetBudget(budget);
+
+    // The first Commit fences the pages, and the next one reclaims and trims them.
+    graphicsMemory.Commit(&queue);
+    graphicsMemory.Commit(&queue);
+
+    stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.totalPages > 0);
+    VERIFY(stats.totalMemory <= budget.maxTotalMemory - budget.maxTotalMemory / 8);
+    VERIFY(stats.trimmedPages == c_PageCount - stats.totalPages);
+    VERIFY(stats.unusedMemory == stats.totalMemory);
+
+    const size_t trimmedPages = stats.trimmedPages;
+    graphicsMemory.Commit(&queue);
+    graphicsMemory.Commit(&queue);
+
+    stats = graphicsMemory.GetStatistics();
+    VERIFY(stats.trimmedPages == trimmedPages);
+
+    return true;
+}
@@ -0,0 +1,297 @@
+//--------------------------------------------------------------------------------------
+// File: TestHash64.cpp
+//
+// Hash64 is used as the key of the on-disk pipeline cache, so its output has to stay the
+// same between builds; these tests pin it down, and check that
+// EffectPipelineStateDescription::ComputeHash64 only depends on field values.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#include <d3d12.h>
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <set>
+
+#include <CommonStates.h>
+#include <EffectPipelineStateDescription.h>
+#include <VertexTypes.h>
+
+#include "Hash64.h"
+#include "TestHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    constexpr uint64_t c_Multiplier = 0xc6a4a7935bd1e995ull;
+    constexpr uint64_t c_Seed = 0x9e3779b97f4a7c15ull;
+
+    // MurmurHash64A of a whole number of 8-byte words, computed with Hash64. MurmurHash64A starts
+    // from seed ^ (len * m) where Hash64 starts from seed ^ c_Seed, so the seed is adjusted to match.
+    uint64_t MurmurHash64A(const char* key, size_t len, uint64_t seed) noexcept
+    {
+        Hash64 hash(seed ^ (len * c_Multiplier) ^ c_Seed);
+        for (size_t j = 0; j + sizeof(uint64_t) <= len; j += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, key + j, sizeof(word));
+            hash.Add(word);
+        }
+        return hash.Finalize();
+    }
+
+    EffectPipelineStateDescription MakeDescription(
+        _In_opt_ const D3D12_INPUT_LAYOUT_DESC* inputLayout,
+        const D3D12_BLEND_DESC& blend = CommonStates::Opaque,
+        const D3D12_DEPTH_STENCIL_DESC& depthStencil = CommonStates::DepthDefault,
+        const D3D12_RASTERIZER_DESC& rasterizer = CommonStates::CullCounterClockwise,
+        DXGI_FORMAT rtvFormat = DXGI_FORMAT_B8G8R8A8_UNORM)
+    {
+        return EffectPipelineStateDescription(inputLayout, blend, depthStencil, rasterizer,
+            RenderTargetState(rtvFormat, DXGI_FORMAT_D32_FLOAT));
+    }
+
+    // Constructs the description over storage filled with a byte pattern, so its padding differs
+    // between calls with a different fill.
+    uint64_t HashInFilledStorage(uint8_t fill, _In_opt_ const D3D12_INPUT_LAYOUT_DESC* inputLayout)
+    {
+        alignas(EffectPipelineStateDescription) uint8_t storage[sizeof(EffectPipelineStateDescription)];
+        memset(storage, fill, sizeof(storage));
+
+        auto desc = new (storage) EffectPipelineStateDescription(MakeDescription(inputLayout));
+        const uint64_t hash = desc->ComputeHash64();
+        desc->~EffectPipelineStateDescription();
+        return hash;
+    }
+
+    // Copies of VertexPositionNormalTexture's elements, with their own semantic name strings.
+    struct ElementCopy
+    {
+        char                        names[VertexPositionNormalTexture::InputElementCount][16];
+        D3D12_INPUT_ELEMENT_DESC    elements[VertexPositionNormalTexture::InputElementCount];
+        D3D12_INPUT_LAYOUT_DESC     layout;
+
+        explicit ElementCopy(uint8_t fill) noexcept
+        {
+            memset(names, fill, sizeof(names));
+            memset(elements, fill, sizeof(elements));
+            memset(&layout, fill, sizeof(layout));
+
+            const auto& source = VertexPositionNormalTexture::InputLayout;
+            for (UINT j = 0; j < source.NumElements; ++j)
+            {
+                strcpy_s(names[j], source.pInputElementDescs[j].SemanticName);
+                elements[j] = source.pInputElementDescs[j];
+                elements[j].SemanticName = names[j];
+            }
+
+            layout.pInputElementDescs = elements;
+            layout.NumElements = source.NumElements;
+        }
+
+        ElementCopy(ElementCopy const&) = delete;
+        ElementCopy& operator= (ElementCopy const&) = delete;
+    };
+}
+
+// Reference values from the SMHasher MurmurHash64A, for inputs that are a whole number of words.
+bool Test_Hash64_MurmurHash64AKnownAnswers()
+{
+    struct KnownAnswer
+    {
+        const char* key;
+        uint64_t    seed;
+        uint64_t    hash;
+    };
+
+    static const KnownAnswer s_knownAnswers[] =
+    {
+        { "",                                   0,                      0x0000000000000000ull },
+        { "",                                   0x1234567890abcdefull,  0xeb8f71ba4fd01d8dull },
+        { "abcdefgh",                           0,                      0xafdb0257ff41aa98ull },
+        { "abcdefgh",                           0x1234567890abcdefull,  0xd689c87953b3e01eull },
+        { "0123456789abcdef",                   0,                      0x93a92d1a91a24bc7ull },
+        { "0123456789abcdef",                   0x1234567890abcdefull,  0x6fe1bc072ff58f7aull },
+        { "The quick brown fox jumps over t",   0,                      0x02e4f19ea9643e03ull },
+        { "The quick brown fox jumps over t",   0x1234567890abcdefull,  0xb9d34845632ee854ull },
+    };
+
+    for (const auto& answer : s_knownAnswers)
+    {
+        VERIFY(MurmurHash64A(answer.key, strlen(answer.key), answer.seed) == answer.hash);
+    }
+
+    return true;
+}
+
+// Hash64's own output for the kinds of values ComputeHash64 adds. If these change, bump the
+// c_DiskCacheVersion in PipelineStateCache.cpp so stale cache files are discarded.
+bool Test_Hash64_Stability()
+{
+    {
+        const Hash64 hash;
+        VERIFY(hash.Finalize() == 0x84d69dcef1e6733aull);
+    }
+
+    {
+        Hash64 hash;
+        hash.Add(1u);
+        VERIFY(hash.Finalize() == 0x23402bb5c04b8de6ull);
+    }
+
+    {
+        Hash64 hash;
+        hash.Add(1.f);
+        VERIFY(hash.Finalize() == 0x85a9b50390ff726aull);
+    }
+
+    {
+        Hash64 hash;
+        hash.AddString("POSITION");
+        VERIFY(hash.Finalize() == 0x09d57d467842247dull);
+    }
+
+    {
+        Hash64 hash(42);
+        hash.AddString("TEXCOORD");
+        hash.Add(0u);
+        hash.Add(-1);
+        VERIFY(hash.Finalize() == 0x00b3d4ef13296880ull);
+    }
+
+    return true;
+}
+
+// The length prefix keeps split points apart, and a null string hashes like an empty one.
+bool Test_Hash64_ByteRanges()
+{
+    Hash64 a;
+    a.AddBytes("ab", 2);
+    a.AddBytes("c", 1);
+
+    Hash64 b;
+    b.AddBytes("a", 1);
+    b.AddBytes("bc", 2);
+
+    VERIFY(a.Finalize() != b.Finalize());
+
+    Hash64 empty;
+    empty.AddString("");
+
+    Hash64 null;
+    null.AddString(nullptr);
+
+    VERIFY(empty.Finalize() == null.Finalize());
+
+    // Order matters.
+    Hash64 c;
+    c.Add(1u);
+    c.Add(2u);
+
+    Hash64 d;
+    d.Add(2u);
+    d.Add(1u);
+
+    VERIFY(c.Finalize() != d.Finalize());
+
+    return true;
+}
+
+// Descriptions with the same field values hash the same, whatever the padding bytes and whichever
+// copies of the input elements and semantic names they point at.
+bool Test_ComputeHash64_IgnoresPaddingAndPointers()
+{
+    VERIFY(HashInFilledStorage(0x00, nullptr) == HashInFilledStorage(0xCD, nullptr));
+
+    const auto& original = VertexPositionNormalTexture::InputLayout;
+    VERIFY(HashInFilledStorage(0x00, &original) == HashInFilledStorage(0xFF, &original));
+
+    const ElementCopy copy1(0x00);
+    const ElementCopy copy2(0xCD);
+    VERIFY(copy1.layout.pInputElementDescs != original.pInputElementDescs);
+    VERIFY(copy1.elements[0].SemanticName != original.pInputElementDescs[0].SemanticName);
+
+    const uint64_t hash = MakeDescription(&original).ComputeHash64();
+    VERIFY(MakeDescription(&copy1.layout).ComputeHash64() == hash);
+    VERIFY(MakeDescription(&copy2.layout).ComputeHash64() == hash);
+    VERIFY(HashInFilledStorage(0xAB, &copy2.layout) == hash);
+
+    return true;
+}
+
+// Changing any single input element field, or only the contents behind the same pointers,
+// changes the hash.
+bool Test_ComputeHash64_InputLayoutContents()
+{
+    ElementCopy copy(0);
+
+    const uint64_t hash = MakeDescription(&copy.layout).ComputeHash64();
+
+    // Same pointers, different semantic name contents.
+    copy.names[1][0] = 'X';
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    strcpy_s(copy.names[1], VertexPositionNormalTexture::InputLayout.pInputElementDescs[1].SemanticName);
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() == hash);
+
+    copy.elements[2].SemanticIndex = 1;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    copy.elements[2].SemanticIndex = 0;
+
+    copy.elements[2].Format = DXGI_FORMAT_R16G16_FLOAT;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    copy.elements[2].Format = VertexPositionNormalTexture::InputLayout.pInputElementDescs[2].Format;
+
+    copy.elements[0].InputSlot = 1;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    copy.elements[0].InputSlot = 0;
+
+    copy.elements[1].AlignedByteOffset = 16;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    copy.elements[1].AlignedByteOffset = VertexPositionNormalTexture::InputLayout.pInputElementDescs[1].AlignedByteOffset;
+
+    copy.elements[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+    copy.elements[0].InstanceDataStepRate = 1;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    copy.elements[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
+    copy.elements[0].InstanceDataStepRate = 0;
+
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() == hash);
+
+    // Fewer elements, or none.
+    copy.layout.NumElements = 2;
+    VERIFY(MakeDescription(&copy.layout).ComputeHash64() != hash);
+    VERIFY(MakeDescription(nullptr).ComputeHash64() != hash);
+
+    return true;
+}
+
+// Every combination of the common states, formats and layouts gets its own hash.
+bool Test_ComputeHash64_NoCollisions()
+{
+    const D3D12_BLEND_DESC* blends[] = { &CommonStates::Opaque, &CommonStates::AlphaBlend, &CommonStates::Additive, &CommonStates::NonPremultiplied };
+    const D3D12_DEPTH_STENCIL_DESC* depths[] = { &CommonStates::DepthNone, &CommonStates::DepthDefault, &CommonStates::DepthRead, &CommonStates::DepthReverseZ, &CommonStates::DepthReadReverseZ };
+    const D3D12_RASTERIZER_DESC* rasterizers[] = { &CommonStates::CullNone, &CommonStates::CullClockwise, &CommonStates::CullCounterClockwise, &CommonStates::Wireframe };
+    const D3D12_INPUT_LAYOUT_DESC* layouts[] = { nullptr, &VertexPositionColor::InputLayout, &VertexPositionNormalTexture::InputLayout };
+    const DXGI_FORMAT formats[] = { DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R16G16B16A16_FLOAT };
+
+    std::set<uint64_t> hashes;
+    size_t count = 0;
+
+    for (auto blend : blends)
+        for (auto depth : depths)
+            for (auto rasterizer : rasterizers)
+                for (auto layout : layouts)
+                    for (auto format : formats)
+                    {
+                        hashes.insert(MakeDescription(layout, *blend, *depth, *rasterizer, format).ComputeHash64());
+                        ++count;
+                    }
+
+    VERIFY(hashes.size() == count);
+
+    return true;
+}
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// File: TestHelpers.h
+//
+// Minimal test harness for the DirectXTK12 CPU-only tests. Each test is a function
+// returning true on success; VERIFY reports the first failing check and returns false.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdio>
+
+
+#define VERIFY(expr) \
+    do \
+    { \
+        if (!(expr)) \
+        { \
+            printf("  FAILED: %s (%s:%d)\n", #expr, __FILE__, __LINE__); \
+            return false; \
+        } \
+    } while (0)
+
+namespace Tests
+{
+    using TestFunction = bool (*)();
+
+    struct TestEntry
+    {
+        const char*     name;
+        TestFunction    function;
+    };
+}
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: TestLinearAllocator.cpp
+//
+// Checks how LinearAllocator orders its used pages, on a mock device.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <cstdint>
+#include <string>
+
+#include <LinearAllocator.h>
+
+#include "MockDevice.h"
+#include "TestHelpers.h"
+
+using namespace DirectX;
+using namespace Tests;
+
+namespace
+{
+    constexpr size_t c_PageSize = 64 * 1024;
+}
+
+// Pages handed back by allocation contexts are mostly full. They mustn't push a shared page that
+// still has room out of the few FindPageForAlloc searches, or every return costs a new page.
+bool Test_LinearAllocator_ReturnedPagesKeepSpaceReachable()
+{
+    MockDevice device;
+    LinearAllocator allocator(&device, c_PageSize);
+
+    auto shared = allocator.FindPageForAlloc(256, 16);
+    VERIFY(shared != nullptr);
+    shared->Suballocate(256, 16);
+
+    for (size_t j = 0; j < 8; ++j)
+    {
+        auto page = allocator.AcquirePage();
+        VERIFY(page != nullptr);
+        VERIFY(page != shared);
+        page->Suballocate(c_PageSize - 256, 16);
+        allocator.ReturnPage(page);
+    }
+
+    VERIFY(allocator.OwnedPageCount() == 0);
+    VERIFY(allocator.TotalPageCount() == 9);
+
+    VERIFY(allocator.FindPageForAlloc(256, 16) == shared);
+    VERIFY(allocator.TotalPageCount() == 9);
+
+    // Nothing references them, so all are fenced together and come back together.
+    VERIFY(allocator.FenceCommittedPages(1) == 9);
+    allocator.RetirePendingPages(1);
+    VERIFY(allocator.UnusedPageCount() == 9);
+
+    return true;
+}
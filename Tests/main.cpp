@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: main.cpp
+//
+// Runs the DirectXTK12 CPU-only tests. None of them need a Direct3D device (those that
+// allocate upload memory use a mock), so they can run on build servers. Returns the number of failed tests.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+#include "TestHelpers.h"
+
+extern bool Test_CommandListStateCache_SkipsRedundantCalls();
+extern bool Test_CommandListStateCache_RootSignatureInvalidatesRootArguments();
+extern bool Test_CommandListStateCache_RootArgumentKinds();
+extern bool Test_CommandListStateCache_InputAssembler();
+extern bool Test_CommandListStateCache_Invalidate();
+extern bool Test_GraphicsMemory_ContextsReturnPages();
+extern bool Test_GraphicsMemory_ContentionBenchmark();
+extern bool Test_GraphicsMemory_TotalBudgetTrimsToLimit();
+extern bool Test_LinearAllocator_ReturnedPagesKeepSpaceReachable();
+extern bool Test_Hash64_MurmurHash64AKnownAnswers();
+extern bool Test_Hash64_Stability();
+extern bool Test_Hash64_ByteRanges();
+extern bool Test_ComputeHash64_IgnoresPaddingAndPointers();
+extern bool Test_ComputeHash64_InputLayoutContents();
+extern bool Test_ComputeHash64_NoCollisions();
+
+namespace
+{
+    const Tests::TestEntry c_Tests[] =
+    {
+        { "CommandListStateCache.SkipsRedundantCalls", Test_CommandListStateCache_SkipsRedundantCalls },
+        { "CommandListStateCache.RootSignatureInvalidatesRootArguments", Test_CommandListStateCache_RootSignatureInvalidatesRootArguments },
+        { "CommandListStateCache.RootArgumentKinds", Test_CommandListStateCache_RootArgumentKinds },
+        { "CommandListStateCache.InputAssembler", Test_CommandListStateCache_InputAssembler },
+        { "CommandListStateCache.Invalidate", Test_CommandListStateCache_Invalidate },
+        { "GraphicsMemory.ContextsReturnPages", Test_GraphicsMemory_ContextsReturnPages },
+        { "GraphicsMemory.ContentionBenchmark", Test_GraphicsMemory_ContentionBenchmark },
+        { "GraphicsMemory.TotalBudgetTrimsToLimit", Test_GraphicsMemory_TotalBudgetTrimsToLimit },
+        { "LinearAllocator.ReturnedPagesKeepSpaceReachable", Test_LinearAllocator_ReturnedPagesKeepSpaceReachable },
+        { "Hash64.MurmurHash64AKnownAnswers", Test_Hash64_MurmurHash64AKnownAnswers },
+        { "Hash64.Stability", Test_Hash64_Stability },
+        { "Hash64.ByteRanges", Test_Hash64_ByteRanges },
+        { "ComputeHash64.IgnoresPaddingAndPointers", Test_ComputeHash64_IgnoresPaddingAndPointers },
+        { "ComputeHash64.InputLayoutContents", Test_ComputeHash64_InputLayoutContents },
+        { "ComputeHash64.NoCollisions", Test_ComputeHash64_NoCollisions },
+    };
+}
+
+int __cdecl main(int argc, char* argv[])
+{
+    // An optional argument runs only the tests whose name starts with it.
+    const char* filter = (argc > 1) ? argv[1] : nullptr;
+
+    int failed = 0;
+    int run = 0;
+    for (const auto& test : c_Tests)
+    {
+        if (filter && strncmp(test.name, filter, strlen(filter)) != 0)
+            continue;
+
+        ++run;
+        printf("%s\n", test.name);
+
+        bool passed = false;
+        try
+        {
+            passed = test.function();
+        }
+        catch (const std::exception& e)
+        {
+            printf("  FAILED: exception %s\n", e.what());
+        }
+
+        if (!passed)
+            ++failed;
+    }
+
+    printf("%d of %d tests passed\n", run - failed, run);
+    return failed;
+}
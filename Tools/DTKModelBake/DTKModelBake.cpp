@@ -0,0 +1,234 @@
+//--------------------------------------------------------------------------------------
+// File: DTKModelBake.cpp
+//
+// Command-line tool that bakes a .sdkmesh, .cmo, or .vbo file into a .dtkmodel, and
+// optionally times the original loader against the .dtkmodel loader.
+//
+// Usage: DTKModelBake <input> [-o <output.dtkmodel>] [-benchmark [<iterations>]]
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//--------------------------------------------------------------------------------------
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <Windows.h>
+
+#include <wrl/client.h>
+
+#include <d3d12.h>
+#include <dxgi1_4.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+#include <GraphicsMemory.h>
+#include <Model.h>
+
+#include "SDKMesh.h"
+#include "BakedSource.h"
+
+using namespace DirectX;
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    constexpr int c_DefaultBenchmarkIterations = 10;
+
+    void Check(HRESULT hr, const char* what)
+    {
+        if (FAILED(hr))
+        {
+            char msg[128] = {};
+            sprintf_s(msg, "%s failed (HRESULT %08X)", what, static_cast<unsigned int>(hr));
+            throw std::runtime_error(msg);
+        }
+    }
+
+    // Model loading doesn't draw, so any adapter will do. WARP keeps the tool usable on
+    // machines without a Direct3D 12 GPU, such as build servers.
+    ComPtr<ID3D12Device> CreateDevice()
+    {
+        ComPtr<ID3D12Device> device;
+        if (SUCCEEDED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(device.GetAddressOf()))))
+            return device;
+
+        ComPtr<IDXGIFactory4> factory;
+        Check(CreateDXGIFactory1(IID_PPV_ARGS(factory.GetAddressOf())), "CreateDXGIFactory1");
+
+        ComPtr<IDXGIAdapter> warpAdapter;
+        Check(factory->EnumWarpAdapter(IID_PPV_ARGS(warpAdapter.GetAddressOf())), "EnumWarpAdapter");
+
+        Check(D3D12CreateDevice(warpAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(device.GetAddressOf())),
+            "D3D12CreateDevice");
+        return device;
+    }
+
+    uint32_t GetBakedSource(const wchar_t* szFileName, const wchar_t* ext)
+    {
+        if (_wcsicmp(ext, L".sdkmesh") == 0)
+        {
+            const ModelFileView modelFile(szFileName);
+            if (modelFile.GetSize() >= sizeof(DXUT::SDKMESH_HEADER)
+                && reinterpret_cast<const DXUT::SDKMESH_HEADER*>(modelFile.GetData())->Version >= 200)
+            {
+                return BakedSource_SDKMESH2;
+            }
+            return BakedSource_SDKMESH;
+        }
+        else if (_wcsicmp(ext, L".cmo") == 0)
+        {
+            return BakedSource_CMO;
+        }
+        else if (_wcsicmp(ext, L".vbo") == 0)
+        {
+            return BakedSource_VBO;
+        }
+
+        return BakedSource_Unknown;
+    }
+
+    void PrintUsage()
+    {
+        wprintf(L"Usage: DTKModelBake <input> [-o <output.dtkmodel>] [-benchmark [<iterations>]]\n\n");
+        wprintf(L"   <input>       .sdkmesh, .cmo, or .vbo file to bake\n");
+        wprintf(L"   -o            output file (defaults to the input name with a .dtkmodel extension)\n");
+        wprintf(L"   -benchmark    time both loaders, reporting the best of <iterations> loads (default %d)\n",
+            c_DefaultBenchmarkIterations);
+    }
+}
+
+int __cdecl wmain(_In_ int argc, _In_z_count_(argc) wchar_t* argv[])
+{
+    const wchar_t* szInput = nullptr;
+    const wchar_t* szOutput = nullptr;
+    int iterations = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"-o") == 0 && (i + 1) < argc)
+        {
+            szOutput = argv[++i];
+        }
+        else if (_wcsicmp(argv[i], L"-benchmark") == 0)
+        {
+            iterations = c_DefaultBenchmarkIterations;
+            if ((i + 1) < argc && iswdigit(argv[i + 1][0]))
+            {
+                iterations = std::max(1, _wtoi(argv[++i]));
+            }
+        }
+        else if (!szInput && argv[i][0] != L'-')
+        {
+            szInput = argv[i];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!szInput)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    wchar_t drive[_MAX_DRIVE] = {};
+    wchar_t path[MAX_PATH] = {};
+    wchar_t ext[_MAX_EXT] = {};
+    wchar_t fname[_MAX_FNAME] = {};
+    _wsplitpath_s(szInput, drive, _MAX_DRIVE, path, MAX_PATH, fname, _MAX_FNAME, ext, _MAX_EXT);
+
+    wchar_t szBaked[MAX_PATH] = {};
+    if (szOutput)
+    {
+        wcscpy_s(szBaked, szOutput);
+    }
+    else
+    {
+        _wmakepath_s(szBaked, drive, path, fname, L".dtkmodel");
+    }
+
+    try
+    {
+        const uint32_t source = GetBakedSource(szInput, ext);
+        if (source == BakedSource_Unknown)
+        {
+            wprintf(L"ERROR: Only .sdkmesh, .cmo, and .vbo files can be baked\n");
+            return 1;
+        }
+
+        auto device = CreateDevice();
+
+        // The loaders put vertex and index data in GraphicsMemory upload pages. Nothing is
+        // drawn, so committing on this queue retires the pages of each discarded model right away.
+        D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+        queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+
+        ComPtr<ID3D12CommandQueue> commandQueue;
+        Check(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(commandQueue.GetAddressOf())), "CreateCommandQueue");
+
+        GraphicsMemory graphicsMemory(device.Get());
+
+        auto loadSource = [&]()
+        {
+            switch (source)
+            {
+            case BakedSource_CMO:   return Model::CreateFromCMO(device.Get(), szInput, ModelLoader_IncludeBones);
+            case BakedSource_VBO:   return Model::CreateFromVBO(device.Get(), szInput);
+            default:                return Model::CreateFromSDKMESH(device.Get(), szInput, ModelLoader_IncludeBones);
+            }
+        };
+
+        loadSource()->SaveToDTKMODEL(szBaked, source);
+        graphicsMemory.Commit(commandQueue.Get());
+
+        wprintf(L"Baked %ls%ls to %ls\n", fname, ext, szBaked);
+
+        if (iterations > 0)
+        {
+            using clock = std::chrono::steady_clock;
+
+            auto bestOf = [&](auto&& load)
+            {
+                double best = 0;
+                for (int j = 0; j < iterations; ++j)
+                {
+                    const auto start = clock::now();
+                    std::ignore = load();
+                    const double time = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+                    best = (j > 0) ? std::min(best, time) : time;
+
+                    // Each load starts from the same pool state instead of growing it.
+                    graphicsMemory.Commit(commandQueue.Get());
+                }
+                return best;
+            };
+
+            const double sourceTime = bestOf(loadSource);
+            const double bakedTime = bestOf([&]() { return Model::CreateFromDTKMODEL(device.Get(), szBaked, ModelLoader_IncludeBones); });
+
+            wprintf(L"Load time (ms, best of %d): %ls %.2f  .dtkmodel %.2f\n", iterations, ext, sourceTime, bakedTime);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        wprintf(L"ERROR: %hs\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -67,6 +67,8 @@
 #include <DirectXColors.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
@@ -74,12 +76,15 @@
 #include <cstring>
 #include <cwchar>
 #include <exception>
+#include <future>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -120,6 +125,7 @@ namespace DX
     }
 }
 
+#include <CommandListStateCache.h>
 #include <CommonStates.h>
 #include <DDSTextureLoader.h>
 #include <DescriptorHeap.h>
@@ -130,6 +136,7 @@ namespace DX
 #include <Keyboard.h>
 #include <Model.h>
 #include <Mouse.h>
+#include <PipelineStateCache.h>
 #include <PostProcess.h>
 #include <PrimitiveBatch.h>
 #include <ResourceUploadBatch.h>